@@ -47,6 +47,7 @@
 static char defaultconf[] = "\
 options {\n\
 	answer-cookie true;\n\
+	async-logging no;\n\
 	automatic-interface-scan yes;\n\
 	bindkeys-file \"" NAMED_SYSCONFDIR "/bind.keys\";\n\
 #	blackhole {none;};\n"
@@ -108,6 +109,8 @@ options {\n\
 #	statistics-interval <obsolete>;\n\
 	tcp-advertised-timeout 300;\n\
 	tcp-clients 150;\n\
+	tcp-defer-accept 0;\n\
+	tcp-fastopen yes;\n\
 	tcp-idle-timeout 300;\n\
 	tcp-initial-timeout 300;\n\
 	tcp-keepalive-timeout 300;\n\
@@ -121,8 +124,11 @@ options {\n\
 	transfers-per-ns 2;\n\
 #	treat-cr-as-space <obsolete>;\n\
 	trust-anchor-telemetry yes;\n\
+	udp-cpu-steering no;\n\
+	udp-run-to-completion no;\n\
 #	use-id-pool <obsolete>;\n\
 #	use-ixfr <obsolete>;\n\
+	work-stealing no;\n\
 \n\
 	/* view */\n\
 	allow-new-zones no;\n\
@@ -186,6 +192,7 @@ options {\n\
 	require-server-cookie no;\n\
 	resolver-nonbackoff-tries 3;\n\
 	resolver-retry-interval 800; /* in milliseconds */\n\
+	response-cache-size 0;\n\
 #	rfc2308-type1 <obsolete>;\n\
 	root-key-sentinel yes;\n\
 	servfail-ttl 1;\n\
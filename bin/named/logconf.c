@@ -102,6 +102,7 @@ channel_fromconf(const cfg_obj_t *channel, isc_logconfig_t *logconfig) {
 	const cfg_obj_t *nullobj = NULL;
 	const cfg_obj_t *stderrobj = NULL;
 	const cfg_obj_t *severity = NULL;
+	const cfg_obj_t *formatobj = NULL;
 	int i;
 
 	channelname = cfg_obj_asstring(cfg_map_getname(channel));
@@ -231,6 +232,19 @@ channel_fromconf(const cfg_obj_t *channel, isc_logconfig_t *logconfig) {
 		}
 	}
 
+	(void)cfg_map_get(channel, "format", &formatobj);
+	if (formatobj != NULL &&
+	    strcasecmp(cfg_obj_asstring(formatobj), "binary") == 0)
+	{
+		if (type == ISC_LOG_TOSYSLOG) {
+			cfg_obj_log(channel, named_g_lctx, ISC_LOG_ERROR,
+				    "channel '%s': binary format cannot be "
+				    "used with syslog", channelname);
+			return (ISC_R_FAILURE);
+		}
+		flags |= ISC_LOG_BINARY;
+	}
+
 	level = ISC_LOG_INFO;
 	if (cfg_map_get(channel, "severity", &severity) == ISC_R_SUCCESS) {
 		if (cfg_obj_isstring(severity)) {
@@ -130,7 +130,9 @@ static bool noedns = false;
 static bool nonearest = false;
 static bool nosoa = false;
 static bool notcp = false;
+static bool uring = false;
 static bool sigvalinsecs = false;
+static bool timerheap = false;
 static unsigned int delay = 0;
 
 /*
@@ -605,6 +607,10 @@ parse_T_opt(char *option) {
 	 *	       simulate remote servers.
 	 * dscp=x:     check that dscp values are as
 	 * 	       expected and assert otherwise.
+	 * timerheap:  use the heap based timer manager
+	 *	       instead of the timing wheels.
+	 * uring:      use io_uring for UDP if it was
+	 *	       built in and the kernel supports it.
 	 */
 	if (!strcmp(option, "clienttest")) {
 		clienttest = true;
@@ -678,6 +684,10 @@ parse_T_opt(char *option) {
 		sigvalinsecs = true;
 	} else if (!strncmp(option, "tat=", 4)) {
 		named_g_tat_interval = atoi(option + 4);
+	} else if (!strcmp(option, "timerheap")) {
+		timerheap = true;
+	} else if (!strcmp(option, "uring")) {
+		uring = true;
 	} else {
 		fprintf(stderr, "unknown -T flag '%s'\n", option);
 	}
@@ -879,22 +889,34 @@ create_managers(void) {
 		return (ISC_R_UNEXPECTED);
 	}
 
-	result = isc_timermgr_create(named_g_mctx, &named_g_timermgr);
+	result = isc_timermgr_create2(named_g_mctx,
+				      timerheap ? isc_timermgrtype_heap
+						: isc_timermgrtype_wheel,
+				      &named_g_timermgr);
 	if (result != ISC_R_SUCCESS) {
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
-				 "isc_timermgr_create() failed: %s",
+				 "isc_timermgr_create2() failed: %s",
 				 isc_result_totext(result));
 		return (ISC_R_UNEXPECTED);
 	}
 
-	result = isc_socketmgr_create2(named_g_mctx, &named_g_socketmgr,
-				       maxsocks, named_g_cpus);
+	result = isc_socketmgr_create3(named_g_mctx, &named_g_socketmgr,
+				       maxsocks, named_g_cpus,
+				       uring ? isc_socketmgrtype_uring
+					     : isc_socketmgrtype_poll);
 	if (result != ISC_R_SUCCESS) {
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
-				 "isc_socketmgr_create() failed: %s",
+				 "isc_socketmgr_create3() failed: %s",
 				 isc_result_totext(result));
 		return (ISC_R_UNEXPECTED);
 	}
+	if (isc_socketmgr_gettype(named_g_socketmgr) ==
+	    isc_socketmgrtype_uring)
+	{
+		isc_log_write(named_g_lctx, NAMED_LOGCATEGORY_GENERAL,
+			      NAMED_LOGMODULE_SERVER,
+			      ISC_LOG_INFO, "using io_uring for UDP");
+	}
 	isc_socketmgr_maxudp(named_g_socketmgr, maxudp);
 	result = isc_socketmgr_getmaxsockets(named_g_socketmgr, &socks);
 	if (result == ISC_R_SUCCESS) {
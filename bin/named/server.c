@@ -84,6 +84,7 @@
 #include <dns/rdataset.h>
 #include <dns/rdatastruct.h>
 #include <dns/resolver.h>
+#include <dns/respcache.h>
 #include <dns/rootns.h>
 #include <dns/rriterator.h>
 #include <dns/secalg.h>
@@ -103,6 +104,7 @@
 #include <ns/hooks.h>
 #include <ns/listenlist.h>
 #include <ns/interfacemgr.h>
+#include <ns/stats.h>
 
 #include <named/config.h>
 #include <named/control.h>
@@ -3806,6 +3808,7 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	size_t max_adb_size;
 	uint32_t lame_ttl, fail_ttl;
 	uint32_t max_stale_ttl;
+	uint64_t respcache_size;
 	dns_tsig_keyring_t *ring = NULL;
 	dns_view_t *pview = NULL;	/* Production view */
 	isc_mem_t *cmctx = NULL, *hmctx = NULL;
@@ -3826,6 +3829,7 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	const cfg_obj_t *disablelist = NULL;
 	isc_stats_t *resstats = NULL;
 	dns_stats_t *resquerystats = NULL;
+	isc_stats_t *latencystats = NULL;
 	bool auto_root = false;
 	named_cache_t *nsc;
 	bool zero_no_soattl;
@@ -4434,12 +4438,14 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	}
 
 	if (resstats == NULL) {
-		CHECK(isc_stats_create(mctx, &resstats,
-				       dns_resstatscounter_max));
+		CHECK(isc_stats_create2(mctx, &resstats,
+					dns_resstatscounter_max,
+					ISC_STATS_SHARDED));
 	}
 	dns_view_setresstats(view, resstats);
 	if (resquerystats == NULL)
-		CHECK(dns_rdatatypestats_create(mctx, &resquerystats));
+		CHECK(dns_rdatatypestats_create2(mctx, &resquerystats,
+						 ISC_STATS_SHARDED));
 	dns_view_setresquerystats(view, resquerystats);
 
 	ndisp = 4 * ISC_MIN(named_g_udpdisp, MAX_UDP_DISPATCH);
@@ -4722,6 +4728,25 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	} else
 		dns_view_restorekeyring(view);
 
+	/*
+	 * Keep counting query latency in the same histograms across
+	 * reconfiguration.
+	 */
+	result = dns_viewlist_find(&named_g_server->viewlist, view->name,
+				   view->rdclass, &pview);
+	if (result != ISC_R_NOTFOUND && result != ISC_R_SUCCESS)
+		goto cleanup;
+	if (pview != NULL) {
+		dns_view_getquerylatencystats(pview, &latencystats);
+		dns_view_detach(&pview);
+	}
+	if (latencystats == NULL) {
+		CHECK(isc_stats_create2(mctx, &latencystats,
+					NS_LATENCY_COUNTERS,
+					ISC_STATS_SHARDED));
+	}
+	dns_view_setquerylatencystats(view, latencystats);
+
 	/*
 	 * Configure the view's peer list.
 	 */
@@ -5542,6 +5567,26 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 		fail_ttl = 30;
 	dns_view_setfailttl(view, fail_ttl);
 
+	/*
+	 * Set up the response cache, if there is to be one.  The view
+	 * is new, so the cache starts out empty after every reload.
+	 */
+	obj = NULL;
+	result = named_config_get(maps, "response-cache-size", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	respcache_size = cfg_obj_asuint64(obj);
+	if (respcache_size > SIZE_MAX) {
+		cfg_obj_log(obj, named_g_lctx, ISC_LOG_WARNING,
+			    "'response-cache-size %" PRIu64 "' "
+			    "is too large for this system; reducing to %lu",
+			    respcache_size, (unsigned long)SIZE_MAX);
+		respcache_size = SIZE_MAX;
+	}
+	if (respcache_size > 0) {
+		CHECK(dns_respcache_create(view->mctx, (size_t)respcache_size,
+					   &view->respcache));
+	}
+
 	/*
 	 * Name space to look up redirect information in.
 	 */
@@ -5623,6 +5668,9 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	if (resquerystats != NULL) {
 		dns_stats_detach(&resquerystats);
 	}
+	if (latencystats != NULL) {
+		isc_stats_detach(&latencystats);
+	}
 	if (order != NULL) {
 		dns_order_detach(&order);
 	}
@@ -8085,6 +8133,7 @@ load_configuration(const char *filename, named_server_t *server,
 	dns_viewlist_t viewlist, builtin_viewlist;
 	in_port_t listen_port, udpport_low, udpport_high;
 	int i, backlog;
+	bool tcpfastopen;
 	int num_zones = 0;
 	bool exclusive = false;
 	isc_interval_t interval;
@@ -8269,6 +8318,14 @@ load_configuration(const char *filename, named_server_t *server,
 	}
 	isc_socketmgr_setreserved(named_g_socketmgr, reserved);
 
+	/*
+	 * Let idle worker threads steal runnable tasks from busy ones.
+	 */
+	obj = NULL;
+	result = named_config_get(maps, "work-stealing", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	isc_taskmgr_setworkstealing(named_g_taskmgr, cfg_obj_asboolean(obj));
+
 #ifdef HAVE_GEOIP
 	/*
 	 * Initialize GeoIP databases from the configured location.
@@ -8556,6 +8613,39 @@ load_configuration(const char *filename, named_server_t *server,
 	}
 	ns_interfacemgr_setbacklog(server->interfacemgr, backlog);
 
+	/*
+	 * TCP listener options.
+	 */
+	obj = NULL;
+	result = named_config_get(maps, "tcp-fastopen", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	tcpfastopen = cfg_obj_asboolean(obj);
+	obj = NULL;
+	result = named_config_get(maps, "tcp-defer-accept", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	ns_interfacemgr_settcpoptions(server->interfacemgr, tcpfastopen,
+				      cfg_obj_asuint32(obj));
+
+	/*
+	 * Steer UDP queries to the listener read on the CPU that
+	 * received them.
+	 */
+	obj = NULL;
+	result = named_config_get(maps, "udp-cpu-steering", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	ns_interfacemgr_setcpusteering(server->interfacemgr,
+				       cfg_obj_asboolean(obj));
+
+	/*
+	 * Process UDP queries on the network thread that read them
+	 * until they have to wait.
+	 */
+	obj = NULL;
+	result = named_config_get(maps, "udp-run-to-completion", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	ns_server_setoption(server->sctx, NS_SERVER_RUNTOCOMPLETION,
+			    cfg_obj_asboolean(obj));
+
 	/*
 	 * Configure the interface manager according to the "listen-on"
 	 * statement.
@@ -9002,6 +9092,18 @@ load_configuration(const char *filename, named_server_t *server,
 			      "config file");
 	}
 
+	/*
+	 * Leave writing log messages to a separate thread?
+	 */
+	obj = NULL;
+	result = named_config_get(maps, "async-logging", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	result = isc_log_setasync(named_g_lctx, cfg_obj_asboolean(obj), 0);
+	if (result != ISC_R_SUCCESS) {
+		cfg_obj_log(obj, named_g_lctx, ISC_LOG_WARNING,
+			    "async-logging: %s", isc_result_totext(result));
+	}
+
 	/*
 	 * Set the default value of the query logging flag depending
 	 * whether a "queries" category has been defined.  This is
@@ -9823,8 +9925,9 @@ named_server_create(isc_mem_t *mctx, named_server_t **serverp) {
 	server->zonestats = NULL;
 	server->resolverstats = NULL;
 	server->sockstats = NULL;
-	CHECKFATAL(isc_stats_create(server->mctx, &server->sockstats,
-				    isc_sockstatscounter_max),
+	CHECKFATAL(isc_stats_create2(server->mctx, &server->sockstats,
+				     isc_sockstatscounter_max,
+				     ISC_STATS_SHARDED),
 		   "isc_stats_create");
 	isc_socketmgr_setstats(named_g_socketmgr, server->sockstats);
 
@@ -9832,8 +9935,9 @@ named_server_create(isc_mem_t *mctx, named_server_t **serverp) {
 				    dns_zonestatscounter_max),
 		   "dns_stats_create (zone)");
 
-	CHECKFATAL(isc_stats_create(named_g_mctx, &server->resolverstats,
-				    dns_resstatscounter_max),
+	CHECKFATAL(isc_stats_create2(named_g_mctx, &server->resolverstats,
+				     dns_resstatscounter_max,
+				     ISC_STATS_SHARDED),
 		   "dns_stats_create (resolver)");
 
 	server->flushonshutdown = false;
@@ -24,10 +24,12 @@
 #include <isc/stats.h>
 #include <isc/string.h>
 #include <isc/task.h>
+#include <isc/time.h>
 #include <isc/util.h>
 
 #include <dns/cache.h>
 #include <dns/db.h>
+#include <dns/name.h>
 #include <dns/opcode.h>
 #include <dns/rcode.h>
 #include <dns/rdataclass.h>
@@ -35,6 +37,7 @@
 #include <dns/resolver.h>
 #include <dns/stats.h>
 #include <dns/view.h>
+#include <dns/zone.h>
 #include <dns/zt.h>
 
 #include <ns/stats.h>
@@ -133,7 +136,7 @@ static const char *tcpinsizestats_desc[dns_sizecounter_in_max];
 static const char *tcpoutsizestats_desc[dns_sizecounter_out_max];
 static const char *dnstapstats_desc[dns_dnstapcounter_max];
 static const char *gluecachestats_desc[dns_gluecachestatscounter_max];
-#if defined(EXTENDED_STATS)
+static const char *latencystats_desc[NS_LATENCY_COUNTERS];
 static const char *nsstats_xmldesc[ns_statscounter_max];
 static const char *resstats_xmldesc[dns_resstatscounter_max];
 static const char *adbstats_xmldesc[dns_adbstats_max];
@@ -146,20 +149,7 @@ static const char *tcpinsizestats_xmldesc[dns_sizecounter_in_max];
 static const char *tcpoutsizestats_xmldesc[dns_sizecounter_out_max];
 static const char *dnstapstats_xmldesc[dns_dnstapcounter_max];
 static const char *gluecachestats_xmldesc[dns_gluecachestatscounter_max];
-#else
-#define nsstats_xmldesc NULL
-#define resstats_xmldesc NULL
-#define adbstats_xmldesc NULL
-#define zonestats_xmldesc NULL
-#define sockstats_xmldesc NULL
-#define dnssecstats_xmldesc NULL
-#define udpinsizestats_xmldesc NULL
-#define udpoutsizestats_xmldesc NULL
-#define tcpinsizestats_xmldesc NULL
-#define tcpoutsizestats_xmldesc NULL
-#define dnstapstats_xmldesc NULL
-#define gluecachestats_xmldesc NULL
-#endif	/* EXTENDED_STATS */
+static const char *latencystats_xmldesc[NS_LATENCY_COUNTERS];
 
 #define TRY0(a) do { xmlrc = (a); if (xmlrc < 0) goto error; } while(0)
 
@@ -180,6 +170,26 @@ static int tcpinsizestats_index[dns_sizecounter_in_max];
 static int tcpoutsizestats_index[dns_sizecounter_out_max];
 static int dnstapstats_index[dns_dnstapcounter_max];
 static int gluecachestats_index[dns_gluecachestatscounter_max];
+static int latencystats_index[NS_LATENCY_COUNTERS];
+
+/*%
+ * The query latency counters are named from their bounds, so their
+ * descriptions are built rather than listed.
+ */
+static char latencystats_descbuf[NS_LATENCY_COUNTERS][64];
+static char latencystats_xmldescbuf[NS_LATENCY_COUNTERS][32];
+
+static const char *latency_protocols[] = { "UDP", "TCP" };
+
+static const struct {
+	const char *desc;
+	const char *xmldesc;
+	const char *label;
+} latency_types[ns_latency_max] = {
+	{ "authoritative", "Auth", "auth" },		/* ns_latency_auth */
+	{ "cached", "Cache", "cache" },			/* ns_latency_cache */
+	{ "recursive", "Recursion", "recursion" }	/* ns_latency_recursion */
+};
 
 static inline void
 set_desc(int counter, int maxcounter, const char *fdesc, const char **fdescs,
@@ -187,30 +197,64 @@ set_desc(int counter, int maxcounter, const char *fdesc, const char **fdescs,
 {
 	REQUIRE(counter < maxcounter);
 	REQUIRE(fdescs != NULL && fdescs[counter] == NULL);
-#if defined(EXTENDED_STATS)
 	REQUIRE(xdescs != NULL && xdescs[counter] == NULL);
-#endif
 
 	fdescs[counter] = fdesc;
-#if defined(EXTENDED_STATS)
 	xdescs[counter] = xdesc;
-#else
-	UNUSED(xdesc);
-	UNUSED(xdescs);
-#endif
+}
+
+/*
+ * Return the smallest latency, in microseconds, counted in 'bucket'.
+ */
+static uint64_t
+latency_lowerbound(unsigned int bucket) {
+	return ((bucket == 0) ? 0 : ns_stats_latencylimit(bucket - 1));
+}
+
+static void
+set_latencydesc(bool tcp, ns_latencytype_t type, unsigned int bucket) {
+	isc_statscounter_t counter;
+	uint64_t limit = ns_stats_latencylimit(bucket);
+	char *desc, *xmldesc;
+
+	counter = ns_stats_latencycounter(tcp, type,
+					  latency_lowerbound(bucket));
+	desc = latencystats_descbuf[counter];
+	xmldesc = latencystats_xmldescbuf[counter];
+
+	if (limit != 0) {
+		snprintf(desc, sizeof(latencystats_descbuf[0]),
+			 "%s %s answers in under %" PRIu64 "us",
+			 latency_protocols[tcp], latency_types[type].desc,
+			 limit);
+		snprintf(xmldesc, sizeof(latencystats_xmldescbuf[0]),
+			 "%s%sLT%" PRIu64 "us", latency_protocols[tcp],
+			 latency_types[type].xmldesc, limit);
+	} else {
+		snprintf(desc, sizeof(latencystats_descbuf[0]),
+			 "%s %s answers in %" PRIu64 "us or more",
+			 latency_protocols[tcp], latency_types[type].desc,
+			 latency_lowerbound(bucket));
+		snprintf(xmldesc, sizeof(latencystats_xmldescbuf[0]),
+			 "%s%sGE%" PRIu64 "us", latency_protocols[tcp],
+			 latency_types[type].xmldesc,
+			 latency_lowerbound(bucket));
+	}
+
+	set_desc(counter, NS_LATENCY_COUNTERS, desc, latencystats_desc,
+		 xmldesc, latencystats_xmldesc);
 }
 
 static void
 init_desc(void) {
 	int i;
+	unsigned int tcp, type, bucket;
 
 	/* Initialize name server statistics */
 	for (i = 0; i < ns_statscounter_max; i++)
 		nsstats_desc[i] = NULL;
-#if defined(EXTENDED_STATS)
 	for (i = 0; i < ns_statscounter_max; i++)
 		nsstats_xmldesc[i] = NULL;
-#endif
 
 #define SET_NSSTATDESC(counterid, desc, xmldesc) \
 	do { \
@@ -313,15 +357,18 @@ init_desc(void) {
 		       "QryUsedStale");
 	SET_NSSTATDESC(prefetch, "queries triggered prefetch", "Prefetch");
 	SET_NSSTATDESC(keytagopt, "Keytag option received", "KeyTagOpt");
+	SET_NSSTATDESC(respcachehit, "responses sent from the response cache",
+		       "RespCacheHit");
+	SET_NSSTATDESC(respcachemiss,
+		       "responses not found in the response cache",
+		       "RespCacheMiss");
 	INSIST(i == ns_statscounter_max);
 
 	/* Initialize resolver statistics */
 	for (i = 0; i < dns_resstatscounter_max; i++)
 		resstats_desc[i] = NULL;
-#if defined(EXTENDED_STATS)
 	for (i = 0; i < dns_resstatscounter_max; i++)
 		resstats_xmldesc[i] = NULL;
-#endif
 
 #define SET_RESSTATDESC(counterid, desc, xmldesc) \
 	do { \
@@ -407,10 +454,8 @@ init_desc(void) {
 	/* Initialize adb statistics */
 	for (i = 0; i < dns_adbstats_max; i++)
 		adbstats_desc[i] = NULL;
-#if defined(EXTENDED_STATS)
 	for (i = 0; i < dns_adbstats_max; i++)
 		adbstats_xmldesc[i] = NULL;
-#endif
 
 #define SET_ADBSTATDESC(id, desc, xmldesc) \
 	do { \
@@ -429,10 +474,8 @@ init_desc(void) {
 	/* Initialize zone statistics */
 	for (i = 0; i < dns_zonestatscounter_max; i++)
 		zonestats_desc[i] = NULL;
-#if defined(EXTENDED_STATS)
 	for (i = 0; i < dns_zonestatscounter_max; i++)
 		zonestats_xmldesc[i] = NULL;
-#endif
 
 #define SET_ZONESTATDESC(counterid, desc, xmldesc) \
 	do { \
@@ -462,10 +505,8 @@ init_desc(void) {
 	/* Initialize socket statistics */
 	for (i = 0; i < isc_sockstatscounter_max; i++)
 		sockstats_desc[i] = NULL;
-#if defined(EXTENDED_STATS)
 	for (i = 0; i < isc_sockstatscounter_max; i++)
 		sockstats_xmldesc[i] = NULL;
-#endif
 
 #define SET_SOCKSTATDESC(counterid, desc, xmldesc) \
 	do { \
@@ -581,10 +622,8 @@ init_desc(void) {
 	/* Initialize DNSSEC statistics */
 	for (i = 0; i < dns_dnssecstats_max; i++)
 		dnssecstats_desc[i] = NULL;
-#if defined(EXTENDED_STATS)
 	for (i = 0; i < dns_dnssecstats_max; i++)
 		dnssecstats_xmldesc[i] = NULL;
-#endif
 
 #define SET_DNSSECSTATDESC(counterid, desc, xmldesc) \
 	do { \
@@ -608,10 +647,8 @@ init_desc(void) {
 	/* Initialize dnstap statistics */
 	for (i = 0; i < dns_dnstapcounter_max; i++)
 		dnstapstats_desc[i] = NULL;
-#if defined(EXTENDED_STATS)
 	for (i = 0; i < dns_dnstapcounter_max; i++)
 		dnstapstats_xmldesc[i] = NULL;
-#endif
 
 #define SET_DNSTAPSTATDESC(counterid, desc, xmldesc) \
 	do { \
@@ -667,7 +704,6 @@ init_desc(void) {
 		INSIST(dnstapstats_desc[i] != NULL);
 	for (i = 0; i < dns_gluecachestatscounter_max; i++)
 		INSIST(gluecachestats_desc[i] != NULL);
-#if defined(EXTENDED_STATS)
 	for (i = 0; i < ns_statscounter_max; i++)
 		INSIST(nsstats_xmldesc[i] != NULL);
 	for (i = 0; i < dns_resstatscounter_max; i++)
@@ -684,24 +720,19 @@ init_desc(void) {
 		INSIST(dnstapstats_xmldesc[i] != NULL);
 	for (i = 0; i < dns_gluecachestatscounter_max; i++)
 		INSIST(gluecachestats_xmldesc[i] != NULL);
-#endif
 
 	/* Initialize traffic size statistics */
 	for (i = 0; i < dns_sizecounter_in_max; i++) {
 		udpinsizestats_desc[i] = NULL;
 		tcpinsizestats_desc[i] = NULL;
-#if defined(EXTENDED_STATS)
 		udpinsizestats_xmldesc[i] = NULL;
 		tcpinsizestats_xmldesc[i] = NULL;
-#endif
 	}
 	for (i = 0; i < dns_sizecounter_out_max; i++) {
 		udpoutsizestats_desc[i] = NULL;
 		tcpoutsizestats_desc[i] = NULL;
-#if defined(EXTENDED_STATS)
 		udpoutsizestats_xmldesc[i] = NULL;
 		tcpoutsizestats_xmldesc[i] = NULL;
-#endif
 	}
 
 #define SET_SIZESTATDESC(counterid, desc, xmldesc, inout) \
@@ -1001,6 +1032,25 @@ init_desc(void) {
 	SET_SIZESTATDESC(4096, "responses sent 4096+ bytes", "4096+", out);
 	INSIST(i == dns_sizecounter_out_max);
 
+	/* Initialize query latency statistics */
+	for (i = 0; i < NS_LATENCY_COUNTERS; i++) {
+		latencystats_desc[i] = NULL;
+		latencystats_xmldesc[i] = NULL;
+	}
+	i = 0;
+	for (tcp = 0; tcp < 2; tcp++) {
+		for (type = 0; type < ns_latency_max; type++) {
+			for (bucket = 0; bucket < NS_LATENCY_BUCKETS; bucket++)
+			{
+				set_latencydesc(tcp, type, bucket);
+				latencystats_index[i++] =
+					ns_stats_latencycounter(tcp, type,
+						latency_lowerbound(bucket));
+			}
+		}
+	}
+	INSIST(i == NS_LATENCY_COUNTERS);
+
 	/* Sanity check */
 	for (i = 0; i < ns_statscounter_max; i++)
 		INSIST(nsstats_desc[i] != NULL);
@@ -1022,7 +1072,6 @@ init_desc(void) {
 		INSIST(udpoutsizestats_desc[i] != NULL);
 		INSIST(tcpoutsizestats_desc[i] != NULL);
 	}
-#if defined(EXTENDED_STATS)
 	for (i = 0; i < ns_statscounter_max; i++)
 		INSIST(nsstats_xmldesc[i] != NULL);
 	for (i = 0; i < dns_resstatscounter_max; i++)
@@ -1043,7 +1092,10 @@ init_desc(void) {
 		INSIST(udpoutsizestats_xmldesc[i] != NULL);
 		INSIST(tcpoutsizestats_xmldesc[i] != NULL);
 	}
-#endif
+	for (i = 0; i < NS_LATENCY_COUNTERS; i++) {
+		INSIST(latencystats_desc[i] != NULL);
+		INSIST(latencystats_xmldesc[i] != NULL);
+	}
 }
 
 /*%
@@ -1595,6 +1647,7 @@ generatexml(named_server_t *server, uint32_t flags,
 	dns_stats_t *cacherrstats;
 	uint64_t nsstat_values[ns_statscounter_max];
 	uint64_t resstat_values[dns_resstatscounter_max];
+	uint64_t latencystat_values[NS_LATENCY_COUNTERS];
 	uint64_t adbstat_values[dns_adbstats_max];
 	uint64_t zonestat_values[dns_zonestatscounter_max];
 	uint64_t sockstat_values[isc_sockstatscounter_max];
@@ -1960,6 +2013,23 @@ generatexml(named_server_t *server, uint32_t flags,
 		}
 		TRY0(xmlTextWriterEndElement(writer)); /* </resstats> */
 
+		/* <latency> */
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
+		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
+						 ISC_XMLCHAR "latency"));
+		if (view->querylatencystats != NULL) {
+			result = dump_counters(view->querylatencystats,
+					       isc_statsformat_xml, writer,
+					       NULL, latencystats_xmldesc,
+					       NS_LATENCY_COUNTERS,
+					       latencystats_index,
+					       latencystat_values,
+					       ISC_STATSDUMP_VERBOSE);
+			if (result != ISC_R_SUCCESS)
+				goto error;
+		}
+		TRY0(xmlTextWriterEndElement(writer)); /* </latency> */
+
 		cacherrstats = dns_db_getrrsetstats(view->cachedb);
 		if (cacherrstats != NULL) {
 			TRY0(xmlTextWriterStartElement(writer,
@@ -2390,6 +2460,7 @@ generatejson(named_server_t *server, size_t *msglen,
 	json_object *tcpreq6 = NULL, *tcpresp6 = NULL;
 	uint64_t nsstat_values[ns_statscounter_max];
 	uint64_t resstat_values[dns_resstatscounter_max];
+	uint64_t latencystat_values[NS_LATENCY_COUNTERS];
 	uint64_t adbstat_values[dns_adbstats_max];
 	uint64_t zonestat_values[dns_zonestatscounter_max];
 	uint64_t sockstat_values[isc_sockstatscounter_max];
@@ -2731,6 +2802,27 @@ generatejson(named_server_t *server, size_t *msglen,
 					json_object_object_add(res, "adb",
 							       counters);
 				}
+
+				istats = view->querylatencystats;
+				if (istats != NULL) {
+					counters = json_object_new_object();
+					CHECKMEM(counters);
+
+					result = dump_counters(istats,
+						       isc_statsformat_json,
+						       counters, NULL,
+						       latencystats_xmldesc,
+						       NS_LATENCY_COUNTERS,
+						       latencystats_index,
+						       latencystat_values, 0);
+					if (result != ISC_R_SUCCESS) {
+						json_object_put(counters);
+						goto error;
+					}
+
+					json_object_object_add(v, "latency",
+							       counters);
+				}
 			}
 
 			view = ISC_LIST_NEXT(view, link);
@@ -3172,6 +3264,872 @@ end:
 	return (ISC_R_SUCCESS);
 }
 
+/*
+ * OpenMetrics rendering.
+ *
+ * Unlike the XML and JSON renderers, this writes the counters straight
+ * into the HTTP send buffer as it walks them, a bounded piece at a time,
+ * so no document is built in memory however many views and zones there
+ * are.  Between pieces the position reached is remembered as the metric
+ * family, the view or zone within it, and the number of counter
+ * positions already written; the counters are always walked in full
+ * (ISC_STATSDUMP_VERBOSE) so that positions stay the same from one
+ * piece to the next.  Counters that are zero are not written.
+ *
+ * The views and zones are attached when the request arrives, so that
+ * they remain valid until the response has been sent even if the
+ * server is reconfigured in between.
+ */
+#define METRICS_MIMETYPE \
+	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+typedef struct metrics_zone {
+	dns_zone_t		*zone;
+	unsigned int		view;		/* index into views */
+} metrics_zone_t;
+
+typedef struct metrics {
+	isc_mem_t		*mctx;
+	named_server_t		*server;
+	dns_view_t		**views;
+	unsigned int		nviews;
+	unsigned int		viewsalloc;
+	metrics_zone_t		*zones;
+	unsigned int		nzones;
+	unsigned int		zonesalloc;
+
+	/* Where the next piece starts. */
+	unsigned int		family;
+	unsigned int		object;
+	unsigned int		line;
+	bool			started;	/* family header written */
+
+	/* State while writing a piece. */
+	isc_buffer_t		*b;
+	bool			full;
+	unsigned int		pos;
+	const char		*name;		/* sample name */
+	const char		*key;		/* label for the counter */
+	const char		**desc;		/* counter names */
+	char			labels[2 * (DNS_NAME_FORMATSIZE + 256)];
+} metrics_t;
+
+typedef enum {
+	metrics_server,
+	metrics_view,
+	metrics_zone
+} metrics_scope_t;
+
+typedef struct metrics_family {
+	const char		*name;
+	const char		*type;
+	const char		*help;
+	metrics_scope_t		scope;
+	void			(*render)(metrics_t *, unsigned int);
+} metrics_family_t;
+
+/*
+ * Append 'value' to 'buf' as an OpenMetrics label value.
+ */
+static void
+metrics_escape(char *buf, size_t size, const char *value) {
+	size_t n = strlen(buf);
+
+	for (; *value != '\0' && n + 3 < size; value++) {
+		switch (*value) {
+		case '\\':
+		case '"':
+			buf[n++] = '\\';
+			buf[n++] = *value;
+			break;
+		case '\n':
+			buf[n++] = '\\';
+			buf[n++] = 'n';
+			break;
+		default:
+			buf[n++] = *value;
+			break;
+		}
+	}
+	buf[n] = '\0';
+}
+
+/*
+ * Write a sample of the current family with the object's labels, a
+ * counter label 'key'="'value'" if 'value' is not NULL, and 'val'.
+ */
+static void
+metrics_sample(metrics_t *m, const char *value, uint64_t val, bool always) {
+	unsigned int pos = m->pos++;
+	isc_result_t result;
+
+	if (m->full || pos < m->line) {
+		return;
+	}
+
+	if (val != 0 || always) {
+		if (value != NULL) {
+			result = isc_buffer_printf(m->b,
+					"%s{%s%s%s=\"%s\"} %" PRIu64 "\n",
+					m->name, m->labels,
+					(m->labels[0] != '\0') ? "," : "",
+					m->key, value, val);
+		} else if (m->labels[0] != '\0') {
+			result = isc_buffer_printf(m->b,
+					"%s{%s} %" PRIu64 "\n",
+					m->name, m->labels, val);
+		} else {
+			result = isc_buffer_printf(m->b, "%s %" PRIu64 "\n",
+						   m->name, val);
+		}
+		if (result != ISC_R_SUCCESS) {
+			m->full = true;
+			return;
+		}
+	}
+
+	m->line = pos + 1;
+}
+
+static void
+metrics_counter_dump(isc_statscounter_t counter, uint64_t val, void *arg) {
+	metrics_t *m = arg;
+
+	metrics_sample(m, m->desc[counter], val, false);
+}
+
+static void
+metrics_rdtype_dump(dns_rdatastatstype_t type, uint64_t val, void *arg) {
+	metrics_t *m = arg;
+	char typebuf[64];
+	const char *typestr;
+
+	if ((DNS_RDATASTATSTYPE_ATTR(type) & DNS_RDATASTATSTYPE_ATTR_OTHERTYPE)
+	    == 0)
+	{
+		dns_rdatatype_format(DNS_RDATASTATSTYPE_BASE(type), typebuf,
+				     sizeof(typebuf));
+		typestr = typebuf;
+	} else {
+		typestr = "Others";
+	}
+
+	metrics_sample(m, typestr, val, false);
+}
+
+/*
+ * Cache RRsets use the names shown in the XML and JSON statistics,
+ * with "!" for nonexistent RRsets and "#" for stale ones.
+ */
+static void
+metrics_rdataset_dump(dns_rdatastatstype_t type, uint64_t val, void *arg) {
+	metrics_t *m = arg;
+	char typebuf[64], namebuf[66];
+	const char *typestr;
+	unsigned int attr = DNS_RDATASTATSTYPE_ATTR(type);
+
+	if ((attr & DNS_RDATASTATSTYPE_ATTR_NXDOMAIN) != 0) {
+		typestr = "NXDOMAIN";
+	} else if ((attr & DNS_RDATASTATSTYPE_ATTR_OTHERTYPE) != 0) {
+		typestr = "Others";
+	} else {
+		dns_rdatatype_format(DNS_RDATASTATSTYPE_BASE(type), typebuf,
+				     sizeof(typebuf));
+		typestr = typebuf;
+	}
+
+	snprintf(namebuf, sizeof(namebuf), "%s%s%s",
+		 ((attr & DNS_RDATASTATSTYPE_ATTR_STALE) != 0) ? "#" : "",
+		 ((attr & DNS_RDATASTATSTYPE_ATTR_NXRRSET) != 0) ? "!" : "",
+		 typestr);
+	metrics_sample(m, namebuf, val, false);
+}
+
+static void
+metrics_opcode_dump(dns_opcode_t code, uint64_t val, void *arg) {
+	metrics_t *m = arg;
+	char codebuf[64];
+	isc_buffer_t b;
+
+	isc_buffer_init(&b, codebuf, sizeof(codebuf) - 1);
+	dns_opcode_totext(code, &b);
+	codebuf[isc_buffer_usedlength(&b)] = '\0';
+
+	metrics_sample(m, codebuf, val, false);
+}
+
+static void
+metrics_rcode_dump(dns_rcode_t code, uint64_t val, void *arg) {
+	metrics_t *m = arg;
+	char codebuf[64];
+	isc_buffer_t b;
+
+	isc_buffer_init(&b, codebuf, sizeof(codebuf) - 1);
+	dns_rcode_totext(code, &b);
+	codebuf[isc_buffer_usedlength(&b)] = '\0';
+
+	metrics_sample(m, codebuf, val, false);
+}
+
+static void
+metrics_counters(metrics_t *m, isc_stats_t *stats, const char *key,
+		 const char **desc)
+{
+	if (stats != NULL) {
+		m->key = key;
+		m->desc = desc;
+		isc_stats_dump(stats, metrics_counter_dump, m,
+			       ISC_STATSDUMP_VERBOSE);
+	}
+}
+
+static void
+metrics_boottime(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	metrics_sample(m, NULL, isc_time_seconds(&named_g_boottime), true);
+}
+
+static void
+metrics_configtime(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	metrics_sample(m, NULL, isc_time_seconds(&named_g_configtime), true);
+}
+
+static void
+metrics_opcodes(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	m->key = "opcode";
+	dns_opcodestats_dump(m->server->sctx->opcodestats,
+			     metrics_opcode_dump, m, ISC_STATSDUMP_VERBOSE);
+}
+
+static void
+metrics_qtypes(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	m->key = "type";
+	dns_rdatatypestats_dump(m->server->sctx->rcvquerystats,
+				metrics_rdtype_dump, m, ISC_STATSDUMP_VERBOSE);
+}
+
+static void
+metrics_rcodes(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	m->key = "rcode";
+	dns_rcodestats_dump(m->server->sctx->rcodestats,
+			    metrics_rcode_dump, m, ISC_STATSDUMP_VERBOSE);
+}
+
+static void
+metrics_nsstats(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	metrics_counters(m, ns_stats_get(m->server->sctx->nsstats),
+			 "counter", nsstats_xmldesc);
+}
+
+static void
+metrics_zonestats(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	metrics_counters(m, m->server->zonestats, "counter",
+			 zonestats_xmldesc);
+}
+
+static void
+metrics_resstats(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	metrics_counters(m, m->server->resolverstats, "counter",
+			 resstats_xmldesc);
+}
+
+static void
+metrics_sockstats(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	metrics_counters(m, m->server->sockstats, "counter",
+			 sockstats_xmldesc);
+}
+
+/*
+ * The traffic size histograms are written as one family for requests
+ * and one for responses, labelled by transport and address family.
+ */
+static void
+metrics_sizes(metrics_t *m, isc_stats_t *stats, const char *transport,
+	      const char *family, const char **desc)
+{
+	snprintf(m->labels, sizeof(m->labels),
+		 "transport=\"%s\",family=\"%s\"", transport, family);
+	metrics_counters(m, stats, "size", desc);
+}
+
+static void
+metrics_requestsizes(metrics_t *m, unsigned int object) {
+	ns_server_t *sctx = m->server->sctx;
+
+	UNUSED(object);
+	metrics_sizes(m, sctx->udpinstats4, "udp", "ipv4",
+		      udpinsizestats_xmldesc);
+	metrics_sizes(m, sctx->udpinstats6, "udp", "ipv6",
+		      udpinsizestats_xmldesc);
+	metrics_sizes(m, sctx->tcpinstats4, "tcp", "ipv4",
+		      tcpinsizestats_xmldesc);
+	metrics_sizes(m, sctx->tcpinstats6, "tcp", "ipv6",
+		      tcpinsizestats_xmldesc);
+}
+
+static void
+metrics_responsesizes(metrics_t *m, unsigned int object) {
+	ns_server_t *sctx = m->server->sctx;
+
+	UNUSED(object);
+	metrics_sizes(m, sctx->udpoutstats4, "udp", "ipv4",
+		      udpoutsizestats_xmldesc);
+	metrics_sizes(m, sctx->udpoutstats6, "udp", "ipv6",
+		      udpoutsizestats_xmldesc);
+	metrics_sizes(m, sctx->tcpoutstats4, "tcp", "ipv4",
+		      tcpoutsizestats_xmldesc);
+	metrics_sizes(m, sctx->tcpoutstats6, "tcp", "ipv6",
+		      tcpoutsizestats_xmldesc);
+}
+
+/*
+ * The task manager's histograms are written like the query latency
+ * ones, one for each worker.
+ */
+static void
+metrics_taskhist(metrics_t *m, unsigned int queue, const uint64_t *hist) {
+	uint64_t total = 0, limit;
+	char le[32];
+	unsigned int bucket;
+
+	snprintf(m->labels, sizeof(m->labels), "queue=\"%u\"", queue);
+	m->key = "le";
+	for (bucket = 0; bucket < ISC_TASKMGR_LATENCYBUCKETS; bucket++) {
+		total += hist[bucket];
+		limit = isc_taskmgr_latencylimit(bucket);
+		if (limit != 0) {
+			snprintf(le, sizeof(le), "%" PRIu64 ".%06" PRIu64,
+				 limit / 1000000, limit % 1000000);
+		} else {
+			strlcpy(le, "+Inf", sizeof(le));
+		}
+		metrics_sample(m, le, total, true);
+	}
+	m->labels[0] = '\0';
+}
+
+static void
+metrics_taskdelay_dump(unsigned int queue, const uint64_t *delay,
+		       const uint64_t *runtime, void *arg)
+{
+	UNUSED(runtime);
+	metrics_taskhist(arg, queue, delay);
+}
+
+static void
+metrics_taskrun_dump(unsigned int queue, const uint64_t *delay,
+		     const uint64_t *runtime, void *arg)
+{
+	UNUSED(delay);
+	metrics_taskhist(arg, queue, runtime);
+}
+
+static void
+metrics_taskdelay(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	isc_taskmgr_dumplatency(named_g_taskmgr, metrics_taskdelay_dump, m);
+}
+
+static void
+metrics_taskrun(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	isc_taskmgr_dumplatency(named_g_taskmgr, metrics_taskrun_dump, m);
+}
+
+/*
+ * Task names are only added to the end of the slow event table, so
+ * the samples keep their positions between pieces of the output.
+ */
+static void
+metrics_slowcount_dump(const char *name, uint64_t count, uint64_t total,
+		       uint64_t max, void *arg)
+{
+	UNUSED(total);
+	UNUSED(max);
+	metrics_sample(arg, name, count, true);
+}
+
+static void
+metrics_slowtime_dump(const char *name, uint64_t count, uint64_t total,
+		      uint64_t max, void *arg)
+{
+	UNUSED(count);
+	UNUSED(max);
+	metrics_sample(arg, name, total, true);
+}
+
+static void
+metrics_slowevents(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	m->key = "task";
+	isc_taskmgr_dumpslow(named_g_taskmgr, metrics_slowcount_dump, m);
+}
+
+static void
+metrics_slowtime(metrics_t *m, unsigned int object) {
+	UNUSED(object);
+	m->key = "task";
+	isc_taskmgr_dumpslow(named_g_taskmgr, metrics_slowtime_dump, m);
+}
+
+static void
+metrics_outqtypes(metrics_t *m, unsigned int object) {
+	dns_view_t *view = m->views[object];
+
+	if (view->resquerystats != NULL) {
+		m->key = "type";
+		dns_rdatatypestats_dump(view->resquerystats,
+					metrics_rdtype_dump, m,
+					ISC_STATSDUMP_VERBOSE);
+	}
+}
+
+static void
+metrics_viewresstats(metrics_t *m, unsigned int object) {
+	metrics_counters(m, m->views[object]->resstats, "counter",
+			 resstats_xmldesc);
+}
+
+static void
+metrics_adbstats(metrics_t *m, unsigned int object) {
+	metrics_counters(m, m->views[object]->adbstats, "counter",
+			 adbstats_xmldesc);
+}
+
+/*
+ * The query latency histograms are written with cumulative buckets, one
+ * histogram for each transport and kind of answer.
+ */
+static void
+metrics_querylatency(metrics_t *m, unsigned int object) {
+	isc_stats_t *stats = m->views[object]->querylatencystats;
+	uint64_t values[NS_LATENCY_COUNTERS], total, limit;
+	char base[sizeof(m->labels)], le[32];
+	stats_dumparg_t dumparg;
+	unsigned int tcp, type, bucket;
+
+	if (stats == NULL) {
+		return;
+	}
+
+	memset(values, 0, sizeof(values));
+	dumparg.ncounters = NS_LATENCY_COUNTERS;
+	dumparg.countervalues = values;
+	isc_stats_dump(stats, generalstat_dump, &dumparg,
+		       ISC_STATSDUMP_VERBOSE);
+
+	strlcpy(base, m->labels, sizeof(base));
+	m->key = "le";
+	for (tcp = 0; tcp < 2; tcp++) {
+		for (type = 0; type < ns_latency_max; type++) {
+			strlcpy(m->labels, base, sizeof(m->labels));
+			strlcat(m->labels, tcp ? ",protocol=\"tcp\"" :
+						 ",protocol=\"udp\"",
+				sizeof(m->labels));
+			strlcat(m->labels, ",type=\"", sizeof(m->labels));
+			strlcat(m->labels, latency_types[type].label,
+				sizeof(m->labels));
+			strlcat(m->labels, "\"", sizeof(m->labels));
+			total = 0;
+			for (bucket = 0; bucket < NS_LATENCY_BUCKETS; bucket++)
+			{
+				total += values[ns_stats_latencycounter(tcp,
+						type, latency_lowerbound(bucket))];
+				limit = ns_stats_latencylimit(bucket);
+				if (limit != 0) {
+					snprintf(le, sizeof(le),
+						 "%" PRIu64 ".%06" PRIu64,
+						 limit / 1000000,
+						 limit % 1000000);
+				} else {
+					strlcpy(le, "+Inf", sizeof(le));
+				}
+				metrics_sample(m, le, total, true);
+			}
+		}
+	}
+	strlcpy(m->labels, base, sizeof(m->labels));
+}
+
+static void
+metrics_cacherrsets(metrics_t *m, unsigned int object) {
+	dns_view_t *view = m->views[object];
+	dns_stats_t *cacherrstats;
+
+	if (view->cachedb == NULL) {
+		return;
+	}
+
+	cacherrstats = dns_db_getrrsetstats(view->cachedb);
+	if (cacherrstats != NULL) {
+		m->key = "type";
+		dns_rdatasetstats_dump(cacherrstats, metrics_rdataset_dump, m,
+				       ISC_STATSDUMP_VERBOSE);
+	}
+}
+
+static void
+metrics_zoneserial(metrics_t *m, unsigned int object) {
+	uint32_t serial;
+
+	if (dns_zone_getserial(m->zones[object].zone,
+			       &serial) == ISC_R_SUCCESS)
+	{
+		metrics_sample(m, NULL, serial, true);
+	}
+}
+
+static void
+metrics_zonensstats(metrics_t *m, unsigned int object) {
+	dns_zone_t *zone = m->zones[object].zone;
+
+	if (dns_zone_getstatlevel(zone) == dns_zonestat_full) {
+		metrics_counters(m, dns_zone_getrequeststats(zone),
+				 "counter", nsstats_xmldesc);
+	}
+}
+
+static void
+metrics_zoneqtypes(metrics_t *m, unsigned int object) {
+	dns_zone_t *zone = m->zones[object].zone;
+	dns_stats_t *rcvquerystats;
+
+	if (dns_zone_getstatlevel(zone) != dns_zonestat_full) {
+		return;
+	}
+
+	rcvquerystats = dns_zone_getrcvquerystats(zone);
+	if (rcvquerystats != NULL) {
+		m->key = "type";
+		dns_rdatatypestats_dump(rcvquerystats, metrics_rdtype_dump, m,
+					ISC_STATSDUMP_VERBOSE);
+	}
+}
+
+static void
+metrics_zonegluecache(metrics_t *m, unsigned int object) {
+	dns_zone_t *zone = m->zones[object].zone;
+
+	if (dns_zone_getstatlevel(zone) == dns_zonestat_full) {
+		metrics_counters(m, dns_zone_getgluecachestats(zone),
+				 "counter", gluecachestats_xmldesc);
+	}
+}
+
+static const metrics_family_t metrics_families[] = {
+	{ "bind_boot_time_seconds", "gauge",
+	  "Time the server was started.", metrics_server, metrics_boottime },
+	{ "bind_config_time_seconds", "gauge",
+	  "Time the configuration was last loaded.",
+	  metrics_server, metrics_configtime },
+	{ "bind_incoming_requests", "counter",
+	  "Requests received, by opcode.", metrics_server, metrics_opcodes },
+	{ "bind_incoming_queries", "counter",
+	  "Queries received, by type.", metrics_server, metrics_qtypes },
+	{ "bind_responses", "counter",
+	  "Responses sent, by rcode.", metrics_server, metrics_rcodes },
+	{ "bind_nsstat", "counter",
+	  "Name server statistics.", metrics_server, metrics_nsstats },
+	{ "bind_zonestat", "counter",
+	  "Zone maintenance statistics.", metrics_server, metrics_zonestats },
+	{ "bind_resstat", "counter",
+	  "Resolver statistics common to all views.",
+	  metrics_server, metrics_resstats },
+	{ "bind_sockstat", "counter",
+	  "Socket I/O statistics.", metrics_server, metrics_sockstats },
+	{ "bind_request_sizes", "counter",
+	  "Requests received, by size in bytes.",
+	  metrics_server, metrics_requestsizes },
+	{ "bind_response_sizes", "counter",
+	  "Responses sent, by size in bytes.",
+	  metrics_server, metrics_responsesizes },
+	{ "bind_task_queue_delay_seconds", "histogram",
+	  "Time tasks waited to be run, by worker.",
+	  metrics_server, metrics_taskdelay },
+	{ "bind_task_run_seconds", "histogram",
+	  "Time taken by task event actions, by worker.",
+	  metrics_server, metrics_taskrun },
+	{ "bind_task_slow_events", "counter",
+	  "Slow task event actions, by task name.",
+	  metrics_server, metrics_slowevents },
+	{ "bind_task_slow_microseconds", "counter",
+	  "Time taken by slow task event actions, by task name.",
+	  metrics_server, metrics_slowtime },
+	{ "bind_outgoing_queries", "counter",
+	  "Queries sent by the resolver, by type.",
+	  metrics_view, metrics_outqtypes },
+	{ "bind_view_resstat", "counter",
+	  "Resolver statistics.", metrics_view, metrics_viewresstats },
+	{ "bind_adbstat", "counter",
+	  "Address database statistics.", metrics_view, metrics_adbstats },
+	{ "bind_query_latency_seconds", "histogram",
+	  "Time taken to answer queries.", metrics_view, metrics_querylatency },
+	{ "bind_cache_rrsets", "gauge",
+	  "RRsets in the cache, by type.", metrics_view, metrics_cacherrsets },
+	{ "bind_zone_serial", "gauge",
+	  "Zone serial number.", metrics_zone, metrics_zoneserial },
+	{ "bind_zone_nsstat", "counter",
+	  "Name server statistics for the zone.",
+	  metrics_zone, metrics_zonensstats },
+	{ "bind_zone_queries", "counter",
+	  "Queries received for the zone, by type.",
+	  metrics_zone, metrics_zoneqtypes },
+	{ "bind_zone_gluecache", "counter",
+	  "Glue cache statistics for the zone.",
+	  metrics_zone, metrics_zonegluecache },
+};
+
+#define METRICS_NFAMILIES \
+	(sizeof(metrics_families) / sizeof(metrics_families[0]))
+
+static void
+metrics_free(metrics_t *m) {
+	unsigned int i;
+
+	for (i = 0; i < m->nzones; i++) {
+		dns_zone_detach(&m->zones[i].zone);
+	}
+	if (m->zones != NULL) {
+		isc_mem_put(m->mctx, m->zones,
+			    m->zonesalloc * sizeof(m->zones[0]));
+	}
+	for (i = 0; i < m->nviews; i++) {
+		dns_view_detach(&m->views[i]);
+	}
+	if (m->views != NULL) {
+		isc_mem_put(m->mctx, m->views,
+			    m->viewsalloc * sizeof(m->views[0]));
+	}
+	isc_mem_putanddetach(&m->mctx, m, sizeof(*m));
+}
+
+static isc_result_t
+metrics_addzone(dns_zone_t *zone, void *arg) {
+	metrics_t *m = arg;
+	metrics_zone_t *zones;
+	unsigned int n;
+
+	if (dns_zone_getstatlevel(zone) == dns_zonestat_none) {
+		return (ISC_R_SUCCESS);
+	}
+
+	if (m->nzones == m->zonesalloc) {
+		n = (m->zonesalloc == 0) ? 16 : m->zonesalloc * 2;
+		zones = isc_mem_get(m->mctx, n * sizeof(zones[0]));
+		if (zones == NULL) {
+			return (ISC_R_NOMEMORY);
+		}
+		if (m->zones != NULL) {
+			memmove(zones, m->zones,
+				m->nzones * sizeof(zones[0]));
+			isc_mem_put(m->mctx, m->zones,
+				    m->zonesalloc * sizeof(zones[0]));
+		}
+		m->zones = zones;
+		m->zonesalloc = n;
+	}
+
+	m->zones[m->nzones].zone = NULL;
+	dns_zone_attach(zone, &m->zones[m->nzones].zone);
+	m->zones[m->nzones].view = m->nviews - 1;
+	m->nzones++;
+
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Set the labels identifying the object being written.
+ */
+static void
+metrics_setlabels(metrics_t *m, metrics_scope_t scope, unsigned int object) {
+	char zonebuf[DNS_NAME_FORMATSIZE];
+	dns_view_t *view;
+
+	m->labels[0] = '\0';
+	switch (scope) {
+	case metrics_server:
+		break;
+	case metrics_view:
+		strlcpy(m->labels, "view=\"", sizeof(m->labels));
+		metrics_escape(m->labels, sizeof(m->labels),
+			       m->views[object]->name);
+		strlcat(m->labels, "\"", sizeof(m->labels));
+		break;
+	case metrics_zone:
+		view = m->views[m->zones[object].view];
+		dns_zone_nameonly(m->zones[object].zone, zonebuf,
+				  sizeof(zonebuf));
+		strlcpy(m->labels, "view=\"", sizeof(m->labels));
+		metrics_escape(m->labels, sizeof(m->labels), view->name);
+		strlcat(m->labels, "\",zone=\"", sizeof(m->labels));
+		metrics_escape(m->labels, sizeof(m->labels), zonebuf);
+		strlcat(m->labels, "\"", sizeof(m->labels));
+		break;
+	}
+}
+
+/*
+ * Write as much of the remaining output as will fit in 'b'.
+ */
+static isc_result_t
+metrics_stream(isc_buffer_t *b, void *arg) {
+	metrics_t *m = arg;
+	const metrics_family_t *family;
+	unsigned int nobjects = 0;
+	const char *suffix;
+	char namebuf[64];
+	isc_result_t result;
+
+	if (b == NULL) {
+		metrics_free(m);
+		return (ISC_R_SUCCESS);
+	}
+
+	m->b = b;
+	m->full = false;
+
+	for (; m->family < METRICS_NFAMILIES; m->family++) {
+		family = &metrics_families[m->family];
+
+		if (!m->started) {
+			result = isc_buffer_printf(b, "# TYPE %s %s\n"
+						   "# HELP %s %s\n",
+						   family->name, family->type,
+						   family->name, family->help);
+			if (result != ISC_R_SUCCESS) {
+				goto full;
+			}
+			m->started = true;
+		}
+
+		if (strcmp(family->type, "counter") == 0) {
+			suffix = "_total";
+		} else if (strcmp(family->type, "histogram") == 0) {
+			suffix = "_bucket";
+		} else {
+			suffix = "";
+		}
+		snprintf(namebuf, sizeof(namebuf), "%s%s", family->name,
+			 suffix);
+		m->name = namebuf;
+
+		switch (family->scope) {
+		case metrics_server:
+			nobjects = 1;
+			break;
+		case metrics_view:
+			nobjects = m->nviews;
+			break;
+		case metrics_zone:
+			nobjects = m->nzones;
+			break;
+		}
+
+		for (; m->object < nobjects; m->object++) {
+			metrics_setlabels(m, family->scope, m->object);
+			m->pos = 0;
+			family->render(m, m->object);
+			if (m->full) {
+				goto full;
+			}
+			m->line = 0;
+		}
+
+		m->object = 0;
+		m->started = false;
+	}
+
+	result = isc_buffer_printf(b, "# EOF\n");
+	if (result == ISC_R_SUCCESS) {
+		return (ISC_R_NOMORE);
+	}
+
+ full:
+	/* Even a single line didn't fit. */
+	if (isc_buffer_usedlength(b) == 0) {
+		return (ISC_R_NOSPACE);
+	}
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+render_metrics(const char *url, isc_httpdurl_t *urlinfo,
+	       const char *querystring, const char *headers, void *arg,
+	       unsigned int *retcode, const char **retmsg,
+	       const char **mimetype, isc_httpdstream_t **streamp,
+	       void **stream_argp)
+{
+	named_server_t *server = arg;
+	isc_result_t result;
+	dns_view_t *view;
+	metrics_t *m;
+
+	UNUSED(url);
+	UNUSED(urlinfo);
+	UNUSED(querystring);
+	UNUSED(headers);
+
+	m = isc_mem_get(server->mctx, sizeof(*m));
+	if (m == NULL) {
+		return (ISC_R_NOMEMORY);
+	}
+	memset(m, 0, sizeof(*m));
+	isc_mem_attach(server->mctx, &m->mctx);
+	m->server = server;
+
+	for (view = ISC_LIST_HEAD(server->viewlist);
+	     view != NULL;
+	     view = ISC_LIST_NEXT(view, link))
+	{
+		m->viewsalloc++;
+	}
+	if (m->viewsalloc != 0) {
+		m->views = isc_mem_get(m->mctx,
+				       m->viewsalloc * sizeof(m->views[0]));
+		if (m->views == NULL) {
+			m->viewsalloc = 0;
+			result = ISC_R_NOMEMORY;
+			goto cleanup;
+		}
+	}
+
+	for (view = ISC_LIST_HEAD(server->viewlist);
+	     view != NULL;
+	     view = ISC_LIST_NEXT(view, link))
+	{
+		m->views[m->nviews] = NULL;
+		dns_view_attach(view, &m->views[m->nviews]);
+		m->nviews++;
+		if (view->zonetable != NULL) {
+			result = dns_zt_apply(view->zonetable, true, NULL,
+					      metrics_addzone, m);
+			if (result != ISC_R_SUCCESS) {
+				goto cleanup;
+			}
+		}
+	}
+
+	*retcode = 200;
+	*retmsg = "OK";
+	*mimetype = METRICS_MIMETYPE;
+	*streamp = metrics_stream;
+	*stream_argp = m;
+
+	return (ISC_R_SUCCESS);
+
+ cleanup:
+	metrics_free(m);
+	return (result);
+}
+
 static void
 shutdown_listener(named_statschannel_t *listener) {
 	char socktext[ISC_SOCKADDR_FORMATSIZE];
@@ -3334,6 +4292,8 @@ add_listener(named_server_t *server, named_statschannel_t **listenerp,
 	isc_httpdmgr_addurl(listener->httpdmgr, "/json/v1/traffic",
 			    render_json_traffic, server);
 #endif
+	isc_httpdmgr_addstreamurl(listener->httpdmgr, "/metrics",
+				  render_metrics, server);
 	isc_httpdmgr_addurl2(listener->httpdmgr, "/bind9.xsl", true,
 			     render_xsl, server);
 
@@ -3440,8 +4400,9 @@ named_statschannels_configure(named_server_t *server, const cfg_obj_t *config,
 #ifndef EXTENDED_STATS
 		isc_log_write(named_g_lctx, NAMED_LOGCATEGORY_GENERAL,
 			      NAMED_LOGMODULE_SERVER, ISC_LOG_WARNING,
-			      "statistics-channels specified but not effective "
-			      "due to missing XML and/or JSON library");
+			      "statistics-channels: XML and JSON libraries "
+			      "missing, only OpenMetrics stats will be "
+			      "available");
 #else /* EXTENDED_STATS */
 #ifndef HAVE_LIBXML2
 		isc_log_write(named_g_lctx, NAMED_LOGCATEGORY_GENERAL,
@@ -3570,6 +4531,7 @@ named_stats_dump(named_server_t *server, FILE *fp) {
 	uint64_t zonestat_values[dns_zonestatscounter_max];
 	uint64_t sockstat_values[isc_sockstatscounter_max];
 	uint64_t gluecachestats_values[dns_gluecachestatscounter_max];
+	uint64_t latencystat_values[NS_LATENCY_COUNTERS];
 
 	RUNTIME_CHECK(isc_once_do(&once, init_desc) == ISC_R_SUCCESS);
 
@@ -3612,6 +4574,22 @@ named_stats_dump(named_server_t *server, FILE *fp) {
 			     nsstats_desc, ns_statscounter_max,
 			     nsstats_index, nsstat_values, 0);
 
+	fprintf(fp, "++ Query Latency ++\n");
+	for (view = ISC_LIST_HEAD(server->viewlist);
+	     view != NULL;
+	     view = ISC_LIST_NEXT(view, link)) {
+		if (view->querylatencystats == NULL)
+			continue;
+		if (strcmp(view->name, "_default") == 0)
+			fprintf(fp, "[View: default]\n");
+		else
+			fprintf(fp, "[View: %s]\n", view->name);
+		(void) dump_counters(view->querylatencystats,
+				     isc_statsformat_file, fp, NULL,
+				     latencystats_desc, NS_LATENCY_COUNTERS,
+				     latencystats_index, latencystat_values, 0);
+	}
+
 	fprintf(fp, "++ Zone Maintenance Statistics ++\n");
 	(void) dump_counters(server->zonestats, isc_statsformat_file, fp, NULL,
 			     zonestats_desc, dns_zonestatscounter_max,
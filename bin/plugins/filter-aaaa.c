@@ -376,7 +376,7 @@ plugin_register(const char *parameters,
 
 	CHECK(isc_mempool_create(mctx, sizeof(filter_data_t),
 				 &inst->datapool));
-	CHECK(isc_ht_init(&inst->ht, mctx, 16));
+	CHECK(isc_ht_init(&inst->ht, mctx, 10));
 	isc_mutex_init(&inst->hlock);
 
 	/*
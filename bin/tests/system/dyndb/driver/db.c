@@ -611,7 +611,8 @@ static dns_dbmethods_t sampledb_methods = {
 	NULL,			/* getsize */
 	NULL,			/* setservestalettl */
 	NULL,			/* getservestalettl */
-	NULL			/* setgluecachestats */
+	NULL,			/* setgluecachestats */
+	NULL			/* getversionid */
 };
 
 /* Auxiliary driver functions. */
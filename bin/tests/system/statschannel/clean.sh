@@ -19,4 +19,5 @@ rm -f ns*/named.stats
 rm -f xml.*stats json.*stats
 rm -f xml.*mem json.*mem
 rm -f compressed.headers regular.headers compressed.out regular.out
+rm -f metrics.headers metrics.headers.1.0 metrics.out metrics.out.1.0
 rm -f ns*/managed-keys.bind*
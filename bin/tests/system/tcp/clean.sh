@@ -13,6 +13,8 @@ rm -f */named.memstats
 rm -f */named.run
 rm -f */named.conf
 rm -f */named.stats
+rm -f connections.out.*
 rm -f dig.out*
+rm -f idle.done
 rm -f ns*/named.lock
 rm -f ns*/managed-keys.bind*
@@ -0,0 +1,162 @@
+#!/usr/bin/perl
+#
+# Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# See the COPYRIGHT file distributed with this work for additional
+# information regarding copyright ownership.
+
+# Open many TCP connections to a server and use them in one of these
+# ways, given as the last argument:
+#
+#   idle      Send nothing.  Print "open <n>" once all are open, then
+#             wait until the file given with -w exists and close them.
+#   pipeline  Write -q queries on each connection at once, then read
+#             the responses.  Print "answered <m> of <n>".
+#   abort     Write -q queries on each connection and close it
+#             straight away, without reading the responses.
+#   quota     Send one query on each connection as soon as it is open;
+#             the server will not have accepted some of them because
+#             of tcp-clients, so -n should not go beyond it by more
+#             than the listen queue, or connecting would block.  Print
+#             "answered <m> of <n>", then close the connections that
+#             were answered, and print "then <k> of <n - m>" for those
+#             which were answered after that.
+#
+# Every query is for "example/SOA"; a response counts as an answer if
+# it has the ID of a query still outstanding on its connection, and
+# has rcode NOERROR and one answer record.
+#
+# Usage: connections.pl [-a address] [-p port] [-n connections]
+#                       [-q queries] [-w file] mode
+
+require 5.006_001;
+
+use strict;
+use Getopt::Std;
+use IO::Select;
+use IO::Socket;
+use Time::HiRes qw(time sleep);
+
+sub usage {
+    print ("Usage: connections.pl [-a address] [-p port] [-n connections] " .
+	   "[-q queries] [-w file] idle|pipeline|abort|quota\n");
+    exit 1;
+}
+
+my %options = ();
+getopts("a:n:p:q:w:", \%options) or usage();
+usage() if (@ARGV != 1);
+
+my $addr = defined $options{a} ? $options{a} : "127.0.0.1";
+my $port = defined $options{p} ? $options{p} : 53;
+my $count = defined $options{n} ? $options{n} : 100;
+my $nqueries = defined $options{q} ? $options{q} : 1;
+my $mode = $ARGV[0];
+
+my $qname = pack("C/a* C", "example", 0);
+
+sub query {
+    my ($id) = @_;
+    my $msg = pack("n6", $id, 0, 1, 0, 0, 0) . $qname . pack("nn", 6, 1);
+    return (pack("n", length($msg)) . $msg);
+}
+
+#
+# Send 'n' queries on each of the given connections in a single write.
+#
+my $id = 1;
+sub send_queries {
+    my ($n, @list) = @_;
+    foreach my $c (@list) {
+	my $data = "";
+	for (my $i = 0; $i < $n; $i++) {
+	    $c->{ids}{$id} = 1;
+	    $data .= query($id++);
+	}
+	$c->{sock}->syswrite($data) == length($data) or die "write: $!";
+    }
+}
+
+#
+# Read from the given connections until every query on them has been
+# answered or 'timeout' seconds have passed.  Returns the number of
+# responses that answered an outstanding query.
+#
+sub read_responses {
+    my ($timeout, @list) = @_;
+    my $answered = 0;
+    my $deadline = time() + $timeout;
+    my %bysock = map { (fileno($_->{sock}) => $_) } @list;
+    my $sel = IO::Select->new();
+    foreach my $c (@list) {
+	$sel->add($c->{sock}) if (%{$c->{ids}});
+    }
+    while ($sel->count() > 0 && time() < $deadline) {
+	foreach my $sock ($sel->can_read($deadline - time())) {
+	    my $c = $bysock{fileno($sock)};
+	    my $data;
+	    if (!$sock->sysread($data, 65535)) {
+		$sel->remove($sock);
+		next;
+	    }
+	    $c->{buf} .= $data;
+	    while (length($c->{buf}) >= 2) {
+		my $len = unpack("n", $c->{buf});
+		last if (length($c->{buf}) < $len + 2);
+		my $msg = substr($c->{buf}, 2, $len);
+		$c->{buf} = substr($c->{buf}, $len + 2);
+		my ($id, $flags, $qd, $an) = unpack("n4", $msg);
+		if (delete $c->{ids}{$id} && ($flags & 0x800f) == 0x8000 &&
+		    $an == 1)
+		{
+		    $answered++;
+		}
+	    }
+	    $sel->remove($sock) if (!%{$c->{ids}});
+	}
+    }
+    return ($answered);
+}
+
+my @conns;
+for (my $i = 0; $i < $count; $i++) {
+    my $sock = IO::Socket::INET->new(PeerAddr => $addr, PeerPort => $port,
+				     Proto => "tcp")
+	or die "connection $i: $!";
+    push @conns, { sock => $sock, buf => "", ids => {} };
+    send_queries(1, $conns[-1]) if ($mode eq "quota");
+}
+
+if ($mode eq "idle") {
+    print "open $count\n";
+    STDOUT->flush();
+    my $deadline = time() + 60;
+    while (defined $options{w} && ! -e $options{w} && time() < $deadline) {
+	sleep(0.1);
+    }
+} elsif ($mode eq "pipeline") {
+    send_queries($nqueries, @conns);
+    my $answered = read_responses(10, @conns);
+    print "answered $answered of ", $count * $nqueries, "\n";
+} elsif ($mode eq "abort") {
+    send_queries($nqueries, @conns);
+} elsif ($mode eq "quota") {
+    my $answered = read_responses(3, @conns);
+    print "answered $answered of $count\n";
+    my @pending = grep { %{$_->{ids}} } @conns;
+    foreach my $c (grep { !%{$_->{ids}} } @conns) {
+	$c->{sock}->close();
+    }
+    $answered = read_responses(10, @pending);
+    print "then $answered of ", scalar(@pending), "\n";
+} else {
+    usage();
+}
+
+foreach my $c (@conns) {
+    $c->{sock}->close();
+}
@@ -55,5 +55,76 @@ if [ "$ntcp21" -ge "$ntcp22" ];then ret=1; fi
 if [ $ret != 0 ]; then echo_i "failed"; fi
 status=`expr $status + $ret`
 
+# Print the number of TCP clients counted against tcp-clients on ns5.
+tcpclients() {
+	$RNDCCMD -s 10.53.0.5 status 2>/dev/null |
+		sed -n 's|^tcp clients: \([0-9]*\)/.*|\1|p'
+}
+
+# Wait for the number of TCP clients on ns5 to come back down to $1.
+wait_for_tcpclients() {
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		[ "`tcpclients`" -le "$1" ] && return 0
+		sleep 1
+	done
+	return 1
+}
+
+ntcp50=`tcpclients`
+
+echo_i "check that idle TCP connections are held open"
+ret=0
+rm -f idle.done
+$PERL connections.pl -a 10.53.0.5 -p ${PORT} -n 80 -w idle.done idle \
+	> connections.out.idle 2>&1 &
+for i in 1 2 3 4 5 6 7 8 9 10
+do
+	grep "^open 80$" connections.out.idle > /dev/null && break
+	sleep 1
+done
+grep "^open 80$" connections.out.idle > /dev/null || ret=1
+ntcp51=`tcpclients`
+[ "$ntcp51" -ge `expr $ntcp50 + 80` ] || ret=1
+$DIG $DIGOPTS +tcp @10.53.0.5 example. soa > dig.out.5 || ret=1
+grep "status: NOERROR" dig.out.5 > /dev/null || ret=1
+touch idle.done
+wait
+wait_for_tcpclients $ntcp50 || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+echo_i "check pipelined queries on many TCP connections"
+ret=0
+$PERL connections.pl -a 10.53.0.5 -p ${PORT} -n 80 -q 10 pipeline \
+	> connections.out.pipeline 2>&1
+grep "^answered 800 of 800$" connections.out.pipeline > /dev/null || ret=1
+wait_for_tcpclients $ntcp50 || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+echo_i "check TCP connections closed with responses pending"
+ret=0
+$PERL connections.pl -a 10.53.0.5 -p ${PORT} -n 80 -q 10 abort \
+	> connections.out.abort 2>&1 || ret=1
+wait_for_tcpclients $ntcp50 || ret=1
+$DIG $DIGOPTS +tcp @10.53.0.5 example. soa > dig.out.5 || ret=1
+grep "status: NOERROR" dig.out.5 > /dev/null || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+echo_i "check TCP connections over tcp-clients are served once others close"
+ret=0
+$PERL connections.pl -a 10.53.0.5 -p ${PORT} -n 105 quota \
+	> connections.out.quota 2>&1
+answered=`sed -n 's/^answered \([0-9]*\) of 105$/\1/p' connections.out.quota`
+[ -n "$answered" ] || ret=1
+[ "${answered:-0}" -ge 90 -a "${answered:-105}" -lt 105 ] || ret=1
+pending=`expr 105 - ${answered:-0}`
+grep "^then $pending of $pending$" connections.out.quota > /dev/null || ret=1
+wait_for_tcpclients $ntcp50 || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
 echo_i "exit status: $status"
 [ $status -eq 0 ] || exit 1
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <isc/buffer.h>
+#include <isc/commandline.h>
+#include <isc/print.h>
+#include <isc/region.h>
+#include <isc/result.h>
+#include <isc/string.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/result.h>
+
+#include <ns/querylog.h>
+
+/*
+ * Large enough for many records; a partial record at the end of the
+ * buffer is moved to the front before reading more.
+ */
+#define READSIZE	65536
+
+typedef enum {
+	printtime_none,
+	printtime_local,
+	printtime_iso8601,
+	printtime_iso8601utc
+} printtime_t;
+
+static const char *program = "named-querylogprint";
+static printtime_t printtime = printtime_local;
+static bool printcategory = false;
+static bool printseverity = false;
+static unsigned int options = 0;
+
+ISC_PLATFORM_NORETURN_PRE static void
+fatal(const char *format, ...) ISC_PLATFORM_NORETURN_POST;
+
+static void
+fatal(const char *format, ...) {
+	va_list args;
+
+	fprintf(stderr, "%s: fatal: ", program);
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static void
+usage(void) {
+	fprintf(stderr, "usage: %s [-csr] [-t format] file...\n", program);
+	fprintf(stderr, "\t-c\tprint the category\n");
+	fprintf(stderr, "\t-s\tprint the severity\n");
+	fprintf(stderr, "\t-r\tprint the response code\n");
+	fprintf(stderr, "\t-t\ttime format: local (default), iso8601, "
+		"iso8601-utc or none\n");
+}
+
+static void
+printrecord(const isc_time_t *when, isc_buffer_t *text) {
+	char timebuf[64];
+
+	switch (printtime) {
+	case printtime_none:
+		timebuf[0] = '\0';
+		break;
+	case printtime_local:
+		isc_time_formattimestamp(when, timebuf, sizeof(timebuf));
+		break;
+	case printtime_iso8601:
+		isc_time_formatISO8601Lms(when, timebuf, sizeof(timebuf));
+		break;
+	case printtime_iso8601utc:
+		isc_time_formatISO8601ms(when, timebuf, sizeof(timebuf));
+		break;
+	}
+
+	printf("%s%s%s%s%.*s\n", timebuf,
+	       (printtime != printtime_none) ? " " : "",
+	       printcategory ? "queries: " : "",
+	       printseverity ? "info: " : "",
+	       (int)isc_buffer_usedlength(text),
+	       (char *)isc_buffer_base(text));
+}
+
+/*
+ * Print every record in 'filename', returning false if the file could
+ * not be read or is malformed.
+ */
+static bool
+printfile(const char *filename) {
+	static unsigned char buf[READSIZE];
+	char textbuf[2048];
+	isc_buffer_t text;
+	isc_region_t r;
+	isc_result_t result;
+	isc_time_t when;
+	uint64_t offset = 0;
+	size_t have = 0, n;
+	unsigned int skipped = 0;
+	bool eof = false, ok = true;
+	FILE *fp;
+
+	fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "%s: %s: %s\n", program, filename,
+			strerror(errno));
+		return (false);
+	}
+
+	while (!eof) {
+		n = fread(buf + have, 1, sizeof(buf) - have, fp);
+		if (n == 0) {
+			if (ferror(fp)) {
+				fprintf(stderr, "%s: %s: read error\n",
+					program, filename);
+				ok = false;
+				break;
+			}
+			eof = true;
+		}
+		have += n;
+
+		r.base = buf;
+		r.length = have;
+		for (;;) {
+			isc_buffer_init(&text, textbuf, sizeof(textbuf));
+			result = ns_querylog_totext(&r, options, &when, &text);
+			if (result == ISC_R_NOTIMPLEMENTED) {
+				/* Unknown version: skip it by its length. */
+				unsigned int length = (r.base[0] << 8) |
+						      r.base[1];
+				if (length < 3) {
+					result = DNS_R_FORMERR;
+				} else {
+					isc_region_consume(&r, length);
+					skipped++;
+					continue;
+				}
+			}
+			if (result != ISC_R_SUCCESS) {
+				break;
+			}
+			printrecord(&when, &text);
+		}
+
+		offset += have - r.length;
+		if (result == ISC_R_NOMORE) {
+			have = 0;
+			continue;
+		}
+		if (result == ISC_R_UNEXPECTEDEND && !eof) {
+			memmove(buf, r.base, r.length);
+			have = r.length;
+			continue;
+		}
+		if (result == ISC_R_UNEXPECTEDEND) {
+			fprintf(stderr, "%s: %s: truncated record at "
+				"offset %" PRIu64 "\n",
+				program, filename, offset);
+		} else {
+			fprintf(stderr, "%s: %s: bad record at "
+				"offset %" PRIu64 ": %s\n",
+				program, filename, offset,
+				isc_result_totext(result));
+		}
+		ok = false;
+		break;
+	}
+
+	if (skipped != 0) {
+		fprintf(stderr, "%s: %s: skipped %u record(s) of an "
+			"unknown version\n", program, filename, skipped);
+	}
+
+	fclose(fp);
+	return (ok);
+}
+
+int
+main(int argc, char **argv) {
+	bool ok = true;
+	int ch;
+
+	while ((ch = isc_commandline_parse(argc, argv, "crst:")) != -1) {
+		switch (ch) {
+		case 'c':
+			printcategory = true;
+			break;
+		case 'r':
+			options |= NS_QUERYLOG_TEXTRCODE;
+			break;
+		case 's':
+			printseverity = true;
+			break;
+		case 't':
+			if (strcasecmp(isc_commandline_argument,
+				       "none") == 0)
+			{
+				printtime = printtime_none;
+			} else if (strcasecmp(isc_commandline_argument,
+					      "local") == 0)
+			{
+				printtime = printtime_local;
+			} else if (strcasecmp(isc_commandline_argument,
+					      "iso8601") == 0)
+			{
+				printtime = printtime_iso8601;
+			} else if (strcasecmp(isc_commandline_argument,
+					      "iso8601-utc") == 0)
+			{
+				printtime = printtime_iso8601utc;
+			} else {
+				fatal("unknown time format '%s'",
+				      isc_commandline_argument);
+			}
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	argc -= isc_commandline_index;
+	argv += isc_commandline_index;
+
+	if (argc < 1) {
+		usage();
+		exit(1);
+	}
+
+	dns_result_register();
+
+	for (; argc > 0; argc--, argv++) {
+		if (!printfile(argv[0])) {
+			ok = false;
+		}
+	}
+
+	return (ok ? 0 : 1);
+}
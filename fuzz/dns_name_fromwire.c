@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <isc/buffer.h>
+#include <isc/result.h>
+#include <isc/util.h>
+
+#include <dns/compress.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/result.h>
+
+/*
+ * Fuzz input to dns_name_fromwire(), and check that it gives the same
+ * result, name, offsets and consumed length as a simple decoder that
+ * reads the input a byte at a time.
+ *
+ * The first byte of the input selects the options: bit 0 asks for the
+ * name to be downcased, bit 1 disallows compression, and the rest
+ * shorten the target buffer.  The second byte is where in the rest of
+ * the input the name starts, so that there is room for compression
+ * pointers to point back to.
+ */
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+typedef struct {
+	isc_result_t	result;
+	unsigned char	ndata[DNS_NAME_MAXWIRE];
+	unsigned char	offsets[128];
+	unsigned int	length;
+	unsigned int	labels;
+	unsigned int	consumed;
+} refname_t;
+
+static void
+ref_fromwire(const uint8_t *msg, size_t size, unsigned int start,
+	     bool compression, bool downcase, unsigned int nmax,
+	     refname_t *ref)
+{
+	unsigned int current = start, biggest = start, pointer;
+	bool seen_pointer = false;
+	unsigned int c, i;
+
+	ref->length = 0;
+	ref->labels = 0;
+	ref->consumed = 0;
+
+#define GETBYTE(c) \
+	do { \
+		if (current >= size) { \
+			ref->result = ISC_R_UNEXPECTEDEND; \
+			return; \
+		} \
+		c = msg[current++]; \
+		if (!seen_pointer) \
+			ref->consumed++; \
+	} while (0)
+
+	for (;;) {
+		GETBYTE(c);
+		if (c < 64) {
+			ref->offsets[ref->labels++] = ref->length;
+			if (ref->length + c + 1 > nmax) {
+				ref->result = (nmax == DNS_NAME_MAXWIRE)
+						? DNS_R_NAMETOOLONG
+						: ISC_R_NOSPACE;
+				return;
+			}
+			ref->ndata[ref->length++] = c;
+			if (c == 0) {
+				ref->result = ISC_R_SUCCESS;
+				return;
+			}
+			for (i = 0; i < c; i++) {
+				unsigned int b;
+
+				GETBYTE(b);
+				if (downcase && b >= 'A' && b <= 'Z') {
+					b += 'a' - 'A';
+				}
+				ref->ndata[ref->length++] = b;
+			}
+		} else if (c >= 192) {
+			if (!compression) {
+				ref->result = DNS_R_DISALLOWED;
+				return;
+			}
+			pointer = (c & 0x3f) * 256;
+			GETBYTE(c);
+			pointer += c;
+			if (pointer >= biggest) {
+				ref->result = DNS_R_BADPOINTER;
+				return;
+			}
+			biggest = pointer;
+			current = pointer;
+			seen_pointer = true;
+		} else {
+			ref->result = DNS_R_BADLABELTYPE;
+			return;
+		}
+	}
+#undef GETBYTE
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	unsigned char fromwire[DNS_NAME_MAXWIRE];
+	dns_decompress_t dctx;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	isc_buffer_t source, target;
+	isc_result_t result;
+	refname_t ref;
+	unsigned int options, start, nmax, i;
+	bool downcase, compression;
+	unsigned char *offsets;
+
+	if (size < 2) {
+		return (0);
+	}
+
+	options = *data++; size--;
+	start = *data++; size--;
+	if (size == 0) {
+		return (0);
+	}
+	start %= size;
+	downcase = ((options & 1) != 0);
+	compression = ((options & 2) == 0);
+	nmax = DNS_NAME_MAXWIRE - (options >> 2);
+
+	ref_fromwire(data, size, start, compression, downcase, nmax, &ref);
+
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_STRICT);
+	dns_decompress_setmethods(&dctx, compression ? DNS_COMPRESS_GLOBAL14
+						     : DNS_COMPRESS_NONE);
+
+	isc_buffer_constinit(&source, data, size);
+	isc_buffer_add(&source, size);
+	isc_buffer_setactive(&source, size);
+	isc_buffer_forward(&source, start);
+
+	isc_buffer_init(&target, fromwire, nmax);
+
+	name = dns_fixedname_initname(&fixed);
+	result = dns_name_fromwire(name, &source, &dctx,
+				   downcase ? DNS_NAME_DOWNCASE : 0, &target);
+	dns_decompress_invalidate(&dctx);
+
+	assert(result == ref.result);
+	if (result != ISC_R_SUCCESS) {
+		assert(source.current == start);
+		assert(target.used == 0);
+		return (0);
+	}
+
+	assert(source.current == start + ref.consumed);
+	assert(target.used == ref.length);
+	assert(name->length == ref.length);
+	assert(name->labels == ref.labels);
+	assert(memcmp(name->ndata, ref.ndata, ref.length) == 0);
+
+	offsets = fixed.offsets;
+	for (i = 0; i < ref.labels; i++) {
+		assert(offsets[i] == ref.offsets[i]);
+	}
+
+	return (0);
+}
@@ -3873,6 +3873,7 @@ bind9_check_logging(const cfg_obj_t *config, isc_log_t *logctx,
 	const cfg_obj_t *syslogobj = NULL;
 	const cfg_obj_t *nullobj = NULL;
 	const cfg_obj_t *stderrobj = NULL;
+	const cfg_obj_t *formatobj = NULL;
 	const cfg_obj_t *logobj = NULL;
 	isc_result_t result = ISC_R_SUCCESS;
 	isc_result_t tresult;
@@ -3904,11 +3905,12 @@ bind9_check_logging(const cfg_obj_t *config, isc_log_t *logctx,
 	{
 		channel = cfg_listelt_value(element);
 		channelname = cfg_obj_asstring(cfg_map_getname(channel));
-		fileobj = syslogobj = nullobj = stderrobj = NULL;
+		fileobj = syslogobj = nullobj = stderrobj = formatobj = NULL;
 		(void)cfg_map_get(channel, "file", &fileobj);
 		(void)cfg_map_get(channel, "syslog", &syslogobj);
 		(void)cfg_map_get(channel, "null", &nullobj);
 		(void)cfg_map_get(channel, "stderr", &stderrobj);
+		(void)cfg_map_get(channel, "format", &formatobj);
 		i = 0;
 		if (fileobj != NULL)
 			i++;
@@ -3925,6 +3927,14 @@ bind9_check_logging(const cfg_obj_t *config, isc_log_t *logctx,
 				     channelname);
 			result = ISC_R_FAILURE;
 		}
+		if (formatobj != NULL && syslogobj != NULL &&
+		    strcasecmp(cfg_obj_asstring(formatobj), "binary") == 0)
+		{
+			cfg_obj_log(channel, logctx, ISC_LOG_ERROR,
+				    "channel '%s': binary format cannot be "
+				    "used with syslog", channelname);
+			result = ISC_R_FAILURE;
+		}
 		tresult = isc_symtab_define(symtab, channelname, 1,
 					    symvalue, isc_symexists_replace);
 		if (tresult != ISC_R_SUCCESS)
@@ -393,11 +393,11 @@ dns_catz_zones_merge(dns_catz_zone_t *target, dns_catz_zone_t *newzone) {
 
 	dns_name_format(&target->name, czname, DNS_NAME_FORMATSIZE);
 
-	result = isc_ht_init(&toadd, target->catzs->mctx, 16);
+	result = isc_ht_init(&toadd, target->catzs->mctx, 4);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup;
 
-	result = isc_ht_init(&tomod, target->catzs->mctx, 16);
+	result = isc_ht_init(&tomod, target->catzs->mctx, 4);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup;
 
@@ -1126,3 +1126,16 @@ dns_db_setgluecachestats(dns_db_t *db, isc_stats_t *stats) {
 
 	return (ISC_R_NOTIMPLEMENTED);
 }
+
+isc_result_t
+dns_db_getversionid(dns_db_t *db, dns_dbversion_t *version, uint64_t *idp) {
+	REQUIRE(dns_db_iszone(db));
+	REQUIRE(version != NULL);
+	REQUIRE(idp != NULL);
+
+	if (db->methods->getversionid != NULL) {
+		return ((db->methods->getversionid)(db, version, idp));
+	}
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
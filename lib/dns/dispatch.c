@@ -1791,12 +1791,14 @@ dns_dispatchmgr_create(isc_mem_t *mctx, dns_dispatchmgr_t **mgrp)
 	isc_mempool_setmaxalloc(mgr->depool, 32768);
 	isc_mempool_setfreemax(mgr->depool, 32768);
 	isc_mempool_associatelock(mgr->depool, &mgr->depool_lock);
+	isc_mempool_setthreaded(mgr->depool);
 	isc_mempool_setfillcount(mgr->depool, 32);
 
 	isc_mempool_setname(mgr->rpool, "dispmgr_rpool");
 	isc_mempool_setmaxalloc(mgr->rpool, 32768);
 	isc_mempool_setfreemax(mgr->rpool, 32768);
 	isc_mempool_associatelock(mgr->rpool, &mgr->rpool_lock);
+	isc_mempool_setthreaded(mgr->rpool);
 	isc_mempool_setfillcount(mgr->rpool, 32);
 
 	isc_mempool_setname(mgr->dpool, "dispmgr_dpool");
@@ -2011,6 +2013,7 @@ dns_dispatchmgr_setudp(dns_dispatchmgr_t *mgr,
 		isc_mempool_setmaxalloc(mgr->bpool, maxbuffers);
 		isc_mempool_setfreemax(mgr->bpool, maxbuffers);
 		isc_mempool_associatelock(mgr->bpool, &mgr->bpool_lock);
+		isc_mempool_setthreaded(mgr->bpool);
 		isc_mempool_setfillcount(mgr->bpool, 32);
 	}
 
@@ -2950,6 +2953,7 @@ dispatch_createudp(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 	isc_mempool_setmaxalloc(disp->sepool, 32768);
 	isc_mempool_setfreemax(disp->sepool, 32768);
 	isc_mempool_associatelock(disp->sepool, &disp->sepool_lock);
+	isc_mempool_setthreaded(disp->sepool);
 	isc_mempool_setfillcount(disp->sepool, 16);
 
 	attributes &= ~DNS_DISPATCHATTR_TCP;
@@ -45,33 +45,49 @@ ISC_LANG_BEGINDECLS
 #define DNS_COMPRESS_ENABLED		0x04
 
 /*
- * DNS_COMPRESS_TABLESIZE must be a power of 2. The compress code
- * utilizes this assumption.
+ * The compression table is an open-addressing index of nodes, one for
+ * each name suffix that can be pointed to, with the name data kept in
+ * an arena.  All three start out in the context itself, and are moved
+ * to memory from the context's mctx, twice the size, when they fill
+ * up; most messages never need to.  DNS_COMPRESS_INITIALSLOTS must be
+ * a power of 2 and at least twice DNS_COMPRESS_INITIALNODES.
  */
-#define DNS_COMPRESS_TABLEBITS 6
-#define DNS_COMPRESS_TABLESIZE (1U << DNS_COMPRESS_TABLEBITS)
-#define DNS_COMPRESS_TABLEMASK (DNS_COMPRESS_TABLESIZE - 1)
-#define DNS_COMPRESS_INITIALNODES 16
+#define DNS_COMPRESS_INITIALSLOTS	64
+#define DNS_COMPRESS_INITIALNODES	32
+#define DNS_COMPRESS_INITIALARENA	1024
 
 typedef struct dns_compressnode dns_compressnode_t;
 
 struct dns_compressnode {
-	dns_compressnode_t	*next;
-	uint16_t		offset;
-	uint16_t		count;
-	isc_region_t            r;
-	dns_name_t              name;
+	uint32_t		hash;		/*%< Of the name data. */
+	uint32_t		data;		/*%< Name data, in the arena. */
+	uint32_t		mark;		/*%< Arena used before adding. */
+	uint32_t		slot;		/*%< Index slot holding this. */
+	uint16_t		offset;		/*%< Offset in the message. */
+	uint8_t			length;		/*%< Of the name data. */
+	uint8_t			labels;
 };
 
 struct dns_compress {
 	unsigned int		magic;		/*%< Magic number. */
 	unsigned int		allowed;	/*%< Allowed methods. */
 	int			edns;		/*%< Edns version or -1. */
-	/*% Global compression table. */
-	dns_compressnode_t	*table[DNS_COMPRESS_TABLESIZE];
-	/*% Preallocated nodes for the table. */
+	/*%
+	 * Global compression table.  'index' holds node numbers plus
+	 * one, or zero for an empty slot; 'nodes' are in the order
+	 * they were added, which is also the order of their offsets.
+	 */
+	uint16_t		*index;
+	unsigned int		slots;		/*%< Size of index. */
+	dns_compressnode_t	*nodes;
+	unsigned int		nodesalloc;
+	unsigned int		count;		/*%< Number of nodes. */
+	unsigned char		*arena;
+	unsigned int		arenasize;
+	unsigned int		arenaused;
+	uint16_t		initialindex[DNS_COMPRESS_INITIALSLOTS];
 	dns_compressnode_t	initialnodes[DNS_COMPRESS_INITIALNODES];
-	uint16_t		count;		/*%< Number of nodes. */
+	unsigned char		initialarena[DNS_COMPRESS_INITIALARENA];
 	isc_mem_t		*mctx;		/*%< Memory context. */
 };
 
@@ -227,6 +243,9 @@ dns_compress_rollback(dns_compress_t *cctx, uint16_t offset);
  *
  *	Requires:
  *\li		'cctx' is initialized.
+ *
+ *\li		Pointers were added in order of increasing offset, as
+ *		they are when rendering a message.
  */
 
 void
@@ -197,6 +197,9 @@ typedef struct dns_dbmethods {
 	isc_result_t	(*setservestalettl)(dns_db_t *db, dns_ttl_t ttl);
 	isc_result_t	(*getservestalettl)(dns_db_t *db, dns_ttl_t *ttl);
 	isc_result_t	(*setgluecachestats)(dns_db_t *db, isc_stats_t *stats);
+	isc_result_t	(*getversionid)(dns_db_t *db,
+					dns_dbversion_t *version,
+					uint64_t *idp);
 } dns_dbmethods_t;
 
 typedef isc_result_t
@@ -1719,6 +1722,24 @@ dns_db_setgluecachestats(dns_db_t *db, isc_stats_t *stats);
  *	dns_rdatasetstats_create(); otherwise NULL.
  */
 
+isc_result_t
+dns_db_getversionid(dns_db_t *db, dns_dbversion_t *version, uint64_t *idp);
+/*%<
+ * Get an identifier for 'version' of 'db' which no other version of any
+ * database in this process has had or will have, so that data derived
+ * from a version can be checked against the version current later
+ * without holding a reference to either.
+ *
+ * Requires:
+ * \li	'db' is a valid zone database.
+ * \li	'version' is a valid version.
+ * \li	'idp' is not NULL.
+ *
+ * Returns:
+ * \li	#ISC_R_SUCCESS
+ * \li	#ISC_R_NOTIMPLEMENTED
+ */
+
 ISC_LANG_ENDDECLS
 
 #endif /* DNS_DB_H */
@@ -587,6 +587,30 @@ dns_message_rendersection(dns_message_t *msg, dns_section_t section,
  *				   are records remaining for this section.
  */
 
+isc_result_t
+dns_message_renderwire(dns_message_t *msg, const isc_region_t *region,
+		       const unsigned int *counts);
+/*%<
+ * Render 'region', the wire format of the question, answer, authority
+ * and additional sections of another message, which held 'counts'
+ * records in each.  Names in 'region' are not added to the compression
+ * table, so names rendered afterwards are not compressed against them.
+ *
+ * Requires:
+ *
+ *\li	'msg' be a valid message.
+ *
+ *\li	dns_message_renderbegin() was called, and no section has been
+ *	rendered since.
+ *
+ *\li	'counts' has DNS_SECTION_MAX elements.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOSPACE		-- Not enough room in the buffer; nothing
+ *				   was written.
+ */
+
 void
 dns_message_renderheader(dns_message_t *msg, isc_buffer_t *target);
 /*%<
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_RESPCACHE_H
+#define DNS_RESPCACHE_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file dns/respcache.h
+ * \brief
+ * Defines dns_respcache_t, the "response cache" object.
+ *
+ * Notes:
+ *\li	A response cache holds the question, answer, authority and
+ *	additional sections of rendered responses, in wire format, so
+ *	that they can be sent again in answer to the same question
+ *	without being looked up and rendered again.  Each entry is
+ *	made from a single version of a zone database, and is thrown
+ *	away when it is found and that database no longer has that
+ *	version current.  Entries that have not been used recently are
+ *	thrown away to keep the cache within its maximum size.
+ *
+ *\li	Entries are keyed on the exact question name, case included,
+ *	the question class and type, and a 'variant' chosen by the
+ *	caller for anything else that makes two responses to the
+ *	question differ.
+ *
+ * MP:
+ *\li	The cache is split into shards, each locked internally.
+ *	Finding an entry only takes a read lock.  Entries found in it
+ *	do not change, and may be used without locking until they are
+ *	detached.
+ */
+
+/***
+ ***	Imports
+ ***/
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <dns/types.h>
+
+ISC_LANG_BEGINDECLS
+
+/***
+ ***	Functions
+ ***/
+
+isc_result_t
+dns_respcache_create(isc_mem_t *mctx, size_t maxsize,
+		     dns_respcache_t **rcp);
+/*%
+ * Create a response cache holding up to 'maxsize' bytes of entries,
+ * and store it in '*rcp'.  The size is shared out evenly between the
+ * shards of the cache.
+ *
+ * Requires:
+ * \li	mctx != NULL
+ * \li	maxsize > 0
+ * \li	rcp != NULL && *rcp == NULL
+ */
+
+void
+dns_respcache_destroy(dns_respcache_t **rcp);
+/*%
+ * Flush and then free the response cache in '*rcp'.  Entries still
+ * attached elsewhere are freed when they are detached.  '*rcp' is set
+ * to NULL on return.
+ *
+ * Requires:
+ * \li	'*rcp' to be a valid response cache.
+ */
+
+isc_result_t
+dns_respcache_find(dns_respcache_t *rc, const dns_name_t *qname,
+		   dns_rdataclass_t qclass, dns_rdatatype_t qtype,
+		   unsigned int variant, dns_db_t *db,
+		   dns_dbversion_t *version, unsigned int maxlength,
+		   uint32_t *flagp, dns_respentry_t **entryp);
+/*%
+ * Find the response to 'qname'/'qclass'/'qtype' with 'variant', made
+ * from 'version' of 'db', and attach '*entryp' to it.  If 'flagp' is
+ * not NULL, '*flagp' is set to the flags it was added with.  An entry
+ * for the question made from any other version is removed.
+ *
+ * A response that, with its header, is longer than 'maxlength' octets
+ * is not found, so that the caller can make one that fits instead.
+ *
+ * Requires:
+ * \li	rc to be a valid response cache.
+ * \li	'db' to be a zone database and 'version' one of its versions.
+ * \li	entryp != NULL && *entryp == NULL
+ *
+ * Returns:
+ * \li	#ISC_R_SUCCESS
+ * \li	#ISC_R_NOTFOUND
+ */
+
+void
+dns_respcache_add(dns_respcache_t *rc, const dns_name_t *qname,
+		  dns_rdataclass_t qclass, dns_rdatatype_t qtype,
+		  unsigned int variant, dns_db_t *db,
+		  dns_dbversion_t *version, uint32_t flags,
+		  dns_message_t *msg);
+/*%
+ * Add the response being rendered in 'msg' to the response cache 'rc'
+ * as the response to 'qname'/'qclass'/'qtype' with 'variant', made
+ * from 'version' of 'db', replacing any that is there already.  The
+ * entry is stored with flags 'flags'.  Nothing is added if 'db' cannot
+ * identify its versions, or the response is larger than a shard of
+ * the cache.
+ *
+ * Requires:
+ * \li	rc to be a valid response cache.
+ * \li	'db' to be a zone database and 'version' one of its versions.
+ * \li	'msg' has had its sections rendered, but not
+ *	dns_message_renderend() called.
+ */
+
+void
+dns_respcache_reply(dns_respentry_t *entry, dns_message_t *msg);
+/*%
+ * Set the AA and AD flags and the rcode of the reply 'msg' to those
+ * of the response in 'entry'.
+ *
+ * Requires:
+ * \li	'entry' to be a valid entry.
+ * \li	'msg' to be a valid message.
+ */
+
+isc_result_t
+dns_respcache_render(dns_respentry_t *entry, dns_message_t *msg);
+/*%
+ * Render the sections of the response in 'entry' into 'msg', as
+ * dns_message_renderwire() does.
+ *
+ * Requires:
+ * \li	'entry' to be a valid entry.
+ * \li	dns_message_renderbegin() was called for 'msg', and no section
+ *	has been rendered since.
+ *
+ * Returns:
+ * \li	#ISC_R_SUCCESS
+ * \li	#ISC_R_NOSPACE
+ */
+
+void
+dns_respcache_detachentry(dns_respentry_t **entryp);
+/*%
+ * Detach '*entryp', freeing it if it is no longer in a cache or
+ * attached elsewhere.  '*entryp' is set to NULL on return.
+ *
+ * Requires:
+ * \li	'*entryp' to be a valid entry.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_RESPCACHE_H */
@@ -526,8 +526,13 @@ dns_generalstats_create(isc_mem_t *mctx, dns_stats_t **statsp, int ncounters);
 
 isc_result_t
 dns_rdatatypestats_create(isc_mem_t *mctx, dns_stats_t **statsp);
+
+isc_result_t
+dns_rdatatypestats_create2(isc_mem_t *mctx, dns_stats_t **statsp,
+			   unsigned int flags);
 /*%<
  * Create a statistics counter structure per rdatatype.
+ * dns_rdatatypestats_create2() passes 'flags' to isc_stats_create2().
  *
  * Requires:
  *\li	'mctx' must be a valid memory context.
@@ -559,7 +564,8 @@ dns_rdatasetstats_create(isc_mem_t *mctx, dns_stats_t **statsp);
 isc_result_t
 dns_opcodestats_create(isc_mem_t *mctx, dns_stats_t **statsp);
 /*%<
- * Create a statistics counter structure per opcode.
+ * Create a statistics counter structure per opcode.  The counters are
+ * sharded per CPU (see isc_stats_create2()).
  *
  * Requires:
  *\li	'mctx' must be a valid memory context.
@@ -575,7 +581,8 @@ dns_opcodestats_create(isc_mem_t *mctx, dns_stats_t **statsp);
 isc_result_t
 dns_rcodestats_create(isc_mem_t *mctx, dns_stats_t **statsp);
 /*%<
- * Create a statistics counter structure per assigned rcode.
+ * Create a statistics counter structure per assigned rcode.  The
+ * counters are sharded per CPU (see isc_stats_create2()).
  *
  * Requires:
  *\li	'mctx' must be a valid memory context.
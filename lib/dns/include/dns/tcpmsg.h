@@ -27,6 +27,7 @@ typedef struct dns_tcpmsg {
 	uint16_t		size;
 	isc_buffer_t		buffer;
 	unsigned int		maxsize;
+	isc_buffer_t		rbuffer;
 	isc_mem_t	       *mctx;
 	isc_socket_t	       *sock;
 	isc_task_t	       *task;
@@ -46,6 +47,11 @@ dns_tcpmsg_init(isc_mem_t *mctx, isc_socket_t *sock, dns_tcpmsg_t *tcpmsg);
  * Associate a tcp message state with a given memory context and
  * TCP socket.
  *
+ * Data is read from the socket in large chunks, so that a single read
+ * can pick up several pipelined messages; these are then handed out
+ * by successive dns_tcpmsg_readmessage() calls without going back to
+ * the socket.
+ *
  * Requires:
  *
  *\li	"mctx" and "sock" be non-NULL and valid types.
@@ -76,7 +82,8 @@ dns_tcpmsg_readmessage(dns_tcpmsg_t *tcpmsg,
 		       isc_task_t *task, isc_taskaction_t action, void *arg);
 /*%<
  * Schedule an event to be delivered when a DNS message is readable, or
- * when an error occurs on the socket.
+ * when an error occurs on the socket.  If a complete message has
+ * already been read, the event is sent immediately.
  *
  * Requires:
  *
@@ -101,7 +108,7 @@ void
 dns_tcpmsg_cancelread(dns_tcpmsg_t *tcpmsg);
 /*%<
  * Cancel a readmessage() call.  The event will still be posted with a
- * CANCELED result code.
+ * CANCELED result code, unless it has already been sent.
  *
  * Requires:
  *
@@ -111,9 +118,11 @@ dns_tcpmsg_cancelread(dns_tcpmsg_t *tcpmsg);
 void
 dns_tcpmsg_keepbuffer(dns_tcpmsg_t *tcpmsg, isc_buffer_t *buffer);
 /*%<
- * If a dns buffer is to be kept between calls, this function marks the
- * internal state-machine buffer as invalid, and copies all the contents
- * of the state into "buffer".
+ * If a dns buffer is to be kept between calls, this function copies
+ * the message most recently read into a new buffer, allocated from
+ * the tcpmsg's memory context, and sets "buffer" to refer to it.
+ * Otherwise, the message is only valid until the next call to
+ * dns_tcpmsg_readmessage() or dns_tcpmsg_invalidate().
  *
  * Requires:
  *
@@ -108,6 +108,7 @@ struct dns_view {
 	isc_stats_t *			adbstats;
 	isc_stats_t *			resstats;
 	dns_stats_t *			resquerystats;
+	isc_stats_t *			querylatencystats;
 	bool				cacheshared;
 
 	/* Configurable data. */
@@ -186,6 +187,7 @@ struct dns_view {
 	dns_dlzdblist_t 		dlz_unsearched;
 	uint32_t			fail_ttl;
 	dns_badcache_t			*failcache;
+	dns_respcache_t			*respcache;
 
 	/*
 	 * Configurable data for server use only,
@@ -1106,6 +1108,33 @@ dns_view_getresquerystats(dns_view_t *view, dns_stats_t **statsp);
  *\li	'statsp' != NULL && '*statsp' != NULL
  */
 
+void
+dns_view_setquerylatencystats(dns_view_t *view, isc_stats_t *stats);
+/*%<
+ * Set a statistics counter set, 'stats', for 'view' to count the time
+ * taken to answer queries.  The counters are maintained by the name
+ * server, not by the view itself.
+ *
+ * Requires:
+ * \li	'view' is valid and is not frozen.
+ *
+ *\li	stats is a valid statistics supporting query latency counters
+ *	(see ns/stats.h).
+ */
+
+void
+dns_view_getquerylatencystats(dns_view_t *view, isc_stats_t **statsp);
+/*%<
+ * Get the query latency statistics counter set for 'view'.  If a
+ * statistics set is set '*statsp' will be attached to the set; otherwise,
+ * '*statsp' will be untouched.
+ *
+ * Requires:
+ * \li	'view' is valid and is not frozen.
+ *
+ *\li	'statsp' != NULL && '*statsp' != NULL
+ */
+
 bool
 dns_view_iscacheshared(dns_view_t *view);
 /*%<
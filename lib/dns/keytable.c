@@ -86,6 +86,7 @@ dns_keytable_create(isc_mem_t *mctx, dns_keytable_t **keytablep) {
 	if (result != ISC_R_SUCCESS) {
 		goto cleanup_rbt;
 	}
+	isc_rwlock_setreaderbias(&keytable->rwlock);
 
 	isc_refcount_init(&keytable->active_nodes, 0);
 	isc_refcount_init(&keytable->references, 1);
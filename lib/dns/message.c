@@ -2150,6 +2150,35 @@ dns_message_rendersection(dns_message_t *msg, dns_section_t sectionid,
 	return (ISC_R_SUCCESS);
 }
 
+isc_result_t
+dns_message_renderwire(dns_message_t *msg, const isc_region_t *region,
+		       const unsigned int *counts)
+{
+	dns_section_t sectionid;
+
+	REQUIRE(DNS_MESSAGE_VALID(msg));
+	REQUIRE(msg->buffer != NULL);
+	REQUIRE(msg->buffer->used == DNS_MESSAGE_HEADERLEN);
+	REQUIRE(region != NULL);
+	REQUIRE(counts != NULL);
+
+	if (msg->buffer->length - msg->buffer->used <
+	    region->length + msg->reserved)
+	{
+		return (ISC_R_NOSPACE);
+	}
+
+	isc_buffer_putmem(msg->buffer, region->base, region->length);
+	for (sectionid = DNS_SECTION_QUESTION;
+	     sectionid < DNS_SECTION_MAX;
+	     sectionid++)
+	{
+		msg->counts[sectionid] += counts[sectionid];
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
 void
 dns_message_renderheader(dns_message_t *msg, isc_buffer_t *target) {
 	uint16_t tmp;
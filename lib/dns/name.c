@@ -16,6 +16,11 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <isc/buffer.h>
 #include <isc/hash.h>
@@ -32,6 +37,8 @@
 #include <dns/name.h>
 #include <dns/result.h>
 
+#include "name_p.h"
+
 #define VALID_NAME(n)	ISC_MAGIC_VALID(n, DNS_NAME_MAGIC)
 
 typedef enum {
@@ -104,6 +111,108 @@ static unsigned char maptolower[] = {
 	0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
 };
 
+/*
+ * Case-insensitive comparison of name data.  maptolower[] only folds
+ * 'A' to 'Z', so the same can be done to a whole word at a time: a
+ * byte is upper case if adding 0x3f to its low seven bits carries into
+ * the top bit but adding 0x25 does not, and its top bit was clear.
+ * The additions cannot carry from one byte into the next.
+ */
+static inline uint64_t
+tolower64(uint64_t w) {
+	const uint64_t msb = 0x8080808080808080ULL;
+	uint64_t heptets = w & ~msb;
+	uint64_t ge_a = heptets + 0x3f3f3f3f3f3f3f3fULL;	/* >= 'A' */
+	uint64_t gt_z = heptets + 0x2525252525252525ULL;	/* > 'Z' */
+	uint64_t upper = ge_a & ~gt_z & ~w & msb;
+
+	return (w | (upper >> 2));
+}
+
+#if defined(__x86_64__) && defined(__SSE2__)
+static inline __m128i
+tolower128(const unsigned char *p) {
+	__m128i v = _mm_loadu_si128((const __m128i *)(const void *)p);
+	__m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(0x80 - 'A'));
+	__m128i upper = _mm_cmplt_epi8(shifted,
+				       _mm_set1_epi8(-128 + 26));
+
+	return (_mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+}
+#endif
+
+/*
+ * Return the offset of the first of 'length' bytes at 'p1' and 'p2'
+ * that differ once folded to lower case, or 'length' if none do.
+ * Sixteen or eight bytes are compared at a time; when a block differs
+ * the bytes in it are compared one by one to find which.  Nothing is
+ * read beyond 'length' bytes.
+ */
+static inline unsigned int
+mismatch(const unsigned char *p1, const unsigned char *p2,
+	 unsigned int length)
+{
+	unsigned int i = 0;
+	uint64_t w1, w2;
+
+#if defined(__x86_64__) && defined(__SSE2__)
+	while (length - i >= 16) {
+		__m128i eq = _mm_cmpeq_epi8(tolower128(p1 + i),
+					    tolower128(p2 + i));
+		if (_mm_movemask_epi8(eq) != 0xffff) {
+			break;
+		}
+		i += 16;
+	}
+#endif
+	while (length - i >= 8) {
+		memmove(&w1, p1 + i, sizeof(w1));
+		memmove(&w2, p2 + i, sizeof(w2));
+		if (tolower64(w1) != tolower64(w2)) {
+			break;
+		}
+		i += 8;
+	}
+	while (i < length && maptolower[p1[i]] == maptolower[p2[i]]) {
+		i++;
+	}
+
+	return (i);
+}
+
+unsigned int
+dns__name_mismatch(const unsigned char *p1, const unsigned char *p2,
+		   unsigned int length)
+{
+	return (mismatch(p1, p2, length));
+}
+
+/*
+ * Copy 'length' bytes from 'src' to 'dst', folding them to lower case
+ * as maptolower[] would.
+ */
+static inline void
+copy_lower(unsigned char *dst, const unsigned char *src, unsigned int length)
+{
+	unsigned int i = 0;
+	uint64_t w;
+
+#if defined(__x86_64__) && defined(__SSE2__)
+	for (; length - i >= 16; i += 16) {
+		_mm_storeu_si128((__m128i *)(void *)(dst + i),
+				 tolower128(src + i));
+	}
+#endif
+	for (; length - i >= 8; i += 8) {
+		memmove(&w, src + i, sizeof(w));
+		w = tolower64(w);
+		memmove(dst + i, &w, sizeof(w));
+	}
+	for (; i < length; i++) {
+		dst[i] = maptolower[src[i]];
+	}
+}
+
 #define CONVERTTOASCII(c)
 #define CONVERTFROMASCII(c)
 
@@ -463,8 +572,7 @@ dns_name_hash(const dns_name_t *name, bool case_sensitive) {
 	if (length > 16)
 		length = 16;
 
-	return (isc_hash_function_reverse(name->ndata, length,
-					  case_sensitive, NULL));
+	return (isc_hash32(name->ndata, length, case_sensitive));
 }
 
 unsigned int
@@ -477,16 +585,15 @@ dns_name_fullhash(const dns_name_t *name, bool case_sensitive) {
 	if (name->labels == 0)
 		return (0);
 
-	return (isc_hash_function_reverse(name->ndata, name->length,
-					  case_sensitive, NULL));
+	return (isc_hash32(name->ndata, name->length, case_sensitive));
 }
 
 dns_namereln_t
 dns_name_fullcompare(const dns_name_t *name1, const dns_name_t *name2,
 		     int *orderp, unsigned int *nlabelsp)
 {
-	unsigned int l1, l2, l, count1, count2, count, nlabels;
-	int cdiff, ldiff, chdiff;
+	unsigned int l1, l2, l, count1, count2, count, nlabels, i;
+	int cdiff, ldiff;
 	unsigned char *label1, *label2;
 	unsigned char *offsets1, *offsets2;
 	dns_offsets_t odata1, odata2;
@@ -557,43 +664,11 @@ dns_name_fullcompare(const dns_name_t *name1, const dns_name_t *name2,
 		else
 			count = count2;
 
-		/* Loop unrolled for performance */
-		while (ISC_LIKELY(count > 3)) {
-			chdiff = (int)maptolower[label1[0]] -
-				 (int)maptolower[label2[0]];
-			if (chdiff != 0) {
-				*orderp = chdiff;
-				goto done;
-			}
-			chdiff = (int)maptolower[label1[1]] -
-				 (int)maptolower[label2[1]];
-			if (chdiff != 0) {
-				*orderp = chdiff;
-				goto done;
-			}
-			chdiff = (int)maptolower[label1[2]] -
-				 (int)maptolower[label2[2]];
-			if (chdiff != 0) {
-				*orderp = chdiff;
-				goto done;
-			}
-			chdiff = (int)maptolower[label1[3]] -
-				 (int)maptolower[label2[3]];
-			if (chdiff != 0) {
-				*orderp = chdiff;
-				goto done;
-			}
-			count -= 4;
-			label1 += 4;
-			label2 += 4;
-		}
-		while (ISC_LIKELY(count-- > 0)) {
-			chdiff = (int)maptolower[*label1++] -
-				 (int)maptolower[*label2++];
-			if (chdiff != 0) {
-				*orderp = chdiff;
-				goto done;
-			}
+		i = mismatch(label1, label2, count);
+		if (i < count) {
+			*orderp = (int)maptolower[label1[i]] -
+				  (int)maptolower[label2[i]];
+			goto done;
 		}
 		if (cdiff != 0) {
 			*orderp = cdiff;
@@ -642,10 +717,6 @@ dns_name_compare(const dns_name_t *name1, const dns_name_t *name2) {
 
 bool
 dns_name_equal(const dns_name_t *name1, const dns_name_t *name2) {
-	unsigned int l, count;
-	unsigned char c;
-	unsigned char *label1, *label2;
-
 	/*
 	 * Are 'name1' and 'name2' equal?
 	 *
@@ -669,46 +740,16 @@ dns_name_equal(const dns_name_t *name1, const dns_name_t *name2) {
 	if (name1->length != name2->length)
 		return (false);
 
-	l = name1->labels;
-
-	if (l != name2->labels)
+	if (name1->labels != name2->labels)
 		return (false);
 
-	label1 = name1->ndata;
-	label2 = name2->ndata;
-	while (ISC_LIKELY(l-- > 0)) {
-		count = *label1++;
-		if (count != *label2++)
-			return (false);
-
-		INSIST(count <= 63); /* no bitstring support */
-
-		/* Loop unrolled for performance */
-		while (ISC_LIKELY(count > 3)) {
-			c = maptolower[label1[0]];
-			if (c != maptolower[label2[0]])
-				return (false);
-			c = maptolower[label1[1]];
-			if (c != maptolower[label2[1]])
-				return (false);
-			c = maptolower[label1[2]];
-			if (c != maptolower[label2[2]])
-				return (false);
-			c = maptolower[label1[3]];
-			if (c != maptolower[label2[3]])
-				return (false);
-			count -= 4;
-			label1 += 4;
-			label2 += 4;
-		}
-		while (ISC_LIKELY(count-- > 0)) {
-			c = maptolower[*label1++];
-			if (c != maptolower[*label2++])
-				return (false);
-		}
-	}
-
-	return (true);
+	/*
+	 * Label lengths are at most 63, so folding to lower case leaves
+	 * them alone, and the names are equal exactly when all of their
+	 * data is equal once folded; there is no need to walk the labels.
+	 */
+	return (mismatch(name1->ndata, name2->ndata, name1->length) ==
+		name1->length);
 }
 
 bool
@@ -742,7 +783,7 @@ dns_name_caseequal(const dns_name_t *name1, const dns_name_t *name2) {
 
 int
 dns_name_rdatacompare(const dns_name_t *name1, const dns_name_t *name2) {
-	unsigned int l1, l2, l, count1, count2, count;
+	unsigned int l1, l2, l, count1, count2, count, i;
 	unsigned char c1, c2;
 	unsigned char *label1, *label2;
 
@@ -775,15 +816,14 @@ dns_name_rdatacompare(const dns_name_t *name1, const dns_name_t *name2) {
 		if (count1 != count2)
 			return ((count1 < count2) ? -1 : 1);
 		count = count1;
-		while (count > 0) {
-			count--;
-			c1 = maptolower[*label1++];
-			c2 = maptolower[*label2++];
-			if (c1 < c2)
-				return (-1);
-			else if (c1 > c2)
-				return (1);
+		i = mismatch(label1, label2, count);
+		if (i < count) {
+			c1 = maptolower[label1[i]];
+			c2 = maptolower[label2[i]];
+			return ((c1 < c2) ? -1 : 1);
 		}
+		label1 += count;
+		label2 += count;
 	}
 
 	/*
@@ -1810,11 +1850,6 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 	current = source->current;
 	biggest_pointer = current;
 
-	/*
-	 * Note:  The following code is not optimized for speed, but
-	 * rather for correctness.  Speed will be addressed in the future.
-	 */
-
 	while (current < source->active && !done) {
 		c = *cdata++;
 		current++;
@@ -1834,6 +1869,23 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 					done = true;
 				n = c;
 				state = fw_ordinary;
+				/*
+				 * Copy the label at once if all of it is in
+				 * the source; otherwise fw_ordinary copies
+				 * what there is and we fail at the end.
+				 */
+				if (c != 0 && c <= source->active - current) {
+					if (downcase)
+						copy_lower(ndata, cdata, c);
+					else
+						memmove(ndata, cdata, c);
+					ndata += c;
+					cdata += c;
+					current += c;
+					if (!seen_pointer)
+						cused += c;
+					state = fw_start;
+				}
 			} else if (c >= 128 && c < 192) {
 				/*
 				 * 14 bit local compression pointer.
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_NAME_P_H
+#define DNS_NAME_P_H
+
+/*! \file */
+
+/*%
+ *     Functions below not be used outside this module and its
+ *     associated unit tests.
+ */
+
+ISC_LANG_BEGINDECLS
+
+unsigned int
+dns__name_mismatch(const unsigned char *p1, const unsigned char *p2,
+		   unsigned int length);
+/*%<
+ * Return the offset of the first of 'length' bytes of name data at 'p1'
+ * and 'p2' that differ once folded to lower case, or 'length' if none
+ * do.  This is the comparison dns_name_equal() uses, for callers such
+ * as the compression table that hold name data without a dns_name_t.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_NAME_P_H */
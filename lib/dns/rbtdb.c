@@ -16,6 +16,7 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include <isc/atomic.h>
 #include <isc/crc64.h>
 #include <isc/event.h>
 #include <isc/heap.h>
@@ -381,6 +382,7 @@ typedef enum {
 typedef struct rbtdb_version {
 	/* Not locked */
 	rbtdb_serial_t                  serial;
+	uint64_t			id;	/* unique in the process */
 	dns_rbtdb_t *			rbtdb;
 	/*
 	 * Protected in the refcount routines.
@@ -704,6 +706,12 @@ static char FILE_VERSION[32] = "\0";
  */
 static unsigned int init_count;
 
+/*%
+ * 'nextversionid' is used to give every version of every database a
+ * different 'id', for dns_db_getversionid().
+ */
+static atomic_uint_fast64_t nextversionid = 1;
+
 /*
  * Locking
  *
@@ -1227,6 +1235,8 @@ allocate_version(isc_mem_t *mctx, rbtdb_serial_t serial,
 	if (version == NULL)
 		return (NULL);
 	version->serial = serial;
+	version->id = atomic_fetch_add_explicit(&nextversionid, 1,
+						memory_order_relaxed);
 
 	isc_refcount_init(&version->references, references);
 
@@ -7918,6 +7928,18 @@ setgluecachestats(dns_db_t *db, isc_stats_t *stats) {
 	return (ISC_R_SUCCESS);
 }
 
+static isc_result_t
+getversionid(dns_db_t *db, dns_dbversion_t *version, uint64_t *idp) {
+	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
+	rbtdb_version_t *rbtversion = version;
+
+	REQUIRE(VALID_RBTDB(rbtdb));
+	REQUIRE(rbtversion->rbtdb == rbtdb);
+
+	*idp = rbtversion->id;
+	return (ISC_R_SUCCESS);
+}
+
 static dns_stats_t *
 getrrsetstats(dns_db_t *db) {
 	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
@@ -8017,7 +8039,8 @@ static dns_dbmethods_t zone_methods = {
 	getsize,
 	NULL,			/* setservestalettl */
 	NULL,			/* getservestalettl */
-	setgluecachestats
+	setgluecachestats,
+	getversionid
 };
 
 static dns_dbmethods_t cache_methods = {
@@ -8068,7 +8091,8 @@ static dns_dbmethods_t cache_methods = {
 	NULL,			/* getsize */
 	setservestalettl,
 	getservestalettl,
-	NULL
+	NULL,			/* setgluecachestats */
+	NULL			/* getversionid */
 };
 
 isc_result_t
@@ -8120,6 +8144,16 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_lock;
 
+	/*
+	 * Zone databases are looked up far more often than they are
+	 * changed, so let readers of the tree and of the nodes bypass
+	 * the shared lock word.  Cache databases are written to on
+	 * nearly every resolution and are better served by the
+	 * ordinary lock.
+	 */
+	if (!IS_CACHE(rbtdb))
+		isc_rwlock_setreaderbias(&rbtdb->tree_lock);
+
 	/*
 	 * Initialize node_lock_count in a generic way to support future
 	 * extension which allows the user to specify this value on creation.
@@ -8199,6 +8233,9 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
 		result = NODE_INITLOCK(&rbtdb->node_locks[i].lock);
 		if (result == ISC_R_SUCCESS) {
 			isc_refcount_init(&rbtdb->node_locks[i].references, 0);
+			if (!IS_CACHE(rbtdb))
+				isc_rwlock_setreaderbias(
+					&rbtdb->node_locks[i].lock);
 		}
 		if (result != ISC_R_SUCCESS) {
 			while (i-- > 0) {
@@ -0,0 +1,500 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <isc/atomic.h>
+#include <isc/buffer.h>
+#include <isc/mem.h>
+#include <isc/refcount.h>
+#include <isc/rwlock.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/message.h>
+#include <dns/name.h>
+#include <dns/respcache.h>
+
+#define RESPCACHE_MAGIC			ISC_MAGIC('R', 's', 'p', 'C')
+#define VALID_RESPCACHE(rc)		ISC_MAGIC_VALID(rc, RESPCACHE_MAGIC)
+
+#define RESPENTRY_MAGIC			ISC_MAGIC('R', 's', 'p', 'E')
+#define VALID_RESPENTRY(e)		ISC_MAGIC_VALID(e, RESPENTRY_MAGIC)
+
+/*
+ * The cache is split into shards, picked by the top bits of the hash
+ * value, each with its own lock and its own share of the maximum size,
+ * so that queries for different names seldom touch the same lock.
+ */
+#define RESPCACHE_SHARDBITS		4
+#define RESPCACHE_SHARDS		(1 << RESPCACHE_SHARDBITS)
+#define SHARD(rc, hashval) \
+	(&(rc)->shards[(hashval) >> (32 - RESPCACHE_SHARDBITS)])
+
+/*
+ * Initial number of hash buckets in each shard; must be a power of 2.
+ * The table doubles whenever there are more entries than buckets.
+ */
+#define RESPCACHE_MINSIZE		64
+
+typedef struct respshard {
+	isc_rwlock_t		lock;
+
+	/* Locked by lock. */
+	dns_respentry_t		**table;
+	unsigned int		size;
+	unsigned int		count;
+	size_t			maxsize;
+	size_t			cursize;
+	ISC_LIST(dns_respentry_t) clock;
+} respshard_t;
+
+struct dns_respcache {
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	respshard_t		shards[RESPCACHE_SHARDS];
+};
+
+struct dns_respentry {
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	isc_refcount_t		references;
+
+	/* Locked by the shard lock while in a cache. */
+	dns_respentry_t		*next;
+	ISC_LINK(dns_respentry_t) link;
+
+	/* Set on a hit, with only the shard read lock held. */
+	atomic_bool		referenced;
+
+	/* Unlocked; set before the entry is added. */
+	unsigned int		hashval;
+	dns_rdataclass_t	qclass;
+	dns_rdatatype_t		qtype;
+	unsigned int		variant;
+	uint64_t		versionid;
+	uint32_t		flags;
+	unsigned int		msgflags;
+	dns_rcode_t		rcode;
+	unsigned int		counts[DNS_SECTION_MAX];
+	unsigned int		namelength;
+	isc_region_t		wire;
+	size_t			size;
+	/* Followed by the question name, then the wire data. */
+};
+
+static inline unsigned int
+hash_key(const dns_name_t *qname, dns_rdataclass_t qclass,
+	 dns_rdatatype_t qtype, unsigned int variant)
+{
+	return (dns_name_hash(qname, true) ^
+		(qtype * 0x9e3779b1U) ^ (qclass * 0xc2b2ae35U) ^
+		(variant * 0x85ebca6bU));
+}
+
+static inline bool
+match_key(dns_respentry_t *entry, unsigned int hashval,
+	  const dns_name_t *qname, dns_rdataclass_t qclass,
+	  dns_rdatatype_t qtype, unsigned int variant)
+{
+	return (entry->hashval == hashval && entry->qtype == qtype &&
+		entry->qclass == qclass && entry->variant == variant &&
+		entry->namelength == qname->length &&
+		memcmp(entry + 1, qname->ndata, qname->length) == 0);
+}
+
+static void
+entry_free(dns_respentry_t *entry) {
+	isc_refcount_destroy(&entry->references);
+	entry->magic = 0;
+	isc_mem_putanddetach(&entry->mctx, entry, entry->size);
+}
+
+/*
+ * Unlink 'entry' from its bucket, found by following 'prevp', and from
+ * the clock list, and drop the cache's reference to it.  The shard must
+ * be write locked.
+ */
+static void
+entry_unlink(respshard_t *shard, dns_respentry_t **prevp,
+	     dns_respentry_t *entry)
+{
+	*prevp = entry->next;
+	ISC_LIST_UNLINK(shard->clock, entry, link);
+	shard->count--;
+	shard->cursize -= entry->size;
+	dns_respcache_detachentry(&entry);
+}
+
+static void
+entry_remove(respshard_t *shard, dns_respentry_t *entry) {
+	dns_respentry_t **prevp;
+
+	prevp = &shard->table[entry->hashval & (shard->size - 1)];
+	while (*prevp != entry) {
+		prevp = &(*prevp)->next;
+	}
+	entry_unlink(shard, prevp, entry);
+}
+
+/*
+ * Remove an entry that has not been used recently.  Entries are taken
+ * from the tail of the clock list; one that has been found since it
+ * was last looked at gets a second chance at the head instead.  Hits
+ * therefore only have to set a flag, not reorder the list.  The shard
+ * must be write locked.
+ */
+static void
+evict(respshard_t *shard) {
+	dns_respentry_t *entry;
+
+	for (;;) {
+		entry = ISC_LIST_TAIL(shard->clock);
+		INSIST(entry != NULL);
+		if (!atomic_load_relaxed(&entry->referenced)) {
+			break;
+		}
+		atomic_store_relaxed(&entry->referenced, false);
+		ISC_LIST_UNLINK(shard->clock, entry, link);
+		ISC_LIST_PREPEND(shard->clock, entry, link);
+	}
+
+	entry_remove(shard, entry);
+}
+
+static void
+grow(isc_mem_t *mctx, respshard_t *shard) {
+	dns_respentry_t **table, *entry, *next;
+	unsigned int size = shard->size * 2;
+	unsigned int i;
+
+	table = isc_mem_get(mctx, sizeof(*table) * size);
+	if (table == NULL) {
+		return;
+	}
+	memset(table, 0, sizeof(*table) * size);
+
+	for (i = 0; i < shard->size; i++) {
+		for (entry = shard->table[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			entry->next = table[entry->hashval & (size - 1)];
+			table[entry->hashval & (size - 1)] = entry;
+		}
+	}
+
+	isc_mem_put(mctx, shard->table, sizeof(*shard->table) * shard->size);
+	shard->table = table;
+	shard->size = size;
+}
+
+isc_result_t
+dns_respcache_create(isc_mem_t *mctx, size_t maxsize,
+		     dns_respcache_t **rcp)
+{
+	dns_respcache_t *rc;
+	respshard_t *shard;
+	isc_result_t result;
+	unsigned int i;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(maxsize > 0);
+	REQUIRE(rcp != NULL && *rcp == NULL);
+
+	rc = isc_mem_get(mctx, sizeof(*rc));
+	if (rc == NULL) {
+		return (ISC_R_NOMEMORY);
+	}
+	rc->mctx = NULL;
+	isc_mem_attach(mctx, &rc->mctx);
+
+	for (i = 0; i < RESPCACHE_SHARDS; i++) {
+		shard = &rc->shards[i];
+		shard->table = isc_mem_get(mctx, sizeof(*shard->table) *
+					   RESPCACHE_MINSIZE);
+		if (shard->table == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto cleanup;
+		}
+		memset(shard->table, 0,
+		       sizeof(*shard->table) * RESPCACHE_MINSIZE);
+		result = isc_rwlock_init(&shard->lock, 0, 0);
+		if (result != ISC_R_SUCCESS) {
+			isc_mem_put(mctx, shard->table,
+				    sizeof(*shard->table) * RESPCACHE_MINSIZE);
+			goto cleanup;
+		}
+		shard->size = RESPCACHE_MINSIZE;
+		shard->count = 0;
+		shard->maxsize = maxsize / RESPCACHE_SHARDS;
+		shard->cursize = 0;
+		ISC_LIST_INIT(shard->clock);
+	}
+	rc->magic = RESPCACHE_MAGIC;
+
+	*rcp = rc;
+	return (ISC_R_SUCCESS);
+
+ cleanup:
+	while (i-- > 0) {
+		shard = &rc->shards[i];
+		isc_rwlock_destroy(&shard->lock);
+		isc_mem_put(mctx, shard->table,
+			    sizeof(*shard->table) * shard->size);
+	}
+	isc_mem_putanddetach(&rc->mctx, rc, sizeof(*rc));
+	return (result);
+}
+
+void
+dns_respcache_destroy(dns_respcache_t **rcp) {
+	dns_respcache_t *rc;
+	respshard_t *shard;
+	unsigned int i;
+
+	REQUIRE(rcp != NULL && VALID_RESPCACHE(*rcp));
+	rc = *rcp;
+	*rcp = NULL;
+
+	rc->magic = 0;
+	for (i = 0; i < RESPCACHE_SHARDS; i++) {
+		shard = &rc->shards[i];
+		while (shard->count > 0) {
+			entry_remove(shard, ISC_LIST_TAIL(shard->clock));
+		}
+		isc_rwlock_destroy(&shard->lock);
+		isc_mem_put(rc->mctx, shard->table,
+			    sizeof(*shard->table) * shard->size);
+	}
+	isc_mem_putanddetach(&rc->mctx, rc, sizeof(*rc));
+}
+
+/*
+ * Remove the entry for a question if it was made from a version other
+ * than 'versionid'.
+ */
+static void
+remove_stale(respshard_t *shard, unsigned int hashval,
+	     const dns_name_t *qname, dns_rdataclass_t qclass,
+	     dns_rdatatype_t qtype, unsigned int variant, uint64_t versionid)
+{
+	dns_respentry_t *entry, **prevp;
+
+	RWLOCK(&shard->lock, isc_rwlocktype_write);
+	prevp = &shard->table[hashval & (shard->size - 1)];
+	for (entry = *prevp; entry != NULL; entry = *prevp) {
+		if (match_key(entry, hashval, qname, qclass, qtype, variant)) {
+			if (entry->versionid != versionid) {
+				entry_unlink(shard, prevp, entry);
+			}
+			break;
+		}
+		prevp = &entry->next;
+	}
+	RWUNLOCK(&shard->lock, isc_rwlocktype_write);
+}
+
+isc_result_t
+dns_respcache_find(dns_respcache_t *rc, const dns_name_t *qname,
+		   dns_rdataclass_t qclass, dns_rdatatype_t qtype,
+		   unsigned int variant, dns_db_t *db,
+		   dns_dbversion_t *version, unsigned int maxlength,
+		   uint32_t *flagp, dns_respentry_t **entryp)
+{
+	dns_respentry_t *entry;
+	respshard_t *shard;
+	isc_result_t result = ISC_R_NOTFOUND;
+	unsigned int hashval;
+	uint64_t versionid;
+	bool stale = false;
+
+	REQUIRE(VALID_RESPCACHE(rc));
+	REQUIRE(qname != NULL);
+	REQUIRE(entryp != NULL && *entryp == NULL);
+
+	if (dns_db_getversionid(db, version, &versionid) != ISC_R_SUCCESS) {
+		return (ISC_R_NOTFOUND);
+	}
+
+	hashval = hash_key(qname, qclass, qtype, variant);
+	shard = SHARD(rc, hashval);
+
+	RWLOCK(&shard->lock, isc_rwlocktype_read);
+	for (entry = shard->table[hashval & (shard->size - 1)];
+	     entry != NULL;
+	     entry = entry->next)
+	{
+		if (!match_key(entry, hashval, qname, qclass, qtype, variant)) {
+			continue;
+		}
+		if (entry->versionid != versionid) {
+			/*
+			 * The database has changed since this was
+			 * rendered.
+			 */
+			stale = true;
+			break;
+		}
+		if (DNS_MESSAGE_HEADERLEN + entry->wire.length > maxlength) {
+			break;
+		}
+		if (!atomic_load_relaxed(&entry->referenced)) {
+			atomic_store_relaxed(&entry->referenced, true);
+		}
+		isc_refcount_increment(&entry->references);
+		if (flagp != NULL) {
+			*flagp = entry->flags;
+		}
+		*entryp = entry;
+		result = ISC_R_SUCCESS;
+		break;
+	}
+	RWUNLOCK(&shard->lock, isc_rwlocktype_read);
+
+	if (stale) {
+		remove_stale(shard, hashval, qname, qclass, qtype, variant,
+			     versionid);
+	}
+
+	return (result);
+}
+
+void
+dns_respcache_add(dns_respcache_t *rc, const dns_name_t *qname,
+		  dns_rdataclass_t qclass, dns_rdatatype_t qtype,
+		  unsigned int variant, dns_db_t *db,
+		  dns_dbversion_t *version, uint32_t flags,
+		  dns_message_t *msg)
+{
+	dns_respentry_t *entry, *old, **prevp;
+	respshard_t *shard;
+	isc_region_t r;
+	unsigned char *p;
+	uint64_t versionid;
+	size_t size;
+
+	REQUIRE(VALID_RESPCACHE(rc));
+	REQUIRE(qname != NULL);
+	REQUIRE(DNS_MESSAGE_VALID(msg));
+	REQUIRE(msg->buffer != NULL);
+
+	if (dns_db_getversionid(db, version, &versionid) != ISC_R_SUCCESS) {
+		return;
+	}
+
+	isc_buffer_usedregion(msg->buffer, &r);
+	INSIST(r.length >= DNS_MESSAGE_HEADERLEN);
+	isc_region_consume(&r, DNS_MESSAGE_HEADERLEN);
+
+	size = sizeof(*entry) + qname->length + r.length;
+	if (size > rc->shards[0].maxsize) {
+		return;
+	}
+
+	entry = isc_mem_get(rc->mctx, size);
+	if (entry == NULL) {
+		return;
+	}
+	entry->mctx = NULL;
+	isc_mem_attach(rc->mctx, &entry->mctx);
+	isc_refcount_init(&entry->references, 1);
+	entry->next = NULL;
+	ISC_LINK_INIT(entry, link);
+	atomic_init(&entry->referenced, false);
+	entry->hashval = hash_key(qname, qclass, qtype, variant);
+	entry->qclass = qclass;
+	entry->qtype = qtype;
+	entry->variant = variant;
+	entry->versionid = versionid;
+	entry->flags = flags;
+	entry->msgflags = msg->flags &
+			  (DNS_MESSAGEFLAG_AA | DNS_MESSAGEFLAG_AD);
+	entry->rcode = msg->rcode;
+	memmove(entry->counts, msg->counts, sizeof(entry->counts));
+	entry->namelength = qname->length;
+	entry->size = size;
+
+	p = (unsigned char *)(entry + 1);
+	memmove(p, qname->ndata, qname->length);
+	p += qname->length;
+	memmove(p, r.base, r.length);
+	entry->wire.base = p;
+	entry->wire.length = r.length;
+	entry->magic = RESPENTRY_MAGIC;
+
+	shard = SHARD(rc, entry->hashval);
+	RWLOCK(&shard->lock, isc_rwlocktype_write);
+
+	/*
+	 * Replace any entry for the same question; another client may
+	 * have added one while this response was being made.
+	 */
+	prevp = &shard->table[entry->hashval & (shard->size - 1)];
+	for (old = *prevp; old != NULL; old = *prevp) {
+		if (match_key(old, entry->hashval, qname, qclass, qtype,
+			      variant))
+		{
+			entry_unlink(shard, prevp, old);
+			break;
+		}
+		prevp = &old->next;
+	}
+
+	while (shard->cursize + size > shard->maxsize) {
+		evict(shard);
+	}
+
+	prevp = &shard->table[entry->hashval & (shard->size - 1)];
+	entry->next = *prevp;
+	*prevp = entry;
+	ISC_LIST_PREPEND(shard->clock, entry, link);
+	shard->count++;
+	shard->cursize += size;
+
+	if (shard->count > shard->size) {
+		grow(rc->mctx, shard);
+	}
+
+	RWUNLOCK(&shard->lock, isc_rwlocktype_write);
+}
+
+void
+dns_respcache_reply(dns_respentry_t *entry, dns_message_t *msg) {
+	REQUIRE(VALID_RESPENTRY(entry));
+	REQUIRE(DNS_MESSAGE_VALID(msg));
+
+	msg->flags &= ~(DNS_MESSAGEFLAG_AA | DNS_MESSAGEFLAG_AD);
+	msg->flags |= entry->msgflags;
+	msg->rcode = entry->rcode;
+}
+
+isc_result_t
+dns_respcache_render(dns_respentry_t *entry, dns_message_t *msg) {
+	REQUIRE(VALID_RESPENTRY(entry));
+
+	return (dns_message_renderwire(msg, &entry->wire, entry->counts));
+}
+
+void
+dns_respcache_detachentry(dns_respentry_t **entryp) {
+	dns_respentry_t *entry;
+
+	REQUIRE(entryp != NULL && VALID_RESPENTRY(*entryp));
+	entry = *entryp;
+	*entryp = NULL;
+
+	if (isc_refcount_decrement(&entry->references) == 1) {
+		entry_free(entry);
+	}
+}
@@ -1288,7 +1288,8 @@ static dns_dbmethods_t sdb_methods = {
 	NULL,			/* getsize */
 	NULL,			/* setservestalettl */
 	NULL,			/* getservestalettl */
-	NULL			/* setgluecachestats */
+	NULL,			/* setgluecachestats */
+	NULL			/* getversionid */
 };
 
 static isc_result_t
@@ -13,6 +13,8 @@
 /*! \file */
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include <isc/mem.h>
 #include <isc/print.h>
@@ -33,74 +35,97 @@
 #define TCPMSG_MAGIC		ISC_MAGIC('T', 'C', 'P', 'm')
 #define VALID_TCPMSG(foo)	ISC_MAGIC_VALID(foo, TCPMSG_MAGIC)
 
-static void recv_length(isc_task_t *, isc_event_t *);
-static void recv_message(isc_task_t *, isc_event_t *);
+/*%
+ * Size of the read buffer; it is grown if a single message needs more,
+ * and shrunk back once that message has been handed out.
+ */
+#define TCPMSG_READSIZE		4096
 
+static void recv_data(isc_task_t *, isc_event_t *);
 
-static void
-recv_length(isc_task_t *task, isc_event_t *ev_in) {
-	isc_socketevent_t *ev = (isc_socketevent_t *)ev_in;
-	isc_event_t *dev;
-	dns_tcpmsg_t *tcpmsg = ev_in->ev_arg;
+/*%
+ * If a complete message has been read, point tcpmsg->buffer at it,
+ * consume it from the read buffer and return true.  A bad length
+ * prefix also returns true, with tcpmsg->result set accordingly.
+ */
+static bool
+next_message(dns_tcpmsg_t *tcpmsg) {
 	isc_region_t region;
-	isc_result_t result;
-
-	INSIST(VALID_TCPMSG(tcpmsg));
+	unsigned int size;
 
-	dev = &tcpmsg->event;
-	tcpmsg->address = ev->address;
-
-	if (ev->result != ISC_R_SUCCESS) {
-		tcpmsg->result = ev->result;
-		goto send_and_free;
+	isc_buffer_remainingregion(&tcpmsg->rbuffer, &region);
+	if (region.length < 2) {
+		return (false);
 	}
 
-	/*
-	 * Success.
-	 */
-	tcpmsg->size = ntohs(tcpmsg->size);
-	if (tcpmsg->size == 0) {
+	size = (region.base[0] << 8) | region.base[1];
+	if (size == 0) {
 		tcpmsg->result = ISC_R_UNEXPECTEDEND;
-		goto send_and_free;
+		return (true);
 	}
-	if (tcpmsg->size > tcpmsg->maxsize) {
+	if (size > tcpmsg->maxsize) {
 		tcpmsg->result = ISC_R_RANGE;
-		goto send_and_free;
+		return (true);
 	}
-
-	region.base = isc_mem_get(tcpmsg->mctx, tcpmsg->size);
-	region.length = tcpmsg->size;
-	if (region.base == NULL) {
-		tcpmsg->result = ISC_R_NOMEMORY;
-		goto send_and_free;
+	if (region.length - 2 < size) {
+		return (false);
 	}
-	XDEBUG(("Allocated %d bytes\n", tcpmsg->size));
 
-	isc_buffer_init(&tcpmsg->buffer, region.base, region.length);
-	result = isc_socket_recv(tcpmsg->sock, &region, 0,
-				 task, recv_message, tcpmsg);
-	if (result != ISC_R_SUCCESS) {
-		tcpmsg->result = result;
-		goto send_and_free;
+	XDEBUG(("Buffered message of %u bytes\n", size));
+
+	tcpmsg->size = size;
+	isc_buffer_init(&tcpmsg->buffer, region.base + 2, size);
+	isc_buffer_add(&tcpmsg->buffer, size);
+	isc_buffer_forward(&tcpmsg->rbuffer, size + 2);
+	tcpmsg->result = ISC_R_SUCCESS;
+
+	return (true);
+}
+
+/*%
+ * Read as much as is available from the socket, making sure there is
+ * room in the buffer for the whole of any partial message.
+ */
+static isc_result_t
+start_read(dns_tcpmsg_t *tcpmsg) {
+	isc_region_t region;
+	unsigned int size = TCPMSG_READSIZE, framelen;
+	unsigned char *base;
+
+	isc_buffer_remainingregion(&tcpmsg->rbuffer, &region);
+	if (region.length >= 2) {
+		framelen = 2 + ((region.base[0] << 8) | region.base[1]);
+		size = ISC_MAX(size, framelen);
 	}
 
-	isc_event_free(&ev_in);
-	return;
+	if (tcpmsg->rbuffer.length < size) {
+		base = isc_mem_get(tcpmsg->mctx, size);
+		if (region.length > 0) {
+			memmove(base, region.base, region.length);
+		}
+		if (tcpmsg->rbuffer.base != NULL) {
+			isc_mem_put(tcpmsg->mctx, tcpmsg->rbuffer.base,
+				    tcpmsg->rbuffer.length);
+		}
+		isc_buffer_init(&tcpmsg->rbuffer, base, size);
+		isc_buffer_add(&tcpmsg->rbuffer, region.length);
+	} else {
+		isc_buffer_compact(&tcpmsg->rbuffer);
+	}
 
- send_and_free:
-	isc_task_send(tcpmsg->task, &dev);
-	tcpmsg->task = NULL;
-	isc_event_free(&ev_in);
-	return;
+	isc_buffer_availableregion(&tcpmsg->rbuffer, &region);
+	return (isc_socket_recv(tcpmsg->sock, &region, 1,
+				tcpmsg->task, recv_data, tcpmsg));
 }
 
 static void
-recv_message(isc_task_t *task, isc_event_t *ev_in) {
+recv_data(isc_task_t *task, isc_event_t *ev_in) {
 	isc_socketevent_t *ev = (isc_socketevent_t *)ev_in;
 	isc_event_t *dev;
 	dns_tcpmsg_t *tcpmsg = ev_in->ev_arg;
+	isc_result_t result;
 
-	(void)task;
+	UNUSED(task);
 
 	INSIST(VALID_TCPMSG(tcpmsg));
 
@@ -112,10 +137,22 @@ recv_message(isc_task_t *task, isc_event_t *ev_in) {
 		goto send_and_free;
 	}
 
-	tcpmsg->result = ISC_R_SUCCESS;
-	isc_buffer_add(&tcpmsg->buffer, ev->n);
+	isc_buffer_add(&tcpmsg->rbuffer, ev->n);
+
+	XDEBUG(("Received %u bytes\n", ev->n));
+
+	if (next_message(tcpmsg)) {
+		goto send_and_free;
+	}
 
-	XDEBUG(("Received %u bytes (of %d)\n", ev->n, tcpmsg->size));
+	result = start_read(tcpmsg);
+	if (result != ISC_R_SUCCESS) {
+		tcpmsg->result = result;
+		goto send_and_free;
+	}
+
+	isc_event_free(&ev_in);
+	return;
 
  send_and_free:
 	isc_task_send(tcpmsg->task, &dev);
@@ -131,8 +168,8 @@ dns_tcpmsg_init(isc_mem_t *mctx, isc_socket_t *sock, dns_tcpmsg_t *tcpmsg) {
 
 	tcpmsg->magic = TCPMSG_MAGIC;
 	tcpmsg->size = 0;
-	tcpmsg->buffer.base = NULL;
-	tcpmsg->buffer.length = 0;
+	isc_buffer_initnull(&tcpmsg->buffer);
+	isc_buffer_initnull(&tcpmsg->rbuffer);
 	tcpmsg->maxsize = 65535;		/* Largest message possible. */
 	tcpmsg->mctx = mctx;
 	tcpmsg->sock = sock;
@@ -158,17 +195,27 @@ dns_tcpmsg_readmessage(dns_tcpmsg_t *tcpmsg,
 		       isc_task_t *task, isc_taskaction_t action, void *arg)
 {
 	isc_result_t result;
-	isc_region_t region;
+	isc_event_t *dev;
 
 	REQUIRE(VALID_TCPMSG(tcpmsg));
 	REQUIRE(task != NULL);
 	REQUIRE(tcpmsg->task == NULL);  /* not currently in use */
 
-	if (tcpmsg->buffer.base != NULL) {
-		isc_mem_put(tcpmsg->mctx, tcpmsg->buffer.base,
-			    tcpmsg->buffer.length);
-		tcpmsg->buffer.base = NULL;
-		tcpmsg->buffer.length = 0;
+	isc_buffer_initnull(&tcpmsg->buffer);
+
+	/*
+	 * The last message handed out is no longer in use.  If nothing
+	 * else is buffered and the read buffer grew for a large message,
+	 * free it, so that a connection waiting for its next message
+	 * holds no more than TCPMSG_READSIZE; start_read() allocates a
+	 * new one.
+	 */
+	if (isc_buffer_remaininglength(&tcpmsg->rbuffer) == 0 &&
+	    tcpmsg->rbuffer.length > TCPMSG_READSIZE)
+	{
+		isc_mem_put(tcpmsg->mctx, tcpmsg->rbuffer.base,
+			    tcpmsg->rbuffer.length);
+		isc_buffer_initnull(&tcpmsg->rbuffer);
 	}
 
 	tcpmsg->task = task;
@@ -180,11 +227,17 @@ dns_tcpmsg_readmessage(dns_tcpmsg_t *tcpmsg,
 		       DNS_EVENT_TCPMSG, action, arg, tcpmsg,
 		       NULL, NULL);
 
-	region.base = (unsigned char *)&tcpmsg->size;
-	region.length = 2;  /* uint16_t */
-	result = isc_socket_recv(tcpmsg->sock, &region, 0,
-				 tcpmsg->task, recv_length, tcpmsg);
+	/*
+	 * A pipelined message may already have arrived with the last one.
+	 */
+	if (next_message(tcpmsg)) {
+		dev = &tcpmsg->event;
+		isc_task_send(tcpmsg->task, &dev);
+		tcpmsg->task = NULL;
+		return (ISC_R_SUCCESS);
+	}
 
+	result = start_read(tcpmsg);
 	if (result != ISC_R_SUCCESS)
 		tcpmsg->task = NULL;
 
@@ -200,27 +253,19 @@ dns_tcpmsg_cancelread(dns_tcpmsg_t *tcpmsg) {
 
 void
 dns_tcpmsg_keepbuffer(dns_tcpmsg_t *tcpmsg, isc_buffer_t *buffer) {
-	REQUIRE(VALID_TCPMSG(tcpmsg));
-	REQUIRE(buffer != NULL);
-
-	*buffer = tcpmsg->buffer;
-	tcpmsg->buffer.base = NULL;
-	tcpmsg->buffer.length = 0;
-}
+	isc_region_t region;
 
-#if 0
-void
-dns_tcpmsg_freebuffer(dns_tcpmsg_t *tcpmsg) {
 	REQUIRE(VALID_TCPMSG(tcpmsg));
+	REQUIRE(buffer != NULL);
 
-	if (tcpmsg->buffer.base == NULL)
-		return;
+	isc_buffer_usedregion(&tcpmsg->buffer, &region);
+	INSIST(region.length > 0);
 
-	isc_mem_put(tcpmsg->mctx, tcpmsg->buffer.base, tcpmsg->buffer.length);
-	tcpmsg->buffer.base = NULL;
-	tcpmsg->buffer.length = 0;
+	isc_buffer_init(buffer, isc_mem_get(tcpmsg->mctx, region.length),
+			region.length);
+	isc_buffer_putmem(buffer, region.base, region.length);
+	isc_buffer_initnull(&tcpmsg->buffer);
 }
-#endif
 
 void
 dns_tcpmsg_invalidate(dns_tcpmsg_t *tcpmsg) {
@@ -228,10 +273,10 @@ dns_tcpmsg_invalidate(dns_tcpmsg_t *tcpmsg) {
 
 	tcpmsg->magic = 0;
 
-	if (tcpmsg->buffer.base != NULL) {
-		isc_mem_put(tcpmsg->mctx, tcpmsg->buffer.base,
-			    tcpmsg->buffer.length);
-		tcpmsg->buffer.base = NULL;
-		tcpmsg->buffer.length = 0;
+	isc_buffer_initnull(&tcpmsg->buffer);
+	if (tcpmsg->rbuffer.base != NULL) {
+		isc_mem_put(tcpmsg->mctx, tcpmsg->rbuffer.base,
+			    tcpmsg->rbuffer.length);
+		isc_buffer_initnull(&tcpmsg->rbuffer);
 	}
 }
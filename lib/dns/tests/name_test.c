@@ -15,6 +15,7 @@
 #include <stddef.h>
 #include <setjmp.h>
 
+#include <ctype.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -29,7 +30,9 @@
 #include <isc/mem.h>
 #include <isc/os.h>
 #include <isc/print.h>
+#include <isc/random.h>
 #include <isc/thread.h>
+#include <isc/time.h>
 #include <isc/util.h>
 
 #include <dns/compress.h>
@@ -102,6 +105,15 @@ fullcompare_test(void **state) {
 		{ "foo.", "bar.foo.", dns_namereln_contains, -1, 2 },
 		{ "baz.bar.foo.", "bar.foo.", dns_namereln_subdomain, 1, 3 },
 		{ "bar.foo.", "baz.bar.foo.", dns_namereln_contains, -1, 3 },
+
+		/* case and long labels */
+		{ "FOO.Example.", "foo.eXAMPLE.", dns_namereln_equal, 0, 3 },
+		{ "abcdefghijklmnopqrstuvwxyz.", "ABCDEFGHIJKLMNOPQRSTUVWXYy.",
+		  dns_namereln_commonancestor, 1, 1 },
+		{ "abcdefghijklmnopqrstuvwxyz.", "ABCDEFGHIJKLMNOPQRSTUVWXYZ0.",
+		  dns_namereln_commonancestor, -1, 1 },
+		{ "abcdefghij[.", "ABCDEFGHIJ{.",
+		  dns_namereln_commonancestor, '[' - '{', 1 },
 		{ NULL, NULL, dns_namereln_none, 0, 0 }
 	};
 
@@ -295,6 +307,126 @@ compression_test(void **state) {
 	dns_compress_invalidate(&cctx);
 }
 
+/*
+ * Compress enough names to grow the compression table well past its
+ * initial size, and check that rolling back forgets only the names
+ * rendered after the rollback offset.
+ */
+#define NCOMPRESS 1000
+
+static void
+makecompressname(const char *format, unsigned int i, dns_name_t *name) {
+	char namestr[DNS_NAME_FORMATSIZE];
+	isc_result_t result;
+
+	snprintf(namestr, sizeof(namestr), format, i);
+	result = dns_name_fromstring(name, namestr, 0, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+static void
+compression_large_test(void **state) {
+	static unsigned char buf[0x4000];
+	static uint16_t offsets[NCOMPRESS];
+	dns_compress_t cctx;
+	dns_decompress_t dctx;
+	dns_fixedname_t fixed, fixedprefix;
+	dns_name_t *name, *prefix;
+	isc_buffer_t source, target;
+	unsigned char out[DNS_NAME_MAXWIRE];
+	uint16_t offset;
+	unsigned int i;
+
+	UNUSED(state);
+
+	name = dns_fixedname_initname(&fixed);
+	prefix = dns_fixedname_initname(&fixedprefix);
+
+	assert_int_equal(dns_compress_init(&cctx, -1, mctx), ISC_R_SUCCESS);
+	dns_compress_setmethods(&cctx, DNS_COMPRESS_GLOBAL14);
+	isc_buffer_init(&target, buf, sizeof(buf));
+
+	for (i = 0; i < NCOMPRESS; i++) {
+		makecompressname("host%u.example.com", i, name);
+		offsets[i] = target.used;
+		assert_int_equal(dns_name_towire(name, &cctx, &target),
+				 ISC_R_SUCCESS);
+		/* Only the first name is written out in full. */
+		if (i > 0) {
+			assert_true(target.used - offsets[i] <
+				    name->length);
+		}
+	}
+
+	/*
+	 * Every name is found, ignoring case, at the offset where it
+	 * was rendered.
+	 */
+	for (i = 0; i < NCOMPRESS; i++) {
+		makecompressname("HOST%u.Example.COM", i, name);
+		assert_true(dns_compress_findglobal(&cctx, name, prefix,
+						    &offset));
+		assert_int_equal(dns_name_countlabels(prefix), 0);
+		assert_int_equal(offset, offsets[i]);
+	}
+
+	dns_compress_setsensitive(&cctx, true);
+	makecompressname("HOST%u.example.com", 1, name);
+	assert_true(dns_compress_findglobal(&cctx, name, prefix, &offset));
+	assert_int_equal(dns_name_countlabels(prefix), 1);
+	dns_compress_setsensitive(&cctx, false);
+
+	/*
+	 * After rolling back, only the common suffix of the names
+	 * rendered since is still found.
+	 */
+	dns_compress_rollback(&cctx, offsets[NCOMPRESS / 2]);
+	for (i = 0; i < NCOMPRESS; i++) {
+		makecompressname("host%u.example.com", i, name);
+		assert_true(dns_compress_findglobal(&cctx, name, prefix,
+						    &offset));
+		if (i < NCOMPRESS / 2) {
+			assert_int_equal(dns_name_countlabels(prefix), 0);
+			assert_int_equal(offset, offsets[i]);
+		} else {
+			assert_int_equal(dns_name_countlabels(prefix), 1);
+			assert_true(offset < offsets[1]);
+		}
+	}
+
+	/*
+	 * Render the names again from the rollback offset, and check
+	 * that the whole buffer decompresses.
+	 */
+	target.used = offsets[NCOMPRESS / 2];
+	for (i = NCOMPRESS / 2; i < NCOMPRESS; i++) {
+		makecompressname("host%u.example.com", i, name);
+		assert_int_equal(target.used, offsets[i]);
+		assert_int_equal(dns_name_towire(name, &cctx, &target),
+				 ISC_R_SUCCESS);
+	}
+	dns_compress_invalidate(&cctx);
+
+	isc_buffer_init(&source, buf, target.used);
+	isc_buffer_add(&source, target.used);
+	isc_buffer_setactive(&source, target.used);
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_STRICT);
+	dns_decompress_setmethods(&dctx, DNS_COMPRESS_GLOBAL14);
+	for (i = 0; i < NCOMPRESS; i++) {
+		dns_fixedname_t fixedwire;
+		dns_name_t *wire = dns_fixedname_initname(&fixedwire);
+
+		makecompressname("host%u.example.com", i, name);
+		isc_buffer_init(&target, out, sizeof(out));
+		assert_int_equal(dns_name_fromwire(wire, &source, &dctx, 0,
+						   &target),
+				 ISC_R_SUCCESS);
+		assert_true(dns_name_equal(wire, name));
+	}
+	assert_int_equal(isc_buffer_remaininglength(&source), 0);
+	dns_decompress_invalidate(&dctx);
+}
+
 /* is trust-anchor-telemetry test */
 static void
 istat_test(void **state) {
@@ -431,6 +563,124 @@ isabsolute_test(void **state) {
 	}
 }
 
+/*
+ * Build a name of 'nlabels' labels of 'length' bytes each from 'data'
+ * into 'buf', and point 'name' at it.
+ */
+static void
+makename(dns_name_t *name, unsigned char *buf, const unsigned char *data,
+	 unsigned int nlabels, unsigned int length)
+{
+	isc_region_t r;
+	unsigned int i, n = 0;
+
+	for (i = 0; i < nlabels; i++) {
+		buf[n++] = length;
+		memmove(buf + n, data + i * length, length);
+		n += length;
+	}
+	buf[n++] = 0;
+
+	r.base = buf;
+	r.length = n;
+	dns_name_init(name, NULL);
+	dns_name_fromregion(name, &r);
+}
+
+static int
+reference_order(const unsigned char *a, const unsigned char *b,
+		unsigned int length)
+{
+	unsigned int i;
+
+	for (i = 0; i < length; i++) {
+		int ca = (a[i] >= 'A' && a[i] <= 'Z') ? a[i] + 0x20 : a[i];
+		int cb = (b[i] >= 'A' && b[i] <= 'Z') ? b[i] + 0x20 : b[i];
+		if (ca != cb) {
+			return (ca - cb);
+		}
+	}
+	return (0);
+}
+
+/*
+ * dns_name_equal(), dns_name_fullcompare() and dns_name_rdatacompare()
+ * agree with a byte at a time comparison for every label length and
+ * every position of the first difference
+ */
+static void
+casecompare_test(void **state) {
+	/* Pairs that differ only in bit 0x20 but are not letters */
+	static const char chars[] = "aBcDeFgHiJkLmNoPqRsTuVwXyZ0-_*\x80\x01";
+	static const unsigned char others[][2] = {
+		{ '@', '`' }, { '[', '{' }, { '^', '~' }, { 0xc1, 0xe1 },
+		{ 0x01, 0x21 }, { 'a', 'b' }, { 'Z', 'y' }, { '0', 'A' },
+	};
+	unsigned char data1[3 * 63], data2[3 * 63];
+	unsigned char buf1[DNS_NAME_MAXWIRE], buf2[DNS_NAME_MAXWIRE];
+	dns_name_t name1, name2;
+	unsigned int length, pos, i, j, nlabels;
+	int order, expect;
+
+	UNUSED(state);
+
+	for (length = 1; length <= 63; length++) {
+		/* A mixture of letters, digits and other bytes */
+		for (i = 0; i < sizeof(data1); i++) {
+			j = isc_random_uniform(sizeof(chars) - 1);
+			data1[i] = chars[j];
+			data2[i] = data1[i];
+			if (isalpha(data2[i]) && isc_random_uniform(2) == 0) {
+				data2[i] ^= 0x20;
+			}
+		}
+		makename(&name1, buf1, data1, 3, length);
+		makename(&name2, buf2, data2, 3, length);
+		assert_true(dns_name_equal(&name1, &name2));
+		assert_int_equal(dns_name_rdatacompare(&name1, &name2), 0);
+		assert_int_equal(dns_name_fullcompare(&name1, &name2,
+						      &order, &nlabels),
+				 dns_namereln_equal);
+		assert_int_equal(nlabels, 4);
+
+		/* Change each byte of the first label in turn. */
+		for (pos = 0; pos < length; pos++) {
+			for (j = 0; j < sizeof(others) / sizeof(others[0]);
+			     j++)
+			{
+				unsigned char save1 = data1[pos];
+				unsigned char save2 = data2[pos];
+
+				data1[pos] = others[j][0];
+				data2[pos] = others[j][1];
+				makename(&name1, buf1, data1, 3, length);
+				makename(&name2, buf2, data2, 3, length);
+				expect = reference_order(data1, data2, length);
+				assert_int_not_equal(expect, 0);
+
+				assert_false(dns_name_equal(&name1, &name2));
+				assert_int_equal(
+					dns_name_rdatacompare(&name1, &name2),
+					(expect < 0) ? -1 : 1);
+				/*
+				 * The first label compared is the last,
+				 * which is the same in both, so the names
+				 * have it and the root in common.
+				 */
+				assert_int_equal(
+					dns_name_fullcompare(&name1, &name2,
+							     &order, &nlabels),
+					dns_namereln_commonancestor);
+				assert_int_equal(nlabels, 3);
+				assert_int_equal(order, expect);
+
+				data1[pos] = save1;
+				data2[pos] = save2;
+			}
+		}
+	}
+}
+
 /* dns_nane_hash */
 static void
 hash_test(void **state) {
@@ -761,6 +1011,81 @@ benchmark_test(void **state) {
 	       (nthreads * 32000000) / (t / 1000000.0));
 }
 
+/* Benchmark dns_name_equal() and dns_name_fullcompare() */
+
+#define COMPARE_NAMES	4096
+#define COMPARE_ROUNDS	2000
+
+static void
+compare_benchmark(const char *what, unsigned int nlabels, unsigned int length)
+{
+	static unsigned char bufs[COMPARE_NAMES][DNS_NAME_MAXWIRE];
+	static dns_name_t names[COMPARE_NAMES];
+	unsigned char data[4 * 63];
+	unsigned int i, j, round, count = 0, nl;
+	isc_time_t ts1, ts2;
+	uint64_t t;
+	int order;
+
+	/*
+	 * Names that are the same but for case, with a few that differ
+	 * in their last byte.
+	 */
+	for (i = 0; i < COMPARE_NAMES; i++) {
+		for (j = 0; j < sizeof(data); j++) {
+			data[j] = "abcdefghijklmnopqrstuvwxyz"[j % 26];
+			if (isc_random_uniform(2) == 0) {
+				data[j] ^= 0x20;
+			}
+		}
+		if (i % 16 == 0) {
+			data[nlabels * length - 1] = '0';
+		}
+		makename(&names[i], bufs[i], data, nlabels, length);
+	}
+
+	isc_time_now(&ts1);
+	for (round = 0; round < COMPARE_ROUNDS; round++) {
+		for (i = 1; i < COMPARE_NAMES; i++) {
+			if (dns_name_equal(&names[i - 1], &names[i])) {
+				count++;
+			}
+		}
+	}
+	isc_time_now(&ts2);
+	t = isc_time_microdiff(&ts2, &ts1);
+	printf("%s: dns_name_equal(): %f calls/second (%u equal)\n",
+	       what, (double)COMPARE_ROUNDS * (COMPARE_NAMES - 1) * 1000000.0 /
+	       (double)t, count);
+
+	count = 0;
+	isc_time_now(&ts1);
+	for (round = 0; round < COMPARE_ROUNDS; round++) {
+		for (i = 1; i < COMPARE_NAMES; i++) {
+			if (dns_name_fullcompare(&names[i - 1], &names[i],
+						 &order, &nl) ==
+			    dns_namereln_equal)
+			{
+				count++;
+			}
+		}
+	}
+	isc_time_now(&ts2);
+	t = isc_time_microdiff(&ts2, &ts1);
+	printf("%s: dns_name_fullcompare(): %f calls/second (%u equal)\n",
+	       what, (double)COMPARE_ROUNDS * (COMPARE_NAMES - 1) * 1000000.0 /
+	       (double)t, count);
+}
+
+static void
+compare_benchmark_test(void **state) {
+	UNUSED(state);
+
+	compare_benchmark("short labels", 4, 3);
+	compare_benchmark("typical labels", 3, 10);
+	compare_benchmark("long labels", 4, 60);
+}
+
 #endif /* DNS_BENCHMARK_TESTS */
 
 int
@@ -769,11 +1094,14 @@ main(int argc, char **argv) {
 		cmocka_unit_test(fullcompare_test),
 		cmocka_unit_test_setup_teardown(compression_test,
 						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(compression_large_test,
+						_setup, _teardown),
 		cmocka_unit_test(istat_test),
 		cmocka_unit_test(init_test),
 		cmocka_unit_test(invalidate_test),
 		cmocka_unit_test(buffer_test),
 		cmocka_unit_test(isabsolute_test),
+		cmocka_unit_test(casecompare_test),
 		cmocka_unit_test(hash_test),
 		cmocka_unit_test(issubdomain_test),
 		cmocka_unit_test(countlabels_test),
@@ -782,6 +1110,7 @@ main(int argc, char **argv) {
 #ifdef DNS_BENCHMARK_TESTS
 		cmocka_unit_test_setup_teardown(benchmark_test,
 						_setup, _teardown),
+		cmocka_unit_test(compare_benchmark_test),
 #endif /* DNS_BENCHMARK_TESTS */
 	};
 	int c;
@@ -0,0 +1,542 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/buffer.h>
+#include <isc/os.h>
+#include <isc/thread.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/compress.h>
+#include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/message.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/respcache.h>
+
+#include "dnstest.h"
+
+static dns_db_t *db = NULL;
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_test_begin(NULL, false);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_db_create(mctx, "rbt", dns_rootname, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	dns_db_detach(&db);
+	dns_test_end();
+
+	return (0);
+}
+
+/*
+ * A response being sent, rendered up to the point where it would be
+ * added to a response cache.
+ */
+typedef struct {
+	dns_message_t	*msg;
+	dns_compress_t	cctx;
+	isc_buffer_t	buffer;
+	unsigned char	data[512];
+} response_t;
+
+static void
+response_begin(response_t *resp) {
+	isc_result_t result;
+
+	resp->msg = NULL;
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER,
+				    &resp->msg);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_compress_init(&resp->cctx, -1, mctx);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_compress_setsensitive(&resp->cctx, true);
+
+	isc_buffer_init(&resp->buffer, resp->data, sizeof(resp->data));
+	result = dns_message_renderbegin(resp->msg, &resp->cctx,
+					 &resp->buffer);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+static void
+response_end(response_t *resp) {
+	dns_compress_invalidate(&resp->cctx);
+	dns_message_destroy(&resp->msg);
+}
+
+/*
+ * Render an answer to 'qname'/A with one address in it.  'qname' must
+ * remain valid until response_end() is called.
+ */
+static void
+response_render(response_t *resp, dns_name_t *qname) {
+	static unsigned char addr[4] = { 192, 0, 2, 1 };
+	dns_message_t *msg = resp->msg;
+	dns_name_t *qn = NULL, *an = NULL;
+	dns_rdataset_t *qrds = NULL, *ards = NULL;
+	dns_rdatalist_t *rdatalist = NULL;
+	dns_rdata_t *rdata = NULL;
+	isc_region_t r;
+	isc_result_t result;
+
+	msg->flags |= DNS_MESSAGEFLAG_QR | DNS_MESSAGEFLAG_AA;
+	msg->rcode = dns_rcode_noerror;
+
+	result = dns_message_gettempname(msg, &qn);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_name_clone(qname, qn);
+	result = dns_message_gettemprdataset(msg, &qrds);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_rdataset_makequestion(qrds, dns_rdataclass_in, dns_rdatatype_a);
+	ISC_LIST_APPEND(qn->list, qrds, link);
+	dns_message_addname(msg, qn, DNS_SECTION_QUESTION);
+
+	result = dns_message_gettemprdata(msg, &rdata);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	r.base = addr;
+	r.length = sizeof(addr);
+	dns_rdata_fromregion(rdata, dns_rdataclass_in, dns_rdatatype_a, &r);
+	result = dns_message_gettemprdatalist(msg, &rdatalist);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	rdatalist->rdclass = dns_rdataclass_in;
+	rdatalist->type = dns_rdatatype_a;
+	rdatalist->ttl = 300;
+	ISC_LIST_APPEND(rdatalist->rdata, rdata, link);
+	result = dns_message_gettemprdataset(msg, &ards);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_rdatalist_tordataset(rdatalist, ards);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_message_gettempname(msg, &an);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_name_clone(qname, an);
+	ISC_LIST_APPEND(an->list, ards, link);
+	dns_message_addname(msg, an, DNS_SECTION_ANSWER);
+
+	result = dns_message_rendersection(msg, DNS_SECTION_QUESTION, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_message_rendersection(msg, DNS_SECTION_ANSWER, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+static void
+add(dns_respcache_t *rc, const char *namestr, dns_dbversion_t *version) {
+	dns_fixedname_t fixed;
+	response_t resp;
+
+	dns_test_namefromstring(namestr, &fixed);
+	response_begin(&resp);
+	response_render(&resp, dns_fixedname_name(&fixed));
+	dns_respcache_add(rc, dns_fixedname_name(&fixed), dns_rdataclass_in,
+			  dns_rdatatype_a, 0, db, version, 0, resp.msg);
+	response_end(&resp);
+}
+
+static isc_result_t
+find(dns_respcache_t *rc, const char *namestr, dns_rdatatype_t qtype,
+     unsigned int variant, dns_dbversion_t *version, unsigned int maxlength)
+{
+	dns_respentry_t *entry = NULL;
+	dns_fixedname_t fixed;
+	isc_result_t result;
+
+	dns_test_namefromstring(namestr, &fixed);
+	result = dns_respcache_find(rc, dns_fixedname_name(&fixed),
+				    dns_rdataclass_in, qtype, variant, db,
+				    version, maxlength, NULL, &entry);
+	if (result == ISC_R_SUCCESS) {
+		dns_respcache_detachentry(&entry);
+	}
+
+	return (result);
+}
+
+/* an added response is found again, and renders the same */
+static void
+findrender_test(void **state) {
+	dns_respcache_t *rc = NULL;
+	dns_respentry_t *entry = NULL;
+	dns_dbversion_t *version = NULL;
+	dns_fixedname_t fixed;
+	dns_name_t *qname;
+	response_t orig, resp;
+	isc_region_t r1, r2;
+	isc_result_t result;
+	uint32_t flags = 0;
+
+	UNUSED(state);
+
+	result = dns_respcache_create(mctx, 65536, &rc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_currentversion(db, &version);
+
+	qname = dns_fixedname_initname(&fixed);
+	dns_test_namefromstring("www.Example.", &fixed);
+
+	result = dns_respcache_find(rc, qname, dns_rdataclass_in,
+				    dns_rdatatype_a, 0, db, version, 65535,
+				    &flags, &entry);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+	assert_null(entry);
+
+	response_begin(&orig);
+	response_render(&orig, qname);
+	dns_respcache_add(rc, qname, dns_rdataclass_in, dns_rdatatype_a, 0,
+			  db, version, 42, orig.msg);
+
+	result = dns_respcache_find(rc, qname, dns_rdataclass_in,
+				    dns_rdatatype_a, 0, db, version, 65535,
+				    &flags, &entry);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_non_null(entry);
+	assert_int_equal(flags, 42);
+
+	response_begin(&resp);
+	dns_respcache_reply(entry, resp.msg);
+	assert_int_equal(resp.msg->flags & DNS_MESSAGEFLAG_AA,
+			 DNS_MESSAGEFLAG_AA);
+	assert_int_equal(resp.msg->rcode, dns_rcode_noerror);
+	result = dns_respcache_render(entry, resp.msg);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_respcache_detachentry(&entry);
+
+	/* The headers have not been written yet. */
+	isc_buffer_usedregion(&orig.buffer, &r1);
+	isc_buffer_usedregion(&resp.buffer, &r2);
+	isc_region_consume(&r1, DNS_MESSAGE_HEADERLEN);
+	isc_region_consume(&r2, DNS_MESSAGE_HEADERLEN);
+	assert_int_equal(r1.length, r2.length);
+	assert_memory_equal(r1.base, r2.base, r1.length);
+	assert_int_equal(resp.msg->counts[DNS_SECTION_QUESTION], 1);
+	assert_int_equal(resp.msg->counts[DNS_SECTION_ANSWER], 1);
+	assert_int_equal(resp.msg->counts[DNS_SECTION_AUTHORITY], 0);
+	assert_int_equal(resp.msg->counts[DNS_SECTION_ADDITIONAL], 0);
+
+	response_end(&resp);
+	response_end(&orig);
+
+	/*
+	 * The question name is matched exactly, case included; the
+	 * question class and type, variant and length also have to
+	 * match.
+	 */
+	result = dns_respcache_find(rc, qname, dns_rdataclass_any,
+				    dns_rdatatype_a, 0, db, version, 65535,
+				    NULL, &entry);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+	assert_null(entry);
+	result = dns_respcache_find(rc, qname, dns_rdataclass_ch,
+				    dns_rdatatype_a, 0, db, version, 65535,
+				    NULL, &entry);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+	assert_null(entry);
+
+	/* A response for another class is kept apart. */
+	response_begin(&resp);
+	response_render(&resp, qname);
+	dns_respcache_add(rc, qname, dns_rdataclass_any, dns_rdatatype_a, 0,
+			  db, version, 7, resp.msg);
+	response_end(&resp);
+	result = dns_respcache_find(rc, qname, dns_rdataclass_any,
+				    dns_rdatatype_a, 0, db, version, 65535,
+				    &flags, &entry);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(flags, 7);
+	dns_respcache_detachentry(&entry);
+	result = dns_respcache_find(rc, qname, dns_rdataclass_in,
+				    dns_rdatatype_a, 0, db, version, 65535,
+				    &flags, &entry);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(flags, 42);
+	dns_respcache_detachentry(&entry);
+
+	assert_int_equal(find(rc, "www.Example.", dns_rdatatype_a, 0,
+			      version, 65535), ISC_R_SUCCESS);
+	assert_int_equal(find(rc, "www.example.", dns_rdatatype_a, 0,
+			      version, 65535), ISC_R_NOTFOUND);
+	assert_int_equal(find(rc, "www.Example.", dns_rdatatype_aaaa, 0,
+			      version, 65535), ISC_R_NOTFOUND);
+	assert_int_equal(find(rc, "www.Example.", dns_rdatatype_a, 1,
+			      version, 65535), ISC_R_NOTFOUND);
+	assert_int_equal(find(rc, "www.Example.", dns_rdatatype_a, 0,
+			      version, DNS_MESSAGE_HEADERLEN + r1.length),
+			 ISC_R_SUCCESS);
+	assert_int_equal(find(rc, "www.Example.", dns_rdatatype_a, 0,
+			      version, DNS_MESSAGE_HEADERLEN + r1.length - 1),
+			 ISC_R_NOTFOUND);
+
+	dns_db_closeversion(db, &version, false);
+	dns_respcache_destroy(&rc);
+	assert_null(rc);
+}
+
+/* a response made from an older version of the database is not found */
+static void
+version_test(void **state) {
+	dns_respcache_t *rc = NULL;
+	dns_dbversion_t *v1 = NULL, *v2 = NULL, *nv = NULL;
+	uint64_t id1, id2;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_respcache_create(mctx, 65536, &rc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_db_currentversion(db, &v1);
+	add(rc, "www.example.", v1);
+	assert_int_equal(find(rc, "www.example.", dns_rdatatype_a, 0, v1,
+			      65535), ISC_R_SUCCESS);
+
+	result = dns_db_newversion(db, &nv);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_closeversion(db, &nv, true);
+	dns_db_currentversion(db, &v2);
+
+	result = dns_db_getversionid(db, v1, &id1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_getversionid(db, v2, &id2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_not_equal(id1, id2);
+
+	assert_int_equal(find(rc, "www.example.", dns_rdatatype_a, 0, v2,
+			      65535), ISC_R_NOTFOUND);
+	/* The stale entry has gone. */
+	assert_int_equal(find(rc, "www.example.", dns_rdatatype_a, 0, v1,
+			      65535), ISC_R_NOTFOUND);
+
+	dns_db_closeversion(db, &v1, false);
+	dns_db_closeversion(db, &v2, false);
+	dns_respcache_destroy(&rc);
+}
+
+/*
+ * responses that have not been used recently are removed to make room
+ */
+static void
+evict_test(void **state) {
+	dns_respcache_t *rc = NULL;
+	dns_dbversion_t *version = NULL;
+	char namebuf[64];
+	isc_result_t result;
+	unsigned int i;
+
+	UNUSED(state);
+
+	/*
+	 * Room for a few entries in each shard, and enough names that
+	 * every shard has to make room several times.
+	 */
+	result = dns_respcache_create(mctx, 16384, &rc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_currentversion(db, &version);
+
+	add(rc, "first.example.", version);
+	for (i = 0; i < 1000; i++) {
+		snprintf(namebuf, sizeof(namebuf), "n%u.example.", i);
+		add(rc, namebuf, version);
+		/* Keep "first" in use. */
+		assert_int_equal(find(rc, "first.example.", dns_rdatatype_a,
+				      0, version, 65535), ISC_R_SUCCESS);
+	}
+
+	assert_int_equal(find(rc, "first.example.", dns_rdatatype_a, 0,
+			      version, 65535), ISC_R_SUCCESS);
+	assert_int_equal(find(rc, "n999.example.", dns_rdatatype_a, 0,
+			      version, 65535), ISC_R_SUCCESS);
+	assert_int_equal(find(rc, "n0.example.", dns_rdatatype_a, 0,
+			      version, 65535), ISC_R_NOTFOUND);
+
+	dns_db_closeversion(db, &version, false);
+	dns_respcache_destroy(&rc);
+}
+
+/* an entry can still be used after the cache is destroyed */
+static void
+detach_test(void **state) {
+	dns_respcache_t *rc = NULL;
+	dns_respentry_t *entry = NULL;
+	dns_dbversion_t *version = NULL;
+	dns_fixedname_t fixed;
+	response_t resp;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_respcache_create(mctx, 65536, &rc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_currentversion(db, &version);
+
+	add(rc, "www.example.", version);
+	dns_test_namefromstring("www.example.", &fixed);
+	result = dns_respcache_find(rc, dns_fixedname_name(&fixed),
+				    dns_rdataclass_in, dns_rdatatype_a, 0, db,
+				    version, 65535, NULL, &entry);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_respcache_destroy(&rc);
+
+	response_begin(&resp);
+	result = dns_respcache_render(entry, resp.msg);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(resp.msg->counts[DNS_SECTION_ANSWER], 1);
+	response_end(&resp);
+
+	dns_respcache_detachentry(&entry);
+	assert_null(entry);
+	dns_db_closeversion(db, &version, false);
+}
+
+#ifdef DNS_BENCHMARK_TESTS
+
+/*
+ * Many threads answering a small, hot set of questions from the cache,
+ * which is what a busy authoritative server mostly does.
+ */
+#define BENCH_NAMES	64
+#define BENCH_FINDS	4000000
+
+static dns_respcache_t *bench_rc = NULL;
+static dns_dbversion_t *bench_version = NULL;
+static dns_fixedname_t bench_names[BENCH_NAMES];
+
+static isc_threadresult_t
+find_thread(isc_threadarg_t arg) {
+	dns_respentry_t *entry;
+	isc_result_t result;
+	unsigned int i, n = (unsigned int)(uintptr_t)arg;
+
+	for (i = 0; i < BENCH_FINDS; i++) {
+		entry = NULL;
+		result = dns_respcache_find(bench_rc,
+				dns_fixedname_name(&bench_names[(n + i) %
+								BENCH_NAMES]),
+				dns_rdataclass_in, dns_rdatatype_a, 0, db,
+				bench_version, 65535, NULL, &entry);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		dns_respcache_detachentry(&entry);
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+static void
+benchmark(void **state) {
+	isc_result_t result;
+	isc_thread_t threads[32];
+	isc_time_t ts1, ts2;
+	char namebuf[64];
+	unsigned int i, nthreads;
+	double t;
+
+	UNUSED(state);
+
+	result = dns_respcache_create(mctx, 1024 * 1024, &bench_rc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_currentversion(db, &bench_version);
+
+	for (i = 0; i < BENCH_NAMES; i++) {
+		snprintf(namebuf, sizeof(namebuf), "name%u.example.", i);
+		dns_test_namefromstring(namebuf, &bench_names[i]);
+		add(bench_rc, namebuf, bench_version);
+	}
+
+	nthreads = ISC_MIN(isc_os_ncpus(), 32);
+	nthreads = ISC_MAX(nthreads, 1);
+
+	result = isc_time_now(&ts1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < nthreads; i++) {
+		result = isc_thread_create(find_thread, (void *)(uintptr_t)i,
+					   &threads[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	for (i = 0; i < nthreads; i++) {
+		result = isc_thread_join(threads[i], NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	result = isc_time_now(&ts2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	t = isc_time_microdiff(&ts2, &ts1);
+
+	printf("%u threads, %u hits, %f seconds, %f hits/second\n",
+	       nthreads, nthreads * BENCH_FINDS, t / 1000000.0,
+	       (nthreads * BENCH_FINDS) / (t / 1000000.0));
+
+	dns_db_closeversion(db, &bench_version, false);
+	dns_respcache_destroy(&bench_rc);
+}
+#endif /* DNS_BENCHMARK_TESTS */
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(findrender_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(version_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(evict_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(detach_test,
+						_setup, _teardown),
+#ifdef DNS_BENCHMARK_TESTS
+		cmocka_unit_test_setup_teardown(benchmark, _setup, _teardown),
+#endif /* DNS_BENCHMARK_TESTS */
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif
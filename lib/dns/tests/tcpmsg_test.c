@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/buffer.h>
+#include <isc/socket.h>
+#include <isc/task.h>
+#include <isc/util.h>
+
+#include <dns/events.h>
+#include <dns/tcpmsg.h>
+
+#include "dnstest.h"
+
+typedef struct {
+	bool done;
+	isc_result_t result;
+	isc_socket_t *socket;
+	unsigned char data[20000];
+	unsigned int length;
+} completion_t;
+
+static isc_socket_t *listener = NULL;
+static isc_socket_t *server = NULL;
+static isc_task_t *task = NULL;
+static int client = -1;
+static dns_tcpmsg_t tcpmsg;
+
+static void
+completion_init(completion_t *completion) {
+	completion->done = false;
+	completion->result = ISC_R_UNSET;
+	completion->socket = NULL;
+	completion->length = 0;
+}
+
+static isc_result_t
+waitfor(completion_t *completion) {
+	int i = 0;
+
+	while (!completion->done && i++ < 5000) {
+		dns_test_nap(1000);
+	}
+	if (completion->done) {
+		return (ISC_R_SUCCESS);
+	}
+	return (ISC_R_FAILURE);
+}
+
+static void
+accept_done(isc_task_t *t, isc_event_t *event) {
+	isc_socket_newconnev_t *nevent = (isc_socket_newconnev_t *)event;
+	completion_t *completion = event->ev_arg;
+
+	UNUSED(t);
+
+	completion->result = nevent->result;
+	if (completion->result == ISC_R_SUCCESS) {
+		completion->socket = nevent->newsocket;
+	}
+	completion->done = true;
+
+	isc_event_free(&event);
+}
+
+static void
+message_done(isc_task_t *t, isc_event_t *event) {
+	dns_tcpmsg_t *msg = event->ev_sender;
+	completion_t *completion = event->ev_arg;
+	isc_region_t r;
+
+	UNUSED(t);
+
+	assert_int_equal(event->ev_type, DNS_EVENT_TCPMSG);
+
+	completion->result = msg->result;
+	if (msg->result == ISC_R_SUCCESS) {
+		isc_buffer_usedregion(&msg->buffer, &r);
+		assert_true(r.length <= sizeof(completion->data));
+		memmove(completion->data, r.base, r.length);
+		completion->length = r.length;
+	}
+	completion->done = true;
+
+	isc_event_free(&event);
+}
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+	isc_sockaddr_t addr;
+	struct sockaddr_in sin;
+	struct in_addr in;
+	completion_t completion;
+
+	UNUSED(state);
+
+	result = dns_test_begin(NULL, true);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	in.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&addr, &in, 0);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_tcp,
+				   &listener);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(listener, &addr, ISC_SOCKET_REUSEADDRESS);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_getsockname(listener, &addr);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_listen(listener, 1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	completion_init(&completion);
+	result = isc_socket_accept(listener, task, accept_done, &completion);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	client = socket(PF_INET, SOCK_STREAM, 0);
+	assert_true(client >= 0);
+	memmove(&sin, &addr.type.sin, sizeof(sin));
+	assert_int_equal(connect(client, (struct sockaddr *)&sin,
+				 sizeof(sin)), 0);
+
+	waitfor(&completion);
+	assert_true(completion.done);
+	assert_int_equal(completion.result, ISC_R_SUCCESS);
+	server = completion.socket;
+
+	dns_tcpmsg_init(mctx, server, &tcpmsg);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	dns_tcpmsg_invalidate(&tcpmsg);
+	close(client);
+	client = -1;
+	isc_socket_detach(&server);
+	isc_socket_detach(&listener);
+	isc_task_detach(&task);
+
+	dns_test_end();
+
+	return (0);
+}
+
+/*
+ * Write a length-prefixed message of 'length' bytes, each set to 'c',
+ * into 'buf', and return the number of bytes used.
+ */
+static size_t
+frame(unsigned char *buf, unsigned int length, unsigned char c) {
+	buf[0] = length >> 8;
+	buf[1] = length & 0xff;
+	memset(buf + 2, c, length);
+	return (length + 2);
+}
+
+static void
+readmessage(completion_t *completion) {
+	isc_result_t result;
+
+	completion_init(completion);
+	result = dns_tcpmsg_readmessage(&tcpmsg, task, message_done,
+					completion);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	waitfor(completion);
+	assert_true(completion->done);
+}
+
+static void
+check_message(completion_t *completion, unsigned int length,
+	      unsigned char c)
+{
+	unsigned int i;
+
+	assert_int_equal(completion->result, ISC_R_SUCCESS);
+	assert_int_equal(completion->length, length);
+	for (i = 0; i < length; i++) {
+		assert_int_equal(completion->data[i], c);
+	}
+}
+
+/* pipelined messages arriving in a single write */
+static void
+pipelined_test(void **state) {
+	unsigned char buf[1024];
+	completion_t completion;
+	size_t n = 0;
+
+	UNUSED(state);
+
+	n += frame(buf + n, 12, 'a');
+	n += frame(buf + n, 100, 'b');
+	n += frame(buf + n, 300, 'c');
+	assert_int_equal(write(client, buf, n), n);
+
+	readmessage(&completion);
+	check_message(&completion, 12, 'a');
+	readmessage(&completion);
+	check_message(&completion, 100, 'b');
+	readmessage(&completion);
+	check_message(&completion, 300, 'c');
+
+	close(client);
+	client = -1;
+	readmessage(&completion);
+	assert_int_equal(completion.result, ISC_R_EOF);
+}
+
+/* messages split across several reads, and larger than the buffer */
+static void
+split_test(void **state) {
+	static unsigned char buf[20000];
+	completion_t completion;
+	isc_buffer_t kept;
+	size_t n = 0, i;
+
+	UNUSED(state);
+
+	n += frame(buf + n, 50, 'x');
+	n += frame(buf + n, 15000, 'y');
+	n += frame(buf + n, 20, 'z');
+
+	/* the length prefix alone, then the rest in pieces */
+	assert_int_equal(write(client, buf, 1), 1);
+	dns_test_nap(10000);
+	assert_int_equal(write(client, buf + 1, 1), 1);
+	dns_test_nap(10000);
+	for (i = 2; i < n; i += 4000) {
+		size_t len = ISC_MIN(4000, n - i);
+		assert_int_equal(write(client, buf + i, len), len);
+		dns_test_nap(10000);
+	}
+
+	readmessage(&completion);
+	check_message(&completion, 50, 'x');
+
+	readmessage(&completion);
+	check_message(&completion, 15000, 'y');
+
+	dns_tcpmsg_keepbuffer(&tcpmsg, &kept);
+	assert_int_equal(isc_buffer_usedlength(&kept), 15000);
+	assert_memory_equal(isc_buffer_base(&kept), completion.data, 15000);
+	isc_mem_put(mctx, kept.base, kept.length);
+
+	readmessage(&completion);
+	check_message(&completion, 20, 'z');
+}
+
+/* the read buffer shrinks again once a large message is done with */
+static void
+shrink_test(void **state) {
+	static unsigned char buf[20000];
+	completion_t completion;
+	size_t n;
+
+	UNUSED(state);
+
+	n = frame(buf, 15000, 'y');
+	assert_int_equal(write(client, buf, n), n);
+
+	readmessage(&completion);
+	check_message(&completion, 15000, 'y');
+	assert_true(tcpmsg.rbuffer.length >= 15002);
+
+	n = frame(buf, 20, 'z');
+	assert_int_equal(write(client, buf, n), n);
+
+	readmessage(&completion);
+	check_message(&completion, 20, 'z');
+	assert_true(tcpmsg.rbuffer.length < 15002);
+}
+
+/* bad length prefixes */
+static void
+badlength_test(void **state) {
+	unsigned char buf[1024];
+	completion_t completion;
+	size_t n = 0;
+
+	UNUSED(state);
+
+	dns_tcpmsg_setmaxsize(&tcpmsg, 512);
+
+	n += frame(buf + n, 10, 'a');
+	n += frame(buf + n, 600, 'b');
+	assert_int_equal(write(client, buf, n), n);
+
+	readmessage(&completion);
+	check_message(&completion, 10, 'a');
+	readmessage(&completion);
+	assert_int_equal(completion.result, ISC_R_RANGE);
+}
+
+/* a zero length prefix */
+static void
+zerolength_test(void **state) {
+	unsigned char buf[2] = { 0, 0 };
+	completion_t completion;
+
+	UNUSED(state);
+
+	assert_int_equal(write(client, buf, 2), 2);
+
+	readmessage(&completion);
+	assert_int_equal(completion.result, ISC_R_UNEXPECTEDEND);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(pipelined_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(split_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(shrink_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(badlength_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(zerolength_test,
+						_setup, _teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif
@@ -50,6 +50,7 @@
 #include <dns/rdataset.h>
 #include <dns/request.h>
 #include <dns/resolver.h>
+#include <dns/respcache.h>
 #include <dns/result.h>
 #include <dns/rpz.h>
 #include <dns/rrl.h>
@@ -168,6 +169,7 @@ dns_view_create(isc_mem_t *mctx, dns_rdataclass_t rdclass,
 	view->adbstats = NULL;
 	view->resstats = NULL;
 	view->resquerystats = NULL;
+	view->querylatencystats = NULL;
 	view->cacheshared = false;
 	ISC_LIST_INIT(view->dns64);
 	view->dns64cnt = 0;
@@ -245,6 +247,7 @@ dns_view_create(isc_mem_t *mctx, dns_rdataclass_t rdclass,
 	view->new_zone_config = NULL;
 	view->cfg_destroy = NULL;
 	view->fail_ttl = 0;
+	view->respcache = NULL;
 	view->failcache = NULL;
 	result = dns_badcache_init(view->mctx, DNS_VIEW_FAILCACHESIZE,
 				   &view->failcache);
@@ -504,6 +507,8 @@ destroy(dns_view_t *view) {
 		isc_stats_detach(&view->resstats);
 	if (view->resquerystats != NULL)
 		dns_stats_detach(&view->resquerystats);
+	if (view->querylatencystats != NULL)
+		isc_stats_detach(&view->querylatencystats);
 	if (view->secroots_priv != NULL)
 		dns_keytable_detach(&view->secroots_priv);
 	if (view->ntatable_priv != NULL)
@@ -545,6 +550,8 @@ destroy(dns_view_t *view) {
 	dns_aclenv_destroy(&view->aclenv);
 	if (view->failcache != NULL)
 		dns_badcache_destroy(&view->failcache);
+	if (view->respcache != NULL)
+		dns_respcache_destroy(&view->respcache);
 	isc_mutex_destroy(&view->new_zone_lock);
 	isc_mutex_destroy(&view->lock);
 	isc_mem_free(view->mctx, view->nta_file);
@@ -1855,6 +1862,24 @@ dns_view_getresquerystats(dns_view_t *view, dns_stats_t **statsp) {
 		dns_stats_attach(view->resquerystats, statsp);
 }
 
+void
+dns_view_setquerylatencystats(dns_view_t *view, isc_stats_t *stats) {
+	REQUIRE(DNS_VIEW_VALID(view));
+	REQUIRE(!view->frozen);
+	REQUIRE(view->querylatencystats == NULL);
+
+	isc_stats_attach(stats, &view->querylatencystats);
+}
+
+void
+dns_view_getquerylatencystats(dns_view_t *view, isc_stats_t **statsp) {
+	REQUIRE(DNS_VIEW_VALID(view));
+	REQUIRE(statsp != NULL && *statsp == NULL);
+
+	if (view->querylatencystats != NULL)
+		isc_stats_attach(view->querylatencystats, statsp);
+}
+
 isc_result_t
 dns_view_initntatable(dns_view_t *view,
 		      isc_taskmgr_t *taskmgr, isc_timermgr_t *timermgr)
@@ -10,12 +10,18 @@
  */
 
 /*
- * 32 bit Fowler/Noll/Vo FNV-1a hash code with modification for BIND
+ * 32 bit Fowler/Noll/Vo FNV-1a hash code with modification for BIND,
+ * and a keyed SipHash-1-3 for hashing DNS names.
  */
 
 #include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "isc/hash.h" // IWYU pragma: keep
 #include "isc/likely.h"
@@ -25,7 +31,21 @@
 #include "isc/types.h"
 #include "isc/util.h"
 
-static uint32_t fnv_offset_basis;
+/*
+ * Everything that makes the hash values of one process differ from
+ * those of another.  isc_hash_get_initializer() hands out a pointer
+ * to this so that a module with its own copy of the library can use
+ * the same values.
+ */
+typedef struct {
+	uint32_t fnv_offset_basis;
+	uint64_t siphash_key[2];
+} hash_initializer_t;
+
+static hash_initializer_t hash_initializer;
+#define fnv_offset_basis	hash_initializer.fnv_offset_basis
+#define siphash_key		hash_initializer.siphash_key
+
 static isc_once_t fnv_once = ISC_ONCE_INIT;
 static bool fnv_initialized = false;
 
@@ -75,6 +95,8 @@ fnv_initialize(void) {
 		fnv_offset_basis = isc_random32();
 	}
 
+	isc_random_buf(siphash_key, sizeof(siphash_key));
+
 	fnv_initialized = true;
 }
 
@@ -84,7 +106,7 @@ isc_hash_get_initializer(void) {
 		RUNTIME_CHECK(isc_once_do(&fnv_once, fnv_initialize) ==
 			      ISC_R_SUCCESS);
 
-	return (&fnv_offset_basis);
+	return (&hash_initializer);
 }
 
 void
@@ -99,7 +121,7 @@ isc_hash_set_initializer(const void *initializer) {
 		RUNTIME_CHECK(isc_once_do(&fnv_once, fnv_initialize) ==
 			      ISC_R_SUCCESS);
 
-	fnv_offset_basis = *((const unsigned int *)initializer);
+	memmove(&hash_initializer, initializer, sizeof(hash_initializer));
 }
 
 #define FNV_32_PRIME ((uint32_t)0x01000193)
@@ -201,3 +223,149 @@ isc_hash_function_reverse(const void *data, size_t length, bool case_sensitive,
 
 	return (hval);
 }
+
+/*
+ * SipHash-1-3, by Jean-Philippe Aumasson and Daniel J. Bernstein, with
+ * one compression round per 8-byte word and three finalization rounds.
+ * Unlike FNV it is keyed with a secret the attacker cannot recover
+ * from the hash values, so colliding names cannot be precomputed, and
+ * it consumes the input a word rather than a byte at a time.
+ */
+
+#define ROTL64(x, b)	(uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND							\
+	do {								\
+		v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0;		\
+		v0 = ROTL64(v0, 32);					\
+		v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;		\
+		v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;		\
+		v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2;		\
+		v2 = ROTL64(v2, 32);					\
+	} while (0)
+
+#define U8TO64_LE(p)							\
+	(((uint64_t)((p)[0])) | ((uint64_t)((p)[1]) << 8) |		\
+	 ((uint64_t)((p)[2]) << 16) | ((uint64_t)((p)[3]) << 24) |	\
+	 ((uint64_t)((p)[4]) << 32) | ((uint64_t)((p)[5]) << 40) |	\
+	 ((uint64_t)((p)[6]) << 48) | ((uint64_t)((p)[7]) << 56))
+
+/*
+ * Fold the upper case ASCII letters in all eight bytes of 'w' at once.
+ * Adding to the low seven bits of each byte cannot carry into the next
+ * byte, and bytes with the top bit set are left alone, as they are by
+ * maptolower[].
+ */
+static inline uint64_t
+tolower64(uint64_t w) {
+	const uint64_t msb = 0x8080808080808080ULL;
+	uint64_t heptets = w & ~msb;
+	uint64_t ge_a = heptets + 0x3f3f3f3f3f3f3f3fULL;	/* >= 'A' */
+	uint64_t gt_z = heptets + 0x2525252525252525ULL;	/* > 'Z' */
+	uint64_t upper = ge_a & ~gt_z & ~w & msb;
+
+	return (w | (upper >> 2));
+}
+
+#if defined(__x86_64__) && defined(__SSE2__)
+/*
+ * The same folding for sixteen bytes, returned as two words.  x86 is
+ * little endian, so the halves of the register are the words that
+ * U8TO64_LE() would have produced.
+ */
+static inline void
+tolower128(const unsigned char *p, uint64_t *m0, uint64_t *m1) {
+	__m128i v = _mm_loadu_si128((const __m128i *)(const void *)p);
+	__m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(0x80 - 'A'));
+	__m128i upper = _mm_cmplt_epi8(shifted,
+				       _mm_set1_epi8(-128 + 26));
+
+	v = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+	*m0 = (uint64_t)_mm_cvtsi128_si64(v);
+	*m1 = (uint64_t)_mm_cvtsi128_si64(_mm_srli_si128(v, 8));
+}
+#endif
+
+uint32_t
+isc_hash32(const void *data, size_t length, bool case_sensitive) {
+	const unsigned char *bp = data;
+	const unsigned char *be;
+	uint64_t k0, k1, v0, v1, v2, v3, m, b = 0;
+	size_t left;
+
+	REQUIRE(length == 0 || data != NULL);
+
+	if (ISC_UNLIKELY(!fnv_initialized)) {
+		RUNTIME_CHECK(isc_once_do(&fnv_once, fnv_initialize) ==
+			      ISC_R_SUCCESS);
+	}
+
+	k0 = siphash_key[0];
+	k1 = siphash_key[1];
+	v0 = k0 ^ 0x736f6d6570736575ULL;
+	v1 = k1 ^ 0x646f72616e646f6dULL;
+	v2 = k0 ^ 0x6c7967656e657261ULL;
+	v3 = k1 ^ 0x7465646279746573ULL;
+
+	be = bp + (length & ~(size_t)7);
+	left = length & 7;
+
+	if (case_sensitive) {
+		for (; bp != be; bp += 8) {
+			m = U8TO64_LE(bp);
+			v3 ^= m; SIPROUND; v0 ^= m;
+		}
+	} else {
+#if defined(__x86_64__) && defined(__SSE2__)
+		for (; be - bp >= 16; bp += 16) {
+			uint64_t m1;
+
+			tolower128(bp, &m, &m1);
+			v3 ^= m; SIPROUND; v0 ^= m;
+			v3 ^= m1; SIPROUND; v0 ^= m1;
+		}
+#endif
+		for (; bp != be; bp += 8) {
+			m = tolower64(U8TO64_LE(bp));
+			v3 ^= m; SIPROUND; v0 ^= m;
+		}
+	}
+
+	switch (left) {
+	case 7:
+		b |= ((uint64_t)bp[6]) << 48;
+		/* FALLTHROUGH */
+	case 6:
+		b |= ((uint64_t)bp[5]) << 40;
+		/* FALLTHROUGH */
+	case 5:
+		b |= ((uint64_t)bp[4]) << 32;
+		/* FALLTHROUGH */
+	case 4:
+		b |= ((uint64_t)bp[3]) << 24;
+		/* FALLTHROUGH */
+	case 3:
+		b |= ((uint64_t)bp[2]) << 16;
+		/* FALLTHROUGH */
+	case 2:
+		b |= ((uint64_t)bp[1]) << 8;
+		/* FALLTHROUGH */
+	case 1:
+		b |= ((uint64_t)bp[0]);
+		/* FALLTHROUGH */
+	case 0:
+		break;
+	}
+	if (!case_sensitive) {
+		b = tolower64(b);
+	}
+	b |= ((uint64_t)length) << 56;
+
+	v3 ^= b; SIPROUND; v0 ^= b;
+
+	v2 ^= 0xff;
+	SIPROUND; SIPROUND; SIPROUND;
+
+	b = v0 ^ v1 ^ v2 ^ v3;
+	return ((uint32_t)(b ^ (b >> 32)));
+}
@@ -10,6 +10,7 @@
  */
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <string.h>
 
 #include <isc/hash.h>
@@ -22,40 +23,269 @@
 
 
 typedef struct isc_ht_node isc_ht_node_t;
+typedef struct isc_ht_slot isc_ht_slot_t;
 
 #define ISC_HT_MAGIC			ISC_MAGIC('H', 'T', 'a', 'b')
 #define ISC_HT_VALID(ht)		ISC_MAGIC_VALID(ht, ISC_HT_MAGIC)
 
+#define HT_MAX_BITS		(sizeof(size_t) > 4 ? 32 : 31)
+#define HT_MAX_LOAD(size)	((size) < 4 ? (size) - 1 : (size) / 4 * 3)
+#define HT_REHASH_STEPS		8	/*%< old slots moved per add */
+
+/*
+ * The table uses open addressing with linear probing.  Each slot holds
+ * the full hash value of its key next to the node pointer, so probing
+ * a run of slots touches a single array and only follows a pointer
+ * when the hash values match.
+ *
+ * Deleted slots are marked with a tombstone rather than emptied, so a
+ * deletion never moves another entry; probe sequences stay intact and
+ * an iterator may delete the entry it is positioned on.  Tombstones
+ * count towards the load of a table until it is rehashed.
+ *
+ * When an addition would take the table over 75% load, a new table is
+ * allocated: twice the size if more than half of the slots hold live
+ * entries, otherwise the same size, which just drops the tombstones.
+ * The entries of the old table are moved over HT_REHASH_STEPS slots at
+ * a time by each subsequent addition, so no single call pays for the
+ * whole rehash.  Until the old table is drained, lookups, deletions
+ * and iterators search both tables.
+ */
 struct isc_ht_node {
 	void *value;
-	isc_ht_node_t *next;
 	size_t keysize;
 	unsigned char key[FLEXIBLE_ARRAY_MEMBER];
 };
 
+struct isc_ht_slot {
+	uint32_t hashval;
+	isc_ht_node_t *node;
+};
+
 struct isc_ht {
 	unsigned int magic;
 	isc_mem_t *mctx;
-	size_t size;
-	size_t mask;
 	unsigned int count;
-	isc_ht_node_t **table;
+	uint8_t hindex;
+	uint8_t hashbits[2];
+	size_t size[2];
+	size_t used[2];
+	isc_ht_slot_t *table[2];
+	size_t hiter;
 };
 
 struct isc_ht_iter {
 	isc_ht_t *ht;
+	uint8_t hindex;
 	size_t i;
-	isc_ht_node_t *cur;
+	isc_ht_slot_t *cur;
 };
 
+static isc_ht_node_t tombstone;
+#define TOMBSTONE	(&tombstone)
+
+#define HT_NEXTTABLE(idx)	((idx) == 0 ? 1 : 0)
+#define REHASHING(ht)		((ht)->table[HT_NEXTTABLE((ht)->hindex)] != NULL)
+
+static inline bool
+slot_live(const isc_ht_slot_t *slot) {
+	return (slot->node != NULL && slot->node != TOMBSTONE);
+}
+
+static inline size_t
+hash_index(uint32_t hashval, uint8_t bits) {
+	/*
+	 * Fibonacci hashing spreads the bits of the hash value over the
+	 * top of the product, so the index does not depend solely on
+	 * the low-order bits.
+	 */
+	return ((size_t)((uint32_t)(hashval * 0x9e3779b9U) >> (32 - bits)));
+}
+
+static isc_result_t
+table_create(isc_ht_t *ht, uint8_t idx, uint8_t bits) {
+	size_t size = (size_t)1 << bits;
+	size_t i;
+
+	ht->table[idx] = isc_mem_get(ht->mctx, size * sizeof(isc_ht_slot_t));
+	if (ht->table[idx] == NULL) {
+		return (ISC_R_NOMEMORY);
+	}
+
+	for (i = 0; i < size; i++) {
+		ht->table[idx][i].hashval = 0;
+		ht->table[idx][i].node = NULL;
+	}
+
+	ht->hashbits[idx] = bits;
+	ht->size[idx] = size;
+	ht->used[idx] = 0;
+
+	return (ISC_R_SUCCESS);
+}
+
+static void
+table_free(isc_ht_t *ht, uint8_t idx) {
+	isc_mem_put(ht->mctx, ht->table[idx],
+		    ht->size[idx] * sizeof(isc_ht_slot_t));
+	ht->table[idx] = NULL;
+	ht->hashbits[idx] = 0;
+	ht->size[idx] = 0;
+	ht->used[idx] = 0;
+}
+
+static void
+node_free(isc_ht_t *ht, isc_ht_node_t *node) {
+	isc_mem_put(ht->mctx, node, offsetof(isc_ht_node_t, key) +
+		    node->keysize);
+}
+
+static isc_ht_slot_t *
+table_find(const isc_ht_t *ht, uint8_t idx, uint32_t hashval,
+	   const unsigned char *key, uint32_t keysize)
+{
+	isc_ht_slot_t *table = ht->table[idx];
+	size_t mask = ht->size[idx] - 1;
+	size_t i;
+
+	/*
+	 * The load limit guarantees that every table has at least one
+	 * empty slot, so the probe always terminates.
+	 */
+	for (i = hash_index(hashval, ht->hashbits[idx]);
+	     table[i].node != NULL;
+	     i = (i + 1) & mask)
+	{
+		isc_ht_node_t *node = table[i].node;
+
+		if (node != TOMBSTONE && table[i].hashval == hashval &&
+		    node->keysize == keysize &&
+		    memcmp(node->key, key, keysize) == 0)
+		{
+			return (&table[i]);
+		}
+	}
+
+	return (NULL);
+}
+
+static isc_ht_slot_t *
+ht_find(const isc_ht_t *ht, uint32_t hashval,
+	const unsigned char *key, uint32_t keysize)
+{
+	isc_ht_slot_t *slot;
+
+	slot = table_find(ht, ht->hindex, hashval, key, keysize);
+	if (slot == NULL && REHASHING(ht)) {
+		slot = table_find(ht, HT_NEXTTABLE(ht->hindex), hashval,
+				  key, keysize);
+	}
+
+	return (slot);
+}
+
+/*
+ * Put 'node' in the first free slot of its probe sequence in the
+ * current table.  The caller has made sure the key is not present.
+ */
+static void
+table_insert(isc_ht_t *ht, uint32_t hashval, isc_ht_node_t *node) {
+	uint8_t idx = ht->hindex;
+	isc_ht_slot_t *table = ht->table[idx];
+	size_t mask = ht->size[idx] - 1;
+	size_t i;
+
+	i = hash_index(hashval, ht->hashbits[idx]);
+	while (slot_live(&table[i])) {
+		i = (i + 1) & mask;
+	}
+
+	if (table[i].node == NULL) {
+		ht->used[idx]++;
+	}
+	table[i].hashval = hashval;
+	table[i].node = node;
+}
+
+/*
+ * Move up to 'steps' slots of the old table into the current one,
+ * freeing the old table once it has been drained.  Moved slots become
+ * tombstones so that probe sequences through them stay intact.
+ */
+static void
+rehash_step(isc_ht_t *ht, size_t steps) {
+	uint8_t oldidx = HT_NEXTTABLE(ht->hindex);
+	isc_ht_slot_t *old = ht->table[oldidx];
+
+	while (steps-- > 0 && ht->hiter < ht->size[oldidx]) {
+		isc_ht_slot_t *slot = &old[ht->hiter++];
+
+		if (slot_live(slot)) {
+			table_insert(ht, slot->hashval, slot->node);
+			slot->node = TOMBSTONE;
+		}
+	}
+
+	if (ht->hiter == ht->size[oldidx]) {
+		table_free(ht, oldidx);
+		ht->hiter = 0;
+	}
+}
+
+static void
+rehash_finish(isc_ht_t *ht) {
+	if (REHASHING(ht)) {
+		rehash_step(ht, ht->size[HT_NEXTTABLE(ht->hindex)]);
+	}
+}
+
+/*
+ * Make room for one more entry in the current table, starting a new
+ * rehash if the table is at its load limit.
+ */
+static isc_result_t
+rehash_start(isc_ht_t *ht) {
+	uint8_t idx = ht->hindex;
+	uint8_t newidx = HT_NEXTTABLE(idx);
+	uint8_t bits = ht->hashbits[idx];
+	isc_result_t result;
+
+	if (ht->used[idx] + 1 <= HT_MAX_LOAD(ht->size[idx])) {
+		return (ISC_R_SUCCESS);
+	}
+
+	/*
+	 * A rehash that is still in progress uses the other table; it
+	 * is finished off before the next one starts.
+	 */
+	rehash_finish(ht);
+
+	if (ht->count + 1 > ht->size[idx] / 2 && bits < HT_MAX_BITS) {
+		bits++;
+	}
+	if (ht->count + 1 > HT_MAX_LOAD((size_t)1 << bits)) {
+		return (ISC_R_NOSPACE);
+	}
+
+	result = table_create(ht, newidx, bits);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+
+	ht->hindex = newidx;
+	ht->hiter = 0;
+
+	return (ISC_R_SUCCESS);
+}
+
 isc_result_t
 isc_ht_init(isc_ht_t **htp, isc_mem_t *mctx, uint8_t bits) {
 	isc_ht_t *ht = NULL;
-	size_t i;
+	isc_result_t result;
 
 	REQUIRE(htp != NULL && *htp == NULL);
 	REQUIRE(mctx != NULL);
-	REQUIRE(bits >= 1 && bits <= (sizeof(size_t)*8 - 1));
+	REQUIRE(bits >= 1 && bits <= HT_MAX_BITS);
 
 	ht = isc_mem_get(mctx, sizeof(struct isc_ht));
 	if (ht == NULL) {
@@ -65,18 +295,18 @@ isc_ht_init(isc_ht_t **htp, isc_mem_t *mctx, uint8_t bits) {
 	ht->mctx = NULL;
 	isc_mem_attach(mctx, &ht->mctx);
 
-	ht->size = ((size_t)1<<bits);
-	ht->mask = ((size_t)1<<bits)-1;
 	ht->count = 0;
-
-	ht->table = isc_mem_get(ht->mctx, ht->size * sizeof(isc_ht_node_t*));
-	if (ht->table == NULL) {
+	ht->hindex = 0;
+	ht->hiter = 0;
+	ht->table[0] = ht->table[1] = NULL;
+	ht->hashbits[0] = ht->hashbits[1] = 0;
+	ht->size[0] = ht->size[1] = 0;
+	ht->used[0] = ht->used[1] = 0;
+
+	result = table_create(ht, 0, bits);
+	if (result != ISC_R_SUCCESS) {
 		isc_mem_putanddetach(&ht->mctx, ht, sizeof(struct isc_ht));
-		return (ISC_R_NOMEMORY);
-	}
-
-	for (i = 0; i < ht->size; i++) {
-		ht->table[i] = NULL;
+		return (result);
 	}
 
 	ht->magic = ISC_HT_MAGIC;
@@ -88,6 +318,7 @@ isc_ht_init(isc_ht_t **htp, isc_mem_t *mctx, uint8_t bits) {
 void
 isc_ht_destroy(isc_ht_t **htp) {
 	isc_ht_t *ht;
+	uint8_t idx;
 	size_t i;
 
 	REQUIRE(htp != NULL);
@@ -99,23 +330,22 @@ isc_ht_destroy(isc_ht_t **htp) {
 
 	ht->magic = 0;
 
-	for (i = 0; i < ht->size; i++) {
-		isc_ht_node_t *node = ht->table[i];
-		while (node != NULL) {
-			isc_ht_node_t *next = node->next;
-			ht->count--;
-			isc_mem_put(ht->mctx, node,
-				    offsetof(isc_ht_node_t, key) +
-				    node->keysize);
-			node = next;
+	for (idx = 0; idx < 2; idx++) {
+		if (ht->table[idx] == NULL) {
+			continue;
 		}
+		for (i = 0; i < ht->size[idx]; i++) {
+			if (slot_live(&ht->table[idx][i])) {
+				ht->count--;
+				node_free(ht, ht->table[idx][i].node);
+			}
+		}
+		table_free(ht, idx);
 	}
 
 	INSIST(ht->count == 0);
 
-	isc_mem_put(ht->mctx, ht->table, ht->size * sizeof(isc_ht_node_t*));
 	isc_mem_putanddetach(&ht->mctx, ht, sizeof(struct isc_ht));
-
 }
 
 isc_result_t
@@ -123,19 +353,20 @@ isc_ht_add(isc_ht_t *ht, const unsigned char *key,
 	   uint32_t keysize, void *value)
 {
 	isc_ht_node_t *node;
+	isc_result_t result;
 	uint32_t hash;
 
 	REQUIRE(ISC_HT_VALID(ht));
 	REQUIRE(key != NULL && keysize > 0);
 
 	hash = isc_hash_function(key, keysize, true, NULL);
-	node = ht->table[hash & ht->mask];
-	while (node != NULL) {
-		if (keysize == node->keysize &&
-		    memcmp(key, node->key, keysize) == 0) {
-			return (ISC_R_EXISTS);
-		}
-		node = node->next;
+	if (ht_find(ht, hash, key, keysize) != NULL) {
+		return (ISC_R_EXISTS);
+	}
+
+	result = rehash_start(ht);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
 	}
 
 	node = isc_mem_get(ht->mctx, offsetof(isc_ht_node_t, key) + keysize);
@@ -144,11 +375,15 @@ isc_ht_add(isc_ht_t *ht, const unsigned char *key,
 
 	memmove(node->key, key, keysize);
 	node->keysize = keysize;
-	node->next = ht->table[hash & ht->mask];
 	node->value = value;
 
+	table_insert(ht, hash, node);
 	ht->count++;
-	ht->table[hash & ht->mask] = node;
+
+	if (REHASHING(ht)) {
+		rehash_step(ht, HT_REHASH_STEPS);
+	}
+
 	return (ISC_R_SUCCESS);
 }
 
@@ -156,7 +391,7 @@ isc_result_t
 isc_ht_find(const isc_ht_t *ht, const unsigned char *key,
 	    uint32_t keysize, void **valuep)
 {
-	isc_ht_node_t *node;
+	isc_ht_slot_t *slot;
 	uint32_t hash;
 
 	REQUIRE(ISC_HT_VALID(ht));
@@ -164,51 +399,35 @@ isc_ht_find(const isc_ht_t *ht, const unsigned char *key,
 	REQUIRE(valuep == NULL || *valuep == NULL);
 
 	hash = isc_hash_function(key, keysize, true, NULL);
-	node = ht->table[hash & ht->mask];
-	while (node != NULL) {
-		if (keysize == node->keysize &&
-		    memcmp(key, node->key, keysize) == 0)
-		{
-			if (valuep != NULL)
-				*valuep = node->value;
-			return (ISC_R_SUCCESS);
-		}
-		node = node->next;
+	slot = ht_find(ht, hash, key, keysize);
+	if (slot == NULL) {
+		return (ISC_R_NOTFOUND);
 	}
 
-	return (ISC_R_NOTFOUND);
+	if (valuep != NULL)
+		*valuep = slot->node->value;
+	return (ISC_R_SUCCESS);
 }
 
 isc_result_t
 isc_ht_delete(isc_ht_t *ht, const unsigned char *key, uint32_t keysize) {
-	isc_ht_node_t *node, *prev;
+	isc_ht_slot_t *slot;
 	uint32_t hash;
 
 	REQUIRE(ISC_HT_VALID(ht));
 	REQUIRE(key != NULL && keysize > 0);
 
-	prev = NULL;
 	hash = isc_hash_function(key, keysize, true, NULL);
-	node = ht->table[hash & ht->mask];
-	while (node != NULL) {
-		if (keysize == node->keysize &&
-		    memcmp(key, node->key, keysize) == 0) {
-			if (prev == NULL)
-				ht->table[hash & ht->mask] = node->next;
-			else
-				prev->next = node->next;
-			isc_mem_put(ht->mctx, node,
-				    offsetof(isc_ht_node_t, key) +
-				    node->keysize);
-			ht->count--;
+	slot = ht_find(ht, hash, key, keysize);
+	if (slot == NULL) {
+		return (ISC_R_NOTFOUND);
+	}
 
-			return (ISC_R_SUCCESS);
-		}
+	node_free(ht, slot->node);
+	slot->node = TOMBSTONE;
+	ht->count--;
 
-		prev = node;
-		node = node->next;
-	}
-	return (ISC_R_NOTFOUND);
+	return (ISC_R_SUCCESS);
 }
 
 isc_result_t
@@ -223,6 +442,7 @@ isc_ht_iter_create(isc_ht_t *ht, isc_ht_iter_t **itp) {
 		return (ISC_R_NOMEMORY);
 
 	it->ht = ht;
+	it->hindex = ht->hindex;
 	it->i = 0;
 	it->cur = NULL;
 
@@ -245,20 +465,46 @@ isc_ht_iter_destroy(isc_ht_iter_t **itp) {
 	*itp = NULL;
 }
 
+/*
+ * Position the iterator on the first live slot at or after it->i,
+ * moving on from the current table to the old one if a rehash is in
+ * progress.  Entries are only moved between the tables by additions,
+ * which are not allowed during an iteration, so each is seen once.
+ */
+static isc_result_t
+iter_seek(isc_ht_iter_t *it) {
+	isc_ht_t *ht = it->ht;
+
+	for (;;) {
+		isc_ht_slot_t *table = ht->table[it->hindex];
+		size_t size = ht->size[it->hindex];
+
+		while (it->i < size && !slot_live(&table[it->i]))
+			it->i++;
+
+		if (it->i < size) {
+			it->cur = &table[it->i];
+			return (ISC_R_SUCCESS);
+		}
+
+		if (it->hindex != ht->hindex || !REHASHING(ht)) {
+			it->cur = NULL;
+			return (ISC_R_NOMORE);
+		}
+
+		/* The old slots before ht->hiter have already been moved. */
+		it->hindex = HT_NEXTTABLE(ht->hindex);
+		it->i = ht->hiter;
+	}
+}
+
 isc_result_t
 isc_ht_iter_first(isc_ht_iter_t *it) {
 	REQUIRE(it != NULL);
 
+	it->hindex = it->ht->hindex;
 	it->i = 0;
-	while (it->i < it->ht->size && it->ht->table[it->i] == NULL)
-		it->i++;
-
-	if (it->i == it->ht->size)
-		return (ISC_R_NOMORE);
-
-	it->cur = it->ht->table[it->i];
-
-	return (ISC_R_SUCCESS);
+	return (iter_seek(it));
 }
 
 isc_result_t
@@ -266,61 +512,25 @@ isc_ht_iter_next(isc_ht_iter_t *it) {
 	REQUIRE(it != NULL);
 	REQUIRE(it->cur != NULL);
 
-	it->cur = it->cur->next;
-	if (it->cur == NULL) {
-		do {
-			it->i++;
-		} while (it->i < it->ht->size && it->ht->table[it->i] == NULL);
-		if (it->i >= it->ht->size)
-			return (ISC_R_NOMORE);
-		it->cur = it->ht->table[it->i];
-	}
-
-	return (ISC_R_SUCCESS);
+	it->i++;
+	return (iter_seek(it));
 }
 
 isc_result_t
 isc_ht_iter_delcurrent_next(isc_ht_iter_t *it) {
-	isc_result_t result = ISC_R_SUCCESS;
-	isc_ht_node_t *to_delete = NULL;
-	isc_ht_node_t *prev = NULL;
-	isc_ht_node_t *node = NULL;
-	uint32_t hash;
 	isc_ht_t *ht;
+
 	REQUIRE(it != NULL);
 	REQUIRE(it->cur != NULL);
-	to_delete = it->cur;
-	ht = it->ht;
-
-	it->cur = it->cur->next;
-	if (it->cur == NULL) {
-		do {
-			it->i++;
-		} while (it->i < ht->size && ht->table[it->i] == NULL);
-		if (it->i >= ht->size)
-			result = ISC_R_NOMORE;
-		else
-			it->cur = ht->table[it->i];
-	}
 
-	hash = isc_hash_function(to_delete->key, to_delete->keysize, true,
-				 NULL);
-	node = ht->table[hash & ht->mask];
-	while (node != to_delete) {
-		prev = node;
-		node = node->next;
-		INSIST(node != NULL);
-	}
+	ht = it->ht;
 
-	if (prev == NULL)
-		ht->table[hash & ht->mask] = node->next;
-	else
-		prev->next = node->next;
-	isc_mem_put(ht->mctx, node,
-		    offsetof(isc_ht_node_t, key) + node->keysize);
+	node_free(ht, it->cur->node);
+	it->cur->node = TOMBSTONE;
 	ht->count--;
 
-	return (result);
+	it->i++;
+	return (iter_seek(it));
 }
 
 void
@@ -329,7 +539,7 @@ isc_ht_iter_current(isc_ht_iter_t *it, void **valuep) {
 	REQUIRE(it->cur != NULL);
 	REQUIRE(valuep != NULL && *valuep == NULL);
 
-	*valuep = it->cur->value;
+	*valuep = it->cur->node->value;
 }
 
 void
@@ -339,8 +549,8 @@ isc_ht_iter_currentkey(isc_ht_iter_t *it, unsigned char **key, size_t *keysize)
 	REQUIRE(it->cur != NULL);
 	REQUIRE(key != NULL && *key == NULL);
 
-	*key = it->cur->key;
-	*keysize = it->cur->keysize;
+	*key = it->cur->node->key;
+	*keysize = it->cur->node->keysize;
 }
 
 unsigned int
@@ -57,11 +57,13 @@
 #define HTTP_RECVLEN			1024
 #define HTTP_SENDGROW			1024
 #define HTTP_SEND_MAXLEN		10240
+#define HTTP_CHUNK_MAXLEN		16384	/* fits the 4 digit chunk size */
 
 #define HTTPD_CLOSE		0x0001 /* Got a Connection: close header */
 #define HTTPD_FOUNDHOST		0x0002 /* Got a Host: header */
 #define HTTPD_KEEPALIVE		0x0004 /* Got a Connection: Keep-Alive */
 #define HTTPD_ACCEPT_DEFLATE   0x0008
+#define HTTPD_CHUNKED		0x0010 /* Sending a chunked body */
 
 /*% http client */
 struct isc_httpd {
@@ -122,6 +124,14 @@ struct isc_httpd {
 	isc_buffer_t		bodybuffer;
 	isc_httpdfree_t	       *freecb;
 	void		       *freecb_arg;
+
+	/*%
+	 * When the body is streamed, 'stream' produces it one piece
+	 * at a time directly into sendbuffer, and is reset to NULL
+	 * once it has finished.
+	 */
+	isc_httpdstream_t      *stream;
+	void		       *stream_arg;
 };
 
 /*% lightweight socket manager for httpd output */
@@ -208,6 +218,8 @@ static isc_result_t process_request(isc_httpd_t *, int);
 static void httpdmgr_destroy(isc_httpdmgr_t *);
 static isc_result_t grow_headerspace(isc_httpd_t *);
 static void reset_client(isc_httpd_t *httpd);
+static isc_result_t stream_fill(isc_httpd_t *httpd);
+static void stream_release(isc_httpd_t *httpd);
 
 static isc_httpdaction_t render_404;
 static isc_httpdaction_t render_500;
@@ -227,6 +239,11 @@ destroy_client(isc_httpd_t **httpdp) {
 	isc_socket_detach(&httpd->sock);
 	ISC_LIST_UNLINK(httpdmgr->running, httpd, link);
 
+	stream_release(httpd);
+	if (httpd->sendbuffer != NULL) {
+		isc_buffer_free(&httpd->sendbuffer);
+	}
+
 	isc_buffer_region(&httpd->headerbuffer, &r);
 	if (r.length > 0) {
 		isc_mem_put(httpdmgr->mctx, r.base, r.length);
@@ -664,6 +681,8 @@ isc_httpd_accept(isc_task_t *task, isc_event_t *ev) {
 	isc_buffer_initnull(&httpd->compbuffer);
 	isc_buffer_initnull(&httpd->bodybuffer);
 	httpd->sendbuffer = NULL;
+	httpd->stream = NULL;
+	httpd->stream_arg = NULL;
 	reset_client(httpd);
 
 	r.base = (unsigned char *)httpd->recvbuf;
@@ -885,7 +904,7 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 			break;
 		url = ISC_LIST_NEXT(url, link);
 	}
-	if (url == NULL)
+	if (url == NULL) {
 		result = httpd->mgr->render_404(httpd->url, NULL,
 						httpd->querystring,
 						NULL, NULL,
@@ -895,7 +914,21 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 						&httpd->bodybuffer,
 						&httpd->freecb,
 						&httpd->freecb_arg);
-	else
+	} else if (url->streamaction != NULL) {
+		httpd->freecb = NULL;
+		httpd->freecb_arg = NULL;
+		result = url->streamaction(httpd->url, url,
+					   httpd->querystring,
+					   httpd->headers,
+					   url->action_arg,
+					   &httpd->retcode, &httpd->retmsg,
+					   &httpd->mimetype,
+					   &httpd->stream,
+					   &httpd->stream_arg);
+		if (result != ISC_R_SUCCESS) {
+			httpd->stream = NULL;
+		}
+	} else {
 		result = url->action(httpd->url, url,
 				     httpd->querystring,
 				     httpd->headers,
@@ -903,6 +936,7 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 				     &httpd->retcode, &httpd->retmsg,
 				     &httpd->mimetype, &httpd->bodybuffer,
 				     &httpd->freecb, &httpd->freecb_arg);
+	}
 	if (result != ISC_R_SUCCESS) {
 		result = httpd->mgr->render_500(httpd->url, url,
 						httpd->querystring,
@@ -916,8 +950,24 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 		RUNTIME_CHECK(result == ISC_R_SUCCESS);
 	}
 
+	/*
+	 * A streamed body has no length known in advance.  HTTP/1.1
+	 * clients get it chunked; for HTTP/1.0 the connection has to be
+	 * closed to mark its end.
+	 */
+	if (httpd->stream != NULL) {
+		if (strcmp(httpd->protocol, "HTTP/1.1") == 0) {
+			httpd->flags |= HTTPD_CHUNKED;
+		} else {
+			httpd->flags &= ~HTTPD_KEEPALIVE;
+			httpd->flags |= HTTPD_CLOSE;
+		}
+	}
+
 #ifdef HAVE_ZLIB
-	if ((httpd->flags & HTTPD_ACCEPT_DEFLATE) != 0) {
+	if (httpd->stream == NULL &&
+	    (httpd->flags & HTTPD_ACCEPT_DEFLATE) != 0)
+	{
 			result = isc_httpd_compress(httpd);
 			if (result == ISC_R_SUCCESS) {
 				is_compressed = true;
@@ -946,7 +996,11 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 
 	isc_httpd_addheader(httpd, "Server: libisc", NULL);
 
-	if (is_compressed == true) {
+	if ((httpd->flags & HTTPD_CHUNKED) != 0) {
+		isc_httpd_addheader(httpd, "Transfer-Encoding", "chunked");
+	} else if (httpd->stream != NULL) {
+		isc_httpd_addheader(httpd, "Connection", "close");
+	} else if (is_compressed == true) {
 		isc_httpd_addheader(httpd, "Content-Encoding", "deflate");
 		isc_httpd_addheaderuint(httpd, "Content-Length",
 					isc_buffer_usedlength(&httpd->compbuffer));
@@ -964,10 +1018,23 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 	isc_buffer_dup(httpd->mgr->mctx,
 		       &httpd->sendbuffer, &httpd->headerbuffer);
 	isc_buffer_setautorealloc(httpd->sendbuffer, true);
-	databuffer = (is_compressed ? &httpd->compbuffer : &httpd->bodybuffer);
-	isc_buffer_usedregion(databuffer, &r);
-	result = isc_buffer_copyregion(httpd->sendbuffer, &r);
-	RUNTIME_CHECK(result == ISC_R_SUCCESS);
+	if (httpd->stream != NULL) {
+		/*
+		 * If the first part of the body can't be produced, send
+		 * what we have and close the connection so that the
+		 * client can tell the response is incomplete.
+		 */
+		if (stream_fill(httpd) != ISC_R_SUCCESS) {
+			stream_release(httpd);
+			httpd->flags |= HTTPD_CLOSE;
+		}
+	} else {
+		databuffer = (is_compressed ? &httpd->compbuffer
+					    : &httpd->bodybuffer);
+		isc_buffer_usedregion(databuffer, &r);
+		result = isc_buffer_copyregion(httpd->sendbuffer, &r);
+		RUNTIME_CHECK(result == ISC_R_SUCCESS);
+	}
 	/*
 	 * Determine total response size.
 	 */
@@ -1122,6 +1189,31 @@ isc_httpd_senddone(isc_task_t *task, isc_event_t *ev) {
 	ENTER("senddone");
 	INSIST(ISC_HTTPD_ISSEND(httpd));
 
+	/*
+	 * If a streamed body isn't finished yet, send the next part of
+	 * it, reusing the send buffer.
+	 */
+	if (httpd->stream != NULL) {
+		if (sev->result != ISC_R_SUCCESS) {
+			destroy_client(&httpd);
+			goto out;
+		}
+
+		isc_buffer_clear(httpd->sendbuffer);
+		if (stream_fill(httpd) != ISC_R_SUCCESS) {
+			destroy_client(&httpd);
+			goto out;
+		}
+
+		isc_buffer_usedregion(httpd->sendbuffer, &r);
+		if (isc_socket_send(httpd->sock, &r, task,
+				    isc_httpd_senddone, httpd) != ISC_R_SUCCESS)
+		{
+			destroy_client(&httpd);
+		}
+		goto out;
+	}
+
 	isc_buffer_free(&httpd->sendbuffer);
 
 	/*
@@ -1191,6 +1283,82 @@ reset_client(isc_httpd_t *httpd) {
 	isc_buffer_invalidate(&httpd->bodybuffer);
 }
 
+/*
+ * Append the next part of a streamed body to the send buffer, framed
+ * as a chunk if the body is being sent chunked.  When the producer
+ * reports the end of the body, the last chunk is appended and the
+ * producer is released.
+ */
+static isc_result_t
+stream_fill(isc_httpd_t *httpd) {
+	isc_result_t result, fillresult;
+	isc_buffer_t chunk;
+	unsigned int prefix = 0, length;
+	bool chunked = ((httpd->flags & HTTPD_CHUNKED) != 0);
+	char sizebuf[sizeof("ffffffff\r\n")];
+
+	INSIST(httpd->stream != NULL);
+
+	/*
+	 * Room for the chunk size, the data and its CRLF, and the last
+	 * chunk.
+	 */
+	result = isc_buffer_reserve(&httpd->sendbuffer,
+				    HTTP_CHUNK_MAXLEN + 6 + 2 + 5);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+	if (chunked) {
+		prefix = 6;
+		isc_buffer_add(httpd->sendbuffer, prefix);
+	}
+
+	isc_buffer_init(&chunk, isc_buffer_used(httpd->sendbuffer),
+			HTTP_CHUNK_MAXLEN);
+	fillresult = httpd->stream(&chunk, httpd->stream_arg);
+	if (fillresult != ISC_R_SUCCESS && fillresult != ISC_R_NOMORE) {
+		return (fillresult);
+	}
+
+	length = isc_buffer_usedlength(&chunk);
+	if (length == 0 && fillresult == ISC_R_SUCCESS) {
+		return (ISC_R_UNEXPECTED);
+	}
+
+	if (length == 0) {
+		isc_buffer_subtract(httpd->sendbuffer, prefix);
+	} else if (chunked) {
+		snprintf(sizebuf, sizeof(sizebuf), "%04x\r\n", length);
+		memmove((unsigned char *)isc_buffer_used(httpd->sendbuffer) -
+			prefix, sizebuf, prefix);
+		isc_buffer_add(httpd->sendbuffer, length);
+		isc_buffer_putmem(httpd->sendbuffer,
+				  (const unsigned char *)"\r\n", 2);
+	} else {
+		isc_buffer_add(httpd->sendbuffer, length);
+	}
+
+	if (fillresult == ISC_R_NOMORE) {
+		if (chunked) {
+			isc_buffer_putmem(httpd->sendbuffer,
+					  (const unsigned char *)"0\r\n\r\n",
+					  5);
+		}
+		stream_release(httpd);
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
+static void
+stream_release(isc_httpd_t *httpd) {
+	if (httpd->stream != NULL) {
+		(void)httpd->stream(NULL, httpd->stream_arg);
+		httpd->stream = NULL;
+		httpd->stream_arg = NULL;
+	}
+}
+
 isc_result_t
 isc_httpdmgr_addurl(isc_httpdmgr_t *httpdmgr, const char *url,
 		    isc_httpdaction_t *func, void *arg)
@@ -1221,6 +1389,7 @@ isc_httpdmgr_addurl2(isc_httpdmgr_t *httpdmgr, const char *url,
 	}
 
 	item->action = func;
+	item->streamaction = NULL;
 	item->action_arg = arg;
 	item->isstatic = isstatic;
 	isc_time_now(&item->loadtime);
@@ -1231,6 +1400,37 @@ isc_httpdmgr_addurl2(isc_httpdmgr_t *httpdmgr, const char *url,
 	return (ISC_R_SUCCESS);
 }
 
+isc_result_t
+isc_httpdmgr_addstreamurl(isc_httpdmgr_t *httpdmgr, const char *url,
+			  isc_httpdstreamaction_t *func, void *arg)
+{
+	isc_httpdurl_t *item;
+
+	REQUIRE(url != NULL);
+	REQUIRE(func != NULL);
+
+	item = isc_mem_get(httpdmgr->mctx, sizeof(isc_httpdurl_t));
+	if (item == NULL)
+		return (ISC_R_NOMEMORY);
+
+	item->url = isc_mem_strdup(httpdmgr->mctx, url);
+	if (item->url == NULL) {
+		isc_mem_put(httpdmgr->mctx, item, sizeof(isc_httpdurl_t));
+		return (ISC_R_NOMEMORY);
+	}
+
+	item->action = NULL;
+	item->streamaction = func;
+	item->action_arg = arg;
+	item->isstatic = false;
+	isc_time_now(&item->loadtime);
+
+	ISC_LINK_INIT(item, link);
+	ISC_LIST_APPEND(httpdmgr->urls, item, link);
+
+	return (ISC_R_SUCCESS);
+}
+
 void
 isc_httpd_setfinishhook(void (*fn)(void))
 {
@@ -20,16 +20,25 @@
 #include <isc/types.h>
 #include <isc/result.h>
 
+/*
+ * The hashtable does no locking of its own.  isc_ht_find() does not
+ * modify the table, so any number of lookups may run concurrently, but
+ * they must be serialized with all other calls, for instance with an
+ * isc_rwlock_t.
+ */
+
 typedef struct isc_ht isc_ht_t;
 typedef struct isc_ht_iter isc_ht_iter_t;
 
 /*%
- * Initialize hashtable at *htp, using memory context and size of (1<<bits)
+ * Initialize hashtable at *htp, using memory context and an initial
+ * size of (1<<bits).  The table grows as entries are added, so 'bits'
+ * need only cover the typical number of entries.
  *
  * Requires:
  *\li	'htp' is not NULL and '*htp' is NULL.
  *\li	'mctx' is a valid memory context.
- *\li	'bits' >=1 and 'bits' <=32
+ *\li	'bits' >=1 and 'bits' <=32 (31 on platforms with a 32-bit size_t)
  *
  * Returns:
  *\li	#ISC_R_NOMEMORY		-- not enough memory to create pool
@@ -56,6 +65,7 @@ isc_ht_destroy(isc_ht_t **htp);
  *
  * Returns:
  *\li	#ISC_R_NOMEMORY		-- not enough memory to create pool
+ *\li	#ISC_R_NOSPACE		-- the hashtable is at its maximum size
  *\li	#ISC_R_EXISTS		-- node of the same key already exists
  *\li	#ISC_R_SUCCESS		-- all is well.
  */
@@ -115,6 +125,10 @@ isc_ht_iter_destroy(isc_ht_iter_t **itp);
 /*%
  * Set an iterator to the first entry.
  *
+ * Until the iteration is finished, entries may be removed from the
+ * hashtable with isc_ht_delete() or isc_ht_iter_delcurrent_next(),
+ * but not added.
+ *
  * Requires:
  *\li	'it' is non NULL.
  *
@@ -30,10 +30,14 @@
  * can handle multiple requests), and a structure to fill in to return a
  * result to the client.  We also pass in a pointer to be filled in for
  * the data cleanup function.
+ *
+ * A URL added with isc_httpdmgr_addstreamurl() has 'streamaction' set
+ * instead of 'action'; see below.
  */
 struct isc_httpdurl {
 	char			       *url;
 	isc_httpdaction_t	       *action;
+	isc_httpdstreamaction_t	       *streamaction;
 	void			       *action_arg;
 	bool			isstatic;
 	isc_time_t			loadtime;
@@ -67,6 +71,30 @@ isc_httpdmgr_addurl2(isc_httpdmgr_t *httpdmgr, const char *url,
 		     bool isstatic,
 		     isc_httpdaction_t *func, void *arg);
 
+isc_result_t
+isc_httpdmgr_addstreamurl(isc_httpdmgr_t *httpdmgr, const char *url,
+			  isc_httpdstreamaction_t *func, void *arg);
+/*%<
+ * Add a URL whose body is produced incrementally rather than rendered
+ * into a single buffer.
+ *
+ * 'func' is called as an ordinary action would be, and on success sets
+ * '*streamp' and '*stream_argp' to a producer and its state.  The
+ * producer is then called repeatedly to fill a buffer of bounded size
+ * with the next part of the body, each of which is sent before the
+ * next is requested.  It returns ISC_R_SUCCESS if there is more to
+ * come, ISC_R_NOMORE after appending the last of the body, or any
+ * other result to abort the response.  It must append at least one
+ * byte when returning ISC_R_SUCCESS.  Once the body is complete, or
+ * if the client goes away first, the producer is called one final
+ * time with a NULL buffer to release its state.
+ *
+ * HTTP/1.1 clients receive the body with chunked transfer coding and
+ * the connection is kept open; for HTTP/1.0 clients the end of the body
+ * is marked by closing the connection.  Streamed bodies are never
+ * compressed.
+ */
+
 isc_result_t
 isc_httpd_response(isc_httpd_t *httpd);
 
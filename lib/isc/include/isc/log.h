@@ -15,6 +15,7 @@
 
 /*! \file isc/log.h */
 
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -69,6 +70,7 @@
 #define ISC_LOG_OPENERR		0x08000		/* internal */
 #define ISC_LOG_ISO8601		0x10000		/* if PRINTTIME, use ISO8601 */
 #define ISC_LOG_UTC		0x20000		/* if PRINTTIME, use UTC */
+#define ISC_LOG_BINARY		0x40000		/* binary records only */
 /*@}*/
 
 /*@{*/
@@ -443,6 +445,12 @@ isc_log_createchannel(isc_logconfig_t *lcfg, const char *name,
  *	debug level of the logging context (see isc_log_setdebuglevel)
  *	is non-zero.
  *
+ *\li	#ISC_LOG_BINARY makes a binary channel: it writes the records
+ *	passed to isc_log_writebinary() as they are, and ignores
+ *	messages logged with isc_log_write() and friends, which in
+ *	turn are never written to it.  The ISC_LOG_PRINT* flags have
+ *	no effect on a binary channel.
+ *
  * Requires:
  *\li	lcfg is a valid logging configuration.
  *
@@ -456,7 +464,11 @@ isc_log_createchannel(isc_logconfig_t *lcfg, const char *name,
  *\li	level is >= #ISC_LOG_CRITICAL (the most negative logging level).
  *
  *\li	flags does not include any bits aside from the ISC_LOG_PRINT* bits,
- *	#ISC_LOG_DEBUGONLY or #ISC_LOG_BUFFERED.
+ *	#ISC_LOG_DEBUGONLY, #ISC_LOG_BUFFERED, #ISC_LOG_ISO8601,
+ *	#ISC_LOG_UTC or #ISC_LOG_BINARY.
+ *
+ *\li	#ISC_LOG_BINARY is only set when type is #ISC_LOG_TOFILE,
+ *	#ISC_LOG_TOFILEDESC or #ISC_LOG_TONULL.
  *
  * Ensures:
  *\li	#ISC_R_SUCCESS
@@ -641,6 +653,35 @@ isc_log_vwrite1(isc_log_t *lctx, isc_logcategory_t *category,
 
 ISC_FORMAT_PRINTF(5, 0);
 
+void
+isc_log_writebinary(isc_log_t *lctx, isc_logcategory_t *category,
+		    isc_logmodule_t *module, int level,
+		    const void *data, unsigned int length);
+/*%<
+ * Write a binary record to the binary channels configured for
+ * 'category' and 'module' at 'level'.
+ *
+ * Notes:
+ *\li	The 'length' bytes at 'data' are written as they are; the
+ *	record must carry its own framing if a reader is to find where
+ *	one record ends and the next begins.
+ *
+ *\li	Channels without #ISC_LOG_BINARY never see the record.
+ *
+ *\li	When asynchronous logging is on, the record is queued like any
+ *	other message, and can likewise be dropped if the calling
+ *	thread's ring buffer is full.
+ *
+ * Requires:
+ *\li	lctx is a valid logging context, or NULL.
+ *
+ *\li	category and module are not NULL.
+ *
+ *\li	level is not #ISC_LOG_DYNAMIC.
+ *
+ *\li	data is not NULL, unless length is zero.
+ */
+
 void
 isc_log_setdebuglevel(isc_log_t *lctx, unsigned int level);
 /*%<
@@ -684,6 +725,36 @@ isc_log_wouldlog(isc_log_t *lctx, int level);
  * If #false is returned, it is guaranteed that nothing would
  * be logged, allowing the caller to omit unnecessary
  * isc_log_write() calls and possible message preformatting.
+ *
+ * Binary channels are not taken into account; see
+ * isc_log_wouldlogbinary().
+ */
+
+bool
+isc_log_wouldlogtext(isc_log_t *lctx, isc_logcategory_t *category,
+		     int level);
+/*%<
+ * Like isc_log_wouldlog(), but only considers the channels that
+ * messages logged in 'category' could be sent to.  This lets a caller
+ * that does expensive preformatting skip it when the category only
+ * goes to binary channels.
+ *
+ * Requires:
+ *\li	category is not NULL.
+ */
+
+bool
+isc_log_wouldlogbinary(isc_log_t *lctx, isc_logcategory_t *category,
+		       int level);
+/*%<
+ * Determine whether a record passed to isc_log_writebinary() for
+ * 'category' at 'level' could be written to any binary channel.
+ *
+ * If #false is returned, it is guaranteed that nothing would be
+ * written, and the caller need not build the record at all.
+ *
+ * Requires:
+ *\li	category is not NULL.
  */
 
 void
@@ -828,6 +899,58 @@ isc_log_closefilelogs(isc_log_t *lctx);
  *	next needed.
  */
 
+isc_result_t
+isc_log_setasync(isc_log_t *lctx, bool enable, unsigned int ringsize);
+/*%<
+ * Turn asynchronous logging on or off.
+ *
+ * Notes:
+ *\li	When asynchronous logging is on, isc_log_write() and friends
+ *	format the message into a ring buffer belonging to the calling
+ *	thread, without taking any lock, and a writer thread sends it
+ *	on to the channels.  Messages are therefore written some time
+ *	after they are logged, and messages logged by different threads
+ *	may not be written in the order they were logged.
+ *
+ *\li	If a thread's ring buffer is full, messages it logs are dropped
+ *	until the writer has caught up; the writer reports how many
+ *	were lost, and isc_log_getdropped() returns the total.
+ *
+ *\li	#ISC_LOG_CRITICAL messages are always written before the call
+ *	returns, after anything queued before them.
+ *
+ *\li	'ringsize' is the size in bytes of the ring buffer for each
+ *	thread; it is rounded up to a power of two no smaller than 16KB,
+ *	and zero means the default, 256KB.  It applies to threads which
+ *	have not yet logged anything asynchronously.
+ *
+ *\li	When asynchronous logging is turned off, anything queued so far
+ *	is written before this function returns.  isc_log_destroy()
+ *	also writes out anything still queued.
+ *
+ *\li	This function must not be called concurrently with itself or
+ *	with isc_log_destroy().
+ *
+ * Requires:
+ *\li	lctx is a valid context.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_RANGE	'ringsize' is too large.
+ *\li	#ISC_R_NOTIMPLEMENTED	asynchronous logging requires thread
+ *				local storage, which is not available.
+ */
+
+uint64_t
+isc_log_getdropped(isc_log_t *lctx);
+/*%<
+ * Return the number of messages dropped because a thread's ring
+ * buffer was full while asynchronous logging was on.
+ *
+ * Requires:
+ *\li	lctx is a valid context.
+ */
+
 isc_logcategory_t *
 isc_log_categorybyname(isc_log_t *lctx, const char *name);
 /*%<
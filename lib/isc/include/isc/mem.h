@@ -338,7 +338,10 @@ isc_mem_inuse(isc_mem_t *mctx);
 /*%<
  * Get an estimate of the amount of memory in use in 'mctx', in bytes.
  * This includes quantization overhead, but does not include memory
- * allocated from the system but not yet used.
+ * allocated from the system but not yet used.  For contexts using the
+ * internal allocator, memory held in the per-thread caches is counted
+ * as in use, so the estimate may be high by a bounded amount (64KB per
+ * thread that has used the context).
  */
 
 size_t
@@ -553,6 +556,32 @@ isc_mempool_associatelock(isc_mempool_t *mpctx, isc_mutex_t *lock);
  *	means of doing that.
  */
 
+void
+isc_mempool_setthreaded(isc_mempool_t *mpctx);
+/*%<
+ * Give each thread using this memory pool its own small free list, so
+ * that most isc_mempool_get() and isc_mempool_put() calls do not need
+ * the pool's lock.  The per-thread lists are refilled from, and
+ * overflow into, the pool's shared free list in batches of up to
+ * 'fillcount' items, and hold at most twice that (but no more than
+ * 'freemax').
+ *
+ * Items held on per-thread free lists count towards 'maxalloc', which
+ * is therefore only approximately enforced.  The values returned by
+ * isc_mempool_getallocated() and isc_mempool_getfreecount() may be
+ * slightly stale.
+ *
+ * Requires:
+ *
+ *\li	mpctx is a valid pool.
+ *
+ *\li	A lock has been associated with the pool using
+ *	isc_mempool_associatelock().
+ *
+ *\li	The pool is not already threaded, and no items are allocated
+ *	from it.
+ */
+
 /*
  * The following functions get/set various parameters.  Note that due to
  * the unlocked nature of pools these are potentially random values unless
@@ -14,6 +14,7 @@
 #define ISC_RWLOCK_H 1
 
 #include <inttypes.h>
+#include <stdbool.h>
 
 /*! \file isc/rwlock.h */
 
@@ -66,6 +67,17 @@ struct isc_rwlock {
 	/* Unlocked. */
 	unsigned int		write_quota;
 
+	/*
+	 * Reader bias (see isc_rwlock_setreaderbias()).  'readerbias' is
+	 * set before the lock is used; 'rbias' is read atomically, and is
+	 * only modified while holding the lock.  'inhibit_until' is
+	 * locked by rwlock itself.  'slowreads' counts reads that took
+	 * the normal lock while the bias was off.
+	 */
+	bool			readerbias;
+	atomic_bool		rbias;
+	uint64_t		inhibit_until;
+	atomic_uint_fast32_t	slowreads;
 };
 
 isc_result_t
@@ -90,6 +102,32 @@ isc_rwlock_downgrade(isc_rwlock_t *rwl);
 void
 isc_rwlock_destroy(isc_rwlock_t *rwl);
 
+void
+isc_rwlock_setreaderbias(isc_rwlock_t *rwl);
+/*%<
+ * Make 'rwl' a reader-biased lock, for locks that are read-locked far
+ * more often than they are write-locked.
+ *
+ * While the bias is on, a reader takes the lock by publishing 'rwl' in
+ * a slot of a global table of visible readers chosen by hashing the
+ * thread and the lock, so readers on different CPUs do not write to a
+ * shared cache line.  A writer first takes the lock normally, then
+ * revokes the bias and waits for the visible readers of 'rwl' to drain.
+ * Readers which find the bias revoked, or their slot in use, fall back
+ * to the normal lock.  After a revocation the bias stays off for a
+ * period proportional to how long the revocation took, so locks that
+ * are frequently write-locked fall back to the normal behaviour.
+ *
+ * isc_rwlock_tryupgrade() first moves a read lock taken through the
+ * reader table to the normal lock, which fails if a writer is waiting
+ * for the table to drain.  isc_rwlock_trylock() for writing and
+ * isc_rwlock_tryupgrade() also fail, rather than wait, if other readers
+ * hold the lock through the reader table.
+ *
+ * Requires:
+ *\li	'rwl' is a valid, unlocked rwlock.
+ */
+
 ISC_LANG_ENDDECLS
 
 #endif /* ISC_RWLOCK_H */
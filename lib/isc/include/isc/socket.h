@@ -182,6 +182,7 @@ enum {
  * _USEMINMTU:	Set the per packet IPV6_USE_MIN_MTU flag.
  */
 typedef enum {
+	ISC_SOCKEVENTATTR_INLINE =	0x20000000U, /* internal */
 	ISC_SOCKEVENTATTR_ATTACHED =	0x10000000U, /* internal */
 	ISC_SOCKEVENTATTR_TRUNC =	0x00800000U, /* public */
 	ISC_SOCKEVENTATTR_CTRUNC =	0x00400000U, /* public */
@@ -246,6 +247,12 @@ typedef enum {
 	isc_sockettype_raw = 4
 } isc_sockettype_t;
 
+/*% Socket Manager Type */
+typedef enum {
+	isc_socketmgrtype_poll = 0,	/*%< epoll, kqueue, /dev/poll or select */
+	isc_socketmgrtype_uring = 1	/*%< io_uring, falling back to poll */
+} isc_socketmgrtype_t;
+
 /*@{*/
 /*!
  * How a socket should be shutdown in isc_socket_shutdown() calls.
@@ -272,6 +279,8 @@ typedef enum {
  */
 #define ISC_SOCKFLAG_IMMEDIATE	0x00000001	/*%< send event only if needed */
 #define ISC_SOCKFLAG_NORETRY	0x00000002	/*%< drop failed UDP sends */
+#define ISC_SOCKFLAG_BATCH	0x00000004	/*%< combine concurrent UDP sends */
+#define ISC_SOCKFLAG_INLINE	0x00000008	/*%< run recv done on net thread */
 /*@}*/
 
 /*%
@@ -553,6 +562,35 @@ isc_socket_listen(isc_socket_t *sock, unsigned int backlog);
  * \li	ISC_R_UNEXPECTED
  */
 
+isc_result_t
+isc_socket_listen2(isc_socket_t *sock, unsigned int backlog,
+		   bool fastopen, unsigned int deferaccept);
+/*%<
+ * Like isc_socket_listen(), which is the same as calling this with
+ * 'fastopen' set to true and 'deferaccept' set to zero.
+ *
+ * Notes:
+ *
+ * \li	If 'fastopen' is true, TCP Fast Open is enabled on the socket,
+ *	with a queue half as long as the backlog.
+ *
+ * \li	If 'deferaccept' is not zero, the system is asked not to complete
+ *	the acceptance of a new connection until the client has sent some
+ *	data, for up to about 'deferaccept' seconds (TCP_DEFER_ACCEPT).
+ *
+ * \li	Either option is silently ignored where the system does not
+ *	support it; failure to set it is logged but is not fatal.
+ *
+ * Requires:
+ *
+ * \li	'socket' is a valid, bound TCP socket or a valid, bound UNIX socket.
+ *
+ * Returns:
+ *
+ * \li	ISC_R_SUCCESS
+ * \li	ISC_R_UNEXPECTED
+ */
+
 isc_result_t
 isc_socket_accept(isc_socket_t *sock,
 		  isc_task_t *task, isc_taskaction_t action, void *arg);
@@ -681,12 +719,19 @@ isc_socket_recv2(isc_socket_t *sock, isc_region_t *region,
  *	expected to be initialized.
  *
  *\li	For isc_socket_recv2():
- *	The only defined value for 'flags' is ISC_SOCKFLAG_IMMEDIATE.  If
- *	set and the operation completes, the return value will be
- *	ISC_R_SUCCESS and the event will be filled in and not sent.  If the
- *	operation does not complete, the return value will be
- *	ISC_R_INPROGRESS and the event will be sent when the operation
- *	completes.
+ *	The only defined values for 'flags' are ISC_SOCKFLAG_IMMEDIATE and
+ *	ISC_SOCKFLAG_INLINE.  If ISC_SOCKFLAG_IMMEDIATE is set and the
+ *	operation completes, the return value will be ISC_R_SUCCESS and
+ *	the event will be filled in and not sent.  If the operation does
+ *	not complete, the return value will be ISC_R_INPROGRESS and the
+ *	event will be sent when the operation completes.
+ *
+ *\li	For isc_socket_recv2():
+ *	If ISC_SOCKFLAG_INLINE is set, the read is always left to the
+ *	socket's network thread, which delivers the done event with
+ *	isc_task_sendinline() once it has released its own locks: the
+ *	event action then runs on the network thread if 'task' is idle.
+ *	The action must not block.  Cancelled events are sent as usual.
  *
  * Requires:
  *
@@ -755,8 +800,8 @@ isc_socket_sendto2(isc_socket_t *sock, isc_region_t *region,
  *	expected to be initialized.
  *
  *\li	For isc_socket_sendto2():
- *	The only defined values for 'flags' are ISC_SOCKFLAG_IMMEDIATE
- *	and ISC_SOCKFLAG_NORETRY.
+ *	The only defined values for 'flags' are ISC_SOCKFLAG_IMMEDIATE,
+ *	ISC_SOCKFLAG_NORETRY and ISC_SOCKFLAG_BATCH.
  *
  *\li	If ISC_SOCKFLAG_IMMEDIATE is set and the operation completes, the
  *	return value will be ISC_R_SUCCESS and the event will be filled
@@ -770,6 +815,14 @@ isc_socket_sendto2(isc_socket_t *sock, isc_region_t *region,
  *	Using this option along with ISC_SOCKFLAG_IMMEDIATE allows the caller
  *	to specify a region that is allocated on the stack.
  *
+ *\li	ISC_SOCKFLAG_BATCH can only be set along with ISC_SOCKFLAG_NORETRY.
+ *	If another thread is sending on the socket at the same time, the
+ *	datagram is left for that thread to send together with others,
+ *	with a single sendmmsg() call where the system supports it.  The
+ *	return value is then ISC_R_INPROGRESS if ISC_SOCKFLAG_IMMEDIATE is
+ *	set, so 'region' must not be allocated on the stack, and the send
+ *	cannot be canceled.
+ *
  * Requires:
  *
  *\li	'socket' is a valid, bound socket.
@@ -814,6 +867,11 @@ isc_socketmgr_create(isc_mem_t *mctx, isc_socketmgr_t **managerp);
 isc_result_t
 isc_socketmgr_create2(isc_mem_t *mctx, isc_socketmgr_t **managerp,
 		      unsigned int maxsocks, int nthreads);
+
+isc_result_t
+isc_socketmgr_create3(isc_mem_t *mctx, isc_socketmgr_t **managerp,
+		      unsigned int maxsocks, int nthreads,
+		      isc_socketmgrtype_t type);
 /*%<
  * Create a socket manager.  If "maxsocks" is non-zero, it specifies the
  * maximum number of sockets that the created manager should handle.
@@ -822,6 +880,19 @@ isc_socketmgr_create2(isc_mem_t *mctx, isc_socketmgr_t **managerp,
  * isc_socketmgr_createinctx() also associates the new manager with the
  * specified application context.
  *
+ * isc_socketmgr_create2() creates a manager of type
+ * isc_socketmgrtype_poll, whose network threads wait for sockets to
+ * become ready with the best mechanism the platform has.
+ *
+ * A manager of type isc_socketmgrtype_uring uses io_uring instead, on
+ * Linux systems where BIND was configured with --enable-io-uring.
+ * UDP datagrams are then received by multishot recvmsg requests into
+ * buffers registered with the kernel, and copied into the waiting
+ * receive events without a system call per datagram.  Network threads
+ * for which the kernel does not support this fall back to polling, as
+ * does the whole manager on other systems; the events posted are the
+ * same either way.
+ *
  * Notes:
  *
  *\li	All memory will be allocated in memory context 'mctx'.
@@ -832,6 +903,8 @@ isc_socketmgr_create2(isc_mem_t *mctx, isc_socketmgr_t **managerp,
  *
  *\li	'managerp' points to a NULL isc_socketmgr_t.
  *
+ *\li	'type' is isc_socketmgrtype_poll or isc_socketmgrtype_uring.
+ *
  *\li	'actx' is a valid application context (for createinctx()).
  *
  * Ensures:
@@ -846,6 +919,17 @@ isc_socketmgr_create2(isc_mem_t *mctx, isc_socketmgr_t **managerp,
  *\li	#ISC_R_NOTIMPLEMENTED
  */
 
+isc_socketmgrtype_t
+isc_socketmgr_gettype(isc_socketmgr_t *manager);
+/*%<
+ * Returns isc_socketmgrtype_uring if all of the network threads of
+ * 'manager' use io_uring, and isc_socketmgrtype_poll otherwise.
+ *
+ * Requires:
+ *
+ *\li	'*manager' is a valid isc_socketmgr_t.
+ */
+
 isc_result_t
 isc_socketmgr_getmaxsockets(isc_socketmgr_t *manager, unsigned int *nsockp);
 /*%<
@@ -1016,6 +1100,30 @@ isc_socket_hasreuseport(void);
  * Return true if there is SO_REUSEPORT support
  */
 
+isc_result_t
+isc_socket_steerbycpu(isc_socket_t **socks, unsigned int nsocks);
+/*%<
+ * Steer datagrams arriving on a group of UDP sockets bound to the same
+ * address with SO_REUSEPORT: each datagram goes to a socket whose
+ * network thread runs on the CPU that received it, if there is one.
+ * Otherwise the system's default choice applies.
+ *
+ * 'socks' must list the sockets in the order in which they were bound.
+ * If sockets leave the group later, the system may renumber the others,
+ * and the steering is then no longer exact.
+ *
+ * Requires:
+ *\li	'socks' is not NULL and 'nsocks' is greater than zero.
+ *\li	Each socket is a valid UDP socket in the same SO_REUSEPORT group.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOTIMPLEMENTED	The system does not support this.
+ *\li	#ISC_R_RANGE		There are too many network threads.
+ *\li	#ISC_R_NOMEMORY
+ *\li	Other errors from setsockopt().
+ */
+
 #ifdef HAVE_LIBXML2
 int
 isc_socketmgr_renderxml(isc_socketmgr_t *mgr, xmlTextWriterPtr writer);
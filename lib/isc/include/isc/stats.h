@@ -26,6 +26,11 @@ ISC_LANG_BEGINDECLS
  */
 #define ISC_STATSDUMP_VERBOSE	0x00000001 /*%< dump 0-value counters */
 
+/*%<
+ * Flag(s) for isc_stats_create2().
+ */
+#define ISC_STATS_SHARDED	0x00000001 /*%< per-CPU counter slabs */
+
 /*%<
  * Dump callback type.
  */
@@ -48,6 +53,31 @@ isc_stats_create(isc_mem_t *mctx, isc_stats_t **statsp, int ncounters);
  *\li	anything else	-- failure
  */
 
+isc_result_t
+isc_stats_create2(isc_mem_t *mctx, isc_stats_t **statsp, int ncounters,
+		  unsigned int flags);
+/*%<
+ * Like isc_stats_create(), with options given in 'flags'.
+ *
+ * If 'flags' contains ISC_STATS_SHARDED, the counters are replicated in
+ * one cache line aligned slab per CPU, and each thread updates the slab
+ * it is assigned to.  This avoids contention and false sharing between
+ * threads updating the same set of counters, at the cost of using
+ * roughly one slab's worth of memory per CPU and of summing the slabs
+ * in isc_stats_dump().  It is intended for counters which are updated
+ * on every query by many threads.
+ *
+ * Requires:
+ *\li	'mctx' must be a valid memory context.
+ *
+ *\li	'statsp' != NULL && '*statsp' == NULL.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS	-- all ok
+ *
+ *\li	anything else	-- failure
+ */
+
 void
 isc_stats_attach(isc_stats_t *stats, isc_stats_t **statsp);
 /*%<
@@ -116,7 +146,8 @@ void
 isc_stats_set(isc_stats_t *stats, uint64_t val,
 	      isc_statscounter_t counter);
 /*%<
- * Set the given counter to the specfied value.
+ * Set the given counter to the specfied value.  For sharded statistics,
+ * updates made concurrently with isc_stats_set() may be lost.
  *
  * Requires:
  *\li	'stats' is a valid isc_stats_t.
@@ -73,6 +73,7 @@
  *** Imports.
  ***/
 
+#include <inttypes.h>
 #include <stdbool.h>
 
 #include <isc/eventclass.h>
@@ -259,6 +260,85 @@ isc_task_sendanddetach(isc_task_t **taskp, isc_event_t **eventp);
  *		all resources used by the task will be freed.
  */
 
+void
+isc_task_sendlist(isc_task_t *task, isc_eventlist_t *events);
+
+void
+isc_task_sendtolist(isc_task_t *task, isc_eventlist_t *events, int c);
+/*%<
+ * Send all the events on '*events' to 'task', in list order.  The
+ * task lock is taken once for the whole list, and the task is made
+ * ready at most once.  If task is idle try starting it on cpu 'c'.
+ * If 'c' is smaller than 0 then cpu is selected randomly.
+ *
+ * Requires:
+ *
+ *\li	'task' is a valid task.
+ *\li	events != NULL.
+ *\li	Every event on '*events' is a valid event that could be passed
+ *	to isc_task_send().
+ *
+ * Ensures:
+ *
+ *\li	'*events' is empty.
+ */
+
+void
+isc_task_sendtolistanddetach(isc_task_t **taskp, isc_eventlist_t *events,
+			     int c, unsigned int references);
+/*%<
+ * Send all the events on '*events' to '*taskp' as isc_task_sendtolist()
+ * does, and then release 'references' references to the task, as if
+ * isc_task_detach() had been called 'references' times.  This is
+ * intended for callers that hold one task reference per queued event.
+ * If '*events' is empty, the references are still released.
+ *
+ * Requires:
+ *
+ *\li	'*taskp' is a valid task.
+ *\li	events != NULL.
+ *\li	references > 0, and the task has at least 'references'
+ *	references.
+ *
+ * Ensures:
+ *
+ *\li	'*events' is empty.
+ *
+ *\li	*taskp == NULL.
+ *
+ *\li	The task is shutdown or freed as described for
+ *	isc_task_sendanddetach() if the last reference was released.
+ */
+
+void
+isc_task_sendinline(isc_task_t *task, isc_event_t **eventp);
+/*%<
+ * Run '*event' on the calling thread, as a worker thread would, if
+ * 'task' is idle; otherwise send it to 'task' with isc_task_send().
+ *
+ * While the event action runs, the task is running, so any event sent
+ * to it meanwhile is dispatched by a worker thread afterwards.  The
+ * event is never run inline while the task manager is paused, is in
+ * exclusive or privileged mode, or while the task is shutting down,
+ * and isc_task_beginexclusive() waits for actions that are being run
+ * inline to return.
+ *
+ * This is intended for threads outside the task manager, such as
+ * network threads, that want to deliver an event without the latency
+ * of a handoff to a worker thread.  The event action must not block,
+ * and the caller must not hold any lock that the action might need.
+ * Called from one of the manager's worker threads, this is the same
+ * as isc_task_send().
+ *
+ * Requires:
+ *
+ *\li	'task' is a valid task.
+ *\li	eventp != NULL && *eventp != NULL.
+ *
+ * Ensures:
+ *
+ *\li	*eventp == NULL.
+ */
 
 unsigned int
 isc_task_purgerange(isc_task_t *task, void *sender, isc_eventtype_t first,
@@ -702,6 +782,26 @@ isc_taskmgr_mode(isc_taskmgr_t *manager);
  *\li      'manager' is a valid task manager.
  */
 
+void
+isc_taskmgr_setworkstealing(isc_taskmgr_t *manager, bool enable);
+
+bool
+isc_taskmgr_workstealing(isc_taskmgr_t *manager);
+/*%<
+ * Enable/disable or query work stealing between the worker threads.
+ *
+ * When enabled, each worker keeps a bounded lock-free deque of unbound
+ * tasks that it has made ready itself, and a worker with nothing to do
+ * steals runnable unbound tasks from the other workers before going to
+ * sleep.  Tasks created with isc_task_create_bound() and privileged
+ * tasks are never stolen.  Work stealing is disabled by default, and
+ * may be switched at any time.
+ *
+ * Requires:
+ *
+ *\li      'manager' is a valid task manager.
+ */
+
 void
 isc_taskmgr_destroy(isc_taskmgr_t **managerp);
 /*%<
@@ -761,6 +861,62 @@ isc_taskmgr_excltask(isc_taskmgr_t *mgr, isc_task_t **taskp);
  */
 
 
+/*%
+ * Latency histograms.  Each worker counts how long tasks wait on its
+ * ready queue before it runs them, and how long each event action
+ * runs, in ISC_TASKMGR_LATENCYBUCKETS buckets: bucket 0 counts times
+ * under 1 microsecond, bucket 1 those under 2us and so on, doubling,
+ * and the last bucket everything slower than the one before it.
+ *
+ * Event actions that run for ISC_TASKMGR_SLOWEVENT microseconds or
+ * more are also counted against the name of their task (see
+ * isc_task_setname()).
+ */
+#define ISC_TASKMGR_LATENCYBUCKETS	24
+#define ISC_TASKMGR_SLOWEVENT		10000
+
+typedef void (*isc_taskmgr_latencydump_t)(unsigned int, const uint64_t *,
+					  const uint64_t *, void *);
+typedef void (*isc_taskmgr_slowdump_t)(const char *, uint64_t, uint64_t,
+				       uint64_t, void *);
+
+uint64_t
+isc_taskmgr_latencylimit(unsigned int bucket);
+/*%<
+ * Return the upper bound, in microseconds, of the times counted in
+ * latency histogram bucket 'bucket', or 0 for the last bucket, which
+ * has none.
+ *
+ * Requires:
+ *\li	'bucket' is less than ISC_TASKMGR_LATENCYBUCKETS.
+ */
+
+void
+isc_taskmgr_dumplatency(isc_taskmgr_t *mgr, isc_taskmgr_latencydump_t dump,
+			void *arg);
+/*%<
+ * Call 'dump' for each worker with the worker's number, its queue delay
+ * histogram, its run time histogram and 'arg'.  The histograms are
+ * arrays of ISC_TASKMGR_LATENCYBUCKETS counters.
+ *
+ * Requires:
+ *\li	'mgr' is a valid task manager.
+ */
+
+void
+isc_taskmgr_dumpslow(isc_taskmgr_t *mgr, isc_taskmgr_slowdump_t dump,
+		     void *arg);
+/*%<
+ * Call 'dump' for each task name that has had slow events, with the
+ * name, the number of slow events, their total and their longest run
+ * time in microseconds, and 'arg'.  Names are reported in the order
+ * they were first seen.  Only a limited number of names are kept;
+ * slow events of any others are reported under the name "(other)".
+ *
+ * Requires:
+ *\li	'mgr' is a valid task manager.
+ */
+
 #ifdef HAVE_LIBXML2
 int
 isc_taskmgr_renderxml(isc_taskmgr_t *mgr, xmlTextWriterPtr writer);
@@ -88,6 +88,12 @@ typedef enum {
 	isc_timertype_inactive = 3 	/*%< Inactive */
 } isc_timertype_t;
 
+/*% Timer Manager Type */
+typedef enum {
+	isc_timermgrtype_heap = 0,	/*%< Binary heap */
+	isc_timermgrtype_wheel = 1	/*%< Hierarchical timing wheel */
+} isc_timermgrtype_t;
+
 typedef struct isc_timerevent {
 	struct isc_event	common;
 	isc_time_t		due;
@@ -321,10 +327,25 @@ isc_timermgr_createinctx(isc_mem_t *mctx, isc_appctx_t *actx,
 
 isc_result_t
 isc_timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp);
+
+isc_result_t
+isc_timermgr_create2(isc_mem_t *mctx, isc_timermgrtype_t type,
+		     isc_timermgr_t **managerp);
 /*%<
  * Create a timer manager.  isc_timermgr_createinctx() also associates
  * the new manager with the specified application context.
  *
+ * isc_timermgr_create() and isc_timermgr_createinctx() create a
+ * manager of type isc_timermgrtype_heap, which keeps the scheduled
+ * timers in a binary heap ordered by due time.
+ *
+ * A manager of type isc_timermgrtype_wheel keeps them in hierarchical
+ * timing wheels instead, one per CPU, so scheduling, resetting and
+ * cancelling a timer take constant time and only lock the timer's own
+ * wheel.  Due times are rounded up to the next millisecond, so events
+ * may be posted up to a millisecond later than with the heap, but
+ * never earlier than requested.
+ *
  * Notes:
  *
  *\li	All memory will be allocated in memory context 'mctx'.
@@ -333,6 +354,8 @@ isc_timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp);
  *
  *\li	'mctx' is a valid memory context.
  *
+ *\li	'type' is isc_timermgrtype_heap or isc_timermgrtype_wheel.
+ *
  *\li	'managerp' points to a NULL isc_timermgr_t.
  *
  *\li	'actx' is a valid application context (for createinctx()).
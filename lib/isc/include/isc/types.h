@@ -97,6 +97,17 @@ typedef isc_result_t (isc_httpdaction_t)(const char *url,
 					 isc_buffer_t *body,
 					 isc_httpdfree_t **freecb,
 					 void **freecb_args);
+typedef isc_result_t (isc_httpdstream_t)(isc_buffer_t *, void *);
+typedef isc_result_t (isc_httpdstreamaction_t)(const char *url,
+					       isc_httpdurl_t *urlinfo,
+					       const char *querystring,
+					       const char *headers,
+					       void *arg,
+					       unsigned int *retcode,
+					       const char **retmsg,
+					       const char **mimetype,
+					       isc_httpdstream_t **streamp,
+					       void **stream_argp);
 typedef bool (isc_httpdclientok_t)(const isc_sockaddr_t *, void *);
 
 /*% Resource */
@@ -20,6 +20,8 @@
 
 #include <sys/types.h>	/* dev_t FreeBSD 2.1 */
 
+#include <isc/atomic.h>
+#include <isc/condition.h>
 #include <isc/dir.h>
 #include <isc/file.h>
 #include <isc/log.h>
@@ -29,6 +31,7 @@
 #include <isc/stat.h>
 #include <isc/stdio.h>
 #include <isc/string.h>
+#include <isc/thread.h>
 #include <isc/time.h>
 #include <isc/util.h>
 
@@ -47,6 +50,16 @@
 #define PATH_MAX 1024	/* WIN32 and others don't define this. */
 #endif
 
+/*
+ * Asynchronous logging: default and minimum sizes of the per-thread
+ * rings, the most threads that can have one, and how long the writer
+ * thread sleeps when it has nothing to do.
+ */
+#define LOG_RING_SIZE		(256 * 1024)
+#define LOG_RING_MINSIZE	(16 * 1024)
+#define LOG_MAXRINGS		256
+#define LOG_WRITER_NAPTIME	100000000	/* nanoseconds */
+
 /*!
  * This is the structure that holds each named channel.  A simple linked
  * list chains all of the channels together, so an individual channel is
@@ -83,6 +96,24 @@ struct isc_logchannellist {
 	ISC_LINK(isc_logchannellist_t)	link;
 };
 
+/*!
+ * For each category, the highest level of any text channel and of any
+ * binary channel it is associated with, so that isc_log_wouldlogtext()
+ * and isc_log_wouldlogbinary() don't have to walk the channel lists.
+ * 'modules' is set if any of the associations is for a particular
+ * module, in which case messages from other modules fall through to
+ * the default category.
+ */
+typedef struct isc_loglevels {
+	int				text;
+	int				binary;
+	bool				textdynamic;
+	bool				binarydynamic;
+	bool				modules;
+} isc_loglevels_t;
+
+#define LOG_LEVEL_NONE		(ISC_LOG_CRITICAL - 1)
+
 /*!
  * This structure is used to remember messages for pruning via
  * isc_log_[v]write1().
@@ -95,6 +126,97 @@ struct isc_logmessage {
 	ISC_LINK(isc_logmessage_t)	link;
 };
 
+typedef struct isc_logasync isc_logasync_t;
+
+#if defined(HAVE_TLS)
+/*!
+ * Messages waiting to be written are kept in per-thread rings, each of
+ * which has a single producer, the thread which owns it, and a single
+ * consumer, whoever holds the log context lock.  A record never wraps
+ * around the end of a ring; if it doesn't fit in the space left, a
+ * padding record (one with no category) fills that space, or if there
+ * isn't room for even that, the consumer skips it.
+ */
+typedef struct isc_logrecord {
+	unsigned int			length;	/* including padding */
+	unsigned int			datalen;
+	int				level;
+	bool				write_once;
+	bool				binary;
+	isc_logcategory_t *		category;
+	isc_logmodule_t *		module;
+	isc_time_t			time;
+	/*
+	 * followed by 'datalen' bytes: the NUL terminated message, or
+	 * the binary record
+	 */
+} isc_logrecord_t;
+
+#define LOG_RECORD_ALIGN(n)	(((n) + 7) & ~(size_t)7)
+
+typedef struct isc_logring {
+	atomic_uint_fast64_t		head;	/* next byte to write */
+	atomic_uint_fast64_t		tail;	/* next byte to read */
+	atomic_uint_fast64_t		dropped;
+	atomic_bool			owned;	/* by a running thread */
+	unsigned int			size;	/* a power of two */
+	unsigned char *			buffer;
+} isc_logring_t;
+
+/*!
+ * Asynchronous logging state.  Once created, this stays with the log
+ * context until it is destroyed, even if asynchronous logging is
+ * turned off again, so that a thread which saw it enabled can always
+ * finish queueing its message.
+ *
+ * Each thread's ring is also set as its value for 'key', whose
+ * destructor hands the ring back when the thread exits so that a new
+ * thread can take it over; otherwise a server that keeps starting
+ * threads would run out of rings.
+ */
+struct isc_logasync {
+	unsigned int			id;
+	isc_log_t *			lctx;
+	atomic_bool			enabled;
+	atomic_uint_fast32_t		ringsize;
+	atomic_uint_fast32_t		nrings;
+	atomic_uintptr_t		rings[LOG_MAXRINGS];
+	isc_thread_key_t		key;
+	isc_thread_t			thread;
+	isc_mutex_t			lock;
+	isc_condition_t			cond;
+	/* Locked by lock. */
+	bool				shutdown;
+	atomic_bool			sleeping;
+	/* Locked by the isc_log lock. */
+	uint64_t			reported;
+};
+
+static atomic_uint_fast32_t log_nextasyncid = 1;
+
+/*
+ * The calling thread's ring, if it has one for the asynchronous
+ * logging state with id 'log_ringid', and a buffer to format
+ * messages in before they are copied into it.
+ */
+#if defined(HAVE_THREAD_LOCAL)
+#include <threads.h>
+static thread_local isc_logring_t *log_ring = NULL;
+static thread_local unsigned int log_ringid = 0;
+static thread_local char log_buffer[LOG_BUFFER_SIZE];
+#elif defined(HAVE___THREAD)
+static __thread isc_logring_t *log_ring = NULL;
+static __thread unsigned int log_ringid = 0;
+static __thread char log_buffer[LOG_BUFFER_SIZE];
+#elif defined(HAVE___DECLSPEC_THREAD)
+static __declspec( thread ) isc_logring_t *log_ring = NULL;
+static __declspec( thread ) unsigned int log_ringid = 0;
+static __declspec( thread ) char log_buffer[LOG_BUFFER_SIZE];
+#else
+#error "Unknown method for defining a TLS variable!"
+#endif
+#endif /* HAVE_TLS */
+
 /*!
  * The isc_logconfig structure is used to store the configurable information
  * about where messages are actually supposed to be sent -- the information
@@ -107,6 +229,7 @@ struct isc_logconfig {
 	isc_log_t *			lctx;
 	ISC_LIST(isc_logchannel_t)	channels;
 	ISC_LIST(isc_logchannellist_t) *channellists;
+	isc_loglevels_t *		levels;
 	unsigned int			channellist_count;
 	unsigned int			duplicate_interval;
 	int				highest_level;
@@ -141,6 +264,7 @@ struct isc_log {
 	unsigned int			module_count;
 	int				debug_level;
 	isc_mutex_t			lock;
+	isc_logasync_t *		async;
 	/* Locked by isc_log lock. */
 	isc_logconfig_t * 		logconfig;
 	char 				buffer[LOG_BUFFER_SIZE];
@@ -230,6 +354,48 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 	     const char *format, va_list args)
      ISC_FORMAT_PRINTF(6, 0);
 
+static void
+log_dispatch(isc_log_t *lctx, isc_logcategory_t *category,
+	     isc_logmodule_t *module, int level, bool write_once,
+	     const isc_time_t *when, const char *format, va_list args)
+     ISC_FORMAT_PRINTF(7, 0);
+
+static void
+log_dispatchbinary(isc_log_t *lctx, isc_logcategory_t *category,
+		   isc_logmodule_t *module, int level,
+		   const void *data, unsigned int length);
+
+#if defined(HAVE_TLS)
+static void
+log_dispatchf(isc_log_t *lctx, isc_logcategory_t *category,
+	      isc_logmodule_t *module, int level, bool write_once,
+	      const isc_time_t *when, const char *format, ...)
+     ISC_FORMAT_PRINTF(7, 8);
+
+static bool
+log_queue(isc_logasync_t *async, isc_logcategory_t *category,
+	  isc_logmodule_t *module, int level, bool write_once, bool binary,
+	  const void *data, size_t length);
+
+static void
+log_enqueue(isc_logasync_t *async, isc_logcategory_t *category,
+	    isc_logmodule_t *module, int level, bool write_once,
+	    const char *format, va_list args)
+     ISC_FORMAT_PRINTF(6, 0);
+
+static unsigned int
+log_drain(isc_log_t *lctx);
+
+static void
+log_ringexit(void *arg);
+
+static isc_threadresult_t
+log_writer(isc_threadarg_t arg);
+
+static void
+log_async_destroy(isc_log_t *lctx);
+#endif /* HAVE_TLS */
+
 /*@{*/
 /*!
  * Convenience macros.
@@ -270,6 +436,7 @@ isc_log_create(isc_mem_t *mctx, isc_log_t **lctxp, isc_logconfig_t **lcfgp) {
 		lctx->modules = NULL;
 		lctx->module_count = 0;
 		lctx->debug_level = 0;
+		lctx->async = NULL;
 
 		ISC_LIST_INIT(lctx->messages);
 
@@ -326,6 +493,7 @@ isc_logconfig_create(isc_log_t *lctx, isc_logconfig_t **lcfgp) {
 	if (lcfg != NULL) {
 		lcfg->lctx = lctx;
 		lcfg->channellists = NULL;
+		lcfg->levels = NULL;
 		lcfg->channellist_count = 0;
 		lcfg->duplicate_interval = 0;
 		lcfg->highest_level = level;
@@ -456,6 +624,16 @@ isc_log_destroy(isc_log_t **lctxp) {
 	lctx = *lctxp;
 	mctx = lctx->mctx;
 
+#if defined(HAVE_TLS)
+	/*
+	 * Write out anything still queued before the configuration
+	 * goes away.
+	 */
+	if (lctx->async != NULL) {
+		log_async_destroy(lctx);
+	}
+#endif
+
 	if (lctx->logconfig != NULL) {
 		lcfg = lctx->logconfig;
 		lctx->logconfig = NULL;
@@ -533,10 +711,13 @@ isc_logconfig_destroy(isc_logconfig_t **lcfgp) {
 			isc_mem_put(mctx, item, sizeof(*item));
 		}
 
-	if (lcfg->channellist_count > 0)
+	if (lcfg->channellist_count > 0) {
 		isc_mem_put(mctx, lcfg->channellists,
 			    lcfg->channellist_count *
 			    sizeof(ISC_LIST(isc_logchannellist_t)));
+		isc_mem_put(mctx, lcfg->levels,
+			    lcfg->channellist_count * sizeof(isc_loglevels_t));
+	}
 
 	lcfg->dynamic = false;
 	if (lcfg->tag != NULL)
@@ -695,7 +876,7 @@ isc_log_createchannel(isc_logconfig_t *lcfg, const char *name,
 	isc_mem_t *mctx;
 	unsigned int permitted = ISC_LOG_PRINTALL | ISC_LOG_DEBUGONLY |
 				 ISC_LOG_BUFFERED | ISC_LOG_ISO8601 |
-				 ISC_LOG_UTC;
+				 ISC_LOG_UTC | ISC_LOG_BINARY;
 
 	REQUIRE(VALID_CONFIG(lcfg));
 	REQUIRE(name != NULL);
@@ -704,6 +885,7 @@ isc_log_createchannel(isc_logconfig_t *lcfg, const char *name,
 	REQUIRE(destination != NULL || type == ISC_LOG_TONULL);
 	REQUIRE(level >= ISC_LOG_CRITICAL);
 	REQUIRE((flags & ~permitted) == 0);
+	REQUIRE((flags & ISC_LOG_BINARY) == 0 || type != ISC_LOG_TOSYSLOG);
 
 	/* XXXDCL find duplicate names? */
 
@@ -976,6 +1158,114 @@ isc_log_closefilelogs(isc_log_t *lctx) {
 	UNLOCK(&lctx->lock);
 }
 
+isc_result_t
+isc_log_setasync(isc_log_t *lctx, bool enable, unsigned int ringsize) {
+#if defined(HAVE_TLS)
+	isc_logasync_t *async;
+	unsigned int size;
+
+	REQUIRE(VALID_CONTEXT(lctx));
+
+	async = lctx->async;
+
+	if (!enable) {
+		if (async != NULL &&
+		    atomic_exchange_explicit(&async->enabled, false,
+					     memory_order_acq_rel))
+		{
+			/*
+			 * Write out what has been queued so far, so that
+			 * it comes before anything logged from now on.
+			 */
+			LOCK(&lctx->lock);
+			(void)log_drain(lctx);
+			UNLOCK(&lctx->lock);
+		}
+		return (ISC_R_SUCCESS);
+	}
+
+	if (ringsize == 0) {
+		ringsize = LOG_RING_SIZE;
+	}
+	for (size = LOG_RING_MINSIZE; size < ringsize; size <<= 1) {
+		if (size > UINT_MAX / 2) {
+			return (ISC_R_RANGE);
+		}
+	}
+
+	if (async == NULL) {
+		async = isc_mem_get(lctx->mctx, sizeof(*async));
+		memset(async, 0, sizeof(*async));
+		async->id = atomic_fetch_add_explicit(&log_nextasyncid, 1,
+						      memory_order_relaxed);
+		async->lctx = lctx;
+		atomic_init(&async->enabled, false);
+		atomic_init(&async->ringsize, size);
+		atomic_init(&async->nrings, 0);
+		atomic_init(&async->sleeping, false);
+		async->shutdown = false;
+		async->reported = 0;
+		isc_mutex_init(&async->lock);
+		isc_condition_init(&async->cond);
+		RUNTIME_CHECK(isc_thread_key_create(&async->key,
+						    log_ringexit) == 0);
+
+		/*
+		 * The writer drains lctx->async, so it must be set
+		 * before the writer starts.
+		 */
+		lctx->async = async;
+
+		RUNTIME_CHECK(isc_thread_create(log_writer, async,
+						&async->thread) ==
+			      ISC_R_SUCCESS);
+		isc_thread_setname(async->thread, "isc-log");
+	}
+
+	atomic_store_explicit(&async->ringsize, size, memory_order_relaxed);
+	atomic_store_explicit(&async->enabled, true, memory_order_release);
+
+	return (ISC_R_SUCCESS);
+#else
+	REQUIRE(VALID_CONTEXT(lctx));
+
+	UNUSED(ringsize);
+
+	return (enable ? ISC_R_NOTIMPLEMENTED : ISC_R_SUCCESS);
+#endif /* HAVE_TLS */
+}
+
+uint64_t
+isc_log_getdropped(isc_log_t *lctx) {
+	uint64_t dropped = 0;
+#if defined(HAVE_TLS)
+	isc_logring_t *ring;
+	unsigned int i, nrings;
+
+	REQUIRE(VALID_CONTEXT(lctx));
+
+	if (lctx->async == NULL) {
+		return (0);
+	}
+
+	nrings = ISC_MIN(atomic_load_explicit(&lctx->async->nrings,
+					      memory_order_acquire),
+			 LOG_MAXRINGS);
+	for (i = 0; i < nrings; i++) {
+		ring = (isc_logring_t *)atomic_load_explicit(
+				&lctx->async->rings[i], memory_order_acquire);
+		if (ring != NULL) {
+			dropped += atomic_load_explicit(&ring->dropped,
+							memory_order_relaxed);
+		}
+	}
+#else
+	REQUIRE(VALID_CONTEXT(lctx));
+#endif /* HAVE_TLS */
+
+	return (dropped);
+}
+
 /****
  **** Internal functions
  ****/
@@ -985,6 +1275,7 @@ assignchannel(isc_logconfig_t *lcfg, unsigned int category_id,
 	      const isc_logmodule_t *module, isc_logchannel_t *channel)
 {
 	isc_logchannellist_t *new_item;
+	isc_loglevels_t *levels;
 	isc_log_t *lctx;
 	isc_result_t result;
 
@@ -1015,13 +1306,29 @@ assignchannel(isc_logconfig_t *lcfg, unsigned int category_id,
 	/*
 	 * Remember the highest logging level set by any channel in the
 	 * logging config, so isc_log_doit() can quickly return if the
-	 * message is too high to be logged by any channel.
+	 * message is too high to be logged by any channel.  Binary
+	 * channels are accounted for separately, as they never take
+	 * text messages.
 	 */
-	if (channel->type != ISC_LOG_TONULL) {
+	levels = &lcfg->levels[category_id];
+	if (module != NULL)
+		levels->modules = true;
+	if (channel->type == ISC_LOG_TONULL) {
+		/* Nothing. */
+	} else if ((channel->flags & ISC_LOG_BINARY) != 0) {
+		if (levels->binary < channel->level)
+			levels->binary = channel->level;
+		if (channel->level == ISC_LOG_DYNAMIC)
+			levels->binarydynamic = true;
+	} else {
 		if (lcfg->highest_level < channel->level)
 			lcfg->highest_level = channel->level;
 		if (channel->level == ISC_LOG_DYNAMIC)
 			lcfg->dynamic = true;
+		if (levels->text < channel->level)
+			levels->text = channel->level;
+		if (channel->level == ISC_LOG_DYNAMIC)
+			levels->textdynamic = true;
 	}
 
 	return (ISC_R_SUCCESS);
@@ -1033,9 +1340,10 @@ assignchannel(isc_logconfig_t *lcfg, unsigned int category_id,
  */
 static isc_result_t
 sync_channellist(isc_logconfig_t *lcfg) {
-	unsigned int bytes;
+	unsigned int bytes, i;
 	isc_log_t *lctx;
 	void *lists;
+	isc_loglevels_t *levels;
 
 	REQUIRE(VALID_CONFIG(lcfg));
 
@@ -1055,14 +1363,34 @@ sync_channellist(isc_logconfig_t *lcfg) {
 
 	memset(lists, 0, bytes);
 
+	levels = isc_mem_get(lctx->mctx,
+			     lctx->category_count * sizeof(*levels));
+	if (levels == NULL) {
+		isc_mem_put(lctx->mctx, lists, bytes);
+		return (ISC_R_NOMEMORY);
+	}
+
+	for (i = 0; i < lctx->category_count; i++) {
+		levels[i].text = LOG_LEVEL_NONE;
+		levels[i].binary = LOG_LEVEL_NONE;
+		levels[i].textdynamic = false;
+		levels[i].binarydynamic = false;
+		levels[i].modules = false;
+	}
+
 	if (lcfg->channellist_count != 0) {
 		bytes = lcfg->channellist_count *
 			sizeof(ISC_LIST(isc_logchannellist_t));
 		memmove(lists, lcfg->channellists, bytes);
 		isc_mem_put(lctx->mctx, lcfg->channellists, bytes);
+
+		bytes = lcfg->channellist_count * sizeof(*levels);
+		memmove(levels, lcfg->levels, bytes);
+		isc_mem_put(lctx->mctx, lcfg->levels, bytes);
 	}
 
 	lcfg->channellists = lists;
+	lcfg->levels = levels;
 	lcfg->channellist_count = lctx->category_count;
 
 	return (ISC_R_SUCCESS);
@@ -1508,25 +1836,133 @@ isc_log_wouldlog(isc_log_t *lctx, int level) {
 		(lctx->logconfig->dynamic && level <= lctx->debug_level));
 }
 
+/*
+ * Decide, from the levels recorded for category 'id', whether
+ * something at 'level' could be written to a text or binary channel.
+ * This mirrors the way log_dispatch() and log_dispatchbinary() pick
+ * channels, and has the same caveats about unlocked access to the
+ * logconfig as isc_log_wouldlog().
+ */
+static bool
+log_wouldlog(isc_log_t *lctx, unsigned int id, int level, bool binary) {
+	isc_logconfig_t *lcfg = lctx->logconfig;
+	isc_loglevels_t *levels;
+
+	if (id >= lcfg->channellist_count ||
+	    ISC_LIST_EMPTY(lcfg->channellists[id]))
+	{
+		if (id != 0) {
+			return (log_wouldlog(lctx, 0, level, binary));
+		}
+
+		/*
+		 * Only the internal default channel, which is a text
+		 * channel.
+		 */
+		return (!binary && isc_log_wouldlog(lctx, level));
+	}
+
+	levels = &lcfg->levels[id];
+	if (binary) {
+		if (level <= levels->binary ||
+		    (levels->binarydynamic && level <= lctx->debug_level))
+		{
+			return (true);
+		}
+	} else {
+		if (level <= levels->text ||
+		    (levels->textdynamic && level <= lctx->debug_level))
+		{
+			return (true);
+		}
+	}
+
+	/*
+	 * Messages from modules which have no channels of their own fall
+	 * through to the default category.
+	 */
+	if (levels->modules) {
+		if (id != 0) {
+			return (log_wouldlog(lctx, 0, level, binary));
+		}
+		return (!binary && isc_log_wouldlog(lctx, level));
+	}
+
+	return (false);
+}
+
+bool
+isc_log_wouldlogtext(isc_log_t *lctx, isc_logcategory_t *category,
+		     int level)
+{
+	REQUIRE(category != NULL);
+
+	if (!isc_log_wouldlog(lctx, level))
+		return (false);
+
+	return (log_wouldlog(lctx, category->id, level, false));
+}
+
+bool
+isc_log_wouldlogbinary(isc_log_t *lctx, isc_logcategory_t *category,
+		       int level)
+{
+	REQUIRE(category != NULL);
+
+	if (lctx == NULL || lctx->logconfig == NULL)
+		return (false);
+
+	return (log_wouldlog(lctx, category->id, level, true));
+}
+
+void
+isc_log_writebinary(isc_log_t *lctx, isc_logcategory_t *category,
+		    isc_logmodule_t *module, int level,
+		    const void *data, unsigned int length)
+{
+#if defined(HAVE_TLS)
+	isc_logasync_t *async;
+#endif
+
+	REQUIRE(lctx == NULL || VALID_CONTEXT(lctx));
+	REQUIRE(category != NULL);
+	REQUIRE(module != NULL);
+	REQUIRE(level != ISC_LOG_DYNAMIC);
+	REQUIRE(data != NULL || length == 0);
+
+	if (lctx == NULL)
+		return;
+
+	REQUIRE(category->id < lctx->category_count);
+	REQUIRE(module->id < lctx->module_count);
+
+	if (! isc_log_wouldlogbinary(lctx, category, level))
+		return;
+
+#if defined(HAVE_TLS)
+	async = lctx->async;
+	if (async != NULL &&
+	    atomic_load_explicit(&async->enabled, memory_order_acquire) &&
+	    log_queue(async, category, module, level, false, true,
+		      data, length))
+	{
+		return;
+	}
+#endif
+
+	LOCK(&lctx->lock);
+	log_dispatchbinary(lctx, category, module, level, data, length);
+	UNLOCK(&lctx->lock);
+}
+
 static void
 isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 	     isc_logmodule_t *module, int level, bool write_once,
 	     const char *format, va_list args)
 {
-	int syslog_level;
-	const char *time_string;
-	char local_time[64];
-	char iso8601z_string[64];
-	char iso8601l_string[64];
-	char level_string[24] = { 0 };
-	struct stat statbuf;
-	bool matched = false;
-	bool printtime, iso8601, utc, printtag, printcolon;
-	bool printcategory, printmodule, printlevel, buffered;
-	isc_logconfig_t *lcfg;
-	isc_logchannel_t *channel;
-	isc_logchannellist_t *category_channels;
-	isc_result_t result;
+#if defined(HAVE_TLS)
+	isc_logasync_t *async;
+#endif
 
 	REQUIRE(lctx == NULL || VALID_CONTEXT(lctx));
 	REQUIRE(category != NULL);
@@ -1548,12 +1984,144 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 	if (! isc_log_wouldlog(lctx, level))
 		return;
 
+#if defined(HAVE_TLS)
+	/*
+	 * Critical messages are usually followed by the program exiting,
+	 * so they are written straight away, after anything that was
+	 * queued before them.
+	 */
+	async = lctx->async;
+	if (async != NULL &&
+	    atomic_load_explicit(&async->enabled, memory_order_acquire))
+	{
+		if (level > ISC_LOG_CRITICAL) {
+			log_enqueue(async, category, module, level,
+				    write_once, format, args);
+			return;
+		}
+		LOCK(&lctx->lock);
+		(void)log_drain(lctx);
+		log_dispatch(lctx, category, module, level, write_once,
+			     NULL, format, args);
+		UNLOCK(&lctx->lock);
+		return;
+	}
+#endif
+
+	LOCK(&lctx->lock);
+	log_dispatch(lctx, category, module, level, write_once,
+		     NULL, format, args);
+	UNLOCK(&lctx->lock);
+}
+
+/*
+ * Get a file channel ready to be written to, reopening the file if it
+ * was closed or has been rolled.  Returns false if nothing can be
+ * written to it now.
+ */
+static bool
+log_openfile(isc_logchannel_t *channel) {
+	struct stat statbuf;
+	isc_result_t result;
+
+	if (FILE_MAXREACHED(channel)) {
+		/*
+		 * If the file can be rolled, OR
+		 * If the file no longer exists, OR
+		 * If the file is less than the maximum size,
+		 *    (such as if it had been renamed and
+		 *     a new one touched, or it was truncated
+		 *     in place)
+		 * ... then close it to trigger reopening.
+		 */
+		if (FILE_VERSIONS(channel) != ISC_LOG_ROLLNEVER ||
+		    (stat(FILE_NAME(channel), &statbuf) != 0 &&
+		     errno == ENOENT) ||
+		    statbuf.st_size < FILE_MAXSIZE(channel)) {
+			(void)fclose(FILE_STREAM(channel));
+			FILE_STREAM(channel) = NULL;
+			FILE_MAXREACHED(channel) = false;
+		} else
+			/*
+			 * Eh, skip it.
+			 */
+			return (false);
+	}
+
+	if (FILE_STREAM(channel) == NULL) {
+		result = isc_log_open(channel);
+		if (result != ISC_R_SUCCESS &&
+		    result != ISC_R_MAXSIZE &&
+		    (channel->flags & ISC_LOG_OPENERR) == 0) {
+			syslog(LOG_ERR,
+			       "isc_log_open '%s' failed: %s",
+			       FILE_NAME(channel),
+			       isc_result_totext(result));
+			channel->flags |= ISC_LOG_OPENERR;
+		}
+		if (result != ISC_R_SUCCESS)
+			return (false);
+		channel->flags &= ~ISC_LOG_OPENERR;
+	}
+
+	return (true);
+}
+
+/*
+ * Finish writing to a file channel.
+ */
+static void
+log_wrotefile(isc_logchannel_t *channel) {
+	struct stat statbuf;
+
+	if ((channel->flags & ISC_LOG_BUFFERED) == 0)
+		fflush(FILE_STREAM(channel));
+
+	/*
+	 * If the file now exceeds its maximum size
+	 * threshold, note it so that it will not be logged
+	 * to any more.
+	 */
+	if (FILE_MAXSIZE(channel) > 0) {
+		INSIST(channel->type == ISC_LOG_TOFILE);
+
+		/* XXXDCL NT fstat/fileno */
+		/* XXXDCL complain if fstat fails? */
+		if (fstat(fileno(FILE_STREAM(channel)), &statbuf) >= 0 &&
+		    statbuf.st_size > FILE_MAXSIZE(channel))
+			FILE_MAXREACHED(channel) = true;
+	}
+}
+
+/*
+ * Send a message to the channels configured for its category and
+ * module.  If 'when' is not NULL, it is the time the message was
+ * logged; otherwise that is now.
+ *
+ * The log context must be locked.
+ */
+static void
+log_dispatch(isc_log_t *lctx, isc_logcategory_t *category,
+	     isc_logmodule_t *module, int level, bool write_once,
+	     const isc_time_t *when, const char *format, va_list args)
+{
+	int syslog_level;
+	const char *time_string;
+	char local_time[64];
+	char iso8601z_string[64];
+	char iso8601l_string[64];
+	char level_string[24] = { 0 };
+	bool matched = false;
+	bool printtime, iso8601, utc, printtag, printcolon;
+	bool printcategory, printmodule, printlevel;
+	isc_logconfig_t *lcfg;
+	isc_logchannel_t *channel;
+	isc_logchannellist_t *category_channels;
+
 	local_time[0] = '\0';
 	iso8601l_string[0] = '\0';
 	iso8601z_string[0] = '\0';
 
-	LOCK(&lctx->lock);
-
 	lctx->buffer[0] = '\0';
 
 	lcfg = lctx->logconfig;
@@ -1605,6 +2173,9 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 		    lctx->debug_level == 0)
 			continue;
 
+		if ((channel->flags & ISC_LOG_BINARY) != 0)
+			continue;
+
 		if (channel->level == ISC_LOG_DYNAMIC) {
 			if (lctx->debug_level < level)
 				continue;
@@ -1616,7 +2187,11 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 		{
 			isc_time_t isctime;
 
-			TIME_NOW(&isctime);
+			if (when != NULL) {
+				isctime = *when;
+			} else {
+				TIME_NOW(&isctime);
+			}
 
 			isc_time_formattimestamp(&isctime,
 						 local_time,
@@ -1718,10 +2293,8 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 					    == 0) {
 						/*
 						 * ... and it is a duplicate.
-						 * Unlock the mutex and
-						 * get the hell out of Dodge.
+						 * Get the hell out of Dodge.
 						 */
-						UNLOCK(&lctx->lock);
 						return;
 					}
 
@@ -1765,7 +2338,6 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 		printcategory = ((channel->flags & ISC_LOG_PRINTCATEGORY) != 0);
 		printmodule   = ((channel->flags & ISC_LOG_PRINTMODULE) != 0);
 		printlevel    = ((channel->flags & ISC_LOG_PRINTLEVEL) != 0);
-		buffered      = ((channel->flags & ISC_LOG_BUFFERED) != 0);
 
 		if (printtime) {
 			if (iso8601) {
@@ -1782,46 +2354,8 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 
 		switch (channel->type) {
 		case ISC_LOG_TOFILE:
-			if (FILE_MAXREACHED(channel)) {
-				/*
-				 * If the file can be rolled, OR
-				 * If the file no longer exists, OR
-				 * If the file is less than the maximum size,
-				 *    (such as if it had been renamed and
-				 *     a new one touched, or it was truncated
-				 *     in place)
-				 * ... then close it to trigger reopening.
-				 */
-				if (FILE_VERSIONS(channel) !=
-				    ISC_LOG_ROLLNEVER ||
-				    (stat(FILE_NAME(channel), &statbuf) != 0 &&
-				     errno == ENOENT) ||
-				    statbuf.st_size < FILE_MAXSIZE(channel)) {
-					(void)fclose(FILE_STREAM(channel));
-					FILE_STREAM(channel) = NULL;
-					FILE_MAXREACHED(channel) = false;
-				} else
-					/*
-					 * Eh, skip it.
-					 */
-					break;
-			}
-
-			if (FILE_STREAM(channel) == NULL) {
-				result = isc_log_open(channel);
-				if (result != ISC_R_SUCCESS &&
-				    result != ISC_R_MAXSIZE &&
-				    (channel->flags & ISC_LOG_OPENERR) == 0) {
-					syslog(LOG_ERR,
-					       "isc_log_open '%s' failed: %s",
-					       FILE_NAME(channel),
-					       isc_result_totext(result));
-					channel->flags |= ISC_LOG_OPENERR;
-				}
-				if (result != ISC_R_SUCCESS)
-					break;
-				channel->flags &= ~ISC_LOG_OPENERR;
-			}
+			if (!log_openfile(channel))
+				break;
 			/* FALLTHROUGH */
 
 		case ISC_LOG_TOFILEDESC:
@@ -1840,25 +2374,7 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 				printlevel    ? level_string	: "",
 				lctx->buffer);
 
-			if (!buffered)
-				fflush(FILE_STREAM(channel));
-
-			/*
-			 * If the file now exceeds its maximum size
-			 * threshold, note it so that it will not be logged
-			 * to any more.
-			 */
-			if (FILE_MAXSIZE(channel) > 0) {
-				INSIST(channel->type == ISC_LOG_TOFILE);
-
-				/* XXXDCL NT fstat/fileno */
-				/* XXXDCL complain if fstat fails? */
-				if (fstat(fileno(FILE_STREAM(channel)),
-					  &statbuf) >= 0 &&
-				    statbuf.st_size > FILE_MAXSIZE(channel))
-					FILE_MAXREACHED(channel) = true;
-			}
-
+			log_wrotefile(channel);
 			break;
 
 		case ISC_LOG_TOSYSLOG:
@@ -1892,6 +2408,470 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 		}
 
 	} while (1);
+}
+
+/*
+ * Write a binary record to the binary channels configured for its
+ * category and module, which are found the same way as in
+ * log_dispatch().
+ *
+ * The log context must be locked.
+ */
+static void
+log_dispatchbinary(isc_log_t *lctx, isc_logcategory_t *category,
+		   isc_logmodule_t *module, int level,
+		   const void *data, unsigned int length)
+{
+	bool matched = false;
+	isc_logconfig_t *lcfg;
+	isc_logchannel_t *channel;
+	isc_logchannellist_t *category_channels;
+
+	lcfg = lctx->logconfig;
+
+	category_channels = ISC_LIST_HEAD(lcfg->channellists[category->id]);
+
+	do {
+		if (category_channels == NULL && matched)
+			break;
+
+		if (category_channels == NULL && ! matched &&
+		    category_channels != ISC_LIST_HEAD(lcfg->channellists[0]))
+			category_channels =
+				ISC_LIST_HEAD(lcfg->channellists[0]);
 
+		/*
+		 * The internal default channel is a text channel.
+		 */
+		if (category_channels == NULL && ! matched)
+			break;
+
+		if (category_channels->module != NULL &&
+		    category_channels->module != module) {
+			category_channels = ISC_LIST_NEXT(category_channels,
+							  link);
+			continue;
+		}
+
+		matched = true;
+
+		channel = category_channels->channel;
+		category_channels = ISC_LIST_NEXT(category_channels, link);
+
+		if (((channel->flags & ISC_LOG_DEBUGONLY) != 0) &&
+		    lctx->debug_level == 0)
+			continue;
+
+		if ((channel->flags & ISC_LOG_BINARY) == 0)
+			continue;
+
+		if (channel->level == ISC_LOG_DYNAMIC) {
+			if (lctx->debug_level < level)
+				continue;
+		} else if (channel->level < level)
+			continue;
+
+		switch (channel->type) {
+		case ISC_LOG_TOFILE:
+			if (!log_openfile(channel))
+				break;
+			/* FALLTHROUGH */
+
+		case ISC_LOG_TOFILEDESC:
+			if (length > 0) {
+				(void)fwrite(data, length, 1,
+					     FILE_STREAM(channel));
+			}
+			log_wrotefile(channel);
+			break;
+
+		case ISC_LOG_TONULL:
+			break;
+		}
+	} while (1);
+}
+
+#if defined(HAVE_TLS)
+static void
+log_dispatchf(isc_log_t *lctx, isc_logcategory_t *category,
+	      isc_logmodule_t *module, int level, bool write_once,
+	      const isc_time_t *when, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	log_dispatch(lctx, category, module, level, write_once, when,
+		     format, args);
+	va_end(args);
+}
+
+/*
+ * Get the calling thread's ring.  If it doesn't have one yet, take over
+ * one whose thread has exited, or failing that create one.  Returns
+ * NULL if there are already too many rings.
+ */
+static isc_logring_t *
+log_getring(isc_logasync_t *async) {
+	isc_logring_t *ring;
+	unsigned int i, nrings, slot;
+
+	if (ISC_LIKELY(log_ringid == async->id)) {
+		return (log_ring);
+	}
+
+	/*
+	 * This thread may have a ring already, if it has logged through
+	 * another log context since it last used this one.
+	 */
+	ring = isc_thread_key_getspecific(async->key);
+
+	nrings = ISC_MIN(atomic_load_explicit(&async->nrings,
+					      memory_order_acquire),
+			 LOG_MAXRINGS);
+	for (i = 0; ring == NULL && i < nrings; i++) {
+		isc_logring_t *orphan;
+		bool owned = false;
+
+		orphan = (isc_logring_t *)atomic_load_explicit(
+				&async->rings[i], memory_order_acquire);
+		if (orphan != NULL &&
+		    atomic_compare_exchange_strong_explicit(
+				&orphan->owned, &owned, true,
+				memory_order_acquire, memory_order_relaxed))
+		{
+			ring = orphan;
+		}
+	}
+
+	if (ring == NULL) {
+		slot = atomic_fetch_add_explicit(&async->nrings, 1,
+						 memory_order_relaxed);
+		if (slot < LOG_MAXRINGS) {
+			ring = isc_mem_get(async->lctx->mctx, sizeof(*ring));
+			ring->size = atomic_load_explicit(&async->ringsize,
+							  memory_order_relaxed);
+			ring->buffer = isc_mem_get(async->lctx->mctx,
+						   ring->size);
+			atomic_init(&ring->head, 0);
+			atomic_init(&ring->tail, 0);
+			atomic_init(&ring->dropped, 0);
+			atomic_init(&ring->owned, true);
+			atomic_store_explicit(&async->rings[slot],
+					      (uintptr_t)ring,
+					      memory_order_release);
+		}
+	}
+
+	if (ring != NULL) {
+		RUNTIME_CHECK(isc_thread_key_setspecific(async->key,
+							 ring) == 0);
+	}
+
+	log_ring = ring;
+	log_ringid = async->id;
+
+	return (ring);
+}
+
+/*
+ * Called as the owner of 'ring' exits: let another thread have it.
+ * Anything still queued on it is written out as usual.
+ */
+static void
+log_ringexit(void *arg) {
+	isc_logring_t *ring = arg;
+
+	if (log_ring == ring) {
+		log_ring = NULL;
+		log_ringid = 0;
+	}
+	atomic_store_explicit(&ring->owned, false, memory_order_release);
+}
+
+/*
+ * Copy a message, or a binary record, onto the calling thread's ring
+ * for the writer thread.  If the ring is full, it is dropped.  Returns
+ * false if the calling thread has no ring (there are too many threads)
+ * and so has to write it out itself.
+ */
+static bool
+log_queue(isc_logasync_t *async, isc_logcategory_t *category,
+	  isc_logmodule_t *module, int level, bool write_once, bool binary,
+	  const void *data, size_t length)
+{
+	isc_logring_t *ring;
+	isc_logrecord_t *record;
+	uint_fast64_t head, tail;
+	size_t needed, offset, skip;
+
+	ring = log_getring(async);
+	if (ring == NULL) {
+		return (false);
+	}
+
+	needed = LOG_RECORD_ALIGN(sizeof(*record) + length);
+
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	offset = head & (ring->size - 1);
+	skip = (ring->size - offset < needed) ? ring->size - offset : 0;
+
+	if (skip + needed > ring->size - (head - tail)) {
+		atomic_fetch_add_explicit(&ring->dropped, 1,
+					  memory_order_relaxed);
+		return (true);
+	}
+
+	if (skip >= sizeof(*record)) {
+		record = (isc_logrecord_t *)(ring->buffer + offset);
+		record->length = skip;
+		record->category = NULL;
+	}
+	offset = (head + skip) & (ring->size - 1);
+
+	record = (isc_logrecord_t *)(ring->buffer + offset);
+	record->length = needed;
+	record->datalen = length;
+	record->level = level;
+	record->write_once = write_once;
+	record->binary = binary;
+	record->category = category;
+	record->module = module;
+	TIME_NOW(&record->time);
+	if (length > 0) {
+		memmove(record + 1, data, length);
+	}
+
+	/*
+	 * Publish the record, then wake the writer if it is asleep.
+	 * Both this and the writer's check of the rings before it goes
+	 * to sleep are sequentially consistent, so one of them will see
+	 * the other.
+	 */
+	atomic_store_explicit(&ring->head, head + skip + needed,
+			      memory_order_seq_cst);
+	if (atomic_load_explicit(&async->sleeping, memory_order_seq_cst)) {
+		LOCK(&async->lock);
+		SIGNAL(&async->cond);
+		UNLOCK(&async->lock);
+	}
+
+	return (true);
+}
+
+/*
+ * Format a message and queue it for the writer thread.
+ */
+static void
+log_enqueue(isc_logasync_t *async, isc_logcategory_t *category,
+	    isc_logmodule_t *module, int level, bool write_once,
+	    const char *format, va_list args)
+{
+	size_t length;
+	int n;
+
+	if (log_getring(async) == NULL) {
+		/*
+		 * Too many threads; this one has to log synchronously.
+		 */
+		LOCK(&async->lctx->lock);
+		log_dispatch(async->lctx, category, module, level,
+			     write_once, NULL, format, args);
+		UNLOCK(&async->lctx->lock);
+		return;
+	}
+
+	n = vsnprintf(log_buffer, sizeof(log_buffer), format, args);
+	if (n < 0) {
+		return;
+	}
+	length = ISC_MIN((size_t)n, sizeof(log_buffer) - 1);
+
+	(void)log_queue(async, category, module, level, write_once, false,
+			log_buffer, length + 1);
+}
+
+/*
+ * Write out the messages queued on a ring.
+ */
+static unsigned int
+log_drainring(isc_log_t *lctx, isc_logring_t *ring) {
+	isc_logrecord_t *record;
+	uint_fast64_t head, tail;
+	size_t offset;
+	unsigned int count = 0;
+
+	tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	while (tail != head) {
+		offset = tail & (ring->size - 1);
+		if (ring->size - offset < sizeof(*record)) {
+			tail += ring->size - offset;
+			continue;
+		}
+
+		record = (isc_logrecord_t *)(ring->buffer + offset);
+		if (record->category != NULL && record->binary) {
+			log_dispatchbinary(lctx, record->category,
+					   record->module, record->level,
+					   record + 1, record->datalen);
+			count++;
+		} else if (record->category != NULL) {
+			log_dispatchf(lctx, record->category, record->module,
+				      record->level, record->write_once,
+				      &record->time, "%s",
+				      (char *)(record + 1));
+			count++;
+		}
+		tail += record->length;
+
+		atomic_store_explicit(&ring->tail, tail,
+				      memory_order_release);
+	}
+
+	atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+	return (count);
+}
+
+/*
+ * Write out everything that has been queued, and report any messages
+ * that had to be dropped.
+ *
+ * The log context must be locked.
+ */
+static unsigned int
+log_drain(isc_log_t *lctx) {
+	isc_logasync_t *async = lctx->async;
+	isc_logring_t *ring;
+	unsigned int i, nrings, count = 0;
+	uint64_t dropped = 0;
+
+	nrings = ISC_MIN(atomic_load_explicit(&async->nrings,
+					      memory_order_acquire),
+			 LOG_MAXRINGS);
+	for (i = 0; i < nrings; i++) {
+		ring = (isc_logring_t *)atomic_load_explicit(
+				&async->rings[i], memory_order_acquire);
+		if (ring == NULL) {
+			continue;
+		}
+		count += log_drainring(lctx, ring);
+		dropped += atomic_load_explicit(&ring->dropped,
+						memory_order_relaxed);
+	}
+
+	if (dropped > async->reported) {
+		log_dispatchf(lctx, ISC_LOGCATEGORY_GENERAL,
+			      ISC_LOGMODULE_OTHER, ISC_LOG_WARNING, false,
+			      NULL, "log buffers full: %" PRIu64
+			      " messages dropped",
+			      dropped - async->reported);
+		async->reported = dropped;
+	}
+
+	return (count);
+}
+
+static bool
+log_pending(isc_logasync_t *async) {
+	isc_logring_t *ring;
+	unsigned int i, nrings;
+
+	nrings = ISC_MIN(atomic_load_explicit(&async->nrings,
+					      memory_order_seq_cst),
+			 LOG_MAXRINGS);
+	for (i = 0; i < nrings; i++) {
+		ring = (isc_logring_t *)atomic_load_explicit(
+				&async->rings[i], memory_order_seq_cst);
+		if (ring != NULL &&
+		    atomic_load_explicit(&ring->head, memory_order_seq_cst) !=
+		    atomic_load_explicit(&ring->tail, memory_order_relaxed))
+		{
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+static isc_threadresult_t
+log_writer(isc_threadarg_t arg) {
+	isc_logasync_t *async = arg;
+	isc_log_t *lctx = async->lctx;
+	isc_interval_t interval;
+	isc_time_t when;
+	unsigned int count;
+
+	isc_interval_set(&interval, 0, LOG_WRITER_NAPTIME);
+
+	for (;;) {
+		LOCK(&lctx->lock);
+		count = log_drain(lctx);
+		UNLOCK(&lctx->lock);
+
+		if (count > 0) {
+			continue;
+		}
+
+		LOCK(&async->lock);
+		if (async->shutdown) {
+			UNLOCK(&async->lock);
+			break;
+		}
+		atomic_store_explicit(&async->sleeping, true,
+				      memory_order_seq_cst);
+		if (!log_pending(async)) {
+			TIME_NOW(&when);
+			(void)isc_time_add(&when, &interval, &when);
+			(void)WAITUNTIL(&async->cond, &async->lock, &when);
+		}
+		atomic_store_explicit(&async->sleeping, false,
+				      memory_order_relaxed);
+		UNLOCK(&async->lock);
+	}
+
+	LOCK(&lctx->lock);
+	(void)log_drain(lctx);
 	UNLOCK(&lctx->lock);
+
+	return ((isc_threadresult_t)0);
+}
+
+static void
+log_async_destroy(isc_log_t *lctx) {
+	isc_logasync_t *async = lctx->async;
+	isc_logring_t *ring;
+	unsigned int i, nrings;
+
+	LOCK(&async->lock);
+	async->shutdown = true;
+	SIGNAL(&async->cond);
+	UNLOCK(&async->lock);
+
+	(void)isc_thread_join(async->thread, NULL);
+
+	lctx->async = NULL;
+
+	/*
+	 * No destructor can run for a thread that exits after this, so
+	 * the rings may be freed.
+	 */
+	(void)isc_thread_key_delete(async->key);
+
+	nrings = ISC_MIN(atomic_load(&async->nrings), LOG_MAXRINGS);
+	for (i = 0; i < nrings; i++) {
+		ring = (isc_logring_t *)atomic_load(&async->rings[i]);
+		if (ring == NULL) {
+			continue;
+		}
+		isc_mem_put(lctx->mctx, ring->buffer, ring->size);
+		isc_mem_put(lctx->mctx, ring, sizeof(*ring));
+	}
+
+	(void)isc_condition_destroy(&async->cond);
+	isc_mutex_destroy(&async->lock);
+	isc_mem_put(lctx->mctx, async, sizeof(*async));
 }
+#endif /* HAVE_TLS */
@@ -19,6 +19,7 @@
 #include <stddef.h>
 #include <limits.h>
 
+#include <isc/atomic.h>
 #include <isc/bind9.h>
 #include <isc/hash.h>
 #include <isc/json.h>
@@ -54,6 +55,10 @@ LIBISC_EXTERNAL_DATA unsigned int isc_mem_defaultflags = ISC_MEMFLAG_DEFAULT;
 #define NUM_BASIC_BLOCKS	64		/*%< must be > 1 */
 #define TABLE_INCREMENT		1024
 #define DEBUG_TABLE_COUNT	512U
+#define MEM_NCACHES		64		/*%< per-thread caches per context */
+#define MEM_MAGAZINE_MAX	32		/*%< max items in a magazine */
+#define MEM_MAGAZINE_BYTES	8192U		/*%< max bytes in a magazine */
+#define MEM_CACHE_MAXBYTES	65536U		/*%< max bytes in a cache */
 
 /*
  * Types.
@@ -103,6 +108,25 @@ struct stats {
 	unsigned long		freefrags;
 };
 
+/*%
+ * A magazine is a thread-private free list for one size class.
+ */
+typedef struct {
+	element *		items;
+	unsigned int		count;
+} magazine_t;
+
+/*%
+ * A per-thread cache of magazines, one per size class, for contexts
+ * using the internal allocator.  'busy' is set while a thread is using
+ * the cache; 'bytes' is the total size of the items held.
+ */
+typedef struct {
+	atomic_bool		busy;
+	size_t			bytes;
+	magazine_t *		magazines;
+} memcache_t;
+
 #define MEM_MAGIC		ISC_MAGIC('M', 'e', 'm', 'C')
 #define VALID_CONTEXT(c)	ISC_MAGIC_VALID(c, MEM_MAGIC)
 
@@ -155,6 +179,7 @@ struct isc__mem {
 	unsigned int		basic_table_size;
 	unsigned char *		lowest;
 	unsigned char *		highest;
+	atomic_uintptr_t	caches[MEM_NCACHES];
 
 #if ISC_MEM_TRACKLINES
 	debuglist_t *	 	debuglist;
@@ -182,6 +207,8 @@ struct isc__mempool {
 	unsigned int	freecount;	/*%< # of items on reserved list */
 	unsigned int	freemax;	/*%< # of items allowed on free list */
 	unsigned int	fillcount;	/*%< # of items to fetch on each fill */
+	/*%< per-thread caches, if threaded; created under 'lock' */
+	atomic_uintptr_t *caches;
 	/*%< Stats only. */
 	unsigned int	gets;		/*%< # of requests to this pool */
 	/*%< Debugging only. */
@@ -190,6 +217,23 @@ struct isc__mempool {
 #endif
 };
 
+/*%
+ * A per-thread free list for a threaded mempool.  Only the thread
+ * holding 'busy' touches 'items' or writes 'count' and 'gets'; the
+ * latter may be read by others for statistics.  The
+ * structure is padded so that caches of different threads do not
+ * share a cache line.
+ */
+typedef union {
+	struct {
+		atomic_bool		busy;
+		element *		items;
+		atomic_uint_fast32_t	count;
+		atomic_uint_fast32_t	gets;
+	} c;
+	char			pad[64];
+} poolcache_t;
+
 /*
  * Private Inline-able.
  */
@@ -218,6 +262,10 @@ print_active(isc__mem_t *ctx, FILE *out);
 
 #endif /* ISC_MEM_TRACKLINES */
 
+static void
+mempool_cachestats(const isc__mempool_t *mpctx, unsigned int *countp,
+		   unsigned int *getsp);
+
 static void *
 isc___mem_get(isc_mem_t *ctx, size_t size FLARG);
 static void
@@ -509,13 +557,14 @@ mem_getunlocked(isc__mem_t *ctx, size_t size) {
 
 
 	/*
-	 * The stats[] uses the _actual_ "size" requested by the
-	 * caller, with the caveat (in the code above) that "size" >= the
-	 * max. size (max_size) ends up getting recorded as a call to
-	 * max_size.
+	 * The stats[] uses the "rounded-up" size "new_size" as well, so
+	 * that items moved in bulk to and from the per-thread caches,
+	 * whose requested sizes are unknown, are accounted consistently.
+	 * "size" >= the max. size (max_size) ends up getting recorded as
+	 * a call to max_size.
 	 */
-	ctx->stats[size].gets++;
-	ctx->stats[size].totalgets++;
+	ctx->stats[new_size].gets++;
+	ctx->stats[new_size].totalgets++;
 	ctx->stats[new_size].freefrags--;
 	ctx->inuse += new_size;
 
@@ -577,13 +626,10 @@ mem_putunlocked(isc__mem_t *ctx, void *mem, size_t size) {
 	ctx->freelists[new_size] = (element *)mem;
 
 	/*
-	 * The stats[] uses the _actual_ "size" requested by the
-	 * caller, with the caveat (in the code above) that "size" >= the
-	 * max. size (max_size) ends up getting recorded as a call to
-	 * max_size.
+	 * See mem_getunlocked() for how stats[] is indexed.
 	 */
-	INSIST(ctx->stats[size].gets != 0U);
-	ctx->stats[size].gets--;
+	INSIST(ctx->stats[new_size].gets != 0U);
+	ctx->stats[new_size].gets--;
 	ctx->stats[new_size].freefrags++;
 	ctx->inuse -= new_size;
 }
@@ -677,6 +723,333 @@ mem_putstats(isc__mem_t *ctx, void *ptr, size_t size) {
 	ctx->malloced -= size;
 }
 
+/*!
+ * Update the overmem state after ctx->inuse has grown; returns true
+ * if the high water callback should be called.
+ */
+static inline bool
+mem_hiwater(isc__mem_t *ctx) {
+	bool call_water = false;
+
+	/* Require: we hold the context lock. */
+
+	if (ctx->hi_water != 0U && ctx->inuse > ctx->hi_water) {
+		ctx->is_overmem = true;
+		if (!ctx->hi_called)
+			call_water = true;
+	}
+	if (ctx->inuse > ctx->maxinuse) {
+		ctx->maxinuse = ctx->inuse;
+		if (ctx->hi_water != 0U && ctx->inuse > ctx->hi_water &&
+		    (isc_mem_debugging & ISC_MEM_DEBUGUSAGE) != 0)
+			fprintf(stderr, "maxinuse = %lu\n",
+				(unsigned long)ctx->inuse);
+	}
+
+	return (call_water);
+}
+
+/*!
+ * Update the overmem state after ctx->inuse has shrunk; returns true
+ * if the low water callback should be called.
+ */
+static inline bool
+mem_lowater(isc__mem_t *ctx) {
+	bool call_water = false;
+
+	/* Require: we hold the context lock. */
+
+	/*
+	 * The check against ctx->lo_water == 0 is for the condition
+	 * when the context was pushed over hi_water but then had
+	 * isc_mem_setwater() called with 0 for hi_water and lo_water.
+	 */
+	if ((ctx->inuse < ctx->lo_water) || (ctx->lo_water == 0U)) {
+		ctx->is_overmem = false;
+		if (ctx->hi_called)
+			call_water = true;
+	}
+
+	return (call_water);
+}
+
+/*
+ * Per-thread magazine caches.
+ *
+ * Contexts using the internal allocator have up to MEM_NCACHES caches,
+ * created on first use.  Each thread is assigned a cache slot the
+ * first time it allocates; if there are more threads than slots, slots
+ * are shared, and a thread that finds its cache busy simply takes the
+ * locked path.  isc___mem_get() and isc___mem_put() are served from
+ * the cache's magazine for the size class without taking the context
+ * lock.  An empty magazine is refilled from the shared free list, and
+ * an overfull one flushed back to it, in bulk under a single lock.
+ *
+ * Items held in magazines are accounted as in use: ctx->inuse and
+ * stats[] are only updated when items move between a magazine and the
+ * shared free lists.  This keeps the accounting consistent however an
+ * item is returned, at the cost of isc_mem_inuse() overstating the
+ * memory actually in use by at most MEM_CACHE_MAXBYTES per cache.  The
+ * water marks are likewise only checked on refill and flush.
+ */
+static atomic_uint_fast32_t mem_nextcacheid;
+
+#if defined(HAVE_TLS)
+#if defined(HAVE_THREAD_LOCAL)
+#include <threads.h>
+static thread_local int mem_cacheid = -1;
+#elif defined(HAVE___THREAD)
+static __thread int mem_cacheid = -1;
+#elif defined(HAVE___DECLSPEC_THREAD)
+static __declspec( thread ) int mem_cacheid = -1;
+#else
+#error "Unknown method for defining a TLS variable!"
+#endif
+
+static inline int
+cache_id(void) {
+	if (ISC_UNLIKELY(mem_cacheid < 0)) {
+		mem_cacheid = atomic_fetch_add_explicit(&mem_nextcacheid, 1,
+							memory_order_relaxed)
+			      % MEM_NCACHES;
+	}
+	return (mem_cacheid);
+}
+#else
+#define cache_id()	(-1)
+#endif
+
+static inline unsigned int
+magazine_capacity(size_t new_size) {
+	size_t capacity = MEM_MAGAZINE_BYTES / new_size;
+
+	if (capacity > MEM_MAGAZINE_MAX)
+		capacity = MEM_MAGAZINE_MAX;
+	if (capacity < 2)
+		capacity = 2;
+	return ((unsigned int)capacity);
+}
+
+static memcache_t *
+cache_create(isc__mem_t *ctx, int id) {
+	memcache_t *cache;
+	size_t size, nclasses;
+
+	nclasses = ctx->max_size / ALIGNMENT_SIZE + 1;
+	size = sizeof(*cache) + nclasses * sizeof(magazine_t);
+
+	LOCK(&ctx->lock);
+	cache = (memcache_t *)atomic_load_relaxed(&ctx->caches[id]);
+	if (cache == NULL) {
+		cache = (ctx->memalloc)(ctx->arg, size);
+		RUNTIME_CHECK(cache != NULL);
+		memset(cache, 0, size);
+		atomic_init(&cache->busy, false);
+		cache->bytes = 0;
+		cache->magazines = (magazine_t *)(cache + 1);
+		ctx->malloced += size;
+		if (ctx->malloced > ctx->maxmalloced)
+			ctx->maxmalloced = ctx->malloced;
+		atomic_store_explicit(&ctx->caches[id], (uintptr_t)cache,
+				      memory_order_release);
+	}
+	UNLOCK(&ctx->lock);
+
+	return (cache);
+}
+
+/*!
+ * Return the calling thread's cache for 'ctx', marked busy, or NULL if
+ * the locked path must be used.
+ */
+static inline memcache_t *
+cache_acquire(isc__mem_t *ctx) {
+	memcache_t *cache;
+	bool busy = false;
+	int id;
+
+	if ((ctx->flags & (ISC_MEMFLAG_INTERNAL|ISC_MEMFLAG_NOLOCK)) !=
+	    ISC_MEMFLAG_INTERNAL)
+		return (NULL);
+
+	/*
+	 * Tracing and recording need to see every get and put.
+	 */
+	if (ISC_UNLIKELY((isc_mem_debugging &
+			  (ISC_MEM_DEBUGTRACE|ISC_MEM_DEBUGRECORD)) != 0))
+		return (NULL);
+
+	id = cache_id();
+	if (id < 0)
+		return (NULL);
+
+	cache = (memcache_t *)atomic_load_explicit(&ctx->caches[id],
+						   memory_order_acquire);
+	if (ISC_UNLIKELY(cache == NULL))
+		cache = cache_create(ctx, id);
+
+	if (!atomic_compare_exchange_strong_explicit(&cache->busy, &busy,
+						     true,
+						     memory_order_acquire,
+						     memory_order_relaxed))
+		return (NULL);
+
+	return (cache);
+}
+
+static inline void
+cache_release(memcache_t *cache) {
+	atomic_store_explicit(&cache->busy, false, memory_order_release);
+}
+
+/*!
+ * Return all but 'keep' items of 'mag' to the shared free list.
+ */
+static void
+magazine_flushunlocked(isc__mem_t *ctx, memcache_t *cache, magazine_t *mag,
+		       size_t new_size, unsigned int keep)
+{
+	unsigned int n = 0;
+
+	/* Require: we hold the context lock. */
+
+	while (mag->count > keep) {
+		element *item = mag->items;
+
+		mag->items = item->next;
+		mag->count--;
+		item->next = ctx->freelists[new_size];
+		ctx->freelists[new_size] = item;
+		n++;
+	}
+
+	INSIST(ctx->stats[new_size].gets >= n);
+	ctx->stats[new_size].gets -= n;
+	ctx->stats[new_size].freefrags += n;
+	INSIST(ctx->inuse >= n * new_size);
+	ctx->inuse -= n * new_size;
+	cache->bytes -= n * new_size;
+}
+
+static inline void *
+cache_get(isc__mem_t *ctx, memcache_t *cache, size_t new_size,
+	  bool *call_water)
+{
+	magazine_t *mag = &cache->magazines[new_size / ALIGNMENT_SIZE];
+	element *item;
+
+	if (mag->items == NULL) {
+		unsigned int n, count;
+
+		count = magazine_capacity(new_size) / 2;
+		while (count > 1 &&
+		       cache->bytes + count * new_size > MEM_CACHE_MAXBYTES)
+			count /= 2;
+
+		LOCK(&ctx->lock);
+		for (n = 0; n < count; n++) {
+			if (ctx->freelists[new_size] == NULL &&
+			    !more_frags(ctx, new_size))
+				break;
+			item = ctx->freelists[new_size];
+			ctx->freelists[new_size] = item->next;
+			item->next = mag->items;
+			mag->items = item;
+		}
+		mag->count += n;
+		cache->bytes += n * new_size;
+		ctx->stats[new_size].gets += n;
+		ctx->stats[new_size].totalgets += n;
+		ctx->stats[new_size].freefrags -= n;
+		ctx->inuse += n * new_size;
+		*call_water = mem_hiwater(ctx);
+		UNLOCK(&ctx->lock);
+
+		if (mag->items == NULL)
+			return (NULL);
+	}
+
+	item = mag->items;
+	mag->items = item->next;
+	mag->count--;
+	cache->bytes -= new_size;
+
+	if (ISC_UNLIKELY((ctx->flags & ISC_MEMFLAG_FILL) != 0))
+		memset(item, 0xbe, new_size); /* Mnemonic for "beef". */
+
+	return (item);
+}
+
+static inline void
+cache_put(isc__mem_t *ctx, memcache_t *cache, void *mem, size_t size,
+	  size_t new_size, bool *call_water)
+{
+	magazine_t *mag = &cache->magazines[new_size / ALIGNMENT_SIZE];
+	unsigned int capacity;
+
+	if (ISC_UNLIKELY((ctx->flags & ISC_MEMFLAG_FILL) != 0)) {
+#if ISC_MEM_CHECKOVERRUN
+		check_overrun(mem, size, new_size);
+#endif
+		memset(mem, 0xde, new_size); /* Mnemonic for "dead". */
+	}
+#if !ISC_MEM_CHECKOVERRUN
+	UNUSED(size);
+#endif
+
+	((element *)mem)->next = mag->items;
+	mag->items = (element *)mem;
+	mag->count++;
+	cache->bytes += new_size;
+
+	/*
+	 * Flush half of an overfull magazine, or all of it if the cache
+	 * as a whole holds too much.
+	 */
+	capacity = magazine_capacity(new_size);
+	if (mag->count > capacity || cache->bytes > MEM_CACHE_MAXBYTES) {
+		LOCK(&ctx->lock);
+		magazine_flushunlocked(ctx, cache, mag, new_size,
+				       (cache->bytes > MEM_CACHE_MAXBYTES)
+					? 0 : capacity / 2);
+		*call_water = mem_lowater(ctx);
+		UNLOCK(&ctx->lock);
+	}
+}
+
+/*!
+ * Return everything held in the per-thread caches to the shared free
+ * lists, and free the caches.  Only safe when no other thread can be
+ * using the context.
+ */
+static void
+cache_destroyall(isc__mem_t *ctx) {
+	size_t nclasses = ctx->max_size / ALIGNMENT_SIZE + 1;
+	unsigned int i;
+	size_t j;
+
+	for (i = 0; i < MEM_NCACHES; i++) {
+		memcache_t *cache;
+
+		cache = (memcache_t *)atomic_load_relaxed(&ctx->caches[i]);
+		if (cache == NULL)
+			continue;
+		INSIST(!atomic_load_relaxed(&cache->busy));
+
+		for (j = 0; j < nclasses; j++) {
+			magazine_flushunlocked(ctx, cache,
+					       &cache->magazines[j],
+					       j * ALIGNMENT_SIZE, 0);
+		}
+		INSIST(cache->bytes == 0);
+
+		(ctx->memfree)(ctx->arg, cache);
+		ctx->malloced -= sizeof(*cache) +
+				 nclasses * sizeof(magazine_t);
+		atomic_store_relaxed(&ctx->caches[i], 0);
+	}
+}
+
 /*
  * Private.
  */
@@ -792,6 +1165,9 @@ isc_mem_createx(size_t init_max_size, size_t target_size,
 	ctx->basic_table_size = 0;
 	ctx->lowest = NULL;
 	ctx->highest = NULL;
+	for (unsigned int i = 0; i < MEM_NCACHES; i++) {
+		atomic_init(&ctx->caches[i], 0);
+	}
 
 	ctx->stats = (memalloc)(arg,
 				(ctx->max_size+1) * sizeof(struct stats));
@@ -842,6 +1218,8 @@ static void
 destroy(isc__mem_t *ctx) {
 	unsigned int i;
 
+	cache_destroyall(ctx);
+
 	LOCK(&contextslock);
 	ISC_LIST_UNLINK(contexts, ctx, link);
 	totallost += ctx->inuse;
@@ -1019,6 +1397,7 @@ isc_mem_destroy(isc_mem_t **ctxp) {
 void *
 isc___mem_get(isc_mem_t *ctx0, size_t size FLARG) {
 	isc__mem_t *ctx = (isc__mem_t *)ctx0;
+	memcache_t *cache;
 	void *ptr;
 	bool call_water = false;
 
@@ -1028,6 +1407,14 @@ isc___mem_get(isc_mem_t *ctx0, size_t size FLARG) {
 			  (ISC_MEM_DEBUGSIZE|ISC_MEM_DEBUGCTX)) != 0))
 		return (isc__mem_allocate(ctx0, size FLARG_PASS));
 
+	if (quantize(size) < ctx->max_size &&
+	    (cache = cache_acquire(ctx)) != NULL)
+	{
+		ptr = cache_get(ctx, cache, quantize(size), &call_water);
+		cache_release(cache);
+		goto water;
+	}
+
 	if ((ctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
 		MCTXLOCK(ctx, &ctx->lock);
 		ptr = mem_getunlocked(ctx, size);
@@ -1040,20 +1427,10 @@ isc___mem_get(isc_mem_t *ctx0, size_t size FLARG) {
 
 	ADD_TRACE(ctx, ptr, size, file, line);
 
-	if (ctx->hi_water != 0U && ctx->inuse > ctx->hi_water) {
-		ctx->is_overmem = true;
-		if (!ctx->hi_called)
-			call_water = true;
-	}
-	if (ctx->inuse > ctx->maxinuse) {
-		ctx->maxinuse = ctx->inuse;
-		if (ctx->hi_water != 0U && ctx->inuse > ctx->hi_water &&
-		    (isc_mem_debugging & ISC_MEM_DEBUGUSAGE) != 0)
-			fprintf(stderr, "maxinuse = %lu\n",
-				(unsigned long)ctx->inuse);
-	}
+	call_water = mem_hiwater(ctx);
 	MCTXUNLOCK(ctx, &ctx->lock);
 
+ water:
 	if (call_water && (ctx->water != NULL))
 		(ctx->water)(ctx->water_arg, ISC_MEM_HIWATER);
 
@@ -1063,6 +1440,7 @@ isc___mem_get(isc_mem_t *ctx0, size_t size FLARG) {
 void
 isc___mem_put(isc_mem_t *ctx0, void *ptr, size_t size FLARG) {
 	isc__mem_t *ctx = (isc__mem_t *)ctx0;
+	memcache_t *cache;
 	bool call_water = false;
 	size_info *si;
 	size_t oldsize;
@@ -1084,6 +1462,14 @@ isc___mem_put(isc_mem_t *ctx0, void *ptr, size_t size FLARG) {
 		return;
 	}
 
+	if (quantize(size) < ctx->max_size &&
+	    (cache = cache_acquire(ctx)) != NULL)
+	{
+		cache_put(ctx, cache, ptr, size, quantize(size), &call_water);
+		cache_release(cache);
+		goto water;
+	}
+
 	MCTXLOCK(ctx, &ctx->lock);
 
 	DELETE_TRACE(ctx, ptr, size, file, line);
@@ -1095,19 +1481,11 @@ isc___mem_put(isc_mem_t *ctx0, void *ptr, size_t size FLARG) {
 		mem_put(ctx, ptr, size);
 	}
 
-	/*
-	 * The check against ctx->lo_water == 0 is for the condition
-	 * when the context was pushed over hi_water but then had
-	 * isc_mem_setwater() called with 0 for hi_water and lo_water.
-	 */
-	if ((ctx->inuse < ctx->lo_water) || (ctx->lo_water == 0U)) {
-		ctx->is_overmem = false;
-		if (ctx->hi_called)
-			call_water = true;
-	}
+	call_water = mem_lowater(ctx);
 
 	MCTXUNLOCK(ctx, &ctx->lock);
 
+ water:
 	if (call_water && (ctx->water != NULL))
 		(ctx->water)(ctx->water_arg, ISC_MEM_LOWATER);
 }
@@ -1204,6 +1582,9 @@ isc_mem_stats(isc_mem_t *ctx0, FILE *out) {
 			"freemax", "fillcount", "gets", "L");
 	}
 	while (pool != NULL) {
+		unsigned int cached, gets;
+
+		mempool_cachestats(pool, &cached, &gets);
 		fprintf(out, "%15s %10lu %10u %10u %10u %10u %10u %10u %s\n",
 #if ISC_MEMPOOL_NAMES
 			pool->name,
@@ -1211,9 +1592,10 @@ isc_mem_stats(isc_mem_t *ctx0, FILE *out) {
 			"(not tracked)",
 #endif
 			(unsigned long) pool->size, pool->maxalloc,
-			pool->allocated, pool->freecount, pool->freemax,
-			pool->fillcount, pool->gets,
-			(pool->lock == NULL ? "N" : "Y"));
+			pool->allocated - cached, pool->freecount + cached,
+			pool->freemax, pool->fillcount, pool->gets + gets,
+			(pool->lock == NULL ? "N" : (pool->caches == NULL)
+						    ? "Y" : "T"));
 		pool = ISC_LIST_NEXT(pool, link);
 	}
 
@@ -1556,6 +1938,295 @@ isc_mem_gettag(isc_mem_t *ctx0) {
  * Memory pool stuff
  */
 
+/*
+ * Memory pools.
+ *
+ * A threaded pool (see isc_mempool_setthreaded()) keeps, in addition
+ * to the shared free list protected by the pool's lock, a small free
+ * list per thread, using the same thread slots as the memory context
+ * caches.  Gets and puts use the calling thread's list without locking;
+ * it is refilled from, and overflows into, the shared free list in
+ * batches.  Items on the per-thread lists count as allocated as far as
+ * 'maxalloc' is concerned, so the quota is only approximately enforced.
+ */
+
+/*!
+ * Put 'count' new items from the memory context on the pool's shared
+ * free list; returns the number actually added.
+ */
+static unsigned int
+mempool_fill(isc__mempool_t *mpctx, unsigned int count) {
+	isc__mem_t *mctx = mpctx->mctx;
+	element *item;
+	unsigned int i;
+
+	/* Require: we hold the pool lock. */
+
+	MCTXLOCK(mctx, &mctx->lock);
+	for (i = 0; i < count; i++) {
+		if ((mctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
+			item = mem_getunlocked(mctx, mpctx->size);
+		} else {
+			item = mem_get(mctx, mpctx->size);
+			if (item != NULL)
+				mem_getstats(mctx, mpctx->size);
+		}
+		if (ISC_UNLIKELY(item == NULL))
+			break;
+		item->next = mpctx->items;
+		mpctx->items = item;
+		mpctx->freecount++;
+	}
+	MCTXUNLOCK(mctx, &mctx->lock);
+
+	return (i);
+}
+
+/*!
+ * Return 'item' to the pool's shared free list, or to the memory
+ * context if the free list is full.
+ */
+static inline void
+mempool_putunlocked(isc__mempool_t *mpctx, element *item) {
+	isc__mem_t *mctx = mpctx->mctx;
+
+	/* Require: we hold the pool lock. */
+
+	if (mpctx->freecount >= mpctx->freemax) {
+		MCTXLOCK(mctx, &mctx->lock);
+		if ((mctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
+			mem_putunlocked(mctx, item, mpctx->size);
+		} else {
+			mem_putstats(mctx, item, mpctx->size);
+			mem_put(mctx, item, mpctx->size);
+		}
+		MCTXUNLOCK(mctx, &mctx->lock);
+		return;
+	}
+
+	mpctx->freecount++;
+	item->next = mpctx->items;
+	mpctx->items = item;
+}
+
+/*!
+ * The number of items a per-thread free list may hold.
+ */
+static inline unsigned int
+mempool_cachemax(isc__mempool_t *mpctx) {
+	unsigned int max = mpctx->fillcount * 2;
+
+	if (max > mpctx->freemax)
+		max = mpctx->freemax;
+	if (max < 1)
+		max = 1;
+	return (max);
+}
+
+/*!
+ * Return the calling thread's free list for 'mpctx', marked busy, or
+ * NULL if the shared free list must be used.
+ */
+static inline poolcache_t *
+mempool_cacheacquire(isc__mempool_t *mpctx) {
+	poolcache_t *cache;
+	bool busy = false;
+	int id;
+
+	if (mpctx->caches == NULL)
+		return (NULL);
+
+	id = cache_id();
+	if (id < 0)
+		return (NULL);
+
+	cache = (poolcache_t *)atomic_load_explicit(&mpctx->caches[id],
+						    memory_order_acquire);
+	if (ISC_UNLIKELY(cache == NULL)) {
+		LOCK(mpctx->lock);
+		cache = (poolcache_t *)atomic_load_relaxed(&mpctx->caches[id]);
+		if (cache == NULL) {
+			cache = isc_mem_get((isc_mem_t *)mpctx->mctx,
+					    sizeof(*cache));
+			RUNTIME_CHECK(cache != NULL);
+			atomic_init(&cache->c.busy, false);
+			cache->c.items = NULL;
+			atomic_init(&cache->c.count, 0);
+			atomic_init(&cache->c.gets, 0);
+			atomic_store_explicit(&mpctx->caches[id],
+					      (uintptr_t)cache,
+					      memory_order_release);
+		}
+		UNLOCK(mpctx->lock);
+	}
+
+	if (!atomic_compare_exchange_strong_explicit(&cache->c.busy, &busy,
+						     true,
+						     memory_order_acquire,
+						     memory_order_relaxed))
+		return (NULL);
+
+	return (cache);
+}
+
+static inline void
+mempool_cacherelease(poolcache_t *cache) {
+	atomic_store_explicit(&cache->c.busy, false, memory_order_release);
+}
+
+/*!
+ * When the pool is at its allocation limit, items held on the free
+ * lists of other threads are the only ones available: move them to
+ * 'cache', skipping any list that is in use.  Returns the number of
+ * items moved.
+ */
+static unsigned int
+mempool_cachesteal(isc__mempool_t *mpctx, poolcache_t *cache) {
+	unsigned int i, n = 0;
+
+	for (i = 0; i < MEM_NCACHES; i++) {
+		poolcache_t *victim;
+		bool busy = false;
+
+		victim = (poolcache_t *)
+			atomic_load_explicit(&mpctx->caches[i],
+					     memory_order_acquire);
+		if (victim == NULL || victim == cache ||
+		    atomic_load_relaxed(&victim->c.count) == 0)
+			continue;
+		if (!atomic_compare_exchange_strong_explicit(
+			    &victim->c.busy, &busy, true,
+			    memory_order_acquire, memory_order_relaxed))
+			continue;
+		n = atomic_load_relaxed(&victim->c.count);
+		atomic_store_relaxed(&victim->c.count, 0);
+		cache->c.items = victim->c.items;
+		victim->c.items = NULL;
+		mempool_cacherelease(victim);
+		if (n > 0)
+			break;
+	}
+
+	return (n);
+}
+
+static void *
+mempool_cacheget(isc__mempool_t *mpctx, poolcache_t *cache) {
+	element *item;
+	uint_fast32_t count = atomic_load_relaxed(&cache->c.count);
+
+	if (cache->c.items == NULL) {
+		unsigned int n = 0, want;
+
+		/*
+		 * Move up to 'fillcount' items from the shared free list,
+		 * filling that from the memory context first if needed.
+		 */
+		LOCK(mpctx->lock);
+		want = mpctx->fillcount;
+		if (want > mempool_cachemax(mpctx))
+			want = mempool_cachemax(mpctx);
+		if (mpctx->allocated >= mpctx->maxalloc)
+			want = 0;
+		else if (want > mpctx->maxalloc - mpctx->allocated)
+			want = mpctx->maxalloc - mpctx->allocated;
+		if (mpctx->freecount < want)
+			(void)mempool_fill(mpctx, want - mpctx->freecount);
+		while (n < want && mpctx->items != NULL) {
+			item = mpctx->items;
+			mpctx->items = item->next;
+			INSIST(mpctx->freecount > 0);
+			mpctx->freecount--;
+			item->next = cache->c.items;
+			cache->c.items = item;
+			n++;
+		}
+		mpctx->allocated += n;
+		UNLOCK(mpctx->lock);
+
+		count += n;
+		if (cache->c.items == NULL)
+			count = mempool_cachesteal(mpctx, cache);
+		if (cache->c.items == NULL) {
+			atomic_store_relaxed(&cache->c.count, count);
+			return (NULL);
+		}
+	}
+
+	item = cache->c.items;
+	cache->c.items = item->next;
+	atomic_store_relaxed(&cache->c.count, count - 1);
+	atomic_store_relaxed(&cache->c.gets,
+			     atomic_load_relaxed(&cache->c.gets) + 1);
+
+	return (item);
+}
+
+static void
+mempool_cacheput(isc__mempool_t *mpctx, poolcache_t *cache, void *mem) {
+	element *item = (element *)mem;
+	uint_fast32_t count = atomic_load_relaxed(&cache->c.count) + 1;
+	unsigned int max;
+
+	item->next = cache->c.items;
+	cache->c.items = item;
+
+	/*
+	 * If the list has overflowed, return half of it to the shared
+	 * free list.
+	 */
+	max = mempool_cachemax(mpctx);
+	if (count > max) {
+		unsigned int n = count - max / 2;
+
+		/*
+		 * Lower 'count' first, so that isc_mempool_getallocated()
+		 * can over- but never underestimate.
+		 */
+		atomic_store_relaxed(&cache->c.count, count - n);
+		LOCK(mpctx->lock);
+		while (n-- > 0) {
+			item = cache->c.items;
+			cache->c.items = item->next;
+			INSIST(mpctx->allocated > 0);
+			mpctx->allocated--;
+			mempool_putunlocked(mpctx, item);
+		}
+		UNLOCK(mpctx->lock);
+		return;
+	}
+
+	atomic_store_relaxed(&cache->c.count, count);
+}
+
+/*!
+ * Get the number of items held and the number of gets served by the
+ * per-thread free lists of 'mpctx'.  These may be slightly stale.
+ */
+static void
+mempool_cachestats(const isc__mempool_t *mpctx, unsigned int *countp,
+		   unsigned int *getsp)
+{
+	unsigned int i, count = 0, gets = 0;
+
+	if (mpctx->caches != NULL) {
+		for (i = 0; i < MEM_NCACHES; i++) {
+			poolcache_t *cache;
+
+			cache = (poolcache_t *)
+				atomic_load_explicit(&mpctx->caches[i],
+						     memory_order_acquire);
+			if (cache == NULL)
+				continue;
+			count += atomic_load_relaxed(&cache->c.count);
+			gets += atomic_load_relaxed(&cache->c.gets);
+		}
+	}
+
+	*countp = count;
+	*getsp = gets;
+}
+
 isc_result_t
 isc_mempool_create(isc_mem_t *mctx0, size_t size, isc_mempool_t **mpctxp) {
 	isc__mem_t *mctx = (isc__mem_t *)mctx0;
@@ -1588,6 +2259,7 @@ isc_mempool_create(isc_mem_t *mctx0, size_t size, isc_mempool_t **mpctxp) {
 	mpctx->freecount = 0;
 	mpctx->freemax = 1;
 	mpctx->fillcount = 1;
+	mpctx->caches = NULL;
 	mpctx->gets = 0;
 #if ISC_MEMPOOL_NAMES
 	mpctx->name[0] = 0;
@@ -1635,6 +2307,40 @@ isc_mempool_destroy(isc_mempool_t **mpctxp) {
 	REQUIRE(mpctxp != NULL);
 	mpctx = (isc__mempool_t *)*mpctxp;
 	REQUIRE(VALID_MEMPOOL(mpctx));
+
+	/*
+	 * Move everything on the per-thread free lists back to the
+	 * shared one; nothing else can be using the pool now.
+	 */
+	if (mpctx->caches != NULL) {
+		unsigned int i;
+
+		for (i = 0; i < MEM_NCACHES; i++) {
+			poolcache_t *cache;
+
+			cache = (poolcache_t *)
+				atomic_load_relaxed(&mpctx->caches[i]);
+			if (cache == NULL)
+				continue;
+			INSIST(!atomic_load_relaxed(&cache->c.busy));
+			while (cache->c.items != NULL) {
+				item = cache->c.items;
+				cache->c.items = item->next;
+				INSIST(mpctx->allocated > 0);
+				mpctx->allocated--;
+				mpctx->freecount++;
+				item->next = mpctx->items;
+				mpctx->items = item;
+			}
+			mpctx->gets += atomic_load_relaxed(&cache->c.gets);
+			isc_mem_put((isc_mem_t *)mpctx->mctx, cache,
+				    sizeof(*cache));
+		}
+		isc_mem_put((isc_mem_t *)mpctx->mctx, mpctx->caches,
+			    MEM_NCACHES * sizeof(mpctx->caches[0]));
+		mpctx->caches = NULL;
+	}
+
 #if ISC_MEMPOOL_NAMES
 	if (mpctx->allocated > 0)
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
@@ -1700,17 +2406,47 @@ isc_mempool_associatelock(isc_mempool_t *mpctx0, isc_mutex_t *lock) {
 	mpctx->lock = lock;
 }
 
+void
+isc_mempool_setthreaded(isc_mempool_t *mpctx0) {
+	isc__mempool_t *mpctx = (isc__mempool_t *)mpctx0;
+	atomic_uintptr_t *caches;
+	unsigned int i;
+
+	REQUIRE(VALID_MEMPOOL(mpctx));
+	REQUIRE(mpctx->lock != NULL);
+
+	caches = isc_mem_get((isc_mem_t *)mpctx->mctx,
+			     MEM_NCACHES * sizeof(caches[0]));
+	RUNTIME_CHECK(caches != NULL);
+	for (i = 0; i < MEM_NCACHES; i++) {
+		atomic_init(&caches[i], 0);
+	}
+
+	LOCK(mpctx->lock);
+	REQUIRE(mpctx->caches == NULL);
+	REQUIRE(mpctx->allocated == 0);
+	mpctx->caches = caches;
+	UNLOCK(mpctx->lock);
+}
+
 void *
 isc__mempool_get(isc_mempool_t *mpctx0 FLARG) {
 	isc__mempool_t *mpctx = (isc__mempool_t *)mpctx0;
+	poolcache_t *cache;
 	element *item;
 	isc__mem_t *mctx;
-	unsigned int i;
 
 	REQUIRE(VALID_MEMPOOL(mpctx));
 
 	mctx = mpctx->mctx;
 
+	cache = mempool_cacheacquire(mpctx);
+	if (cache != NULL) {
+		item = mempool_cacheget(mpctx, cache);
+		mempool_cacherelease(cache);
+		goto trace;
+	}
+
 	if (mpctx->lock != NULL)
 		LOCK(mpctx->lock);
 
@@ -1724,25 +2460,9 @@ isc__mempool_get(isc_mempool_t *mpctx0 FLARG) {
 
 	if (ISC_UNLIKELY(mpctx->items == NULL)) {
 		/*
-		 * We need to dip into the well.  Lock the memory context
-		 * here and fill up our free list.
+		 * We need to dip into the well and fill up our free list.
 		 */
-		MCTXLOCK(mctx, &mctx->lock);
-		for (i = 0; i < mpctx->fillcount; i++) {
-			if ((mctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
-				item = mem_getunlocked(mctx, mpctx->size);
-			} else {
-				item = mem_get(mctx, mpctx->size);
-				if (item != NULL)
-					mem_getstats(mctx, mpctx->size);
-			}
-			if (ISC_UNLIKELY(item == NULL))
-				break;
-			item->next = mpctx->items;
-			mpctx->items = item;
-			mpctx->freecount++;
-		}
-		MCTXUNLOCK(mctx, &mctx->lock);
+		(void)mempool_fill(mpctx, mpctx->fillcount);
 	}
 
 	/*
@@ -1762,6 +2482,7 @@ isc__mempool_get(isc_mempool_t *mpctx0 FLARG) {
 	if (mpctx->lock != NULL)
 		UNLOCK(mpctx->lock);
 
+ trace:
 #if ISC_MEM_TRACKLINES
 	if (ISC_UNLIKELY(((isc_mem_debugging & TRACE_OR_RECORD) != 0) &&
 			 item != NULL))
@@ -1779,52 +2500,42 @@ isc__mempool_get(isc_mempool_t *mpctx0 FLARG) {
 void
 isc__mempool_put(isc_mempool_t *mpctx0, void *mem FLARG) {
 	isc__mempool_t *mpctx = (isc__mempool_t *)mpctx0;
+	poolcache_t *cache;
 	isc__mem_t *mctx;
-	element *item;
 
 	REQUIRE(VALID_MEMPOOL(mpctx));
 	REQUIRE(mem != NULL);
 
 	mctx = mpctx->mctx;
 
-	if (mpctx->lock != NULL)
-		LOCK(mpctx->lock);
-
-	INSIST(mpctx->allocated > 0);
-	mpctx->allocated--;
-
 #if ISC_MEM_TRACKLINES
 	if (ISC_UNLIKELY((isc_mem_debugging & TRACE_OR_RECORD) != 0)) {
 		MCTXLOCK(mctx, &mctx->lock);
 		DELETE_TRACE(mctx, mem, mpctx->size, file, line);
 		MCTXUNLOCK(mctx, &mctx->lock);
 	}
+#else
+	UNUSED(mctx);
 #endif /* ISC_MEM_TRACKLINES */
 
-	/*
-	 * If our free list is full, return this to the mctx directly.
-	 */
-	if (mpctx->freecount >= mpctx->freemax) {
-		MCTXLOCK(mctx, &mctx->lock);
-		if ((mctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
-			mem_putunlocked(mctx, mem, mpctx->size);
-		} else {
-			mem_putstats(mctx, mem, mpctx->size);
-			mem_put(mctx, mem, mpctx->size);
-		}
-		MCTXUNLOCK(mctx, &mctx->lock);
-		if (mpctx->lock != NULL)
-			UNLOCK(mpctx->lock);
+	cache = mempool_cacheacquire(mpctx);
+	if (cache != NULL) {
+		mempool_cacheput(mpctx, cache, mem);
+		mempool_cacherelease(cache);
 		return;
 	}
 
+	if (mpctx->lock != NULL)
+		LOCK(mpctx->lock);
+
+	INSIST(mpctx->allocated > 0);
+	mpctx->allocated--;
+
 	/*
-	 * Otherwise, attach it to our free list and bump the counter.
+	 * Attach it to our free list, or return it to the mctx directly
+	 * if the free list is full.
 	 */
-	mpctx->freecount++;
-	item = (element *)mem;
-	item->next = mpctx->items;
-	mpctx->items = item;
+	mempool_putunlocked(mpctx, mem);
 
 	if (mpctx->lock != NULL)
 		UNLOCK(mpctx->lock);
@@ -1870,14 +2581,15 @@ isc_mempool_getfreemax(isc_mempool_t *mpctx0) {
 unsigned int
 isc_mempool_getfreecount(isc_mempool_t *mpctx0) {
 	isc__mempool_t *mpctx = (isc__mempool_t *)mpctx0;
-	unsigned int freecount;
+	unsigned int freecount, cached, gets;
 
 	REQUIRE(VALID_MEMPOOL(mpctx));
 
 	if (mpctx->lock != NULL)
 		LOCK(mpctx->lock);
 
-	freecount = mpctx->freecount;
+	mempool_cachestats(mpctx, &cached, &gets);
+	freecount = mpctx->freecount + cached;
 
 	if (mpctx->lock != NULL)
 		UNLOCK(mpctx->lock);
@@ -1923,14 +2635,19 @@ isc_mempool_getmaxalloc(isc_mempool_t *mpctx0) {
 unsigned int
 isc_mempool_getallocated(isc_mempool_t *mpctx0) {
 	isc__mempool_t *mpctx = (isc__mempool_t *)mpctx0;
-	unsigned int allocated;
+	unsigned int allocated, cached, gets;
 
 	REQUIRE(VALID_MEMPOOL(mpctx));
 
 	if (mpctx->lock != NULL)
 		LOCK(mpctx->lock);
 
-	allocated = mpctx->allocated;
+	/*
+	 * Items on the per-thread free lists are counted in
+	 * mpctx->allocated, but have not been handed out.
+	 */
+	mempool_cachestats(mpctx, &cached, &gets);
+	allocated = mpctx->allocated - cached;
 
 	if (mpctx->lock != NULL)
 		UNLOCK(mpctx->lock);
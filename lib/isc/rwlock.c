@@ -25,6 +25,7 @@
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/rwlock.h>
+#include <isc/time.h>
 #include <isc/util.h>
 
 #define RWLOCK_MAGIC		ISC_MAGIC('R', 'W', 'L', 'k')
@@ -65,6 +66,19 @@
 # define isc_rwlock_pause()
 #endif
 
+#ifndef RWLOCK_READER_SLOTBITS
+#define RWLOCK_READER_SLOTBITS 12
+#endif
+#define RWLOCK_READER_SLOTS (1U << RWLOCK_READER_SLOTBITS)
+
+#ifndef RWLOCK_BIAS_INHIBIT_FACTOR
+#define RWLOCK_BIAS_INHIBIT_FACTOR 9
+#endif
+
+#ifndef RWLOCK_BIAS_RECHECK
+#define RWLOCK_BIAS_RECHECK 64
+#endif
+
 static isc_result_t
 isc__rwlock_lock(isc_rwlock_t *rwl, isc_rwlocktype_t type);
 
@@ -107,6 +121,10 @@ isc_rwlock_init(isc_rwlock_t *rwl, unsigned int read_quota,
 	atomic_init(&rwl->cnt_and_flag, 0);
 	rwl->readers_waiting = 0;
 	rwl->write_granted = 0;
+	rwl->readerbias = false;
+	atomic_init(&rwl->rbias, false);
+	rwl->inhibit_until = 0;
+	atomic_init(&rwl->slowreads, 0);
 	if (read_quota != 0) {
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
 				 "read quota is not supported");
@@ -139,6 +157,185 @@ isc_rwlock_destroy(isc_rwlock_t *rwl) {
 	isc_mutex_destroy(&rwl->lock);
 }
 
+/*
+ * Reader bias, after "BRAVO - Biased Locking for Reader-Writer Locks"
+ * (Dice and Kogan, USENIX ATC 2019).
+ *
+ * visible_readers is a table of slots shared by all reader-biased
+ * locks.  While a lock's 'rbias' flag is set, a reader claims the slot
+ * selected by hashing its thread and the lock address by storing the
+ * lock address in it, and then rechecks 'rbias'.  If the flag is still
+ * set the reader holds the lock without touching the lock itself.
+ *
+ * A writer acquires the underlying lock as usual, which stops new slow
+ * path readers.  It then clears 'rbias' and waits until no slot holds
+ * the lock address any more.  The slot store and the 'rbias' recheck
+ * by readers, and the 'rbias' store and slot scan by writers, are
+ * sequentially consistent, so either the reader sees the revocation
+ * and backs out, or the writer sees the reader's slot and waits.
+ *
+ * Slow path readers turn the bias back on once 'inhibit_until' has
+ * passed, which is set by the revoking writer to a multiple of the
+ * time the revocation took.  Reading the clock costs about as much as
+ * the slow path itself, so it is only checked on every
+ * RWLOCK_BIAS_RECHECK'th slow path read.
+ *
+ * Read holds are interchangeable: if two threads hash to the same slot,
+ * one of them takes the slow path, and whichever unlocks first may
+ * release the slot while the other releases the slow path hold.
+ */
+static atomic_uintptr_t visible_readers[RWLOCK_READER_SLOTS];
+
+#if defined(HAVE_TLS)
+static atomic_uint_fast32_t rwlock_nextthreadid;
+
+#if defined(HAVE_THREAD_LOCAL)
+#include <threads.h>
+static thread_local int rwlock_threadid = -1;
+#elif defined(HAVE___THREAD)
+static __thread int rwlock_threadid = -1;
+#elif defined(HAVE___DECLSPEC_THREAD)
+static __declspec( thread ) int rwlock_threadid = -1;
+#else
+#error "Unknown method for defining a TLS variable!"
+#endif
+
+static inline uint32_t
+thread_id(void) {
+	if (ISC_UNLIKELY(rwlock_threadid < 0)) {
+		rwlock_threadid = atomic_fetch_add_explicit(
+					&rwlock_nextthreadid, 1,
+					memory_order_relaxed) & INT32_MAX;
+	}
+	return ((uint32_t)rwlock_threadid);
+}
+#else
+#define thread_id()	(0U)
+#endif
+
+static inline atomic_uintptr_t *
+reader_slot(isc_rwlock_t *rwl) {
+	uint64_t h;
+
+	h = (uint64_t)(uintptr_t)rwl ^ ((uint64_t)thread_id() << 32);
+	h *= UINT64_C(0x9e3779b97f4a7c15);
+	return (&visible_readers[h >> (64 - RWLOCK_READER_SLOTBITS)]);
+}
+
+static inline uint64_t
+now_ns(void) {
+	isc_time_t now;
+
+	TIME_NOW(&now);
+	return ((uint64_t)isc_time_seconds(&now) * 1000000000 +
+		isc_time_nanoseconds(&now));
+}
+
+static inline bool
+reader_fastlock(isc_rwlock_t *rwl) {
+	atomic_uintptr_t *slot;
+	uintptr_t expected = 0;
+
+	if (!rwl->readerbias ||
+	    !atomic_load_explicit(&rwl->rbias, memory_order_relaxed))
+	{
+		return (false);
+	}
+
+	slot = reader_slot(rwl);
+	if (!atomic_compare_exchange_strong_explicit(slot, &expected,
+						     (uintptr_t)rwl,
+						     memory_order_seq_cst,
+						     memory_order_relaxed))
+	{
+		return (false);
+	}
+	if (atomic_load_explicit(&rwl->rbias, memory_order_seq_cst))
+		return (true);
+
+	/* A writer revoked the bias, back out. */
+	atomic_store_explicit(slot, 0, memory_order_release);
+	return (false);
+}
+
+static inline bool
+reader_fastunlock(isc_rwlock_t *rwl) {
+	atomic_uintptr_t *slot;
+
+	if (!rwl->readerbias)
+		return (false);
+
+	slot = reader_slot(rwl);
+	if (atomic_load_explicit(slot, memory_order_relaxed) != (uintptr_t)rwl)
+		return (false);
+	atomic_store_explicit(slot, 0, memory_order_release);
+	return (true);
+}
+
+static inline void
+reader_slowlocked(isc_rwlock_t *rwl) {
+	/*
+	 * The caller holds a read lock, so no writer is revoking.
+	 */
+	if (rwl->readerbias &&
+	    !atomic_load_explicit(&rwl->rbias, memory_order_relaxed) &&
+	    atomic_fetch_add_explicit(&rwl->slowreads, 1,
+				      memory_order_relaxed) %
+	    RWLOCK_BIAS_RECHECK == RWLOCK_BIAS_RECHECK - 1 &&
+	    now_ns() >= rwl->inhibit_until)
+	{
+		atomic_store_explicit(&rwl->rbias, true, memory_order_relaxed);
+	}
+}
+
+static bool
+writer_revoke(isc_rwlock_t *rwl, bool wait) {
+	uint64_t start, end;
+	unsigned int i;
+	bool revoked = true;
+
+	/*
+	 * The caller holds the write lock.  If 'wait' is false, give up
+	 * as soon as a visible reader is found; the bias stays revoked.
+	 */
+	if (!rwl->readerbias ||
+	    !atomic_load_explicit(&rwl->rbias, memory_order_seq_cst))
+	{
+		return (true);
+	}
+
+	atomic_store_explicit(&rwl->rbias, false, memory_order_seq_cst);
+	start = now_ns();
+	for (i = 0; i < RWLOCK_READER_SLOTS && revoked; i++) {
+		while (atomic_load_explicit(&visible_readers[i],
+					    memory_order_seq_cst) ==
+		       (uintptr_t)rwl)
+		{
+			if (!wait) {
+				revoked = false;
+				break;
+			}
+			isc_rwlock_pause();
+		}
+	}
+	end = now_ns();
+	rwl->inhibit_until = end + (end - start) * RWLOCK_BIAS_INHIBIT_FACTOR;
+
+	return (revoked);
+}
+
+void
+isc_rwlock_setreaderbias(isc_rwlock_t *rwl) {
+	REQUIRE(VALID_RWLOCK(rwl));
+	REQUIRE(atomic_load_explicit(&rwl->cnt_and_flag,
+				     memory_order_relaxed) == 0);
+
+#if defined(HAVE_TLS)
+	rwl->readerbias = true;
+	atomic_store_explicit(&rwl->rbias, true, memory_order_relaxed);
+#endif
+}
+
 /*
  * When some architecture-dependent atomic operations are available,
  * rwlock can be more efficient than the generic algorithm defined below.
@@ -278,6 +475,8 @@ isc__rwlock_lock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 		 * matter).
 		 */
 		rwl->write_granted = 0;
+
+		reader_slowlocked(rwl);
 	} else {
 		int32_t prev_writer;
 
@@ -314,6 +513,8 @@ isc__rwlock_lock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 
 		INSIST((atomic_load_explicit(&rwl->cnt_and_flag, memory_order_relaxed) & WRITER_ACTIVE));
 		rwl->write_granted++;
+
+		(void)writer_revoke(rwl, true);
 	}
 
 #ifdef ISC_RWLOCK_TRACE
@@ -329,6 +530,9 @@ isc_rwlock_lock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 	int32_t max_cnt = rwl->spins * 2 + 10;
 	isc_result_t result = ISC_R_SUCCESS;
 
+	if (type == isc_rwlocktype_read && reader_fastlock(rwl))
+		return (ISC_R_SUCCESS);
+
 	if (max_cnt > RWLOCK_MAX_ADAPTIVE_COUNT)
 		max_cnt = RWLOCK_MAX_ADAPTIVE_COUNT;
 
@@ -356,6 +560,9 @@ isc_rwlock_trylock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 #endif
 
 	if (type == isc_rwlocktype_read) {
+		if (reader_fastlock(rwl))
+			return (ISC_R_SUCCESS);
+
 		/* If a writer is waiting or working, we fail. */
 		if (atomic_load_explicit(&rwl->write_requests, memory_order_relaxed) !=
 		    atomic_load_explicit(&rwl->write_completions, memory_order_relaxed))
@@ -387,6 +594,8 @@ isc_rwlock_trylock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 
 			return (ISC_R_LOCKBUSY);
 		}
+
+		reader_slowlocked(rwl);
 	} else {
 		/* Try locking without entering the waiting queue. */
 		int_fast32_t zero = 0;
@@ -405,6 +614,12 @@ isc_rwlock_trylock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 					  memory_order_relaxed);
 
 		rwl->write_granted++;
+
+		if (!writer_revoke(rwl, false)) {
+			/* Readers are still visible; don't wait for them. */
+			isc_rwlock_unlock(rwl, isc_rwlocktype_write);
+			return (ISC_R_LOCKBUSY);
+		}
 	}
 
 #ifdef ISC_RWLOCK_TRACE
@@ -418,6 +633,43 @@ isc_result_t
 isc_rwlock_tryupgrade(isc_rwlock_t *rwl) {
 	REQUIRE(VALID_RWLOCK(rwl));
 
+	/*
+	 * A read lock held through the reader table is first turned
+	 * into a normal one, unless a writer has already revoked the
+	 * bias and is waiting for it to be released.  Read holds are
+	 * interchangeable (see above), so it doesn't matter if the slot
+	 * was in fact taken by another thread holding a normal one.
+	 */
+	if (rwl->readerbias &&
+	    atomic_load_explicit(reader_slot(rwl), memory_order_relaxed) ==
+	    (uintptr_t)rwl)
+	{
+		int32_t cntflag;
+
+		cntflag = atomic_fetch_add_explicit(&rwl->cnt_and_flag,
+						    READER_INCR,
+						    memory_order_relaxed);
+		if ((cntflag & WRITER_ACTIVE) != 0) {
+			/* See isc_rwlock_trylock(). */
+			cntflag = atomic_fetch_sub_explicit(
+					&rwl->cnt_and_flag, READER_INCR,
+					memory_order_relaxed);
+			if (cntflag == READER_INCR &&
+			    atomic_load_explicit(&rwl->write_completions,
+						 memory_order_relaxed) !=
+			    atomic_load_explicit(&rwl->write_requests,
+						 memory_order_relaxed))
+			{
+				LOCK(&rwl->lock);
+				BROADCAST(&rwl->writeable);
+				UNLOCK(&rwl->lock);
+			}
+			return (ISC_R_LOCKBUSY);
+		}
+		atomic_store_explicit(reader_slot(rwl), 0,
+				      memory_order_release);
+	}
+
 	{
 		int_fast32_t reader_incr = READER_INCR;
 
@@ -444,6 +696,11 @@ isc_rwlock_tryupgrade(isc_rwlock_t *rwl) {
 
 	}
 
+	if (!writer_revoke(rwl, false)) {
+		isc_rwlock_downgrade(rwl);
+		return (ISC_R_LOCKBUSY);
+	}
+
 	return (ISC_R_SUCCESS);
 }
 
@@ -486,6 +743,13 @@ isc_rwlock_unlock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 #endif
 
 	if (type == isc_rwlocktype_read) {
+		if (reader_fastunlock(rwl)) {
+#ifdef ISC_RWLOCK_TRACE
+			print_lock("postunlock", rwl, type);
+#endif
+			return (ISC_R_SUCCESS);
+		}
+
 		prev_cnt = atomic_fetch_sub_explicit(&rwl->cnt_and_flag,
 						     READER_INCR,
 						     memory_order_relaxed);
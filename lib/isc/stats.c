@@ -13,6 +13,7 @@
 /*! \file */
 
 #include <inttypes.h>
+#include <limits.h>
 #include <string.h>
 
 #include <isc/atomic.h>
@@ -20,6 +21,7 @@
 #include <isc/magic.h>
 #include <isc/mem.h>
 #include <isc/platform.h>
+#include <isc/os.h>
 #include <isc/print.h>
 #include <isc/refcount.h>
 #include <isc/stats.h>
@@ -28,6 +30,12 @@
 #define ISC_STATS_MAGIC			ISC_MAGIC('S', 't', 'a', 't')
 #define ISC_STATS_VALID(x)		ISC_MAGIC_VALID(x, ISC_STATS_MAGIC)
 
+/*%
+ * Sharded statistics give each shard its own cache line aligned slab
+ * of counters.
+ */
+#define STATS_CACHELINE			64U
+
 typedef atomic_int_fast64_t isc_stat_t;
 
 struct isc_stats {
@@ -35,19 +43,86 @@ struct isc_stats {
 	isc_mem_t		*mctx;
 	isc_refcount_t		refs;
 	int			ncounters;
+	unsigned int		nshards;
+	int			stride;
+	size_t			size;
+	void			*base;
 	isc_stat_t		*counters;
 };
 
+static atomic_uint_fast32_t stats_nextshardid;
+
+#if defined(HAVE_TLS)
+#if defined(HAVE_THREAD_LOCAL)
+#include <threads.h>
+static thread_local int stats_shardid = -1;
+#elif defined(HAVE___THREAD)
+static __thread int stats_shardid = -1;
+#elif defined(HAVE___DECLSPEC_THREAD)
+static __declspec( thread ) int stats_shardid = -1;
+#else
+#error "Unknown method for defining a TLS variable!"
+#endif
+
+static inline unsigned int
+shard_id(void) {
+	if (ISC_UNLIKELY(stats_shardid < 0)) {
+		stats_shardid = atomic_fetch_add_explicit(&stats_nextshardid,
+							  1,
+							  memory_order_relaxed)
+				& INT_MAX;
+	}
+	return ((unsigned int)stats_shardid);
+}
+#else
+#define shard_id()	(0U)
+#endif
+
+static inline isc_stat_t *
+counter_ptr(isc_stats_t *stats, isc_statscounter_t counter) {
+	unsigned int shard = 0;
+
+	if (stats->nshards > 1)
+		shard = shard_id() % stats->nshards;
+	return (&stats->counters[shard * stats->stride + counter]);
+}
+
 static isc_result_t
-create_stats(isc_mem_t *mctx, int ncounters, isc_stats_t **statsp) {
+create_stats(isc_mem_t *mctx, int ncounters, unsigned int flags,
+	     isc_stats_t **statsp)
+{
 	isc_stats_t *stats;
+	uintptr_t align;
 
 	REQUIRE(statsp != NULL && *statsp == NULL);
 
 	stats = isc_mem_get(mctx, sizeof(*stats));
-	stats->counters = isc_mem_get(mctx, sizeof(isc_stat_t) * ncounters);
+	stats->nshards = 1;
+	stats->stride = ncounters;
+	stats->size = sizeof(isc_stat_t) * ncounters;
+	if ((flags & ISC_STATS_SHARDED) != 0) {
+		stats->nshards = isc_os_ncpus();
+		if (stats->nshards < 1)
+			stats->nshards = 1;
+	}
+	if (stats->nshards > 1) {
+		/*
+		 * Round each slab up to a whole number of cache lines,
+		 * and leave room to align the first one.
+		 */
+		stats->stride = (int)(ISC_ALIGN(sizeof(isc_stat_t) * ncounters,
+						STATS_CACHELINE) /
+				      sizeof(isc_stat_t));
+		stats->size = sizeof(isc_stat_t) * stats->stride *
+			      stats->nshards + STATS_CACHELINE;
+	}
+	stats->base = isc_mem_get(mctx, stats->size);
+	memset(stats->base, 0, stats->size);
+	align = (uintptr_t)stats->base;
+	if (stats->nshards > 1)
+		align = ISC_ALIGN(align, STATS_CACHELINE);
+	stats->counters = (isc_stat_t *)align;
 	isc_refcount_init(&stats->refs, 1);
-	memset(stats->counters, 0, sizeof(isc_stat_t) * ncounters);
 	stats->mctx = NULL;
 	isc_mem_attach(mctx, &stats->mctx);
 	stats->ncounters = ncounters;
@@ -76,8 +151,7 @@ isc_stats_detach(isc_stats_t **statsp) {
 	*statsp = NULL;
 
 	if (isc_refcount_decrement(&stats->refs) == 1) {
-		isc_mem_put(stats->mctx, stats->counters,
-			    sizeof(isc_stat_t) * stats->ncounters);
+		isc_mem_put(stats->mctx, stats->base, stats->size);
 		isc_mem_putanddetach(&stats->mctx, stats, sizeof(*stats));
 	}
 }
@@ -93,7 +167,16 @@ isc_result_t
 isc_stats_create(isc_mem_t *mctx, isc_stats_t **statsp, int ncounters) {
 	REQUIRE(statsp != NULL && *statsp == NULL);
 
-	return (create_stats(mctx, ncounters, statsp));
+	return (create_stats(mctx, ncounters, 0, statsp));
+}
+
+isc_result_t
+isc_stats_create2(isc_mem_t *mctx, isc_stats_t **statsp, int ncounters,
+		  unsigned int flags)
+{
+	REQUIRE(statsp != NULL && *statsp == NULL);
+
+	return (create_stats(mctx, ncounters, flags, statsp));
 }
 
 void
@@ -101,7 +184,7 @@ isc_stats_increment(isc_stats_t *stats, isc_statscounter_t counter) {
 	REQUIRE(ISC_STATS_VALID(stats));
 	REQUIRE(counter < stats->ncounters);
 
-	atomic_fetch_add_explicit(&stats->counters[counter], 1,
+	atomic_fetch_add_explicit(counter_ptr(stats, counter), 1,
 				  memory_order_relaxed);
 }
 
@@ -110,10 +193,23 @@ isc_stats_decrement(isc_stats_t *stats, isc_statscounter_t counter) {
 	REQUIRE(ISC_STATS_VALID(stats));
 	REQUIRE(counter < stats->ncounters);
 
-	atomic_fetch_sub_explicit(&stats->counters[counter], 1,
+	atomic_fetch_sub_explicit(counter_ptr(stats, counter), 1,
 				  memory_order_relaxed);
 }
 
+static inline uint64_t
+counter_value(isc_stats_t *stats, isc_statscounter_t counter) {
+	int_fast64_t value = 0;
+	unsigned int i;
+
+	for (i = 0; i < stats->nshards; i++) {
+		value += atomic_load_explicit(
+			&stats->counters[i * stats->stride + counter],
+			memory_order_relaxed);
+	}
+	return ((uint64_t)value);
+}
+
 void
 isc_stats_dump(isc_stats_t *stats, isc_stats_dumper_t dump_fn,
 	       void *arg, unsigned int options)
@@ -123,8 +219,7 @@ isc_stats_dump(isc_stats_t *stats, isc_stats_dumper_t dump_fn,
 	REQUIRE(ISC_STATS_VALID(stats));
 
 	for (i = 0; i < stats->ncounters; i++) {
-		uint32_t counter = atomic_load_explicit(&stats->counters[i],
-							memory_order_relaxed);
+		uint64_t counter = counter_value(stats, i);
 		if ((options & ISC_STATSDUMP_VERBOSE) == 0 && counter == 0) {
 			continue;
 		}
@@ -136,9 +231,16 @@ void
 isc_stats_set(isc_stats_t *stats, uint64_t val,
 	      isc_statscounter_t counter)
 {
+	unsigned int i;
+
 	REQUIRE(ISC_STATS_VALID(stats));
 	REQUIRE(counter < stats->ncounters);
 
 	atomic_store_explicit(&stats->counters[counter], val,
 			      memory_order_relaxed);
+	for (i = 1; i < stats->nshards; i++) {
+		atomic_store_explicit(
+			&stats->counters[i * stats->stride + counter], 0,
+			memory_order_relaxed);
+	}
 }
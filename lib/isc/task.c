@@ -50,6 +50,15 @@
  * To make load even some tasks (from task pools) are bound to specific
  * queues using isc_task_create_bound. This way load balancing between
  * CPUs/queues happens on the higher layer.
+ *
+ * When work stealing is enabled (isc_taskmgr_setworkstealing()), every
+ * worker additionally owns a bounded lock-free deque (Chase-Lev).  Unbound,
+ * unprivileged tasks made ready by a worker thread are pushed onto that
+ * worker's own deque instead of a locked ready queue, and a worker that
+ * runs out of work steals tasks from the top of the other workers' deques
+ * (and, opportunistically, unbound tasks from their ready queues) before
+ * going to sleep.  Bound tasks are never placed on a deque and are never
+ * stolen, so they keep their affinity.
  */
 
 #ifdef ISC_TASK_TRACE
@@ -102,6 +111,7 @@ struct isc__task {
 	unsigned int			flags;
 	isc_stdtime_t			now;
 	isc_time_t			tnow;
+	isc_time_t			readytime;	/* last made ready */
 	char				name[16];
 	void *				tag;
 	unsigned int			threadid;
@@ -123,6 +133,19 @@ struct isc__task {
 
 typedef ISC_LIST(isc__task_t)	isc__tasklist_t;
 
+/*%
+ * Size of the per-worker work-stealing deque; must be a power of two.
+ * When a deque is full, tasks overflow onto the locked ready queue.
+ */
+#define TASK_DEQUE_SIZE			256
+#define TASK_DEQUE_MASK			(TASK_DEQUE_SIZE - 1)
+
+typedef struct isc__taskdeque {
+	atomic_int_fast64_t		top;	/* Stolen from by other workers */
+	atomic_int_fast64_t		bottom;	/* Pushed/popped by owner */
+	atomic_uintptr_t		tasks[TASK_DEQUE_SIZE];
+} isc__taskdeque_t;
+
 struct isc__taskqueue {
 	/* Everything locked by lock */
 	isc_mutex_t			lock;
@@ -131,9 +154,28 @@ struct isc__taskqueue {
 	isc_condition_t			work_available;
 	isc_thread_t			thread;
 	unsigned int			threadid;
+	bool				sleeping;
 	isc__taskmgr_t			*manager;
+	/* Lock-free, see deque_push()/deque_pop()/deque_steal() */
+	isc__taskdeque_t		deque;
+	/* Updated only by this queue's worker, see count_run() */
+	atomic_uint_fast64_t		delay[ISC_TASKMGR_LATENCYBUCKETS];
+	atomic_uint_fast64_t		runtime[ISC_TASKMGR_LATENCYBUCKETS];
 };
 
+/*%
+ * Slow events are counted per task name in a small table; once it is
+ * full, the last entry collects the slow events of all other names.
+ */
+#define TASK_SLOW_NAMES			64
+
+typedef struct isc__taskslow {
+	char				name[16];
+	uint64_t			count;
+	uint64_t			total;
+	uint64_t			max;
+} isc__taskslow_t;
+
 struct isc__taskmgr {
 	/* Not locked. */
 	isc_taskmgr_t			common;
@@ -143,6 +185,7 @@ struct isc__taskmgr {
 	isc_condition_t			halt_cond;
 	unsigned int			workers;
 	atomic_uint_fast32_t		tasks_running;
+	atomic_uint_fast32_t		tasks_inline;
 	atomic_uint_fast32_t		tasks_ready;
 	atomic_uint_fast32_t		curq;
 	atomic_uint_fast32_t		tasks_count;
@@ -155,6 +198,8 @@ struct isc__taskmgr {
 	atomic_bool			pause_req;
 	atomic_bool			exclusive_req;
 	atomic_bool			exiting;
+	atomic_bool			stealing;
+	atomic_uint_fast32_t		idle_workers;
 
 	/* Locked by halt_lock */
 	unsigned int			halted;
@@ -166,6 +211,11 @@ struct isc__taskmgr {
 	 */
 	isc_mutex_t			excl_lock;
 	isc__task_t			*excl;
+
+	/* Locked by slow_lock */
+	isc_mutex_t			slow_lock;
+	unsigned int			nslow;
+	isc__taskslow_t			slow[TASK_SLOW_NAMES];
 };
 
 void
@@ -178,6 +228,30 @@ isc__taskmgr_resume(isc_taskmgr_t *manager0);
 #define FINISHED(m)	(atomic_load_relaxed(&((m)->exiting)) == true && \
 			 atomic_load(&(m)->tasks_count) == 0)
 
+/*
+ * The queue of the worker thread we are running on, if any; used to
+ * decide whether a task made ready can go onto the worker's own deque.
+ */
+#if defined(HAVE_TLS)
+#if defined(HAVE_THREAD_LOCAL)
+#include <threads.h>
+static thread_local isc__taskqueue_t *worker_queue = NULL;
+#elif defined(HAVE___THREAD)
+static __thread isc__taskqueue_t *worker_queue = NULL;
+#elif defined(HAVE___DECLSPEC_THREAD)
+static __declspec( thread ) isc__taskqueue_t *worker_queue = NULL;
+#else
+#error "Unknown method for defining a TLS variable!"
+#endif
+#define CURRENT_QUEUE(m)	((worker_queue != NULL && \
+				  worker_queue->manager == (m)) \
+				 ? worker_queue : NULL)
+#define SET_CURRENT_QUEUE(q)	(worker_queue = (q))
+#else
+#define CURRENT_QUEUE(m)	NULL
+#define SET_CURRENT_QUEUE(q)	UNUSED(q)
+#endif
+
 /*%
  * The following are intended for internal use (indicated by "isc__"
  * prefix) but are not declared as static, allowing direct access from
@@ -193,6 +267,9 @@ isc_taskmgr_excltask(isc_taskmgr_t *mgr0, isc_task_t **taskp);
 static inline bool
 empty_readyq(isc__taskmgr_t *manager, int c);
 
+static inline bool
+normal_mode(isc__taskmgr_t *manager);
+
 static inline isc__task_t *
 pop_readyq(isc__taskmgr_t *manager, int c);
 
@@ -202,6 +279,16 @@ push_readyq(isc__taskmgr_t *manager, isc__task_t *task, int c);
 static inline void
 wake_all_queues(isc__taskmgr_t *manager);
 
+static inline bool
+deque_push_ready(isc__taskmgr_t *manager, isc__taskqueue_t *queue,
+		 isc__task_t *task);
+
+static inline void
+wake_idle_queue(isc__taskmgr_t *manager, unsigned int threadid);
+
+static void
+count_slow(isc__taskmgr_t *manager, isc__task_t *task, uint64_t usec);
+
 /***
  *** Tasks.
  ***/
@@ -296,6 +383,7 @@ isc_task_create_bound(isc_taskmgr_t *manager0, unsigned int quantum,
 	task->flags = 0;
 	task->now = 0;
 	isc_time_settoepoch(&task->tnow);
+	isc_time_settoepoch(&task->readytime);
 	memset(task->name, 0, sizeof(task->name));
 	task->tag = NULL;
 	INIT_LINK(task, link);
@@ -362,6 +450,7 @@ task_shutdown(isc__task_t *task) {
 		if (task->state == task_state_idle) {
 			INSIST(EMPTY(task->events));
 			task->state = task_state_ready;
+			TIME_NOW(&task->readytime);
 			was_idle = true;
 		}
 		INSIST(task->state == task_state_ready ||
@@ -384,7 +473,8 @@ task_shutdown(isc__task_t *task) {
 }
 
 /*
- * Moves a task onto the appropriate run queue.
+ * Moves a task onto the appropriate run queue.  The caller set
+ * task->readytime under the task lock when it made the task ready.
  *
  * Caller must NOT hold manager lock.
  */
@@ -397,6 +487,23 @@ task_ready(isc__task_t *task) {
 	REQUIRE(task->state == task_state_ready);
 
 	XTRACE("task_ready");
+
+	/*
+	 * In work-stealing mode an unbound, unprivileged task made ready
+	 * by one of our own workers goes onto that worker's deque, where
+	 * idle workers can steal it.
+	 */
+	if (!task->bound && !has_privilege &&
+	    atomic_load_relaxed(&manager->stealing))
+	{
+		isc__taskqueue_t *queue = CURRENT_QUEUE(manager);
+
+		if (queue != NULL && deque_push_ready(manager, queue, task)) {
+			wake_idle_queue(manager, queue->threadid);
+			return;
+		}
+	}
+
 	LOCK(&manager->queues[task->threadid].lock);
 	push_readyq(manager, task, task->threadid);
 	if (atomic_load(&manager->mode) == isc_taskmgrmode_normal ||
@@ -429,6 +536,7 @@ task_detach(isc__task_t *task) {
 		 * loop to deal with shutting down and termination.
 		 */
 		task->state = task_state_ready;
+		TIME_NOW(&task->readytime);
 		return (true);
 	}
 
@@ -483,6 +591,7 @@ task_send(isc__task_t *task, isc_event_t **eventp, int c) {
 		task->threadid = c;
 		INSIST(EMPTY(task->events));
 		task->state = task_state_ready;
+		TIME_NOW(&task->readytime);
 	}
 	INSIST(task->state == task_state_ready ||
 	       task->state == task_state_running);
@@ -493,6 +602,58 @@ task_send(isc__task_t *task, isc_event_t **eventp, int c) {
 	return (was_idle);
 }
 
+static inline bool
+task_sendlist(isc__task_t *task, isc_eventlist_t *events, unsigned int n,
+	      int c)
+{
+	bool was_idle = false;
+
+	/*
+	 * Caller must be holding the task lock.
+	 */
+
+	REQUIRE(task->state != task_state_done);
+
+	XTRACE("task_sendlist");
+
+	if (task->state == task_state_idle) {
+		was_idle = true;
+		task->threadid = c;
+		INSIST(EMPTY(task->events));
+		task->state = task_state_ready;
+		TIME_NOW(&task->readytime);
+	}
+	INSIST(task->state == task_state_ready ||
+	       task->state == task_state_running);
+	APPENDLIST(task->events, *events, ev_link);
+	task->nevents += n;
+
+	return (was_idle);
+}
+
+static inline unsigned int
+eventlist_count(isc_eventlist_t *events) {
+	isc_event_t *event;
+	unsigned int n = 0;
+
+	/*
+	 * Validate and count the events on 'events'.  This is done
+	 * before the task lock is taken so that the time the lock is
+	 * held does not depend on the length of the list.
+	 */
+
+	for (event = HEAD(*events);
+	     event != NULL;
+	     event = NEXT(event, ev_link))
+	{
+		REQUIRE(event->ev_type > 0);
+		REQUIRE(!ISC_LINK_LINKED(event, ev_ratelink));
+		n++;
+	}
+
+	return (n);
+}
+
 void
 isc_task_send(isc_task_t *task0, isc_event_t **eventp) {
 	isc_task_sendto(task0, eventp, -1);
@@ -593,6 +754,211 @@ isc_task_sendtoanddetach(isc_task_t **taskp, isc_event_t **eventp, int c) {
 	*taskp = NULL;
 }
 
+void
+isc_task_sendlist(isc_task_t *task0, isc_eventlist_t *events) {
+	isc_task_sendtolist(task0, events, -1);
+}
+
+void
+isc_task_sendtolist(isc_task_t *task0, isc_eventlist_t *events, int c) {
+	isc__task_t *task = (isc__task_t *)task0;
+	unsigned int n;
+	bool was_idle;
+
+	/*
+	 * Send all the events on '*events' to 'task'.
+	 */
+
+	REQUIRE(VALID_TASK(task));
+	REQUIRE(events != NULL);
+	XTRACE("isc_task_sendlist");
+
+	n = eventlist_count(events);
+	if (n == 0)
+		return;
+
+	LOCK(&task->lock);
+	if (task->bound) {
+		c = task->threadid;
+	} else if (c < 0) {
+		c = atomic_fetch_add_explicit(&task->manager->curq, 1,
+					      memory_order_relaxed);
+	}
+	c %= task->manager->workers;
+	was_idle = task_sendlist(task, events, n, c);
+	UNLOCK(&task->lock);
+
+	/*
+	 * See isc_task_sendto() for why this is done after the task
+	 * lock has been released.
+	 */
+	if (was_idle)
+		task_ready(task);
+}
+
+void
+isc_task_sendtolistanddetach(isc_task_t **taskp, isc_eventlist_t *events,
+			     int c, unsigned int references)
+{
+	bool idle1 = false, idle2;
+	isc__task_t *task;
+	unsigned int n;
+
+	/*
+	 * Send all the events on '*events' to '*taskp' and then release
+	 * 'references' references to its task.
+	 */
+
+	REQUIRE(taskp != NULL);
+	task = (isc__task_t *)*taskp;
+	REQUIRE(VALID_TASK(task));
+	REQUIRE(events != NULL);
+	REQUIRE(references > 0);
+	XTRACE("isc_task_sendlistanddetach");
+
+	n = eventlist_count(events);
+
+	LOCK(&task->lock);
+	REQUIRE(task->references >= references);
+	if (n > 0) {
+		if (task->bound) {
+			c = task->threadid;
+		} else if (c < 0) {
+			c = atomic_fetch_add_explicit(&task->manager->curq, 1,
+						      memory_order_relaxed);
+		}
+		c %= task->manager->workers;
+		idle1 = task_sendlist(task, events, n, c);
+	}
+	/*
+	 * Only the last reference can make the task idle; drop the
+	 * others directly.
+	 */
+	task->references -= references - 1;
+	idle2 = task_detach(task);
+	UNLOCK(&task->lock);
+
+	/*
+	 * As in isc_task_sendtoanddetach(), idle1 and idle2 cannot both
+	 * be true.
+	 */
+	INSIST(!(idle1 && idle2));
+
+	if (idle1 || idle2)
+		task_ready(task);
+
+	*taskp = NULL;
+}
+
+/*
+ * An inline runner announces itself in 'tasks_inline' before checking
+ * for a pause or exclusive request, while isc_task_beginexclusive() and
+ * isc__taskmgr_pause() set their request before waiting for
+ * 'tasks_inline' to drop to zero, so at least one of the two sees the
+ * other.
+ */
+static void
+inline_done(isc__taskmgr_t *manager) {
+	if (atomic_fetch_sub(&manager->tasks_inline, 1) == 1 &&
+	    (atomic_load(&manager->exclusive_req) ||
+	     atomic_load(&manager->pause_req)))
+	{
+		LOCK(&manager->halt_lock);
+		BROADCAST(&manager->halt_cond);
+		UNLOCK(&manager->halt_lock);
+	}
+}
+
+void
+isc_task_sendinline(isc_task_t *task0, isc_event_t **eventp) {
+	isc__task_t *task = (isc__task_t *)task0;
+	isc__taskmgr_t *manager;
+	isc_event_t *event;
+	isc_time_t end;
+	bool finished = false;
+	bool was_idle = false;
+
+	REQUIRE(VALID_TASK(task));
+	REQUIRE(eventp != NULL);
+	event = *eventp;
+	REQUIRE(event != NULL);
+	REQUIRE(event->ev_type > 0);
+	REQUIRE(!ISC_LINK_LINKED(event, ev_ratelink));
+	XTRACE("isc_task_sendinline");
+
+	manager = task->manager;
+	if (CURRENT_QUEUE(manager) != NULL) {
+		isc_task_send(task0, eventp);
+		return;
+	}
+
+	atomic_fetch_add(&manager->tasks_inline, 1);
+	if (atomic_load(&manager->exclusive_req) ||
+	    atomic_load(&manager->pause_req) ||
+	    atomic_load(&manager->mode) != isc_taskmgrmode_normal)
+	{
+		inline_done(manager);
+		isc_task_send(task0, eventp);
+		return;
+	}
+
+	LOCK(&task->lock);
+	if (task->state != task_state_idle || TASK_SHUTTINGDOWN(task)) {
+		UNLOCK(&task->lock);
+		inline_done(manager);
+		isc_task_send(task0, eventp);
+		return;
+	}
+	INSIST(EMPTY(task->events));
+	task->state = task_state_running;
+	XTRACE("running inline");
+	TIME_NOW(&task->tnow);
+	task->now = isc_time_seconds(&task->tnow);
+	UNLOCK(&task->lock);
+
+	*eventp = NULL;
+	if (event->ev_action != NULL) {
+		(event->ev_action)((isc_task_t *)task, event);
+	}
+	TIME_NOW(&end);
+
+	/*
+	 * Leave the task as dispatch() would after running one event:
+	 * idle, done, or ready to run whatever was sent to it meanwhile.
+	 * There is no worker to charge the run time to, but a slow event
+	 * is still counted against the task's name.
+	 */
+	LOCK(&task->lock);
+	INSIST(task->state == task_state_running);
+	count_slow(manager, task, isc_time_microdiff(&end, &task->tnow));
+	if (task->references == 0 && EMPTY(task->events) &&
+	    !TASK_SHUTTINGDOWN(task))
+	{
+		(void)task_shutdown(task);
+	}
+	if (EMPTY(task->events)) {
+		if (task->references == 0 && TASK_SHUTTINGDOWN(task)) {
+			finished = true;
+			task->state = task_state_done;
+		} else {
+			task->state = task_state_idle;
+		}
+	} else {
+		task->state = task_state_ready;
+		task->readytime = end;
+		was_idle = true;
+	}
+	UNLOCK(&task->lock);
+
+	inline_done(manager);
+
+	if (finished) {
+		task_finished(task);
+	} else if (was_idle) {
+		task_ready(task);
+	}
+}
+
 #define PURGE_OK(event)	(((event)->ev_attributes & ISC_EVENTATTR_NOPURGE) == 0)
 
 static unsigned int
@@ -893,6 +1259,169 @@ isc_task_getcurrenttimex(isc_task_t *task0, isc_time_t *t) {
  *** Task Manager.
  ***/
 
+/*
+ * Work-stealing deque, after Chase and Lev, "Dynamic Circular Work-Stealing
+ * Deque" (SPAA 2005), using sequentially consistent operations on 'top' and
+ * 'bottom' so no explicit fences are needed.  Only the owning worker may
+ * call deque_push() and deque_pop(); any thread may call deque_steal().
+ * The deque never grows: deque_push() fails when it is full and the caller
+ * falls back to the locked ready queue.
+ */
+static inline bool
+deque_push(isc__taskdeque_t *deque, isc__task_t *task) {
+	int_fast64_t b = atomic_load_relaxed(&deque->bottom);
+	int_fast64_t t = atomic_load(&deque->top);
+
+	if (b - t >= TASK_DEQUE_SIZE) {
+		return (false);
+	}
+	atomic_store_relaxed(&deque->tasks[b & TASK_DEQUE_MASK],
+			     (uintptr_t)task);
+	atomic_store(&deque->bottom, b + 1);
+	return (true);
+}
+
+static inline isc__task_t *
+deque_pop(isc__taskdeque_t *deque) {
+	isc__task_t *task = NULL;
+	int_fast64_t b, t;
+
+	b = atomic_load_relaxed(&deque->bottom) - 1;
+	atomic_store(&deque->bottom, b);
+	t = atomic_load(&deque->top);
+	if (t <= b) {
+		task = (isc__task_t *)
+		       atomic_load_relaxed(&deque->tasks[b & TASK_DEQUE_MASK]);
+		if (t == b) {
+			/* Last element; race against thieves for it. */
+			if (!atomic_compare_exchange_strong(&deque->top,
+							    &t, t + 1))
+			{
+				task = NULL;
+			}
+			atomic_store(&deque->bottom, b + 1);
+		}
+	} else {
+		atomic_store(&deque->bottom, b + 1);
+	}
+
+	return (task);
+}
+
+static inline isc__task_t *
+deque_steal(isc__taskdeque_t *deque) {
+	isc__task_t *task;
+	int_fast64_t t = atomic_load(&deque->top);
+	int_fast64_t b = atomic_load(&deque->bottom);
+
+	if (t >= b) {
+		return (NULL);
+	}
+	task = (isc__task_t *)
+	       atomic_load_relaxed(&deque->tasks[t & TASK_DEQUE_MASK]);
+	if (!atomic_compare_exchange_strong(&deque->top, &t, t + 1)) {
+		return (NULL);
+	}
+	return (task);
+}
+
+static inline bool
+deque_empty(isc__taskdeque_t *deque) {
+	return (atomic_load(&deque->top) >= atomic_load(&deque->bottom));
+}
+
+/*
+ * Push a ready task onto 'queue''s deque.  The task is counted in
+ * 'tasks_ready' before it is pushed, as a thief may run it (and uncount
+ * it) as soon as it is on the deque.
+ */
+static inline bool
+deque_push_ready(isc__taskmgr_t *manager, isc__taskqueue_t *queue,
+		 isc__task_t *task)
+{
+	atomic_fetch_add_explicit(&manager->tasks_ready, 1,
+				  memory_order_acquire);
+	if (!deque_push(&queue->deque, task)) {
+		atomic_fetch_sub_explicit(&manager->tasks_ready, 1,
+					  memory_order_release);
+		return (false);
+	}
+	return (true);
+}
+
+/*
+ * Wake up one sleeping worker other than 'threadid' so that it can steal
+ * work that has just been pushed onto a deque.
+ */
+static inline void
+wake_idle_queue(isc__taskmgr_t *manager, unsigned int threadid) {
+	if (atomic_load(&manager->idle_workers) == 0) {
+		return;
+	}
+
+	for (unsigned int i = 1; i < manager->workers; i++) {
+		isc__taskqueue_t *queue =
+			&manager->queues[(threadid + i) % manager->workers];
+		bool woken = false;
+
+		LOCK(&queue->lock);
+		if (queue->sleeping) {
+			queue->sleeping = false;
+			SIGNAL(&queue->work_available);
+			woken = true;
+		}
+		UNLOCK(&queue->lock);
+		if (woken) {
+			return;
+		}
+	}
+}
+
+/*
+ * Try to take a runnable task away from another worker: first from the
+ * deques, then from the locked ready queues, which may only hold unbound,
+ * unprivileged tasks that were made ready outside of the worker threads.
+ * Bound and privileged tasks are never stolen.
+ *
+ * Caller must hold the lock of queue 'threadid', hence the trylock.
+ */
+static isc__task_t *
+steal_task(isc__taskmgr_t *manager, unsigned int threadid) {
+	isc__task_t *task = NULL;
+	unsigned int i;
+
+	for (i = 1; i < manager->workers && task == NULL; i++) {
+		isc__taskqueue_t *victim =
+			&manager->queues[(threadid + i) % manager->workers];
+		task = deque_steal(&victim->deque);
+	}
+
+	for (i = 1; i < manager->workers && task == NULL; i++) {
+		isc__taskqueue_t *victim =
+			&manager->queues[(threadid + i) % manager->workers];
+		isc__task_t *t;
+
+		if (isc_mutex_trylock(&victim->lock) != ISC_R_SUCCESS) {
+			continue;
+		}
+		for (t = HEAD(victim->ready_tasks);
+		     t != NULL;
+		     t = NEXT(t, ready_link))
+		{
+			if (!t->bound &&
+			    !ISC_LINK_LINKED(t, ready_priority_link))
+			{
+				DEQUEUE(victim->ready_tasks, t, ready_link);
+				task = t;
+				break;
+			}
+		}
+		UNLOCK(&victim->lock);
+	}
+
+	return (task);
+}
+
 /*
  * Return true if the current ready list for the manager, which is
  * either ready_tasks or the ready_priority_tasks, depending on whether
@@ -912,19 +1441,29 @@ empty_readyq(isc__taskmgr_t *manager, int c) {
 	return (EMPTY(queue));
 }
 
+static inline bool
+normal_mode(isc__taskmgr_t *manager) {
+	return (atomic_load_relaxed(&manager->mode) ==
+		isc_taskmgrmode_normal);
+}
+
 /*
  * Dequeue and return a pointer to the first task on the current ready
  * list for the manager.
  * If the task is privileged, dequeue it from the other ready list
- * as well.
+ * as well.  In normal mode, fall back to the worker's own deque.
  *
- * Caller must hold the task manager lock.
+ * Caller must hold the task manager lock, and must be the worker
+ * thread owning queue 'c'.
  */
 static inline isc__task_t *
 pop_readyq(isc__taskmgr_t *manager, int c) {
 	isc__task_t *task;
+	bool normal;
 
-	if (atomic_load_relaxed(&manager->mode) == isc_taskmgrmode_normal) {
+	normal = (atomic_load_relaxed(&manager->mode) ==
+		  isc_taskmgrmode_normal);
+	if (normal) {
 		task = HEAD(manager->queues[c].ready_tasks);
 	} else {
 		task = HEAD(manager->queues[c].ready_priority_tasks);
@@ -936,6 +1475,8 @@ pop_readyq(isc__taskmgr_t *manager, int c) {
 			DEQUEUE(manager->queues[c].ready_priority_tasks, task,
 				ready_priority_link);
 		}
+	} else if (normal) {
+		task = deque_pop(&manager->queues[c].deque);
 	}
 
 	return (task);
@@ -958,6 +1499,77 @@ push_readyq(isc__taskmgr_t *manager, isc__task_t *task, int c) {
 				  memory_order_acquire);
 }
 
+static inline unsigned int
+latency_bucket(uint64_t usec) {
+	unsigned int bucket = 0;
+
+	while (usec >= ((uint64_t)1 << bucket) &&
+	       bucket < ISC_TASKMGR_LATENCYBUCKETS - 1)
+	{
+		bucket++;
+	}
+	return (bucket);
+}
+
+/*
+ * Count an event of 'task' that ran for 'usec' microseconds against
+ * its name if it was slow.  Caller must hold the task lock.
+ */
+static void
+count_slow(isc__taskmgr_t *manager, isc__task_t *task, uint64_t usec) {
+	isc__taskslow_t *slow = NULL;
+	unsigned int i;
+
+	if (usec < ISC_TASKMGR_SLOWEVENT) {
+		return;
+	}
+
+	LOCK(&manager->slow_lock);
+	for (i = 0; i < manager->nslow; i++) {
+		if (strcmp(manager->slow[i].name, task->name) == 0) {
+			slow = &manager->slow[i];
+			break;
+		}
+	}
+	if (slow == NULL) {
+		if (manager->nslow < TASK_SLOW_NAMES) {
+			slow = &manager->slow[manager->nslow++];
+			slow->count = 0;
+			slow->total = 0;
+			slow->max = 0;
+			if (manager->nslow < TASK_SLOW_NAMES) {
+				strlcpy(slow->name, task->name,
+					sizeof(slow->name));
+			} else {
+				strlcpy(slow->name, "(other)",
+					sizeof(slow->name));
+			}
+		} else {
+			slow = &manager->slow[TASK_SLOW_NAMES - 1];
+		}
+	}
+	slow->count++;
+	slow->total += usec;
+	if (usec > slow->max) {
+		slow->max = usec;
+	}
+	UNLOCK(&manager->slow_lock);
+}
+
+/*
+ * Count an event action that ran for 'usec' microseconds on worker
+ * 'threadid'.  Caller must hold the task lock.
+ */
+static inline void
+count_run(isc__taskmgr_t *manager, unsigned int threadid, isc__task_t *task,
+	  uint64_t usec)
+{
+	atomic_fetch_add_explicit(
+		&manager->queues[threadid].runtime[latency_bucket(usec)], 1,
+		memory_order_relaxed);
+	count_slow(manager, task, usec);
+}
+
 static void
 dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 	isc__task_t *task;
@@ -1030,11 +1642,37 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 		 * If a pause has been requested, don't do any work
 		 * until it's been released.
 		 */
+		task = NULL;
 		while ((empty_readyq(manager, threadid) &&
+			(!normal_mode(manager) ||
+			 deque_empty(&manager->queues[threadid].deque)) &&
 			!atomic_load_relaxed(&manager->pause_req) &&
 			!atomic_load_relaxed(&manager->exclusive_req)) &&
 		       !FINISHED(manager))
 		{
+			bool stealing = atomic_load_relaxed(&manager->stealing);
+
+			/*
+			 * Announce that we are idle before the last attempt
+			 * to steal, so that a concurrent deque_push() either
+			 * is seen by steal_task() or sees us sleeping and
+			 * wakes us up.
+			 */
+			if (stealing) {
+				manager->queues[threadid].sleeping = true;
+				atomic_fetch_add(&manager->idle_workers, 1);
+				if (normal_mode(manager)) {
+					task = steal_task(manager, threadid);
+				}
+				if (task != NULL) {
+					manager->queues[threadid].sleeping =
+						false;
+					atomic_fetch_sub(&manager->idle_workers,
+							 1);
+					XTHREADTRACE("stole");
+					break;
+				}
+			}
 			XTHREADTRACE("wait");
 			XTHREADTRACE(atomic_load_relaxed(&manager->pause_req)
 				     ? "paused"
@@ -1044,12 +1682,21 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 				     : "notexcreq");
 			WAIT(&manager->queues[threadid].work_available,
 			     &manager->queues[threadid].lock);
+			if (stealing) {
+				manager->queues[threadid].sleeping = false;
+				atomic_fetch_sub(&manager->idle_workers, 1);
+			}
 			XTHREADTRACE("awake");
 		}
 		XTHREADTRACE("working");
 
-		if (atomic_load_relaxed(&manager->pause_req) ||
-		    atomic_load_relaxed(&manager->exclusive_req)) {
+		/*
+		 * A stolen task is run before honouring a pause or
+		 * exclusive request; see the comment below.
+		 */
+		if (task == NULL &&
+		    (atomic_load_relaxed(&manager->pause_req) ||
+		     atomic_load_relaxed(&manager->exclusive_req))) {
 			UNLOCK(&manager->queues[threadid].lock);
 			XTHREADTRACE("halting");
 
@@ -1083,13 +1730,16 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 			continue;
 		}
 
-		task = pop_readyq(manager, threadid);
+		if (task == NULL) {
+			task = pop_readyq(manager, threadid);
+		}
 		if (task != NULL) {
 			unsigned int dispatch_count = 0;
 			bool done = false;
 			bool requeue = false;
 			bool finished = false;
 			isc_event_t *event;
+			isc_time_t start, end;
 
 			INSIST(VALID_TASK(task));
 
@@ -1108,10 +1758,20 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 			LOCK(&task->lock);
 			INSIST(task->state == task_state_ready);
 			task->state = task_state_running;
+			if (!task->bound) {
+				/* It may have been stolen. */
+				task->threadid = threadid;
+			}
 			XTRACE("running");
 			XTRACE(task->name);
 			TIME_NOW(&task->tnow);
 			task->now = isc_time_seconds(&task->tnow);
+			atomic_fetch_add_explicit(
+				&manager->queues[threadid].delay[
+				    latency_bucket(isc_time_microdiff(
+					&task->tnow, &task->readytime))],
+				1, memory_order_relaxed);
+			start = task->tnow;
 			do {
 				if (!EMPTY(task->events)) {
 					event = HEAD(task->events);
@@ -1119,7 +1779,10 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 					task->nevents--;
 
 					/*
-					 * Execute the event action.
+					 * Execute the event action.  Each
+					 * action is timed from the end of
+					 * the previous one, so that only
+					 * one clock read is needed for each.
 					 */
 					XTRACE("execute action");
 					XTRACE(task->name);
@@ -1128,7 +1791,13 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 						(event->ev_action)(
 							(isc_task_t *)task,
 							event);
+						TIME_NOW(&end);
 						LOCK(&task->lock);
+						count_run(manager, threadid,
+							  task,
+							  isc_time_microdiff(
+								&end, &start));
+						start = end;
 					}
 					dispatch_count++;
 				}
@@ -1194,6 +1863,7 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 					 */
 					XTRACE("quantum");
 					task->state = task_state_ready;
+					task->readytime = start;
 					requeue = true;
 					done = true;
 				}
@@ -1206,6 +1876,24 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 			RUNTIME_CHECK(
 			      atomic_fetch_sub_explicit(&manager->tasks_running,
 						1, memory_order_release) > 0);
+
+			/*
+			 * In work-stealing mode an unbound task whose
+			 * quantum has expired goes back onto our deque, so
+			 * that an idle worker can pick it up.  This must
+			 * happen before we take our queue lock, as
+			 * wake_idle_queue() locks other queues.
+			 */
+			if (requeue && !task->bound &&
+			    (task->flags & TASK_F_PRIVILEGED) == 0 &&
+			    atomic_load_relaxed(&manager->stealing) &&
+			    deque_push_ready(manager,
+					     &manager->queues[threadid], task))
+			{
+				requeue = false;
+				wake_idle_queue(manager, threadid);
+			}
+
 			LOCK(&manager->queues[threadid].lock);
 			if (requeue) {
 				/*
@@ -1292,7 +1980,9 @@ run(void *queuep) {
 
 	XTHREADTRACE("starting");
 
+	SET_CURRENT_QUEUE(tq);
 	dispatch(manager, threadid);
+	SET_CURRENT_QUEUE(NULL);
 
 	XTHREADTRACE("exiting");
 
@@ -1310,6 +2000,7 @@ manager_free(isc__taskmgr_t *manager) {
 	}
 	isc_mutex_destroy(&manager->lock);
 	isc_mutex_destroy(&manager->halt_lock);
+	isc_mutex_destroy(&manager->slow_lock);
 	isc_mem_put(manager->mctx, manager->queues,
 		    manager->workers * sizeof(isc__taskqueue_t));
 	manager->common.impmagic = 0;
@@ -1321,7 +2012,7 @@ isc_result_t
 isc_taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 		    unsigned int default_quantum, isc_taskmgr_t **managerp)
 {
-	unsigned int i;
+	unsigned int i, j;
 	isc__taskmgr_t *manager;
 
 	/*
@@ -1339,6 +2030,8 @@ isc_taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 	manager->mctx = NULL;
 	isc_mutex_init(&manager->lock);
 	isc_mutex_init(&manager->excl_lock);
+	isc_mutex_init(&manager->slow_lock);
+	manager->nslow = 0;
 
 	isc_mutex_init(&manager->halt_lock);
 	isc_condition_init(&manager->halt_cond);
@@ -1355,9 +2048,12 @@ isc_taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 	RUNTIME_CHECK(manager->queues != NULL);
 
 	manager->tasks_running = 0;
+	atomic_init(&manager->tasks_inline, 0);
 	manager->tasks_ready = 0;
 	manager->curq = 0;
 	manager->exiting = false;
+	atomic_init(&manager->stealing, false);
+	atomic_init(&manager->idle_workers, 0);
 	manager->excl = NULL;
 	manager->halted = 0;
 	atomic_store_relaxed(&manager->exclusive_req, false);
@@ -1377,6 +2073,13 @@ isc_taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 
 		manager->queues[i].manager = manager;
 		manager->queues[i].threadid = i;
+		manager->queues[i].sleeping = false;
+		atomic_init(&manager->queues[i].deque.top, 0);
+		atomic_init(&manager->queues[i].deque.bottom, 0);
+		for (j = 0; j < ISC_TASKMGR_LATENCYBUCKETS; j++) {
+			atomic_init(&manager->queues[i].delay[j], 0);
+			atomic_init(&manager->queues[i].runtime[j], 0);
+		}
 		RUNTIME_CHECK(isc_thread_create(run, &manager->queues[i],
 						&manager->queues[i].thread)
 			      == ISC_R_SUCCESS);
@@ -1498,6 +2201,31 @@ isc_taskmgr_mode(isc_taskmgr_t *manager0) {
 	return (atomic_load(&manager->mode));
 }
 
+void
+isc_taskmgr_setworkstealing(isc_taskmgr_t *manager0, bool enable) {
+	isc__taskmgr_t *manager = (isc__taskmgr_t *)manager0;
+
+	REQUIRE(VALID_MANAGER(manager));
+
+	atomic_store(&manager->stealing, enable);
+	if (!enable) {
+		/*
+		 * Idle workers may be waiting on a deque that will
+		 * no longer be stolen from; let them re-evaluate.
+		 */
+		wake_all_queues(manager);
+	}
+}
+
+bool
+isc_taskmgr_workstealing(isc_taskmgr_t *manager0) {
+	isc__taskmgr_t *manager = (isc__taskmgr_t *)manager0;
+
+	REQUIRE(VALID_MANAGER(manager));
+
+	return (atomic_load(&manager->stealing));
+}
+
 void
 isc__taskmgr_pause(isc_taskmgr_t *manager0) {
 	isc__taskmgr_t *manager = (isc__taskmgr_t *)manager0;
@@ -1511,8 +2239,10 @@ isc__taskmgr_pause(isc_taskmgr_t *manager0) {
 		LOCK(&manager->halt_lock);
 	}
 
-	atomic_store_relaxed(&manager->pause_req, true);
-	while (manager->halted < manager->workers) {
+	atomic_store(&manager->pause_req, true);
+	while (manager->halted < manager->workers ||
+	       atomic_load(&manager->tasks_inline) > 0)
+	{
 		wake_all_queues(manager);
 		WAIT(&manager->halt_cond, &manager->halt_lock);
 	}
@@ -1588,8 +2318,10 @@ isc_task_beginexclusive(isc_task_t *task0) {
 	LOCK(&manager->halt_lock);
 	INSIST(!atomic_load_relaxed(&manager->exclusive_req) &&
 	       !atomic_load_relaxed(&manager->pause_req));
-	atomic_store_relaxed(&manager->exclusive_req, true);
-	while (manager->halted + 1 < manager->workers) {
+	atomic_store(&manager->exclusive_req, true);
+	while (manager->halted + 1 < manager->workers ||
+	       atomic_load(&manager->tasks_inline) > 0)
+	{
 		wake_all_queues(manager);
 		WAIT(&manager->halt_cond, &manager->halt_lock);
 	}
@@ -1654,6 +2386,55 @@ isc_task_privilege(isc_task_t *task0) {
 	return (priv);
 }
 
+uint64_t
+isc_taskmgr_latencylimit(unsigned int bucket) {
+	REQUIRE(bucket < ISC_TASKMGR_LATENCYBUCKETS);
+
+	if (bucket == ISC_TASKMGR_LATENCYBUCKETS - 1) {
+		return (0);
+	}
+	return ((uint64_t)1 << bucket);
+}
+
+void
+isc_taskmgr_dumplatency(isc_taskmgr_t *mgr0, isc_taskmgr_latencydump_t dump,
+			void *arg)
+{
+	isc__taskmgr_t *mgr = (isc__taskmgr_t *)mgr0;
+	uint64_t delay[ISC_TASKMGR_LATENCYBUCKETS];
+	uint64_t runtime[ISC_TASKMGR_LATENCYBUCKETS];
+	unsigned int i, j;
+
+	REQUIRE(VALID_MANAGER(mgr));
+
+	for (i = 0; i < mgr->workers; i++) {
+		for (j = 0; j < ISC_TASKMGR_LATENCYBUCKETS; j++) {
+			delay[j] = atomic_load_relaxed(
+					&mgr->queues[i].delay[j]);
+			runtime[j] = atomic_load_relaxed(
+					&mgr->queues[i].runtime[j]);
+		}
+		dump(i, delay, runtime, arg);
+	}
+}
+
+void
+isc_taskmgr_dumpslow(isc_taskmgr_t *mgr0, isc_taskmgr_slowdump_t dump,
+		     void *arg)
+{
+	isc__taskmgr_t *mgr = (isc__taskmgr_t *)mgr0;
+	unsigned int i;
+
+	REQUIRE(VALID_MANAGER(mgr));
+
+	LOCK(&mgr->slow_lock);
+	for (i = 0; i < mgr->nslow; i++) {
+		dump(mgr->slow[i].name, mgr->slow[i].count,
+		     mgr->slow[i].total, mgr->slow[i].max, arg);
+	}
+	UNLOCK(&mgr->slow_lock);
+}
+
 bool
 isc_task_exiting(isc_task_t *t) {
 	isc__task_t *task = (isc__task_t *)t;
@@ -1663,14 +2444,80 @@ isc_task_exiting(isc_task_t *t) {
 }
 
 
+#if defined(HAVE_LIBXML2) || defined(HAVE_JSON)
+/*
+ * Latency histogram buckets are named from their bounds, like the
+ * query latency counters: "LT16us" for bucket 4 and "GE4194304us" for
+ * the last.
+ */
+static void
+latency_name(unsigned int bucket, char *buf, size_t size) {
+	uint64_t limit = isc_taskmgr_latencylimit(bucket);
+
+	if (limit != 0) {
+		snprintf(buf, size, "LT%" PRIu64 "us", limit);
+	} else {
+		snprintf(buf, size, "GE%" PRIu64 "us",
+			 isc_taskmgr_latencylimit(bucket - 1));
+	}
+}
+
+/*
+ * Copy the slow event table, so that it can be rendered without
+ * holding the lock.
+ */
+static unsigned int
+copy_slow(isc__taskmgr_t *mgr, isc__taskslow_t *slow) {
+	unsigned int nslow;
+
+	LOCK(&mgr->slow_lock);
+	nslow = mgr->nslow;
+	memmove(slow, mgr->slow, nslow * sizeof(slow[0]));
+	UNLOCK(&mgr->slow_lock);
+
+	return (nslow);
+}
+#endif
+
 #ifdef HAVE_LIBXML2
 #define TRY0(a) do { xmlrc = (a); if (xmlrc < 0) goto error; } while(0)
+
+static int
+latency_renderxml(xmlTextWriterPtr writer, const char *type,
+		  atomic_uint_fast64_t *hist)
+{
+	char name[32];
+	unsigned int i;
+	int xmlrc;
+
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
+	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
+					 ISC_XMLCHAR type));
+	for (i = 0; i < ISC_TASKMGR_LATENCYBUCKETS; i++) {
+		latency_name(i, name, sizeof(name));
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counter"));
+		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "name",
+						 ISC_XMLCHAR name));
+		TRY0(xmlTextWriterWriteFormatString(writer, "%" PRIu64,
+				(uint64_t)atomic_load_relaxed(&hist[i])));
+		TRY0(xmlTextWriterEndElement(writer)); /* counter */
+	}
+	TRY0(xmlTextWriterEndElement(writer)); /* counters */
+
+ error:
+	return (xmlrc);
+}
+
 int
 isc_taskmgr_renderxml(isc_taskmgr_t *mgr0, xmlTextWriterPtr writer) {
 	isc__taskmgr_t *mgr = (isc__taskmgr_t *)mgr0;
 	isc__task_t *task = NULL;
+	isc__taskslow_t slow[TASK_SLOW_NAMES];
+	unsigned int i, nslow;
 	int xmlrc;
 
+	nslow = copy_slow(mgr, slow);
+
 	LOCK(&mgr->lock);
 
 	/*
@@ -1708,6 +2555,45 @@ isc_taskmgr_renderxml(isc_taskmgr_t *mgr0, xmlTextWriterPtr writer) {
 
 	TRY0(xmlTextWriterEndElement(writer)); /* thread-model */
 
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "queues"));
+	for (i = 0; i < mgr->workers; i++) {
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "queue"));
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "id"));
+		TRY0(xmlTextWriterWriteFormatString(writer, "%u", i));
+		TRY0(xmlTextWriterEndElement(writer)); /* id */
+		TRY0(latency_renderxml(writer, "delay",
+				       mgr->queues[i].delay));
+		TRY0(latency_renderxml(writer, "run",
+				       mgr->queues[i].runtime));
+		TRY0(xmlTextWriterEndElement(writer)); /* queue */
+	}
+	TRY0(xmlTextWriterEndElement(writer)); /* queues */
+
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "slow-events"));
+	for (i = 0; i < nslow; i++) {
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "task"));
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "name"));
+		TRY0(xmlTextWriterWriteFormatString(writer, "%s",
+						    slow[i].name));
+		TRY0(xmlTextWriterEndElement(writer)); /* name */
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "events"));
+		TRY0(xmlTextWriterWriteFormatString(writer, "%" PRIu64,
+						    slow[i].count));
+		TRY0(xmlTextWriterEndElement(writer)); /* events */
+		TRY0(xmlTextWriterStartElement(writer,
+					       ISC_XMLCHAR "total-usec"));
+		TRY0(xmlTextWriterWriteFormatString(writer, "%" PRIu64,
+						    slow[i].total));
+		TRY0(xmlTextWriterEndElement(writer)); /* total-usec */
+		TRY0(xmlTextWriterStartElement(writer,
+					       ISC_XMLCHAR "max-usec"));
+		TRY0(xmlTextWriterWriteFormatString(writer, "%" PRIu64,
+						    slow[i].max));
+		TRY0(xmlTextWriterEndElement(writer)); /* max-usec */
+		TRY0(xmlTextWriterEndElement(writer)); /* task */
+	}
+	TRY0(xmlTextWriterEndElement(writer)); /* slow-events */
+
 	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "tasks"));
 	task = ISC_LIST_HEAD(mgr->tasks);
 	while (task != NULL) {
@@ -1771,12 +2657,41 @@ isc_taskmgr_renderxml(isc_taskmgr_t *mgr0, xmlTextWriterPtr writer) {
 	} \
 } while(0)
 
+static isc_result_t
+latency_renderjson(json_object *queue, const char *type,
+		   atomic_uint_fast64_t *hist)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+	json_object *counters, *obj;
+	char name[32];
+	unsigned int i;
+
+	counters = json_object_new_object();
+	CHECKMEM(counters);
+	json_object_object_add(queue, type, counters);
+
+	for (i = 0; i < ISC_TASKMGR_LATENCYBUCKETS; i++) {
+		latency_name(i, name, sizeof(name));
+		obj = json_object_new_int64(atomic_load_relaxed(&hist[i]));
+		CHECKMEM(obj);
+		json_object_object_add(counters, name, obj);
+	}
+
+ error:
+	return (result);
+}
+
 isc_result_t
 isc_taskmgr_renderjson(isc_taskmgr_t *mgr0, json_object *tasks) {
 	isc_result_t result = ISC_R_SUCCESS;
 	isc__taskmgr_t *mgr = (isc__taskmgr_t *)mgr0;
 	isc__task_t *task = NULL;
 	json_object *obj = NULL, *array = NULL, *taskobj = NULL;
+	json_object *list;
+	isc__taskslow_t slow[TASK_SLOW_NAMES];
+	unsigned int i, nslow;
+
+	nslow = copy_slow(mgr, slow);
 
 	LOCK(&mgr->lock);
 
@@ -1808,6 +2723,57 @@ isc_taskmgr_renderjson(isc_taskmgr_t *mgr0, json_object *tasks) {
 	CHECKMEM(obj);
 	json_object_object_add(tasks, "tasks-ready", obj);
 
+	list = json_object_new_array();
+	CHECKMEM(list);
+	json_object_object_add(tasks, "queues", list);
+
+	for (i = 0; i < mgr->workers; i++) {
+		taskobj = json_object_new_object();
+		CHECKMEM(taskobj);
+		json_object_array_add(list, taskobj);
+
+		obj = json_object_new_int(i);
+		CHECKMEM(obj);
+		json_object_object_add(taskobj, "id", obj);
+
+		result = latency_renderjson(taskobj, "delay",
+					    mgr->queues[i].delay);
+		if (result != ISC_R_SUCCESS) {
+			goto error;
+		}
+		result = latency_renderjson(taskobj, "run",
+					    mgr->queues[i].runtime);
+		if (result != ISC_R_SUCCESS) {
+			goto error;
+		}
+	}
+
+	list = json_object_new_array();
+	CHECKMEM(list);
+	json_object_object_add(tasks, "slow-events", list);
+
+	for (i = 0; i < nslow; i++) {
+		taskobj = json_object_new_object();
+		CHECKMEM(taskobj);
+		json_object_array_add(list, taskobj);
+
+		obj = json_object_new_string(slow[i].name);
+		CHECKMEM(obj);
+		json_object_object_add(taskobj, "name", obj);
+
+		obj = json_object_new_int64(slow[i].count);
+		CHECKMEM(obj);
+		json_object_object_add(taskobj, "events", obj);
+
+		obj = json_object_new_int64(slow[i].total);
+		CHECKMEM(obj);
+		json_object_object_add(taskobj, "total-usec", obj);
+
+		obj = json_object_new_int64(slow[i].max);
+		CHECKMEM(obj);
+		json_object_object_add(taskobj, "max-usec", obj);
+	}
+
 	array = json_object_new_array();
 	CHECKMEM(array);
 
@@ -32,6 +32,7 @@
 #include <isc/util.h>
 #include <isc/print.h>
 #include <isc/string.h>
+#include <isc/time.h>
 
 #include <pk11/site.h>
 
@@ -155,12 +156,143 @@ isc_hash_initializer_test(void **state) {
 	assert_int_equal(h1, h2);
 }
 
+/* Keyed hash function test */
+static void
+isc_hash32_test(void **state) {
+	unsigned char lower[64], upper[64];
+	uint32_t h1, h2;
+	size_t i, len;
+
+	UNUSED(state);
+
+	for (i = 0; i < sizeof(lower); i++) {
+		lower[i] = 'a' + (i % 26);
+		upper[i] = 'A' + (i % 26);
+	}
+
+	/*
+	 * Every length exercises a different mix of the wide, word
+	 * and byte-at-a-time paths.
+	 */
+	for (len = 0; len <= sizeof(lower); len++) {
+		/* Immutability of hash function */
+		h1 = isc_hash32(lower, len, true);
+		h2 = isc_hash32(lower, len, true);
+		assert_int_equal(h1, h2);
+
+		/* Case */
+		h1 = isc_hash32(lower, len, false);
+		h2 = isc_hash32(upper, len, false);
+		assert_int_equal(h1, h2);
+
+		if (len == 0) {
+			continue;
+		}
+
+		/* Unequal */
+		h1 = isc_hash32(lower, len, true);
+		h2 = isc_hash32(upper, len, true);
+		assert_int_not_equal(h1, h2);
+
+		/* The length is part of the hash */
+		h1 = isc_hash32(lower, len, true);
+		h2 = isc_hash32(lower, len - 1, true);
+		assert_int_not_equal(h1, h2);
+	}
+
+	/* Only ASCII letters are folded */
+	h1 = isc_hash32("\x40\x5b\x60\x7b\xc1\xe1", 6, false);
+	h2 = isc_hash32("\x60\x7b\x40\x5b\xe1\xc1", 6, false);
+	assert_int_not_equal(h1, h2);
+	h1 = isc_hash32("\x40\x5b\xc1", 3, false);
+	h2 = isc_hash32("\x40\x5b\xc1", 3, true);
+	assert_int_equal(h1, h2);
+
+	/* The initializer carries the key */
+	h1 = isc_hash32("Hello world", 12, true);
+	isc_hash_set_initializer(isc_hash_get_initializer());
+	h2 = isc_hash32("Hello world", 12, true);
+	assert_int_equal(h1, h2);
+}
+
+#ifdef ISC_BENCHMARK_TESTS
+
+/*
+ * Compare the keyed hash with FNV on the kind of input they are used
+ * for: case-insensitive hashing of DNS names in wire format.
+ */
+
+#define BENCHMARK_ROUNDS	10000000
+
+static void
+isc_hash_benchmark_test(void **state) {
+	static const struct {
+		const char *name;
+		size_t length;
+	} names[] = {
+		{ TEST_INPUT("\003com\000") },
+		{ TEST_INPUT("\007example\003com\000") },
+		{ TEST_INPUT("\003WwW\007ExAmPlE\003CoM\000") },
+		{ TEST_INPUT("\004mail\005corp1\010internal\007example"
+			     "\003org\000") },
+		{ TEST_INPUT("\0011\0010\0010\003127\007in-addr\004arpa"
+			     "\000") },
+		{ TEST_INPUT("\077aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+			     "aaaaaaaaaaaaaaaaaaa\007example\003net\000") },
+	};
+	isc_time_t ts1, ts2;
+	isc_result_t result;
+	uint32_t h = 0;
+	double t;
+	size_t i, j;
+
+	UNUSED(state);
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		result = isc_time_now(&ts1);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		for (j = 0; j < BENCHMARK_ROUNDS; j++) {
+			h += isc_hash_function_reverse(names[i].name,
+						       names[i].length,
+						       false, NULL);
+		}
+		result = isc_time_now(&ts2);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		t = isc_time_microdiff(&ts2, &ts1);
+		printf("# %2zu bytes: isc_hash_function_reverse() "
+		       "%6.2f ns/call\n", names[i].length,
+		       t * 1000.0 / BENCHMARK_ROUNDS);
+
+		result = isc_time_now(&ts1);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		for (j = 0; j < BENCHMARK_ROUNDS; j++) {
+			h += isc_hash32(names[i].name, names[i].length,
+					false);
+		}
+		result = isc_time_now(&ts2);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		t = isc_time_microdiff(&ts2, &ts1);
+		printf("# %2zu bytes: isc_hash32()                "
+		       "%6.2f ns/call\n", names[i].length,
+		       t * 1000.0 / BENCHMARK_ROUNDS);
+	}
+
+	/* Keep the compiler from dropping the loops */
+	printf("# %08x\n", h);
+}
+
+#endif /* ISC_BENCHMARK_TESTS */
+
 int
 main(void) {
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(isc_hash_function_test),
 		cmocka_unit_test(isc_hash_function_reverse_test),
 		cmocka_unit_test(isc_hash_initializer_test),
+		cmocka_unit_test(isc_hash32_test),
+#ifdef ISC_BENCHMARK_TESTS
+		cmocka_unit_test(isc_hash_benchmark_test),
+#endif /* ISC_BENCHMARK_TESTS */
 	};
 
 	return (cmocka_run_group_tests(tests, NULL, NULL));
@@ -195,13 +195,12 @@ test_ht_full(int bits, uintptr_t count) {
 }
 
 static void
-test_ht_iterator() {
+test_ht_iterator(int bits, uintptr_t count) {
 	isc_ht_t *ht = NULL;
 	isc_result_t result;
 	isc_mem_t *mctx = NULL;
 	isc_ht_iter_t * iter = NULL;
 	uintptr_t i;
-	uintptr_t count = 10000;
 	uint32_t walked;
 	unsigned char key[16];
 	size_t tksize;
@@ -210,7 +209,7 @@ test_ht_iterator() {
 				 NULL, &mctx, 0);
 	assert_int_equal(result, ISC_R_SUCCESS);
 
-	result = isc_ht_init(&ht, mctx, 16);
+	result = isc_ht_init(&ht, mctx, bits);
 	assert_int_equal(result, ISC_R_SUCCESS);
 	assert_non_null(ht);
 	for (i = 1; i <= count; i++) {
@@ -315,6 +314,78 @@ test_ht_iterator() {
 	isc_mem_detach(&mctx);
 }
 
+static void
+test_ht_churn(int bits, uintptr_t count, int rounds) {
+	isc_ht_t *ht = NULL;
+	isc_result_t result;
+	isc_mem_t *mctx = NULL;
+	uintptr_t i;
+	int round;
+
+	result = isc_mem_createx(0, 0, default_memalloc, default_memfree,
+				 NULL, &mctx, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_ht_init(&ht, mctx, bits);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Keep 'count' entries in the table while repeatedly replacing
+	 * them, so that deleted slots pile up and force rehashes at the
+	 * same size, interleaved with the lookups.
+	 */
+	for (round = 0; round < rounds; round++) {
+		for (i = 0; i < count; i++) {
+			unsigned char key[16];
+			uintptr_t v = round * count + i;
+			void *f = NULL;
+
+			memset(key, 0, sizeof(key));
+			snprintf((char *)key, sizeof(key), "%u",
+				 (unsigned int)v);
+			result = isc_ht_add(ht, key, 16, (void *)v);
+			assert_int_equal(result, ISC_R_SUCCESS);
+
+			if (round == 0) {
+				continue;
+			}
+
+			memset(key, 0, sizeof(key));
+			snprintf((char *)key, sizeof(key), "%u",
+				 (unsigned int)(v - count));
+			result = isc_ht_find(ht, key, 16, &f);
+			assert_int_equal(result, ISC_R_SUCCESS);
+			assert_ptr_equal(f, (void *)(v - count));
+			result = isc_ht_delete(ht, key, 16);
+			assert_int_equal(result, ISC_R_SUCCESS);
+		}
+		assert_int_equal(isc_ht_count(ht), count);
+	}
+
+	for (i = 0; i < count; i++) {
+		unsigned char key[16];
+		uintptr_t v = (rounds - 1) * count + i;
+		void *f = NULL;
+
+		memset(key, 0, sizeof(key));
+		snprintf((char *)key, sizeof(key), "%u", (unsigned int)v);
+		result = isc_ht_find(ht, key, 16, &f);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		assert_ptr_equal(f, (void *)v);
+
+		memset(key, 0, sizeof(key));
+		snprintf((char *)key, sizeof(key), "%u",
+			 (unsigned int)(v - count));
+		result = isc_ht_find(ht, key, 16, NULL);
+		assert_int_equal(result, ISC_R_NOTFOUND);
+	}
+
+	isc_ht_destroy(&ht);
+	assert_null(ht);
+
+	isc_mem_detach(&mctx);
+}
+
 /* 20 bit, 200K elements test */
 static void
 isc_ht_20(void **state) {
@@ -337,11 +408,29 @@ isc_ht_1(void **state) {
 	test_ht_full(1, 100);
 }
 
+/* 4 bit, 1000 elements replaced 20 times */
+static void
+isc_ht_churn(void **state) {
+	UNUSED(state);
+	test_ht_churn(4, 1000, 20);
+}
+
 /* test hashtable iterator */
 static void
 isc_ht_iterator_test(void **state) {
 	UNUSED(state);
-	test_ht_iterator();
+	test_ht_iterator(16, 10000);
+}
+
+/*
+ * test hashtable iterator while a rehash is in progress: 800 entries
+ * grow a 4 bit table to 1024 slots and leave it part of the way
+ * through moving them into 2048
+ */
+static void
+isc_ht_iterator_rehash_test(void **state) {
+	UNUSED(state);
+	test_ht_iterator(4, 800);
 }
 
 int
@@ -350,7 +439,9 @@ main(void) {
 		cmocka_unit_test(isc_ht_20),
 		cmocka_unit_test(isc_ht_8),
 		cmocka_unit_test(isc_ht_1),
+		cmocka_unit_test(isc_ht_churn),
 		cmocka_unit_test(isc_ht_iterator_test),
+		cmocka_unit_test(isc_ht_iterator_rehash_test),
 	};
 
 	return (cmocka_run_group_tests(tests, NULL, NULL));
@@ -0,0 +1,481 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/log.h>
+#include <isc/mem.h>
+#include <isc/result.h>
+#include <isc/thread.h>
+#include <isc/util.h>
+
+#include "isctest.h"
+
+#define NTHREADS	4
+#define NMESSAGES	2000
+#define NONESHOTS	300	/* more than the number of rings */
+
+static isc_log_t *alctx = NULL;
+static FILE *output = NULL;
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+	isc_logconfig_t *logconfig = NULL;
+	isc_logdestination_t destination;
+
+	UNUSED(state);
+
+	result = isc_test_begin(NULL, false, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	output = tmpfile();
+	assert_non_null(output);
+
+	result = isc_log_create(mctx, &alctx, &logconfig);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	destination.file.stream = output;
+	destination.file.name = NULL;
+	destination.file.versions = ISC_LOG_ROLLNEVER;
+	destination.file.maximum_size = 0;
+	result = isc_log_createchannel(logconfig, "output",
+				       ISC_LOG_TOFILEDESC, ISC_LOG_INFO,
+				       &destination, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_log_usechannel(logconfig, "output", NULL, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	if (alctx != NULL) {
+		isc_log_destroy(&alctx);
+	}
+	if (output != NULL) {
+		fclose(output);
+		output = NULL;
+	}
+
+	isc_test_end();
+
+	return (0);
+}
+
+static isc_threadresult_t
+logger(isc_threadarg_t arg) {
+	uintptr_t id = (uintptr_t)arg;
+	unsigned int i;
+
+	for (i = 0; i < NMESSAGES; i++) {
+		isc_log_write(alctx, ISC_LOGCATEGORY_GENERAL,
+			      ISC_LOGMODULE_OTHER, ISC_LOG_INFO,
+			      "thread %u message %u %s", (unsigned int)id, i,
+			      "................................................"
+			      "................................................");
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+/*
+ * Read back what was written, checking that each thread's messages
+ * appear in the order they were logged, and return how many there
+ * were.
+ */
+static unsigned int
+readback(unsigned int *others) {
+	char line[1024];
+	unsigned int next[NTHREADS] = { 0 };
+	unsigned int id, n, count = 0;
+
+	*others = 0;
+	fflush(output);
+	rewind(output);
+	while (fgets(line, sizeof(line), output) != NULL) {
+		if (sscanf(line, "thread %u message %u", &id, &n) != 2) {
+			(*others)++;
+			continue;
+		}
+		assert_true(id < NTHREADS);
+		assert_true(n >= next[id]);
+		next[id] = n + 1;
+		count++;
+	}
+
+	return (count);
+}
+
+/*
+ * Add up the messages that the reports of dropped messages say were
+ * dropped, and count the reports.
+ */
+static uint64_t
+readdropped(unsigned int *reports) {
+	char line[1024];
+	uint64_t n, dropped = 0;
+
+	*reports = 0;
+	fflush(output);
+	rewind(output);
+	while (fgets(line, sizeof(line), output) != NULL) {
+		if (sscanf(line, "log buffers full: %" SCNu64, &n) == 1) {
+			dropped += n;
+			(*reports)++;
+		}
+	}
+
+	return (dropped);
+}
+
+/* messages logged from several threads are all written, in order */
+static void
+async_write_test(void **state) {
+	isc_result_t result;
+	isc_thread_t threads[NTHREADS];
+	unsigned int i, others;
+
+	UNUSED(state);
+
+	result = isc_log_setasync(alctx, true, 1024 * 1024);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		skip();
+	}
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < NTHREADS; i++) {
+		result = isc_thread_create(logger,
+					   (isc_threadarg_t)(uintptr_t)i,
+					   &threads[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		isc_thread_join(threads[i], NULL);
+	}
+
+	/*
+	 * The rings are large enough for everything; once turned off,
+	 * everything must have been written.
+	 */
+	result = isc_log_setasync(alctx, false, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	assert_int_equal(isc_log_getdropped(alctx), 0);
+	assert_int_equal(readback(&others), NTHREADS * NMESSAGES);
+	assert_int_equal(others, 0);
+}
+
+/* messages that don't fit are dropped, counted and reported */
+static void
+async_drop_test(void **state) {
+	isc_result_t result;
+	unsigned int count, others, reports;
+	uint64_t dropped;
+
+	UNUSED(state);
+
+	result = isc_log_setasync(alctx, true, 16 * 1024);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		skip();
+	}
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	(void)logger((isc_threadarg_t)0);
+
+	result = isc_log_setasync(alctx, false, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Every message was either written or dropped, and every one
+	 * that was dropped was reported, though the writer may have
+	 * done so more than once as it caught up.
+	 */
+	dropped = isc_log_getdropped(alctx);
+	count = readback(&others);
+	assert_int_equal(count + dropped, NMESSAGES);
+	assert_int_equal(readdropped(&reports), dropped);
+	assert_int_equal(reports, others);
+}
+
+/*
+ * Log one message from a thread which then exits.
+ */
+static isc_threadresult_t
+oneshot(isc_threadarg_t arg) {
+	isc_log_write(alctx, ISC_LOGCATEGORY_GENERAL, ISC_LOGMODULE_OTHER,
+		      ISC_LOG_INFO, "thread 0 message %u",
+		      (unsigned int)(uintptr_t)arg);
+
+	return ((isc_threadresult_t)0);
+}
+
+/* the ring of a thread that has exited is reused by the next one */
+static void
+async_reuse_test(void **state) {
+	isc_result_t result;
+	isc_thread_t thread;
+	unsigned int i, others;
+	size_t inuse = 0;
+
+	UNUSED(state);
+
+	result = isc_log_setasync(alctx, true, 16 * 1024);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		skip();
+	}
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Start more threads, one after another, than there can be
+	 * rings; the memory used must not grow after the first.
+	 */
+	for (i = 0; i < NONESHOTS; i++) {
+		result = isc_thread_create(oneshot,
+					   (isc_threadarg_t)(uintptr_t)i,
+					   &thread);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		isc_thread_join(thread, NULL);
+		if (i == 0) {
+			inuse = isc_mem_inuse(mctx);
+		}
+	}
+	assert_int_equal(isc_mem_inuse(mctx), inuse);
+
+	result = isc_log_setasync(alctx, false, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	assert_int_equal(isc_log_getdropped(alctx), 0);
+	assert_int_equal(readback(&others), NONESHOTS);
+	assert_int_equal(others, 0);
+}
+
+/* critical messages are written before isc_log_write() returns */
+static void
+async_critical_test(void **state) {
+	isc_result_t result;
+	unsigned int others;
+
+	UNUSED(state);
+
+	result = isc_log_setasync(alctx, true, 0);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		skip();
+	}
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	isc_log_write(alctx, ISC_LOGCATEGORY_GENERAL, ISC_LOGMODULE_OTHER,
+		      ISC_LOG_INFO, "thread 0 message 0");
+	isc_log_write(alctx, ISC_LOGCATEGORY_GENERAL, ISC_LOGMODULE_OTHER,
+		      ISC_LOG_CRITICAL, "critical");
+
+	assert_int_equal(readback(&others), 1);
+	assert_int_equal(others, 1);
+}
+
+/*
+ * Switch to a configuration in which the general category goes only
+ * to a binary channel writing to 'binout', and everything else to the
+ * text channel.
+ */
+static void
+usebinary(FILE *binout) {
+	isc_result_t result;
+	isc_logconfig_t *logconfig = NULL;
+	isc_logdestination_t destination;
+
+	result = isc_logconfig_create(alctx, &logconfig);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	destination.file.stream = output;
+	destination.file.name = NULL;
+	destination.file.versions = ISC_LOG_ROLLNEVER;
+	destination.file.maximum_size = 0;
+	result = isc_log_createchannel(logconfig, "output",
+				       ISC_LOG_TOFILEDESC, ISC_LOG_INFO,
+				       &destination, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_log_usechannel(logconfig, "output",
+				    ISC_LOGCATEGORY_DEFAULT, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	destination.file.stream = binout;
+	result = isc_log_createchannel(logconfig, "binary",
+				       ISC_LOG_TOFILEDESC, ISC_LOG_INFO,
+				       &destination, ISC_LOG_BINARY);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_log_usechannel(logconfig, "binary",
+				    ISC_LOGCATEGORY_GENERAL, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_logconfig_use(alctx, logconfig);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+#define RECORDSIZE	16
+
+/*
+ * Log text messages and binary records to both categories.
+ */
+static void
+writebinary(void) {
+	unsigned char record[RECORDSIZE];
+	unsigned int i;
+
+	for (i = 0; i < 4; i++) {
+		memset(record, i, sizeof(record));
+		isc_log_writebinary(alctx, ISC_LOGCATEGORY_GENERAL,
+				    ISC_LOGMODULE_OTHER, ISC_LOG_INFO,
+				    record, sizeof(record));
+		isc_log_writebinary(alctx, ISC_LOGCATEGORY_DEFAULT,
+				    ISC_LOGMODULE_OTHER, ISC_LOG_INFO,
+				    record, sizeof(record));
+		isc_log_write(alctx, ISC_LOGCATEGORY_GENERAL,
+			      ISC_LOGMODULE_OTHER, ISC_LOG_INFO,
+			      "thread 1 message %u", i);
+		isc_log_write(alctx, ISC_LOGCATEGORY_DEFAULT,
+			      ISC_LOGMODULE_OTHER, ISC_LOG_INFO,
+			      "thread 0 message %u", i);
+	}
+
+	/* debug records are below the binary channel's severity */
+	isc_log_writebinary(alctx, ISC_LOGCATEGORY_GENERAL,
+			    ISC_LOGMODULE_OTHER, ISC_LOG_DEBUG(1),
+			    record, sizeof(record));
+}
+
+/*
+ * Check that what writebinary() logged only went to the right kind of
+ * channel.
+ */
+static void
+checkbinary(FILE *binout) {
+	unsigned char buf[RECORDSIZE * 4];
+	unsigned int i, others;
+
+	assert_int_equal(readback(&others), 4);
+	assert_int_equal(others, 0);
+
+	fflush(binout);
+	rewind(binout);
+	assert_int_equal(fread(buf, 1, sizeof(buf), binout), sizeof(buf));
+	assert_int_equal(fgetc(binout), EOF);
+	for (i = 0; i < sizeof(buf); i++) {
+		assert_int_equal(buf[i], i / RECORDSIZE);
+	}
+}
+
+/* binary records only go to binary channels, and text to text ones */
+static void
+binary_test(void **state) {
+	FILE *binout;
+
+	UNUSED(state);
+
+	binout = tmpfile();
+	assert_non_null(binout);
+
+	usebinary(binout);
+
+	assert_true(isc_log_wouldlogbinary(alctx, ISC_LOGCATEGORY_GENERAL,
+					   ISC_LOG_INFO));
+	assert_false(isc_log_wouldlogbinary(alctx, ISC_LOGCATEGORY_GENERAL,
+					    ISC_LOG_DEBUG(1)));
+	assert_false(isc_log_wouldlogbinary(alctx, ISC_LOGCATEGORY_DEFAULT,
+					    ISC_LOG_INFO));
+	assert_false(isc_log_wouldlogtext(alctx, ISC_LOGCATEGORY_GENERAL,
+					  ISC_LOG_INFO));
+	assert_true(isc_log_wouldlogtext(alctx, ISC_LOGCATEGORY_DEFAULT,
+					 ISC_LOG_INFO));
+
+	writebinary();
+	checkbinary(binout);
+
+	fclose(binout);
+}
+
+/* the same, with asynchronous logging */
+static void
+async_binary_test(void **state) {
+	isc_result_t result;
+	FILE *binout;
+
+	UNUSED(state);
+
+	binout = tmpfile();
+	assert_non_null(binout);
+
+	usebinary(binout);
+
+	result = isc_log_setasync(alctx, true, 0);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		fclose(binout);
+		skip();
+	}
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	writebinary();
+
+	result = isc_log_setasync(alctx, false, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	checkbinary(binout);
+
+	fclose(binout);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(async_write_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(async_drop_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(async_reuse_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(async_critical_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(binary_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(async_binary_test,
+						_setup, _teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif
@@ -27,6 +27,7 @@
 #include <isc/print.h>
 #include <isc/result.h>
 #include <isc/stdio.h>
+#include <isc/thread.h>
 #include <isc/util.h>
 
 #include "../mem_p.h"
@@ -275,6 +276,174 @@ isc_mem_inuse_test(void **state) {
 
 }
 
+#define MAGAZINE_THREADS	4
+#define MAGAZINE_ITEMS		100
+#define MAGAZINE_ROUNDS		1000
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+magazine_thread(isc_threadarg_t arg) {
+	isc_mem_t *mctx2 = (isc_mem_t *)arg;
+	void *items[MAGAZINE_ITEMS];
+	size_t i, j;
+
+	for (i = 0; i < MAGAZINE_ROUNDS; i++) {
+		for (j = 0; j < MAGAZINE_ITEMS; j++) {
+			items[j] = isc_mem_get(mctx2, 8 + (i + j) % 512);
+			assert_non_null(items[j]);
+			memset(items[j], 0, 8);
+		}
+		for (j = 0; j < MAGAZINE_ITEMS; j++) {
+			isc_mem_put(mctx2, items[j], 8 + (i + j) % 512);
+		}
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+/* test the per-thread caches */
+static void
+isc_mem_magazine_test(void **state) {
+	isc_result_t result;
+	isc_mem_t *mctx2 = NULL;
+	isc_thread_t threads[MAGAZINE_THREADS];
+	unsigned int debugging = isc_mem_debugging;
+	void *ptr;
+	size_t i;
+
+	UNUSED(state);
+
+	/* Tracing and recording bypass the caches */
+	isc_mem_debugging = 0;
+
+	result = isc_mem_createx(0, 0, default_memalloc, default_memfree,
+				 NULL, &mctx2,
+				 ISC_MEMFLAG_INTERNAL|ISC_MEMFLAG_FILL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < MAGAZINE_THREADS; i++) {
+		result = isc_thread_create(magazine_thread, mctx2,
+					   &threads[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	/* Keep one item allocated while the threads run */
+	ptr = isc_mem_get(mctx2, 100);
+	assert_non_null(ptr);
+
+	for (i = 0; i < MAGAZINE_THREADS; i++) {
+		isc_thread_join(threads[i], NULL);
+	}
+
+	/*
+	 * Everything but 'ptr' has been returned; at most a bounded
+	 * amount is still held in the caches.
+	 */
+	assert_true(isc_mem_inuse(mctx2) >= 104);
+	assert_true(isc_mem_inuse(mctx2) <= 104 + (MAGAZINE_THREADS + 1) *
+					       65536 + 8192);
+
+	isc_mem_put(mctx2, ptr, 100);
+
+	/* Destroying checks that every get was matched by a put */
+	isc_mem_destroy(&mctx2);
+
+	isc_mem_debugging = debugging;
+}
+
+/* The most that the per-thread free lists can hold in total */
+#define MP_THREADSLACK		(MAGAZINE_THREADS * MP1_FILLCNT * 2)
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+mempool_thread(isc_threadarg_t arg) {
+	isc_mempool_t *mp = (isc_mempool_t *)arg;
+	void *items[MAGAZINE_ITEMS];
+	size_t i, j;
+
+	for (i = 0; i < MAGAZINE_ROUNDS; i++) {
+		for (j = 0; j < MAGAZINE_ITEMS; j++) {
+			items[j] = isc_mempool_get(mp);
+			assert_non_null(items[j]);
+			memset(items[j], 0, 24);
+		}
+		for (j = 0; j < MAGAZINE_ITEMS; j++) {
+			isc_mempool_put(mp, items[j]);
+		}
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+/* test threaded memory pools */
+static void
+isc_mempool_threaded_test(void **state) {
+	isc_result_t result;
+	isc_mem_t *localmctx = NULL;
+	isc_mempool_t *mp = NULL;
+	isc_mutex_t lock;
+	isc_thread_t threads[MAGAZINE_THREADS];
+	void *items[MP1_MAXALLOC + MP_THREADSLACK];
+	size_t i;
+
+	UNUSED(state);
+
+	result = isc_mem_create(0, 0, &localmctx);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_mempool_create(localmctx, 24, &mp);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	isc_mutex_init(&lock);
+	isc_mempool_associatelock(mp, &lock);
+	isc_mempool_setthreaded(mp);
+	isc_mempool_setfreemax(mp, MP2_FREEMAX);
+	isc_mempool_setfillcount(mp, MP1_FILLCNT);
+
+	for (i = 0; i < MAGAZINE_THREADS; i++) {
+		result = isc_thread_create(mempool_thread, mp, &threads[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	for (i = 0; i < MAGAZINE_THREADS; i++) {
+		isc_thread_join(threads[i], NULL);
+	}
+
+	/*
+	 * Everything has been returned, and nothing beyond the free
+	 * list limits is being held.
+	 */
+	assert_int_equal(isc_mempool_getallocated(mp), 0);
+	assert_true(isc_mempool_getfreecount(mp) <=
+		    MP2_FREEMAX + MP_THREADSLACK);
+
+	/*
+	 * The allocation limit is honoured, give or take what was held
+	 * on the per-thread free lists when it was set.
+	 */
+	isc_mempool_setmaxalloc(mp, MP1_MAXALLOC);
+	for (i = 0; i < MP1_MAXALLOC + MP_THREADSLACK; i++) {
+		items[i] = isc_mempool_get(mp);
+		if (items[i] == NULL) {
+			break;
+		}
+	}
+	assert_true(i >= MP1_MAXALLOC);
+	assert_true(i < MP1_MAXALLOC + MP_THREADSLACK);
+	assert_int_equal(isc_mempool_getallocated(mp), i);
+	while (i-- > 0) {
+		isc_mempool_put(mp, items[i]);
+	}
+	assert_int_equal(isc_mempool_getallocated(mp), 0);
+
+	isc_mempool_destroy(&mp);
+	isc_mutex_destroy(&lock);
+	isc_mem_destroy(&localmctx);
+}
+
 #if ISC_MEM_TRACKLINES
 
 /* test mem with no flags */
@@ -435,6 +604,10 @@ main(void) {
 				_setup, _teardown),
 		cmocka_unit_test_setup_teardown(isc_mem_inuse_test,
 				_setup, _teardown),
+		cmocka_unit_test_setup_teardown(isc_mem_magazine_test,
+				_setup, _teardown),
+		cmocka_unit_test_setup_teardown(isc_mempool_threaded_test,
+				_setup, _teardown),
 
 #if ISC_MEM_TRACKLINES
 		cmocka_unit_test_setup_teardown(isc_mem_noflags_test,
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/result.h>
+#include <isc/rwlock.h>
+#include <isc/thread.h>
+#include <isc/util.h>
+
+#include "isctest.h"
+
+#define NTHREADS	4
+#define NITERATIONS	20000
+#define WRITE_EVERY	100
+
+static isc_rwlock_t rwlock;
+static unsigned int value1, value2;
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = isc_test_begin(NULL, true, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	isc_test_end();
+
+	return (0);
+}
+
+static void
+basic(bool readerbias) {
+	isc_result_t result;
+
+	result = isc_rwlock_init(&rwlock, 0, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	if (readerbias) {
+		isc_rwlock_setreaderbias(&rwlock);
+	}
+
+	/* A reader excludes writers. */
+	result = isc_rwlock_lock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_trylock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_LOCKBUSY);
+	result = isc_rwlock_unlock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* Readers share the lock. */
+	result = isc_rwlock_lock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_trylock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_trylock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_LOCKBUSY);
+	result = isc_rwlock_unlock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_unlock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* A writer excludes readers and other writers. */
+	result = isc_rwlock_lock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_trylock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_LOCKBUSY);
+	result = isc_rwlock_trylock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_LOCKBUSY);
+
+	/* Downgrade, then upgrade again, or fail to. */
+	isc_rwlock_downgrade(&rwlock);
+	result = isc_rwlock_trylock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_LOCKBUSY);
+	result = isc_rwlock_tryupgrade(&rwlock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_unlock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* A sole reader can upgrade, however it took the lock. */
+	result = isc_rwlock_lock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_tryupgrade(&rwlock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_unlock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* Two readers can't, and both can still unlock. */
+	result = isc_rwlock_lock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_lock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_tryupgrade(&rwlock);
+	assert_int_equal(result, ISC_R_LOCKBUSY);
+	result = isc_rwlock_unlock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_unlock(&rwlock, isc_rwlocktype_read);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_trylock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_unlock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	isc_rwlock_destroy(&rwlock);
+}
+
+/* basic lock operations */
+static void
+isc_rwlock_basic_test(void **state) {
+	UNUSED(state);
+
+	basic(false);
+}
+
+/* basic lock operations on a reader-biased lock */
+static void
+isc_rwlock_readerbias_test(void **state) {
+	isc_result_t result;
+	unsigned int i;
+
+	UNUSED(state);
+
+	basic(true);
+
+	/*
+	 * A writer revokes the bias; reading turns it back on, though
+	 * not on every read.
+	 */
+	result = isc_rwlock_init(&rwlock, 0, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	isc_rwlock_setreaderbias(&rwlock);
+	if (!rwlock.readerbias) {
+		/* No thread-local storage. */
+		isc_rwlock_destroy(&rwlock);
+		return;
+	}
+	result = isc_rwlock_lock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_rwlock_unlock(&rwlock, isc_rwlocktype_write);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_false(atomic_load(&rwlock.rbias));
+	for (i = 0; i < 1000 && !atomic_load(&rwlock.rbias); i++) {
+		isc_test_nap(100);
+		result = isc_rwlock_lock(&rwlock, isc_rwlocktype_read);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		result = isc_rwlock_unlock(&rwlock, isc_rwlocktype_read);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	assert_true(atomic_load(&rwlock.rbias));
+	assert_true(i > 1);
+	isc_rwlock_destroy(&rwlock);
+}
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+worker(isc_threadarg_t arg) {
+	uintptr_t id = (uintptr_t)arg;
+	unsigned int i;
+
+	for (i = 0; i < NITERATIONS; i++) {
+		if ((i + id) % WRITE_EVERY == 0) {
+			RWLOCK(&rwlock, isc_rwlocktype_write);
+			value1++;
+			value2++;
+			RWUNLOCK(&rwlock, isc_rwlocktype_write);
+		} else {
+			RWLOCK(&rwlock, isc_rwlocktype_read);
+			INSIST(value1 == value2);
+			RWUNLOCK(&rwlock, isc_rwlocktype_read);
+		}
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+/* readers never see a partial update of a reader-biased lock */
+static void
+isc_rwlock_threads_test(void **state) {
+	isc_result_t result;
+	isc_thread_t threads[NTHREADS];
+	uintptr_t i;
+
+	UNUSED(state);
+
+	result = isc_rwlock_init(&rwlock, 0, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	isc_rwlock_setreaderbias(&rwlock);
+
+	value1 = value2 = 0;
+	for (i = 0; i < NTHREADS; i++) {
+		result = isc_thread_create(worker, (isc_threadarg_t)i,
+					   &threads[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		result = isc_thread_join(threads[i], NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	assert_int_equal(value1, NTHREADS * (NITERATIONS / WRITE_EVERY));
+	assert_int_equal(value2, value1);
+
+	isc_rwlock_destroy(&rwlock);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(isc_rwlock_basic_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(isc_rwlock_readerbias_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(isc_rwlock_threads_test,
+						_setup, _teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif
@@ -36,6 +36,8 @@ static bool recv_dscp;
 static unsigned int recv_dscp_value;
 static bool recv_trunc;
 
+#define NDGRAMS		8
+
 /*
  * Helper functions
  */
@@ -52,6 +54,40 @@ _setup(void **state) {
 	return (0);
 }
 
+static int
+_setup_uring(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = isc_test_begin(NULL, true, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Replace the socket manager with one that uses io_uring if
+	 * it can.
+	 */
+	isc_socketmgr_destroy(&socketmgr);
+	result = isc_socketmgr_create3(mctx, &socketmgr, 0, 1,
+				       isc_socketmgrtype_uring);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_setup1(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	/* One worker thread */
+	result = isc_test_begin(NULL, true, 1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
 static int
 _teardown(void **state) {
 	UNUSED(state);
@@ -688,6 +724,112 @@ tcp_dscp_v6_test(void **state) {
 
 }
 
+#define NCONNS		8
+
+/* Test accepting several queued TCP connections with listener options */
+static void
+tcp_accept_test(void **state) {
+	isc_result_t result;
+	isc_sockaddr_t addr1;
+	struct in_addr in;
+	isc_socket_t *s1 = NULL, *cs[NCONNS], *ss[NCONNS];
+	isc_task_t *task = NULL;
+	char sendbuf[BUFSIZ], recvbuf[BUFSIZ];
+	completion_t completion, accepted[NCONNS];
+	isc_region_t r;
+	int i;
+
+	UNUSED(state);
+
+	in.s_addr = inet_addr("127.0.0.1");
+	isc_sockaddr_fromin(&addr1, &in, 0);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_tcp, &s1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_bind(s1, &addr1, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_getsockname(s1, &addr1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(isc_sockaddr_getport(&addr1) != 0);
+
+	/*
+	 * With TCP_DEFER_ACCEPT, the connections are only accepted
+	 * once the clients below have sent their data.
+	 */
+	result = isc_socket_listen2(s1, NCONNS, true, 1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < NCONNS; i++) {
+		completion_init(&accepted[i]);
+		result = isc_socket_accept(s1, task, accept_done,
+					   &accepted[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	snprintf(sendbuf, sizeof(sendbuf), "Hello");
+	r.base = (void *) sendbuf;
+	r.length = strlen(sendbuf) + 1;
+
+	for (i = 0; i < NCONNS; i++) {
+		cs[i] = NULL;
+		result = isc_socket_create(socketmgr, PF_INET,
+					   isc_sockettype_tcp, &cs[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+
+		completion_init(&completion);
+		result = isc_socket_connect(cs[i], &addr1, task, event_done,
+					    &completion);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		waitfor(&completion);
+		assert_true(completion.done);
+		assert_int_equal(completion.result, ISC_R_SUCCESS);
+
+		completion_init(&completion);
+		result = isc_socket_send(cs[i], &r, task, event_done,
+					 &completion);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		waitfor(&completion);
+		assert_true(completion.done);
+		assert_int_equal(completion.result, ISC_R_SUCCESS);
+	}
+
+	/*
+	 * Every pending accept gets its own connection, with the data
+	 * sent on it.
+	 */
+	for (i = 0; i < NCONNS; i++) {
+		waitfor(&accepted[i]);
+		assert_true(accepted[i].done);
+		assert_int_equal(accepted[i].result, ISC_R_SUCCESS);
+		ss[i] = accepted[i].socket;
+		assert_non_null(ss[i]);
+
+		memset(recvbuf, 0, sizeof(recvbuf));
+		r.base = (void *) recvbuf;
+		r.length = strlen(sendbuf) + 1;
+		completion_init(&completion);
+		result = isc_socket_recv(ss[i], &r, r.length, task,
+					 event_done, &completion);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		waitfor(&completion);
+		assert_true(completion.done);
+		assert_int_equal(completion.result, ISC_R_SUCCESS);
+		assert_string_equal(recvbuf, "Hello");
+	}
+
+	isc_task_detach(&task);
+
+	for (i = 0; i < NCONNS; i++) {
+		isc_socket_detach(&cs[i]);
+		isc_socket_detach(&ss[i]);
+	}
+	isc_socket_detach(&s1);
+}
+
 /* probe dscp capabilities */
 static void
 net_probedscp_test(void **state) {
@@ -829,6 +971,404 @@ udp_trunc_test(void **state) {
 
 }
 
+/* Test batched UDP sends and receives */
+static void
+udp_batch_test(void **state) {
+	isc_result_t result;
+	isc_sockaddr_t addr1, addr2;
+	struct in_addr in;
+	isc_socket_t *s1 = NULL, *s2 = NULL;
+	isc_task_t *task = NULL;
+	char sendbuf[NDGRAMS][32], recvbuf[NDGRAMS][BUFSIZ];
+	completion_t completion[NDGRAMS], scompletion[NDGRAMS];
+	isc_socketevent_t *sev;
+	isc_region_t r;
+	unsigned int flags;
+	int i;
+
+	UNUSED(state);
+
+	in.s_addr = inet_addr("127.0.0.1");
+	isc_sockaddr_fromin(&addr1, &in, 0);
+	isc_sockaddr_fromin(&addr2, &in, 0);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_udp, &s1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(s1, &addr1, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_udp, &s2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(s2, &addr2, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_getsockname(s2, &addr2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(isc_sockaddr_getport(&addr2) != 0);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Queue the reads first, so that the datagrams are read
+	 * several at a time where possible.
+	 */
+	for (i = 0; i < NDGRAMS; i++) {
+		r.base = (void *) recvbuf[i];
+		r.length = BUFSIZ;
+		completion_init(&completion[i]);
+		result = isc_socket_recv(s2, &r, 1, task, event_done,
+					 &completion[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	flags = ISC_SOCKFLAG_IMMEDIATE | ISC_SOCKFLAG_NORETRY |
+		ISC_SOCKFLAG_BATCH;
+	for (i = 0; i < NDGRAMS; i++) {
+		snprintf(sendbuf[i], sizeof(sendbuf[i]), "Hello %d", i);
+		r.base = (void *) sendbuf[i];
+		r.length = strlen(sendbuf[i]) + 1;
+
+		completion_init(&scompletion[i]);
+		sev = isc_socket_socketevent(mctx, s1, ISC_SOCKEVENT_SENDDONE,
+					     event_done, &scompletion[i]);
+		assert_non_null(sev);
+		result = isc_socket_sendto2(s1, &r, task, &addr2, NULL,
+					    sev, flags);
+		if (result == ISC_R_SUCCESS) {
+			/* Sent right away; no event will be posted. */
+			scompletion[i].done = true;
+			scompletion[i].result = sev->result;
+			isc_event_free((isc_event_t **)&sev);
+		} else {
+			assert_int_equal(result, ISC_R_INPROGRESS);
+		}
+	}
+
+	for (i = 0; i < NDGRAMS; i++) {
+		char expected[32];
+
+		waitfor(&scompletion[i]);
+		assert_true(scompletion[i].done);
+		assert_int_equal(scompletion[i].result, ISC_R_SUCCESS);
+
+		waitfor(&completion[i]);
+		assert_true(completion[i].done);
+		assert_int_equal(completion[i].result, ISC_R_SUCCESS);
+		snprintf(expected, sizeof(expected), "Hello %d", i);
+		assert_string_equal(recvbuf[i], expected);
+	}
+
+	isc_task_detach(&task);
+
+	isc_socket_detach(&s1);
+	isc_socket_detach(&s2);
+}
+
+/* Test steering a SO_REUSEPORT group by CPU */
+static void
+udp_steer_test(void **state) {
+	isc_result_t result;
+	isc_sockaddr_t addr1, addr2;
+	struct in_addr in;
+	isc_socket_t *s1 = NULL, *s2[2] = { NULL, NULL };
+	isc_task_t *task = NULL;
+	char sendbuf[BUFSIZ], recvbuf[2][BUFSIZ];
+	completion_t completion[2], scompletion;
+	isc_region_t r;
+	int i;
+
+	UNUSED(state);
+
+	if (!isc_socket_hasreuseport()) {
+		skip();
+		return;
+	}
+
+	in.s_addr = inet_addr("127.0.0.1");
+	isc_sockaddr_fromin(&addr1, &in, 0);
+	isc_sockaddr_fromin(&addr2, &in, 0);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_udp, &s1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(s1, &addr1, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Find a free port, then bind both listeners to it.
+	 */
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_udp,
+				   &s2[0]);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(s2[0], &addr2, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_getsockname(s2[0], &addr2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(isc_sockaddr_getport(&addr2) != 0);
+	isc_socket_detach(&s2[0]);
+
+	for (i = 0; i < 2; i++) {
+		int n = 0;
+
+		result = isc_socket_create(socketmgr, PF_INET,
+					   isc_sockettype_udp, &s2[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		/* The probe socket is closed asynchronously. */
+		do {
+			result = isc_socket_bind(s2[i], &addr2,
+						 ISC_SOCKET_REUSEADDRESS);
+			if (result == ISC_R_ADDRINUSE) {
+				waitbody();
+			}
+		} while (result == ISC_R_ADDRINUSE && n++ < 5000);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	result = isc_socket_steerbycpu(s2, 2);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		isc_socket_detach(&s2[1]);
+		isc_socket_detach(&s2[0]);
+		isc_socket_detach(&s1);
+		skip();
+		return;
+	}
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 2; i++) {
+		r.base = (void *) recvbuf[i];
+		r.length = BUFSIZ;
+		completion_init(&completion[i]);
+		result = isc_socket_recv(s2[i], &r, 1, task, event_done,
+					 &completion[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	snprintf(sendbuf, sizeof(sendbuf), "Hello");
+	r.base = (void *) sendbuf;
+	r.length = strlen(sendbuf) + 1;
+	completion_init(&scompletion);
+	result = isc_socket_sendto(s1, &r, task, event_done, &scompletion,
+				   &addr2, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	waitfor(&scompletion);
+	assert_true(scompletion.done);
+	assert_int_equal(scompletion.result, ISC_R_SUCCESS);
+
+	/*
+	 * The datagram is read by exactly one of the listeners.
+	 */
+	i = 0;
+	while (!completion[0].done && !completion[1].done && i++ < 5000) {
+		waitbody();
+	}
+	assert_true(completion[0].done != completion[1].done);
+	i = completion[0].done ? 0 : 1;
+	assert_int_equal(completion[i].result, ISC_R_SUCCESS);
+	assert_string_equal(recvbuf[i], "Hello");
+
+	isc_socket_cancel(s2[1 - i], task, ISC_SOCKCANCEL_RECV);
+	waitfor(&completion[1 - i]);
+	assert_true(completion[1 - i].done);
+	assert_int_equal(completion[1 - i].result, ISC_R_CANCELED);
+
+	isc_task_detach(&task);
+
+	isc_socket_detach(&s1);
+	isc_socket_detach(&s2[0]);
+	isc_socket_detach(&s2[1]);
+}
+
+/* Test that UDP datagrams are received in order through io_uring */
+static void
+udp_uring_test(void **state) {
+	isc_result_t result;
+	isc_sockaddr_t addr1, addr2;
+	struct in_addr in;
+	isc_socket_t *s1 = NULL, *s2 = NULL;
+	isc_task_t *task = NULL;
+	char sendbuf[NDGRAMS][32], recvbuf[NDGRAMS][BUFSIZ];
+	completion_t completion[NDGRAMS], scompletion;
+	isc_region_t r;
+	int i;
+
+	UNUSED(state);
+
+	if (isc_socketmgr_gettype(socketmgr) != isc_socketmgrtype_uring) {
+		skip();
+	}
+
+	in.s_addr = inet_addr("127.0.0.1");
+	isc_sockaddr_fromin(&addr1, &in, 0);
+	isc_sockaddr_fromin(&addr2, &in, 0);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_udp, &s1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(s1, &addr1, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_udp, &s2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(s2, &addr2, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_getsockname(s2, &addr2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Start reading with a single receive, so that the datagrams
+	 * after the first one are taken in while there is no receive
+	 * waiting for them, and have to be held until there is.
+	 */
+	r.base = (void *) recvbuf[0];
+	r.length = BUFSIZ;
+	completion_init(&completion[0]);
+	result = isc_socket_recv(s2, &r, 1, task, event_done, &completion[0]);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < NDGRAMS; i++) {
+		snprintf(sendbuf[i], sizeof(sendbuf[i]), "Hello %d", i);
+		r.base = (void *) sendbuf[i];
+		r.length = strlen(sendbuf[i]) + 1;
+
+		completion_init(&scompletion);
+		result = isc_socket_sendto(s1, &r, task, event_done,
+					   &scompletion, &addr2, NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		waitfor(&scompletion);
+		assert_true(scompletion.done);
+		assert_int_equal(scompletion.result, ISC_R_SUCCESS);
+	}
+
+	waitfor(&completion[0]);
+	assert_true(completion[0].done);
+	assert_int_equal(completion[0].result, ISC_R_SUCCESS);
+	assert_string_equal(recvbuf[0], "Hello 0");
+
+	for (i = 1; i < NDGRAMS; i++) {
+		r.base = (void *) recvbuf[i];
+		r.length = BUFSIZ;
+		completion_init(&completion[i]);
+		result = isc_socket_recv(s2, &r, 1, task, event_done,
+					 &completion[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	for (i = 1; i < NDGRAMS; i++) {
+		char expected[32];
+
+		waitfor(&completion[i]);
+		assert_true(completion[i].done);
+		assert_int_equal(completion[i].result, ISC_R_SUCCESS);
+		snprintf(expected, sizeof(expected), "Hello %d", i);
+		assert_string_equal(recvbuf[i], expected);
+	}
+
+	isc_task_detach(&task);
+
+	isc_socket_detach(&s1);
+	isc_socket_detach(&s2);
+}
+
+static bool blocked, unblock;
+
+static void
+block_done(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	isc_event_free(&event);
+	blocked = true;
+	while (!unblock) {
+		isc_test_nap(1000);
+	}
+}
+
+/* Test that ISC_SOCKFLAG_INLINE receives complete on the network thread */
+static void
+udp_inline_test(void **state) {
+	isc_result_t result;
+	isc_sockaddr_t addr1, addr2;
+	struct in_addr in;
+	isc_socket_t *s1 = NULL, *s2 = NULL;
+	isc_task_t *task = NULL, *blocker = NULL;
+	isc_event_t *event = NULL;
+	isc_socketevent_t *sev = NULL;
+	char sendbuf[BUFSIZ], recvbuf[BUFSIZ];
+	completion_t completion, scompletion;
+	isc_region_t r;
+
+	UNUSED(state);
+
+	in.s_addr = inet_addr("127.0.0.1");
+	isc_sockaddr_fromin(&addr1, &in, 0);
+	isc_sockaddr_fromin(&addr2, &in, 0);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_udp, &s1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(s1, &addr1, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_udp, &s2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(s2, &addr2, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_socket_getsockname(s2, &addr2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_task_create(taskmgr, 0, &blocker);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* Keep the only worker thread busy. */
+	blocked = unblock = false;
+	event = isc_event_allocate(mctx, blocker, ISC_TASKEVENT_TEST,
+				   block_done, NULL, sizeof(*event));
+	assert_non_null(event);
+	isc_task_send(blocker, &event);
+	while (!blocked) {
+		isc_test_nap(1000);
+	}
+
+	r.base = (void *) recvbuf;
+	r.length = BUFSIZ;
+	completion_init(&completion);
+	sev = isc_socket_socketevent(mctx, s2, ISC_SOCKEVENT_RECVDONE,
+				     event_done, &completion);
+	assert_non_null(sev);
+	result = isc_socket_recv2(s2, &r, 1, task, sev, ISC_SOCKFLAG_INLINE);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	snprintf(sendbuf, sizeof(sendbuf), "Hello");
+	r.base = (void *) sendbuf;
+	r.length = strlen(sendbuf) + 1;
+	completion_init(&scompletion);
+	sev = isc_socket_socketevent(mctx, s1, ISC_SOCKEVENT_SENDDONE,
+				     event_done, &scompletion);
+	assert_non_null(sev);
+	result = isc_socket_sendto2(s1, &r, task, &addr2, NULL, sev,
+				    ISC_SOCKFLAG_IMMEDIATE);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	isc_event_free(ISC_EVENT_PTR(&sev));
+
+	/* The receive completes although no worker thread is free. */
+	waitfor(&completion);
+	assert_true(completion.done);
+	assert_int_equal(completion.result, ISC_R_SUCCESS);
+	assert_string_equal(recvbuf, "Hello");
+
+	unblock = true;
+
+	isc_task_detach(&blocker);
+	isc_task_detach(&task);
+
+	isc_socket_detach(&s1);
+	isc_socket_detach(&s2);
+}
+
 /*
  * Main
  */
@@ -843,6 +1383,8 @@ main(void) {
 						_setup, _teardown),
 		cmocka_unit_test_setup_teardown(tcp_dscp_v6_test,
 						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(tcp_accept_test,
+						_setup, _teardown),
 		cmocka_unit_test_setup_teardown(udp_dscp_v4_test,
 						_setup, _teardown),
 		cmocka_unit_test_setup_teardown(udp_dscp_v6_test,
@@ -851,6 +1393,28 @@ main(void) {
 						_setup, _teardown),
 		cmocka_unit_test_setup_teardown(udp_trunc_test,
 						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(udp_batch_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(udp_steer_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(udp_inline_test,
+						_setup1, _teardown),
+		cmocka_unit_test_setup_teardown(udp_sendto_test,
+						_setup_uring, _teardown),
+		cmocka_unit_test_setup_teardown(udp_dup_test,
+						_setup_uring, _teardown),
+		cmocka_unit_test_setup_teardown(tcp_dscp_v4_test,
+						_setup_uring, _teardown),
+		cmocka_unit_test_setup_teardown(tcp_accept_test,
+						_setup_uring, _teardown),
+		cmocka_unit_test_setup_teardown(udp_dscp_v4_test,
+						_setup_uring, _teardown),
+		cmocka_unit_test_setup_teardown(udp_trunc_test,
+						_setup_uring, _teardown),
+		cmocka_unit_test_setup_teardown(udp_batch_test,
+						_setup_uring, _teardown),
+		cmocka_unit_test_setup_teardown(udp_uring_test,
+						_setup_uring, _teardown),
 	};
 
 	return (cmocka_run_group_tests(tests, NULL, NULL));
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/result.h>
+#include <isc/stats.h>
+#include <isc/thread.h>
+#include <isc/util.h>
+
+#include "isctest.h"
+
+#define NCOUNTERS	13
+#define NTHREADS	4
+#define NITERATIONS	10000
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = isc_test_begin(NULL, true, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	isc_test_end();
+
+	return (0);
+}
+
+static void
+dump_values(isc_statscounter_t counter, uint64_t value, void *arg) {
+	uint64_t *values = arg;
+
+	assert_true(counter < NCOUNTERS);
+	values[counter] = value;
+}
+
+static void
+check_values(isc_stats_t *stats, uint64_t *expected) {
+	uint64_t values[NCOUNTERS];
+
+	memset(values, 0xff, sizeof(values));
+	isc_stats_dump(stats, dump_values, values, ISC_STATSDUMP_VERBOSE);
+	assert_memory_equal(values, expected, sizeof(values));
+}
+
+static void
+basic(unsigned int flags) {
+	isc_result_t result;
+	isc_stats_t *stats = NULL;
+	uint64_t expected[NCOUNTERS];
+	int i;
+
+	result = isc_stats_create2(mctx, &stats, NCOUNTERS, flags);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(isc_stats_ncounters(stats), NCOUNTERS);
+
+	memset(expected, 0, sizeof(expected));
+	check_values(stats, expected);
+
+	for (i = 0; i < NCOUNTERS; i++) {
+		int j;
+
+		for (j = 0; j <= i; j++) {
+			isc_stats_increment(stats, i);
+		}
+		expected[i] = i + 1;
+	}
+	isc_stats_decrement(stats, 5);
+	expected[5]--;
+	check_values(stats, expected);
+
+	isc_stats_set(stats, (uint64_t)1 << 40, 7);
+	expected[7] = (uint64_t)1 << 40;
+	isc_stats_increment(stats, 7);
+	expected[7]++;
+	check_values(stats, expected);
+
+	isc_stats_detach(&stats);
+	assert_null(stats);
+}
+
+/* basic counter operations */
+static void
+isc_stats_basic_test(void **state) {
+	UNUSED(state);
+
+	basic(0);
+}
+
+/* basic counter operations on sharded counters */
+static void
+isc_stats_sharded_test(void **state) {
+	UNUSED(state);
+
+	basic(ISC_STATS_SHARDED);
+}
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+increment_thread(isc_threadarg_t arg) {
+	isc_stats_t *stats = arg;
+	int i;
+
+	for (i = 0; i < NITERATIONS; i++) {
+		isc_stats_increment(stats, i % NCOUNTERS);
+		isc_stats_increment(stats, 0);
+		isc_stats_decrement(stats, 0);
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+/* concurrent updates of sharded counters all get counted */
+static void
+isc_stats_threads_test(void **state) {
+	isc_result_t result;
+	isc_stats_t *stats = NULL;
+	isc_thread_t threads[NTHREADS];
+	uint64_t expected[NCOUNTERS];
+	int i;
+
+	UNUSED(state);
+
+	result = isc_stats_create2(mctx, &stats, NCOUNTERS,
+				   ISC_STATS_SHARDED);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < NTHREADS; i++) {
+		result = isc_thread_create(increment_thread, stats,
+					   &threads[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		result = isc_thread_join(threads[i], NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	for (i = 0; i < NCOUNTERS; i++) {
+		expected[i] = NTHREADS * (NITERATIONS / NCOUNTERS);
+		if (i < NITERATIONS % NCOUNTERS) {
+			expected[i] += NTHREADS;
+		}
+	}
+	check_values(stats, expected);
+
+	isc_stats_detach(&stats);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(isc_stats_basic_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(isc_stats_sharded_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(isc_stats_threads_test,
+						_setup, _teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif
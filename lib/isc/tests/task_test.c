@@ -30,6 +30,7 @@
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/task.h>
+#include <isc/thread.h>
 #include <isc/time.h>
 #include <isc/timer.h>
 #include <isc/util.h>
@@ -190,6 +191,176 @@ all_events(void **state) {
 	assert_null(task);
 }
 
+/* Process a list of events sent in one call */
+static void
+list_events(void **state) {
+	isc_result_t result;
+	isc_task_t *task = NULL, *task2 = NULL;
+	isc_event_t *event = NULL;
+	isc_eventlist_t events;
+	int values[6] = { 0, 0, 0, 0, 0, 0 };
+	int i;
+
+	UNUSED(state);
+
+	counter = 1;
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* Sending an empty list is a no-op */
+	ISC_LIST_INIT(events);
+	isc_task_sendlist(task, &events);
+
+	for (i = 0; i < 4; i++) {
+		event = isc_event_allocate(mctx, task, ISC_TASKEVENT_TEST,
+					   set, &values[i],
+					   sizeof (isc_event_t));
+		assert_non_null(event);
+		ISC_LIST_APPEND(events, event, ev_link);
+	}
+	isc_task_sendlist(task, &events);
+	assert_true(ISC_LIST_EMPTY(events));
+
+	/*
+	 * Have each event of the next batch hold a task reference, as
+	 * socket events do, and release them all when sending.
+	 */
+	for (i = 4; i < 6; i++) {
+		isc_task_attach(task, &task2);
+		event = isc_event_allocate(mctx, task2, ISC_TASKEVENT_TEST,
+					   set, &values[i],
+					   sizeof (isc_event_t));
+		assert_non_null(event);
+		ISC_LIST_APPEND(events, event, ev_link);
+		task2 = NULL;
+	}
+	task2 = task;
+	isc_task_sendtolistanddetach(&task2, &events, -1, 2);
+	assert_null(task2);
+	assert_true(ISC_LIST_EMPTY(events));
+
+	i = 0;
+	while (values[5] == 0 && i++ < 5000) {
+		isc_test_nap(1000);
+	}
+
+	/* Events are run in the order they were on the lists */
+	for (i = 0; i < 6; i++) {
+		assert_int_equal(values[i], i + 1);
+	}
+
+	isc_task_destroy(&task);
+	assert_null(task);
+}
+
+static isc_thread_t inline_thread;
+static int inline_value, inline_next;
+static bool inline_blocked, inline_release;
+
+static void
+inline_cb(isc_task_t *task, isc_event_t *event) {
+	isc_event_t *next = NULL;
+
+	inline_thread = isc_thread_self();
+
+	/* An event sent meanwhile waits for the action to return. */
+	next = isc_event_allocate(mctx, task, ISC_TASKEVENT_TEST,
+				  set, &inline_next, sizeof (isc_event_t));
+	assert_non_null(next);
+	isc_task_send(task, &next);
+	assert_int_equal(inline_next, 0);
+
+	isc_event_free(&event);
+	LOCK(&lock);
+	inline_value = counter++;
+	UNLOCK(&lock);
+}
+
+static void
+inline_block_cb(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	isc_event_free(&event);
+	LOCK(&lock);
+	inline_blocked = true;
+	BROADCAST(&cv);
+	while (!inline_release) {
+		WAIT(&cv, &lock);
+	}
+	UNLOCK(&lock);
+}
+
+/* Run events on the sending thread when the task is idle */
+static void
+inline_events(void **state) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_event_t *event = NULL;
+	int i;
+
+	UNUSED(state);
+
+	counter = 1;
+	inline_value = inline_next = 0;
+	inline_blocked = inline_release = false;
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* The task is idle, so the event is run before returning. */
+	event = isc_event_allocate(mctx, task, ISC_TASKEVENT_TEST,
+				   inline_cb, NULL, sizeof (isc_event_t));
+	assert_non_null(event);
+	isc_task_sendinline(task, &event);
+	assert_null(event);
+	assert_int_equal(inline_value, 1);
+	assert_true(inline_thread == isc_thread_self());
+
+	i = 0;
+	while (inline_next == 0 && i++ < 5000) {
+		isc_test_nap(1000);
+	}
+	assert_int_equal(inline_next, 2);
+
+	/* The task is running, so the event is queued behind it. */
+	event = isc_event_allocate(mctx, task, ISC_TASKEVENT_TEST,
+				   inline_block_cb, NULL,
+				   sizeof (isc_event_t));
+	assert_non_null(event);
+	isc_task_send(task, &event);
+
+	LOCK(&lock);
+	while (!inline_blocked) {
+		WAIT(&cv, &lock);
+	}
+	UNLOCK(&lock);
+
+	inline_value = inline_next = 0;
+	event = isc_event_allocate(mctx, task, ISC_TASKEVENT_TEST,
+				   inline_cb, NULL, sizeof (isc_event_t));
+	assert_non_null(event);
+	isc_task_sendinline(task, &event);
+	assert_null(event);
+	assert_int_equal(inline_value, 0);
+
+	LOCK(&lock);
+	inline_release = true;
+	BROADCAST(&cv);
+	UNLOCK(&lock);
+
+	i = 0;
+	while (inline_next == 0 && i++ < 5000) {
+		isc_test_nap(1000);
+	}
+	assert_int_equal(inline_value, 3);
+	assert_int_equal(inline_next, 4);
+	assert_false(inline_thread == isc_thread_self());
+
+	isc_task_destroy(&task);
+	assert_null(task);
+}
+
 /* Privileged events */
 static void
 privileged_events(void **state) {
@@ -730,6 +901,181 @@ manytasks(void **state) {
 	isc_condition_destroy(&cv);
 }
 
+/*
+ * Work stealing test:
+ * With work stealing enabled the task system can still create and
+ * execute many tasks, and bound tasks are always run by the same thread.
+ * Tasks made ready by a worker that then stays busy are stolen and run
+ * by the other workers.
+ */
+#define STEAL_TASKS 16
+
+static isc_thread_t bound_thread;
+static int bound_count = 0;
+static isc_thread_t steal_sender;
+static int steal_count = 0;
+static int stolen_count = 0;
+
+static void
+worksteal_bound_cb(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	LOCK(&lock);
+	if (bound_count++ == 0) {
+		bound_thread = isc_thread_self();
+	} else {
+		assert_true(bound_thread == isc_thread_self());
+	}
+	UNLOCK(&lock);
+
+	isc_event_free(&event);
+}
+
+static void
+worksteal_stolen_cb(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	LOCK(&lock);
+	if (steal_sender != isc_thread_self()) {
+		stolen_count++;
+	}
+	steal_count++;
+	BROADCAST(&cv);
+	UNLOCK(&lock);
+
+	isc_event_free(&event);
+}
+
+static void
+worksteal_send_cb(isc_task_t *task, isc_event_t *event) {
+	isc_result_t result;
+	isc_interval_t interval;
+	isc_time_t expires;
+	int i;
+
+	UNUSED(task);
+
+	LOCK(&lock);
+	steal_sender = isc_thread_self();
+	UNLOCK(&lock);
+
+	/*
+	 * These tasks are made ready on this worker, so they go onto its
+	 * deque.
+	 */
+	for (i = 0; i < STEAL_TASKS; i++) {
+		isc_task_t *newtask = NULL;
+		isc_event_t *ev;
+
+		result = isc_task_create(taskmgr, 0, &newtask);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		ev = isc_event_allocate(mctx, newtask, ISC_TASKEVENT_TEST,
+					worksteal_stolen_cb, NULL, sizeof(*ev));
+		assert_non_null(ev);
+		isc_task_send(newtask, &ev);
+		isc_task_detach(&newtask);
+	}
+
+	/*
+	 * Keep this worker busy, so that the events can only be run if
+	 * the other workers steal them.
+	 */
+	isc_interval_set(&interval, 10, 0);
+	result = isc_time_nowplusinterval(&expires, &interval);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	LOCK(&lock);
+	while (steal_count < STEAL_TASKS) {
+		if (WAITUNTIL(&cv, &lock, &expires) == ISC_R_TIMEDOUT) {
+			break;
+		}
+	}
+	done = true;
+	BROADCAST(&cv);
+	UNLOCK(&lock);
+
+	isc_event_free(&event);
+}
+
+static void
+worksteal(void **state) {
+	isc_result_t result;
+	isc_event_t *event = NULL;
+	isc_task_t *bound = NULL;
+	isc_task_t *task = NULL;
+	uintptr_t ntasks = 10000;
+	int i;
+
+	UNUSED(state);
+
+	isc_condition_init(&cv);
+
+	isc_mem_debugging = ISC_MEM_DEBUGRECORD;
+	result = isc_mem_create(0, 0, &mctx);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_taskmgr_create(mctx, 4, 0, &taskmgr);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	assert_false(isc_taskmgr_workstealing(taskmgr));
+	isc_taskmgr_setworkstealing(taskmgr, true);
+	assert_true(isc_taskmgr_workstealing(taskmgr));
+
+	result = isc_task_create_bound(taskmgr, 0, &bound, 2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	done = false;
+	bound_count = 0;
+
+	event = isc_event_allocate(mctx, (void *)1, 1, maxtask_cb,
+				   (void *)ntasks, sizeof(*event));
+	assert_non_null(event);
+
+	LOCK(&lock);
+	maxtask_cb(NULL, event);
+	UNLOCK(&lock);
+
+	for (i = 0; i < 100; i++) {
+		event = isc_event_allocate(mctx, bound, ISC_TASKEVENT_TEST,
+					   worksteal_bound_cb, NULL,
+					   sizeof(*event));
+		assert_non_null(event);
+		isc_task_send(bound, &event);
+	}
+	isc_task_detach(&bound);
+
+	LOCK(&lock);
+	while (!done) {
+		WAIT(&cv, &lock);
+	}
+	UNLOCK(&lock);
+
+	done = false;
+	steal_count = 0;
+	stolen_count = 0;
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	event = isc_event_allocate(mctx, task, ISC_TASKEVENT_TEST,
+				   worksteal_send_cb, NULL, sizeof(*event));
+	assert_non_null(event);
+	isc_task_send(task, &event);
+	isc_task_detach(&task);
+
+	LOCK(&lock);
+	while (!done) {
+		WAIT(&cv, &lock);
+	}
+	UNLOCK(&lock);
+
+	isc_taskmgr_destroy(&taskmgr);
+	assert_int_equal(bound_count, 100);
+	assert_int_equal(steal_count, STEAL_TASKS);
+	assert_int_equal(stolen_count, STEAL_TASKS);
+	isc_mem_destroy(&mctx);
+	isc_condition_destroy(&cv);
+}
+
 /*
  * Shutdown test:
  * When isc_task_shutdown() is called, shutdown events are posted
@@ -1434,13 +1780,134 @@ purgeevent_notpurge(void **state) {
 	try_purgeevent(false);
 }
 
+/*
+ * Latency test:
+ * Events are counted in the queue delay and run time histograms, and
+ * an event that runs for longer than ISC_TASKMGR_SLOWEVENT is counted
+ * against the name of its task.
+ */
+
+static void
+slow_action(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	isc_test_nap(2 * ISC_TASKMGR_SLOWEVENT);
+
+	LOCK(&lock);
+	done = true;
+	SIGNAL(&cv);
+	UNLOCK(&lock);
+
+	isc_event_free(&event);
+}
+
+static void
+latency_dump(unsigned int queue, const uint64_t *delay,
+	     const uint64_t *runtime, void *arg)
+{
+	uint64_t *sums = arg;
+	unsigned int i;
+
+	UNUSED(queue);
+
+	for (i = 0; i < ISC_TASKMGR_LATENCYBUCKETS; i++) {
+		sums[0] += delay[i];
+		sums[1] += runtime[i];
+		if (isc_taskmgr_latencylimit(i) == 0 ||
+		    isc_taskmgr_latencylimit(i) > ISC_TASKMGR_SLOWEVENT)
+		{
+			sums[2] += runtime[i];
+		}
+	}
+}
+
+static void
+slow_dump(const char *name, uint64_t count, uint64_t total, uint64_t max,
+	  void *arg)
+{
+	unsigned int *found = arg;
+
+	if (verbose) {
+		print_message("# %s: %" PRIu64 " events, %" PRIu64
+			      "us total, %" PRIu64 "us max\n",
+			      name, count, total, max);
+	}
+
+	if (strcmp(name, "slow") == 0) {
+		assert_int_equal(count, 1);
+		assert_true(max >= ISC_TASKMGR_SLOWEVENT);
+		assert_true(total >= max);
+		(*found)++;
+	}
+}
+
+static void
+latency(void **state) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_event_t *event = NULL;
+	isc_time_t now;
+	isc_interval_t interval;
+	uint64_t sums[3] = { 0, 0, 0 };
+	unsigned int found = 0;
+
+	UNUSED(state);
+
+	assert_int_equal(isc_taskmgr_latencylimit(0), 1);
+	assert_int_equal(isc_taskmgr_latencylimit(4), 16);
+	assert_int_equal(
+		isc_taskmgr_latencylimit(ISC_TASKMGR_LATENCYBUCKETS - 1), 0);
+
+	done = false;
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	isc_task_setname(task, "slow", NULL);
+
+	event = isc_event_allocate(mctx, task, ISC_TASKEVENT_TEST,
+				   slow_action, NULL, sizeof (isc_event_t));
+	assert_non_null(event);
+
+	LOCK(&lock);
+	isc_task_send(task, &event);
+
+	isc_interval_set(&interval, 5, 0);
+	while (!done) {
+		result = isc_time_nowplusinterval(&now, &interval);
+		assert_int_equal(result, ISC_R_SUCCESS);
+
+		WAITUNTIL(&cv, &lock, &now);
+	}
+	UNLOCK(&lock);
+
+	isc_task_detach(&task);
+
+	/*
+	 * The action is counted once its task's lock is retaken, which
+	 * can be just after it has signalled us; give it a moment.
+	 */
+	isc_test_nap(100000);
+
+	isc_taskmgr_dumplatency(taskmgr, latency_dump, sums);
+	assert_true(sums[0] >= 1);
+	assert_true(sums[1] >= 1);
+	assert_true(sums[2] >= 1);
+
+	isc_taskmgr_dumpslow(taskmgr, slow_dump, &found);
+	assert_int_equal(found, 1);
+}
+
 int
 main(int argc, char **argv) {
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test_setup_teardown(create_task, _setup, _teardown),
 		cmocka_unit_test_setup_teardown(shutdown, _setup4, _teardown),
+		cmocka_unit_test(worksteal),
 		cmocka_unit_test(manytasks),
 		cmocka_unit_test_setup_teardown(all_events, _setup, _teardown),
+		cmocka_unit_test_setup_teardown(list_events, _setup, _teardown),
+		cmocka_unit_test_setup_teardown(inline_events,
+						_setup, _teardown),
 		cmocka_unit_test_setup_teardown(basic, _setup2, _teardown),
 		cmocka_unit_test_setup_teardown(privileged_events,
 						_setup, _teardown),
@@ -1455,6 +1922,7 @@ main(int argc, char **argv) {
 		cmocka_unit_test_setup_teardown(purgeevent, _setup2, _teardown),
 		cmocka_unit_test_setup_teardown(purgeevent_notpurge,
 						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(latency, _setup, _teardown),
 	};
 	int c;
 
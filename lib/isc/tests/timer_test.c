@@ -63,6 +63,26 @@ _setup(void **state) {
 	return (0);
 }
 
+static int
+_setup_wheel(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = isc_test_begin(NULL, true, 2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Replace the default timer manager with a timing wheel.
+	 */
+	isc_timermgr_destroy(&timermgr);
+	result = isc_timermgr_create2(mctx, isc_timermgrtype_wheel,
+				      &timermgr);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
 static int
 _teardown(void **state) {
 	UNUSED(state);
@@ -559,6 +579,227 @@ purge(void **state) {
 	isc_mutex_destroy(&mx);
 }
 
+#define WHEEL_NTIMERS	64
+
+static isc_timer_t *wheeltimers[WHEEL_NTIMERS];
+static isc_time_t wheelexpires[WHEEL_NTIMERS];
+
+static void
+wheel_event(isc_task_t *task, isc_event_t *event) {
+	isc_result_t result;
+	isc_time_t now, ulim;
+	isc_interval_t interval;
+	uintptr_t i = (uintptr_t)event->ev_arg;
+
+	UNUSED(task);
+
+	assert_int_equal(event->ev_type, ISC_TIMEREVENT_LIFE);
+	assert_true(i < WHEEL_NTIMERS);
+
+	/*
+	 * The event must not be early, and should be reasonably
+	 * close to the requested time.
+	 */
+	result = isc_time_now(&now);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(isc_time_compare(&now, &wheelexpires[i]) >= 0);
+
+	isc_interval_set(&interval, FUDGE_SECONDS, FUDGE_NANOSECONDS);
+	result = isc_time_add(&wheelexpires[i], &interval, &ulim);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(isc_time_compare(&ulim, &now) >= 0);
+
+	LOCK(&mx);
+	eventcnt++;
+	if (eventcnt == nevents) {
+		result = isc_condition_signal(&cv);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	UNLOCK(&mx);
+
+	isc_event_free(&event);
+}
+
+/*
+ * timing wheel: timers spread over several wheel levels fire on time,
+ * and cancelled or rescheduled timers do not fire at their old time
+ */
+static void
+wheel(void **state) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_interval_t interval;
+	uintptr_t i;
+	unsigned int ms;
+
+	UNUSED(state);
+
+	eventcnt = 0;
+	nevents = 0;
+
+	isc_mutex_init(&mx);
+	isc_condition_init(&cv);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	LOCK(&mx);
+
+	for (i = 0; i < WHEEL_NTIMERS; i++) {
+		/*
+		 * Spread the due times between 1ms and 4.5 seconds,
+		 * so level 0, 1 and 2 slots are all used.
+		 */
+		ms = (unsigned int)(i * i * 37 + 1) % 4500;
+		isc_interval_set(&interval, ms / 1000,
+				 (ms % 1000) * 1000000);
+		result = isc_time_nowplusinterval(&wheelexpires[i], &interval);
+		assert_int_equal(result, ISC_R_SUCCESS);
+
+		wheeltimers[i] = NULL;
+		result = isc_timer_create(timermgr, isc_timertype_once,
+					  &wheelexpires[i], NULL, task,
+					  wheel_event, (void *)i,
+					  &wheeltimers[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	for (i = 0; i < WHEEL_NTIMERS; i++) {
+		switch (i % 4) {
+		case 2:
+			/* Push back by 300ms. */
+			isc_interval_set(&interval, 0, 300000000);
+			result = isc_time_add(&wheelexpires[i], &interval,
+					      &wheelexpires[i]);
+			assert_int_equal(result, ISC_R_SUCCESS);
+			result = isc_timer_reset(wheeltimers[i],
+						 isc_timertype_once,
+						 &wheelexpires[i], NULL, true);
+			assert_int_equal(result, ISC_R_SUCCESS);
+			nevents++;
+			break;
+		case 3:
+			/* Cancel. */
+			result = isc_timer_reset(wheeltimers[i],
+						 isc_timertype_inactive,
+						 NULL, NULL, true);
+			assert_int_equal(result, ISC_R_SUCCESS);
+			break;
+		default:
+			nevents++;
+			break;
+		}
+	}
+
+	while (eventcnt != nevents) {
+		result = isc_condition_wait(&cv, &mx);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	UNLOCK(&mx);
+
+	/*
+	 * Give the cancelled timers a chance to misfire.
+	 */
+	isc_test_nap(500000);
+	assert_int_equal(eventcnt, nevents);
+
+	for (i = 0; i < WHEEL_NTIMERS; i++) {
+		isc_timer_detach(&wheeltimers[i]);
+	}
+	isc_task_destroy(&task);
+	isc_mutex_destroy(&mx);
+	(void) isc_condition_destroy(&cv);
+}
+
+/*
+ * timing wheel boundaries: timers just before, on and just after the
+ * start of a level 1 and a level 2 slot all fire, however the wheel
+ * position lands on the boundary
+ */
+static void
+wheel_boundary(void **state) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_time_t now;
+	uint64_t tick, b64, b4096;
+	uint64_t ticks[10];
+	uintptr_t i, n = 0;
+
+	UNUSED(state);
+
+	eventcnt = 0;
+
+	isc_mutex_init(&mx);
+	isc_condition_init(&cv);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_time_now(&now);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	tick = (uint64_t)isc_time_seconds(&now) * 1000 +
+	       isc_time_nanoseconds(&now) / 1000000;
+
+	/*
+	 * The next 64ms and 4096ms boundaries far enough ahead for the
+	 * timers on both sides of them to be on a higher level when set.
+	 */
+	b64 = (tick / 64 + 2) * 64;
+	b4096 = (tick / 4096 + 1) * 4096;
+	if (b4096 - tick < 200)
+		b4096 += 4096;
+
+	ticks[n++] = b64 - 1;
+	ticks[n++] = b64;
+	ticks[n++] = b64 + 1;
+	ticks[n++] = b64 + 36;
+	ticks[n++] = b4096 - 1;
+	ticks[n++] = b4096;
+	ticks[n++] = b4096 + 1;
+	ticks[n++] = b4096 + 36;
+	ticks[n++] = b4096 + 100;
+	ticks[n++] = b4096 + 64 * 3 + 5;
+	nevents = (int)n;
+
+	LOCK(&mx);
+
+	for (i = 0; i < n; i++) {
+		isc_time_set(&wheelexpires[i], (unsigned int)(ticks[i] / 1000),
+			     (unsigned int)(ticks[i] % 1000) * 1000000);
+		wheeltimers[i] = NULL;
+		result = isc_timer_create(timermgr, isc_timertype_once,
+					  &wheelexpires[i], NULL, task,
+					  wheel_event, (void *)i,
+					  &wheeltimers[i]);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	/*
+	 * A timer left behind never fires, so give up a second after
+	 * the last one is due.
+	 */
+	tick = ticks[n - 1] + 1000;
+	isc_time_set(&endtime, (unsigned int)(tick / 1000),
+		     (unsigned int)(tick % 1000) * 1000000);
+	while (eventcnt != nevents) {
+		result = isc_condition_waituntil(&cv, &mx, &endtime);
+		if (result == ISC_R_TIMEDOUT)
+			break;
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	assert_int_equal(eventcnt, nevents);
+
+	UNLOCK(&mx);
+
+	for (i = 0; i < n; i++) {
+		isc_timer_detach(&wheeltimers[i]);
+	}
+	isc_task_destroy(&task);
+	isc_mutex_destroy(&mx);
+	(void) isc_condition_destroy(&cv);
+}
+
 int
 main(int argc, char **argv) {
 	const struct CMUnitTest tests[] = {
@@ -567,6 +808,20 @@ main(int argc, char **argv) {
 		cmocka_unit_test_setup_teardown(once_idle, _setup, _teardown),
 		cmocka_unit_test_setup_teardown(reset, _setup, _teardown),
 		cmocka_unit_test_setup_teardown(purge, _setup, _teardown),
+		cmocka_unit_test_setup_teardown(ticker, _setup_wheel,
+						_teardown),
+		cmocka_unit_test_setup_teardown(once_life, _setup_wheel,
+						_teardown),
+		cmocka_unit_test_setup_teardown(once_idle, _setup_wheel,
+						_teardown),
+		cmocka_unit_test_setup_teardown(reset, _setup_wheel,
+						_teardown),
+		cmocka_unit_test_setup_teardown(purge, _setup_wheel,
+						_teardown),
+		cmocka_unit_test_setup_teardown(wheel, _setup_wheel,
+						_teardown),
+		cmocka_unit_test_setup_teardown(wheel_boundary, _setup_wheel,
+						_teardown),
 	};
 	int c;
 
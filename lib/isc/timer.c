@@ -15,12 +15,14 @@
 #include <stdbool.h>
 
 #include <isc/app.h>
+#include <isc/atomic.h>
 #include <isc/condition.h>
 #include <isc/heap.h>
 #include <isc/log.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
 #include <isc/once.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/task.h>
@@ -55,16 +57,33 @@
 
 typedef struct isc__timer isc__timer_t;
 typedef struct isc__timermgr isc__timermgr_t;
+typedef struct isc__timerwheel isc__timerwheel_t;
+typedef ISC_LIST(isc__timer_t) isc__timerlist_t;
+
+/*%
+ * Timing wheel geometry.  Each level has WHEEL_SLOTS slots, and a slot
+ * on level 'n' covers WHEEL_SLOTS^n ticks of one millisecond.  Timers
+ * too far in the future for the top level are parked on an overflow
+ * list, which is re-examined each time the top level wraps (every
+ * 2^36 ms, or a little over two years).
+ */
+#define WHEEL_BITS			6
+#define WHEEL_SLOTS			(1 << WHEEL_BITS)
+#define WHEEL_MASK			(WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS			6
+#define WHEEL_OVERFLOW			(WHEEL_LEVELS * WHEEL_SLOTS + 1)
+#define WHEEL_NOTICK			UINT64_MAX
 
 struct isc__timer {
 	/*! Not locked. */
 	isc_timer_t			common;
 	isc__timermgr_t *		manager;
+	isc__timerwheel_t *		wheel;
 	isc_mutex_t			lock;
 	/*! Locked by timer lock. */
 	unsigned int			references;
 	isc_time_t			idle;
-	/*! Locked by manager lock. */
+	/*! Locked by manager lock, or by the wheel lock if 'wheel'. */
 	isc_timertype_t			type;
 	isc_time_t			expires;
 	isc_interval_t			interval;
@@ -73,7 +92,25 @@ struct isc__timer {
 	void *				arg;
 	unsigned int			index;
 	isc_time_t			due;
+	uint64_t			tick;
 	LINK(isc__timer_t)		link;
+	LINK(isc__timer_t)		slotlink;
+};
+
+/*%
+ * One shard of a timing wheel manager.  Timers are spread over the
+ * shards when they are created, so that resetting timers from several
+ * worker threads does not serialize on a single lock.
+ */
+struct isc__timerwheel {
+	isc_mutex_t			lock;
+	/* Locked by wheel lock. */
+	isc__timerlist_t		timers;
+	unsigned int			nscheduled;
+	uint64_t			now;
+	uint64_t			occupied[WHEEL_LEVELS];
+	isc__timerlist_t		slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	isc__timerlist_t		overflow;
 };
 
 #define TIMER_MANAGER_MAGIC		ISC_MAGIC('T', 'I', 'M', 'M')
@@ -84,9 +121,15 @@ struct isc__timermgr {
 	isc_timermgr_t			common;
 	isc_mem_t *			mctx;
 	isc_mutex_t			lock;
+	isc_timermgrtype_t		type;
+	unsigned int			nwheels;
+	isc__timerwheel_t *		wheels;
+	atomic_uint_fast32_t		nextwheel;
+	atomic_uint_fast64_t		wheeldue;
 	/* Locked by manager lock. */
 	bool			done;
-	LIST(isc__timer_t)		timers;
+	bool			poked;
+	isc__timerlist_t		timers;
 	unsigned int			nscheduled;
 	isc_time_t			due;
 	isc_condition_t			wakeup;
@@ -97,6 +140,202 @@ struct isc__timermgr {
 void
 isc_timermgr_poke(isc_timermgr_t *manager0);
 
+/*
+ * Timing wheel support.
+ */
+
+static inline uint64_t
+time_totick(const isc_time_t *t, bool roundup) {
+	uint64_t tick;
+	unsigned int ns;
+
+	tick = (uint64_t)isc_time_seconds(t) * 1000;
+	ns = isc_time_nanoseconds(t);
+	if (roundup)
+		ns += 999999;
+	return (tick + ns / 1000000);
+}
+
+static inline void
+tick_totime(uint64_t tick, isc_time_t *t) {
+	isc_time_set(t, (unsigned int)(tick / 1000),
+		     (unsigned int)(tick % 1000) * 1000000);
+}
+
+static inline unsigned int
+lowest_bit(uint64_t bits) {
+	INSIST(bits != 0);
+#ifdef HAVE_BUILTIN_CLZ
+	return (63 - __builtin_clzll(bits & (~bits + 1)));
+#else
+	{
+		unsigned int bit = 0;
+
+		while ((bits & 1) == 0) {
+			bits >>= 1;
+			bit++;
+		}
+		return (bit);
+	}
+#endif
+}
+
+static void
+wheel_insert(isc__timerwheel_t *wheel, isc__timer_t *timer) {
+	unsigned int level = 0, slot;
+	uint64_t tick, diff;
+
+	/*
+	 * The timer goes on the level of the most significant digit
+	 * in which its tick differs from the current wheel position, so
+	 * it is always in a slot ahead of the one currently being
+	 * processed on that level.  It moves down when that slot is
+	 * reached (see wheel_advance()).
+	 */
+	tick = timer->tick;
+	if (tick < wheel->now)
+		tick = wheel->now;
+	diff = tick ^ wheel->now;
+	if ((diff >> (WHEEL_BITS * WHEEL_LEVELS)) != 0) {
+		APPEND(wheel->overflow, timer, slotlink);
+		timer->index = WHEEL_OVERFLOW;
+		return;
+	}
+	while ((diff >> (WHEEL_BITS * (level + 1))) != 0)
+		level++;
+
+	slot = (tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	APPEND(wheel->slots[level][slot], timer, slotlink);
+	wheel->occupied[level] |= (uint64_t)1 << slot;
+	timer->index = level * WHEEL_SLOTS + slot + 1;
+}
+
+static void
+wheel_remove(isc__timerwheel_t *wheel, isc__timer_t *timer) {
+	unsigned int level, slot;
+
+	INSIST(timer->index > 0);
+
+	if (timer->index == WHEEL_OVERFLOW) {
+		UNLINK(wheel->overflow, timer, slotlink);
+	} else {
+		level = (timer->index - 1) / WHEEL_SLOTS;
+		slot = (timer->index - 1) % WHEEL_SLOTS;
+		UNLINK(wheel->slots[level][slot], timer, slotlink);
+		if (EMPTY(wheel->slots[level][slot]))
+			wheel->occupied[level] &= ~((uint64_t)1 << slot);
+	}
+	timer->index = 0;
+}
+
+/*%
+ * Return the first tick at which the wheel has work to do: either a
+ * level 0 slot to expire or a higher level slot to cascade.
+ */
+static uint64_t
+wheel_next(isc__timerwheel_t *wheel) {
+	unsigned int level, shift, cur;
+	uint64_t bits, base;
+
+	if (wheel->nscheduled == 0)
+		return (WHEEL_NOTICK);
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		shift = WHEEL_BITS * level;
+		cur = (wheel->now >> shift) & WHEEL_MASK;
+		bits = wheel->occupied[level];
+		if (level == 0)
+			bits &= ~(uint64_t)0 << cur;
+		else if (cur == WHEEL_MASK)
+			bits = 0;
+		else
+			bits &= ~(uint64_t)0 << (cur + 1);
+		if (bits != 0) {
+			base = (wheel->now >> (shift + WHEEL_BITS)) <<
+				(shift + WHEEL_BITS);
+			return (base | ((uint64_t)lowest_bit(bits) << shift));
+		}
+	}
+
+	if (!EMPTY(wheel->overflow)) {
+		shift = WHEEL_BITS * WHEEL_LEVELS;
+		return (((wheel->now >> shift) + 1) << shift);
+	}
+
+	return (WHEEL_NOTICK);
+}
+
+static void
+wheel_cascade(isc__timerwheel_t *wheel, isc__timerlist_t *list) {
+	isc__timerlist_t timers;
+	isc__timer_t *timer;
+
+	timers = *list;
+	INIT_LIST(*list);
+	while ((timer = HEAD(timers)) != NULL) {
+		UNLINK(timers, timer, slotlink);
+		wheel_insert(wheel, timer);
+	}
+}
+
+/*%
+ * Move the wheel position to 'tick', moving timers down from the
+ * higher level slots that start there, highest level first.  This must
+ * be done whenever the position changes, as wheel_next() only looks
+ * ahead of the current slot on each level.
+ */
+static void
+wheel_moveto(isc__timerwheel_t *wheel, uint64_t tick) {
+	unsigned int level, slot;
+	uint64_t mask;
+
+	INSIST(tick >= wheel->now);
+	wheel->now = tick;
+
+	mask = ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+	if ((tick & mask) == 0)
+		wheel_cascade(wheel, &wheel->overflow);
+	for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+		mask = ((uint64_t)1 << (WHEEL_BITS * level)) - 1;
+		if ((tick & mask) != 0)
+			continue;
+		slot = (tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+		wheel->occupied[level] &= ~((uint64_t)1 << slot);
+		wheel_cascade(wheel, &wheel->slots[level][slot]);
+	}
+}
+
+static void
+wheel_poke(isc__timermgr_t *manager, uint64_t tick) {
+	/*
+	 * Wake the run thread if it is going to sleep past 'tick'.
+	 * Lock order is wheel lock, then manager lock.
+	 */
+	if (tick < atomic_load_explicit(&manager->wheeldue,
+					memory_order_acquire))
+	{
+		LOCK(&manager->lock);
+		manager->poked = true;
+		XTRACE("signal (poke)");
+		SIGNAL(&manager->wakeup);
+		UNLOCK(&manager->lock);
+	}
+}
+
+static inline isc_mutex_t *
+timer_schedlock(isc__timer_t *timer) {
+	if (timer->wheel != NULL)
+		return (&timer->wheel->lock);
+	return (&timer->manager->lock);
+}
+
+static inline isc__timerlist_t *
+timer_list(isc__timer_t *timer) {
+	if (timer->wheel != NULL)
+		return (&timer->wheel->timers);
+	return (&timer->manager->timers);
+}
+
 static inline isc_result_t
 schedule(isc__timer_t *timer, isc_time_t *now, bool signal_ok) {
 	isc_result_t result;
@@ -137,6 +376,25 @@ schedule(isc__timer_t *timer, isc_time_t *now, bool signal_ok) {
 	 * Schedule the timer.
 	 */
 
+	if (timer->wheel != NULL) {
+		isc__timerwheel_t *wheel = timer->wheel;
+
+		if (timer->index > 0)
+			wheel_remove(wheel, timer);
+		else
+			wheel->nscheduled++;
+		timer->due = due;
+		timer->tick = time_totick(&due, true);
+		wheel_insert(wheel, timer);
+
+		XTRACETIMER("schedule", timer, due);
+
+		if (signal_ok)
+			wheel_poke(manager, timer->tick);
+
+		return (ISC_R_SUCCESS);
+	}
+
 	if (timer->index > 0) {
 		/*
 		 * Already scheduled.
@@ -191,6 +449,14 @@ deschedule(isc__timer_t *timer) {
 	 */
 
 	manager = timer->manager;
+	if (timer->wheel != NULL) {
+		if (timer->index > 0) {
+			wheel_remove(timer->wheel, timer);
+			INSIST(timer->wheel->nscheduled > 0);
+			timer->wheel->nscheduled--;
+		}
+		return;
+	}
 	if (timer->index > 0) {
 		if (timer->index == 1)
 			need_wakeup = true;
@@ -213,7 +479,7 @@ destroy(isc__timer_t *timer) {
 	 * The caller must ensure it is safe to destroy the timer.
 	 */
 
-	LOCK(&manager->lock);
+	LOCK(timer_schedlock(timer));
 
 	(void)isc_task_purgerange(timer->task,
 				  timer,
@@ -221,9 +487,9 @@ destroy(isc__timer_t *timer) {
 				  ISC_TIMEREVENT_LASTEVENT,
 				  NULL);
 	deschedule(timer);
-	UNLINK(manager->timers, timer, link);
+	UNLINK(*timer_list(timer), timer, link);
 
-	UNLOCK(&manager->lock);
+	UNLOCK(timer_schedlock(timer));
 
 	isc_task_detach(&timer->task);
 	isc_mutex_destroy(&timer->lock);
@@ -284,6 +550,14 @@ isc_timer_create(isc_timermgr_t *manager0, isc_timertype_t type,
 		return (ISC_R_NOMEMORY);
 
 	timer->manager = manager;
+	timer->wheel = NULL;
+	if (manager->type == isc_timermgrtype_wheel) {
+		unsigned int n;
+
+		n = atomic_fetch_add_explicit(&manager->nextwheel, 1,
+					      memory_order_relaxed);
+		timer->wheel = &manager->wheels[n % manager->nwheels];
+	}
 	timer->references = 1;
 
 	if (type == isc_timertype_once && !isc_interval_iszero(interval)) {
@@ -313,12 +587,14 @@ isc_timer_create(isc_timermgr_t *manager0, isc_timertype_t type,
 	 */
 	DE_CONST(arg, timer->arg);
 	timer->index = 0;
+	timer->tick = 0;
 	isc_mutex_init(&timer->lock);
 	ISC_LINK_INIT(timer, link);
+	ISC_LINK_INIT(timer, slotlink);
 	timer->common.impmagic = TIMER_MAGIC;
 	timer->common.magic = ISCAPI_TIMER_MAGIC;
 
-	LOCK(&manager->lock);
+	LOCK(timer_schedlock(timer));
 
 	/*
 	 * Note we don't have to lock the timer like we normally would because
@@ -331,10 +607,10 @@ isc_timer_create(isc_timermgr_t *manager0, isc_timertype_t type,
 		result = ISC_R_SUCCESS;
 	if (result == ISC_R_SUCCESS) {
 		*timerp = (isc_timer_t *)timer;
-		APPEND(manager->timers, timer, link);
+		APPEND(*timer_list(timer), timer, link);
 	}
 
-	UNLOCK(&manager->lock);
+	UNLOCK(timer_schedlock(timer));
 
 	if (result != ISC_R_SUCCESS) {
 		timer->common.impmagic = 0;
@@ -391,7 +667,7 @@ isc_timer_reset(isc_timer_t *timer0, isc_timertype_t type,
 		isc_time_settoepoch(&now);
 	}
 
-	LOCK(&manager->lock);
+	LOCK(timer_schedlock(timer));
 	LOCK(&timer->lock);
 
 	if (purge)
@@ -419,7 +695,7 @@ isc_timer_reset(isc_timer_t *timer0, isc_timertype_t type,
 	}
 
 	UNLOCK(&timer->lock);
-	UNLOCK(&manager->lock);
+	UNLOCK(timer_schedlock(timer));
 
 	return (result);
 }
@@ -513,14 +789,93 @@ isc_timer_detach(isc_timer_t **timerp) {
 	*timerp = NULL;
 }
 
-static void
-dispatch(isc__timermgr_t *manager, isc_time_t *now) {
-	bool done = false, post_event, need_schedule;
+/*%
+ * Post the event for an expired timer, if any, and return true if it
+ * has to be scheduled again.
+ */
+static bool
+expire(isc__timermgr_t *manager, isc__timer_t *timer, isc_time_t *now) {
+	bool post_event, need_schedule;
 	isc_timerevent_t *event;
 	isc_eventtype_t type = 0;
+	bool idle;
+
+	if (timer->type == isc_timertype_ticker) {
+		type = ISC_TIMEREVENT_TICK;
+		post_event = true;
+		need_schedule = true;
+	} else if (timer->type == isc_timertype_limited) {
+		int cmp;
+		cmp = isc_time_compare(now, &timer->expires);
+		if (cmp >= 0) {
+			type = ISC_TIMEREVENT_LIFE;
+			post_event = true;
+			need_schedule = false;
+		} else {
+			type = ISC_TIMEREVENT_TICK;
+			post_event = true;
+			need_schedule = true;
+		}
+	} else if (!isc_time_isepoch(&timer->expires) &&
+		   isc_time_compare(now,
+				    &timer->expires) >= 0) {
+		type = ISC_TIMEREVENT_LIFE;
+		post_event = true;
+		need_schedule = false;
+	} else {
+		idle = false;
+
+		LOCK(&timer->lock);
+		if (!isc_time_isepoch(&timer->idle) &&
+		    isc_time_compare(now,
+				     &timer->idle) >= 0) {
+			idle = true;
+		}
+		UNLOCK(&timer->lock);
+		if (idle) {
+			type = ISC_TIMEREVENT_IDLE;
+			post_event = true;
+			need_schedule = false;
+		} else {
+			/*
+			 * Idle timer has been touched;
+			 * reschedule.
+			 */
+			XTRACEID("idle reschedule", timer);
+			post_event = false;
+			need_schedule = true;
+		}
+	}
+
+	if (post_event) {
+		XTRACEID("posting", timer);
+		/*
+		 * XXX We could preallocate this event.
+		 */
+		event = (isc_timerevent_t *)isc_event_allocate(manager->mctx,
+					   timer,
+					   type,
+					   timer->action,
+					   timer->arg,
+					   sizeof(*event));
+
+		if (event != NULL) {
+			event->due = timer->due;
+			isc_task_send(timer->task,
+				      ISC_EVENT_PTR(&event));
+		} else
+			UNEXPECTED_ERROR(__FILE__, __LINE__, "%s",
+					 "couldn't allocate event");
+	}
+
+	return (need_schedule);
+}
+
+static void
+dispatch(isc__timermgr_t *manager, isc_time_t *now) {
+	bool done = false, need_schedule;
 	isc__timer_t *timer;
 	isc_result_t result;
-	bool idle;
 
 	/*!
 	 * The caller must be holding the manager lock.
@@ -530,73 +885,7 @@ dispatch(isc__timermgr_t *manager, isc_time_t *now) {
 		timer = isc_heap_element(manager->heap, 1);
 		INSIST(timer != NULL && timer->type != isc_timertype_inactive);
 		if (isc_time_compare(now, &timer->due) >= 0) {
-			if (timer->type == isc_timertype_ticker) {
-				type = ISC_TIMEREVENT_TICK;
-				post_event = true;
-				need_schedule = true;
-			} else if (timer->type == isc_timertype_limited) {
-				int cmp;
-				cmp = isc_time_compare(now, &timer->expires);
-				if (cmp >= 0) {
-					type = ISC_TIMEREVENT_LIFE;
-					post_event = true;
-					need_schedule = false;
-				} else {
-					type = ISC_TIMEREVENT_TICK;
-					post_event = true;
-					need_schedule = true;
-				}
-			} else if (!isc_time_isepoch(&timer->expires) &&
-				   isc_time_compare(now,
-						    &timer->expires) >= 0) {
-				type = ISC_TIMEREVENT_LIFE;
-				post_event = true;
-				need_schedule = false;
-			} else {
-				idle = false;
-
-				LOCK(&timer->lock);
-				if (!isc_time_isepoch(&timer->idle) &&
-				    isc_time_compare(now,
-						     &timer->idle) >= 0) {
-					idle = true;
-				}
-				UNLOCK(&timer->lock);
-				if (idle) {
-					type = ISC_TIMEREVENT_IDLE;
-					post_event = true;
-					need_schedule = false;
-				} else {
-					/*
-					 * Idle timer has been touched;
-					 * reschedule.
-					 */
-					XTRACEID("idle reschedule", timer);
-					post_event = false;
-					need_schedule = true;
-				}
-			}
-
-			if (post_event) {
-				XTRACEID("posting", timer);
-				/*
-				 * XXX We could preallocate this event.
-				 */
-				event = (isc_timerevent_t *)isc_event_allocate(manager->mctx,
-							   timer,
-							   type,
-							   timer->action,
-							   timer->arg,
-							   sizeof(*event));
-
-				if (event != NULL) {
-					event->due = timer->due;
-					isc_task_send(timer->task,
-						      ISC_EVENT_PTR(&event));
-				} else
-					UNEXPECTED_ERROR(__FILE__, __LINE__, "%s",
-							 "couldn't allocate event");
-			}
+			need_schedule = expire(manager, timer, now);
 
 			timer->index = 0;
 			isc_heap_delete(manager->heap, 1);
@@ -617,6 +906,61 @@ dispatch(isc__timermgr_t *manager, isc_time_t *now) {
 	}
 }
 
+static void
+wheel_advance(isc__timermgr_t *manager, isc__timerwheel_t *wheel,
+	      isc_time_t *now)
+{
+	isc__timerlist_t timers;
+	isc__timer_t *timer;
+	isc_result_t result;
+	uint64_t limit, tick;
+	unsigned int slot;
+
+	/*!
+	 * The caller must be holding the wheel lock.
+	 *
+	 * Process every tick up to and including 'now', skipping
+	 * directly from one occupied slot to the next.
+	 */
+
+	limit = time_totick(now, false);
+	while ((tick = wheel_next(wheel)) <= limit) {
+		if (tick != wheel->now)
+			wheel_moveto(wheel, tick);
+
+		/*
+		 * Expire the level 0 slot.  Anything rescheduled from
+		 * here is due after 'limit', so it cannot land back in
+		 * this slot.
+		 */
+		slot = tick & WHEEL_MASK;
+		wheel->occupied[0] &= ~((uint64_t)1 << slot);
+		timers = wheel->slots[0][slot];
+		INIT_LIST(wheel->slots[0][slot]);
+		wheel_moveto(wheel, tick + 1);
+
+		while ((timer = HEAD(timers)) != NULL) {
+			UNLINK(timers, timer, slotlink);
+			INSIST(timer->type != isc_timertype_inactive);
+			timer->index = 0;
+			INSIST(wheel->nscheduled > 0);
+			wheel->nscheduled--;
+
+			if (expire(manager, timer, now)) {
+				result = schedule(timer, now, false);
+				if (result != ISC_R_SUCCESS)
+					UNEXPECTED_ERROR(__FILE__, __LINE__,
+							 "%s: %u",
+							 "couldn't schedule timer",
+							 result);
+			}
+		}
+	}
+
+	if (wheel->now <= limit)
+		wheel_moveto(wheel, limit + 1);
+}
+
 static isc_threadresult_t
 #ifdef _WIN32			/* XXXDCL */
 WINAPI
@@ -654,6 +998,72 @@ run(void *uap) {
 	return ((isc_threadresult_t)0);
 }
 
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+run_wheel(void *uap) {
+	isc__timermgr_t *manager = uap;
+	isc__timerwheel_t *wheel;
+	isc_time_t now, due;
+	isc_result_t result;
+	uint64_t next, tick;
+	unsigned int i;
+
+	LOCK(&manager->lock);
+	while (!manager->done) {
+		/*
+		 * Make schedule() poke us while the wheels are being
+		 * scanned, so a timer added to an already scanned wheel
+		 * is not missed.
+		 */
+		manager->poked = false;
+		atomic_store_explicit(&manager->wheeldue, WHEEL_NOTICK,
+				      memory_order_release);
+		UNLOCK(&manager->lock);
+
+		TIME_NOW(&now);
+
+		XTRACETIME("running", now);
+
+		next = WHEEL_NOTICK;
+		for (i = 0; i < manager->nwheels; i++) {
+			wheel = &manager->wheels[i];
+			LOCK(&wheel->lock);
+			wheel_advance(manager, wheel, &now);
+			tick = wheel_next(wheel);
+			UNLOCK(&wheel->lock);
+			if (tick < next)
+				next = tick;
+		}
+
+		LOCK(&manager->lock);
+		atomic_store_explicit(&manager->wheeldue, next,
+				      memory_order_release);
+		if (manager->done || manager->poked)
+			continue;
+		if (next != WHEEL_NOTICK) {
+			tick_totime(next, &due);
+			XTRACETIME2("waituntil", due, now);
+			result = WAITUNTIL(&manager->wakeup, &manager->lock,
+					   &due);
+			INSIST(result == ISC_R_SUCCESS ||
+			       result == ISC_R_TIMEDOUT);
+		} else {
+			XTRACETIME("wait", now);
+			WAIT(&manager->wakeup, &manager->lock);
+		}
+		XTRACE("wakeup");
+	}
+	UNLOCK(&manager->lock);
+
+#ifdef OPENSSL_LEAKS
+	ERR_remove_state(0);
+#endif
+
+	return ((isc_threadresult_t)0);
+}
+
 static bool
 sooner(void *v1, void *v2) {
 	isc__timer_t *t1, *t2;
@@ -678,15 +1088,59 @@ set_index(void *what, unsigned int index) {
 	timer->index = index;
 }
 
+static void
+wheels_create(isc__timermgr_t *manager, isc_time_t *now) {
+	isc__timerwheel_t *wheel;
+	unsigned int i, level, slot;
+
+	for (i = 0; i < manager->nwheels; i++) {
+		wheel = &manager->wheels[i];
+		isc_mutex_init(&wheel->lock);
+		INIT_LIST(wheel->timers);
+		wheel->nscheduled = 0;
+		wheel->now = time_totick(now, false);
+		for (level = 0; level < WHEEL_LEVELS; level++) {
+			wheel->occupied[level] = 0;
+			for (slot = 0; slot < WHEEL_SLOTS; slot++)
+				INIT_LIST(wheel->slots[level][slot]);
+		}
+		INIT_LIST(wheel->overflow);
+	}
+}
+
+static void
+wheels_destroy(isc__timermgr_t *manager) {
+	unsigned int i;
+
+	for (i = 0; i < manager->nwheels; i++) {
+		INSIST(EMPTY(manager->wheels[i].timers));
+		INSIST(manager->wheels[i].nscheduled == 0);
+		isc_mutex_destroy(&manager->wheels[i].lock);
+	}
+	isc_mem_put(manager->mctx, manager->wheels,
+		    manager->nwheels * sizeof(manager->wheels[0]));
+	manager->wheels = NULL;
+}
+
 isc_result_t
 isc_timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp) {
+	return (isc_timermgr_create2(mctx, isc_timermgrtype_heap, managerp));
+}
+
+isc_result_t
+isc_timermgr_create2(isc_mem_t *mctx, isc_timermgrtype_t type,
+		     isc_timermgr_t **managerp)
+{
 	isc__timermgr_t *manager;
 	isc_result_t result;
+	isc_time_t now;
 
 	/*
 	 * Create a timer manager.
 	 */
 
+	REQUIRE(type == isc_timermgrtype_heap ||
+		type == isc_timermgrtype_wheel);
 	REQUIRE(managerp != NULL && *managerp == NULL);
 
 	manager = isc_mem_get(mctx, sizeof(*manager));
@@ -696,26 +1150,55 @@ isc_timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp) {
 	manager->common.impmagic = TIMER_MANAGER_MAGIC;
 	manager->common.magic = ISCAPI_TIMERMGR_MAGIC;
 	manager->mctx = NULL;
+	manager->type = type;
+	manager->nwheels = 0;
+	manager->wheels = NULL;
+	atomic_init(&manager->nextwheel, 0);
+	atomic_init(&manager->wheeldue, WHEEL_NOTICK);
 	manager->done = false;
+	manager->poked = false;
 	INIT_LIST(manager->timers);
 	manager->nscheduled = 0;
 	isc_time_settoepoch(&manager->due);
 	manager->heap = NULL;
-	result = isc_heap_create(mctx, sooner, set_index, 0, &manager->heap);
-	if (result != ISC_R_SUCCESS) {
-		INSIST(result == ISC_R_NOMEMORY);
-		isc_mem_put(mctx, manager, sizeof(*manager));
-		return (ISC_R_NOMEMORY);
+	if (type == isc_timermgrtype_wheel) {
+		/*
+		 * One wheel per CPU keeps lock contention between worker
+		 * threads resetting timers low.
+		 */
+		manager->nwheels = isc_os_ncpus();
+		if (manager->nwheels == 0)
+			manager->nwheels = 1;
+		manager->wheels = isc_mem_get(mctx, manager->nwheels *
+					      sizeof(manager->wheels[0]));
+		if (manager->wheels == NULL) {
+			isc_mem_put(mctx, manager, sizeof(*manager));
+			return (ISC_R_NOMEMORY);
+		}
+		TIME_NOW(&now);
+		wheels_create(manager, &now);
+	} else {
+		result = isc_heap_create(mctx, sooner, set_index, 0,
+					 &manager->heap);
+		if (result != ISC_R_SUCCESS) {
+			INSIST(result == ISC_R_NOMEMORY);
+			isc_mem_put(mctx, manager, sizeof(*manager));
+			return (ISC_R_NOMEMORY);
+		}
 	}
 	isc_mutex_init(&manager->lock);
 	isc_mem_attach(mctx, &manager->mctx);
 	isc_condition_init(&manager->wakeup);
-	if (isc_thread_create(run, manager, &manager->thread) !=
-	    ISC_R_SUCCESS) {
+	if (isc_thread_create(type == isc_timermgrtype_wheel ? run_wheel : run,
+			      manager, &manager->thread) != ISC_R_SUCCESS)
+	{
+		if (manager->wheels != NULL)
+			wheels_destroy(manager);
 		isc_mem_detach(&manager->mctx);
 		(void)isc_condition_destroy(&manager->wakeup);
 		isc_mutex_destroy(&manager->lock);
-		isc_heap_destroy(&manager->heap);
+		if (manager->heap != NULL)
+			isc_heap_destroy(&manager->heap);
 		isc_mem_put(mctx, manager, sizeof(*manager));
 		UNEXPECTED_ERROR(__FILE__, __LINE__, "%s",
 				 "isc_thread_create() failed");
@@ -741,6 +1224,7 @@ void
 isc_timermgr_destroy(isc_timermgr_t **managerp) {
 	isc__timermgr_t *manager;
 	isc_mem_t *mctx;
+	unsigned int i;
 
 	/*
 	 * Destroy a timer manager.
@@ -750,6 +1234,12 @@ isc_timermgr_destroy(isc_timermgr_t **managerp) {
 	manager = (isc__timermgr_t *)*managerp;
 	REQUIRE(VALID_MANAGER(manager));
 
+	for (i = 0; i < manager->nwheels; i++) {
+		LOCK(&manager->wheels[i].lock);
+		REQUIRE(EMPTY(manager->wheels[i].timers));
+		UNLOCK(&manager->wheels[i].lock);
+	}
+
 	LOCK(&manager->lock);
 
 	REQUIRE(EMPTY(manager->timers));
@@ -772,7 +1262,10 @@ isc_timermgr_destroy(isc_timermgr_t **managerp) {
 	 */
 	(void)isc_condition_destroy(&manager->wakeup);
 	isc_mutex_destroy(&manager->lock);
-	isc_heap_destroy(&manager->heap);
+	if (manager->wheels != NULL)
+		wheels_destroy(manager);
+	if (manager->heap != NULL)
+		isc_heap_destroy(&manager->heap);
 	manager->common.impmagic = 0;
 	manager->common.magic = 0;
 	mctx = manager->mctx;
@@ -29,6 +29,10 @@
 #include <linux/rtnetlink.h>
 #endif
 
+#ifdef HAVE_LINUX_FILTER_H
+#include <linux/filter.h>
+#endif
+
 #include <errno.h>
 #include <fcntl.h>
 #include <stddef.h>
@@ -104,6 +108,27 @@ typedef struct {
 #define USE_SELECT
 #endif	/* HAVE_KQUEUE */
 
+/*%
+ * Read and write UDP datagrams several at a time where the system
+ * supports it.
+ */
+#if defined(HAVE_RECVMMSG)
+#define USE_RECVMMSG
+#endif
+#if defined(HAVE_SENDMMSG)
+#define USE_SENDMMSG
+#endif
+
+/*%
+ * Optionally replace epoll with io_uring; see "io_uring support" below.
+ */
+#if defined(USE_EPOLL) && defined(ENABLE_IO_URING)
+#define USE_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
 /*
  * Set by the -T dscp option on the command line. If set to a value
  * other than -1, we check to make sure DSCP values match it, and
@@ -322,9 +347,29 @@ typedef isc_event_t intev_t;
  */
 #define NRETRIES 10
 
+/*%
+ * The maximum number of UDP datagrams read by one recvmmsg() call or
+ * written by one sendmmsg() call.
+ */
+#define MAXBATCH 32
+
+/*%
+ * The number of sendmmsg() calls a sending thread makes on behalf of
+ * the others before leaving the rest of the batch to the watcher.
+ */
+#define MAXBATCHROUNDS 4
+
+/*%
+ * The maximum number of connections internal_accept() takes from a
+ * listening socket on one wakeup, so that a busy listener does not
+ * starve the other sockets handled by the same thread.
+ */
+#define MAXACCEPT 16
+
 typedef struct isc__socket isc__socket_t;
 typedef struct isc__socketmgr isc__socketmgr_t;
 typedef struct isc__socketthread isc__socketthread_t;
+typedef ISC_LIST(isc_socketevent_t) isc__socketeventlist_t;
 
 #define NEWCONNSOCK(ev) ((isc__socket_t *)(ev)->newsocket)
 
@@ -345,8 +390,9 @@ struct isc__socket {
 	char				name[16];
 	void *				tag;
 
-	ISC_LIST(isc_socketevent_t)		send_list;
-	ISC_LIST(isc_socketevent_t)		recv_list;
+	isc__socketeventlist_t			send_list;
+	isc__socketeventlist_t			recv_list;
+	isc__socketeventlist_t			batch_list;
 	ISC_LIST(isc_socket_newconnev_t)	accept_list;
 	ISC_LIST(isc_socket_connev_t)		connect_list;
 
@@ -359,6 +405,10 @@ struct isc__socket {
 				dupped : 1,
 				active : 1,         /* currently active */
 				pktdscp : 1;	    /* per packet dscp */
+	bool			batching;	    /* sending batch_list */
+#ifdef USE_URING
+	bool			uring;		    /* read through io_uring */
+#endif
 
 #ifdef ISC_PLATFORM_RECVOVERFLOW
 	unsigned char		overflow; /* used for MSG_TRUNC fake */
@@ -370,12 +420,47 @@ struct isc__socket {
 #define SOCKET_MANAGER_MAGIC	ISC_MAGIC('I', 'O', 'm', 'g')
 #define VALID_MANAGER(m)	ISC_MAGIC_VALID(m, SOCKET_MANAGER_MAGIC)
 
+#ifdef USE_URING
+/*%
+ * Per descriptor io_uring state, owned by the network thread except
+ * for 'udp', which is set when a socket is registered with the thread.
+ */
+#define URING_NBUFS	32	/*%< receive buffers per thread */
+#define URING_NAMELEN	sizeof(((isc_sockaddr_t *)0)->type)
+#ifdef USE_CMSG
+#define URING_CMSGLEN	RECVCMSGBUFLEN
+#else
+#define URING_CMSGLEN	0
+#endif
+#define URING_HDRLEN	(sizeof(struct io_uring_recvmsg_out) + \
+			 URING_NAMELEN + URING_CMSGLEN)
+#define URING_BUFSIZE	ISC_ALIGN(URING_HDRLEN + 65535, 64)
+
+typedef struct {
+	uint32_t		gen;		/*%< bumped on close */
+	uint32_t		pollevents;	/*%< of the pending poll */
+	bool			udp;		/*%< use multishot recvmsg */
+	bool			polling;	/*%< poll pending */
+	bool			pollcancel;	/*%< ... and being cancelled */
+	bool			receiving;	/*%< recvmsg pending */
+	bool			recvcancel;	/*%< ... and being cancelled */
+	bool			ready;		/*%< on the ready list */
+	bool			starved;	/*%< on the starved list */
+	bool			deferred;	/*%< on the deferred list */
+	bool			closing;	/*%< close() is deferred */
+	int			recverr;	/*%< errno of failed recvmsg */
+	int			head;		/*%< first held buffer */
+	int			tail;		/*%< last held buffer */
+} uringfd_t;
+#endif	/* USE_URING */
+
 struct isc__socketmgr {
 	/* Not locked. */
 	isc_socketmgr_t		common;
 	isc_mem_t	       *mctx;
 	isc_mutex_t		lock;
 	isc_stats_t		*stats;
+	isc_socketmgrtype_t	type;
 	int			nthreads;
 	isc__socketthread_t	*threads;
 	unsigned int		maxsocks;
@@ -395,6 +480,8 @@ struct isc__socketthread {
 	/* Locked by fdlock. */
 	isc__socket_t	       **fds;
 	int			*fdstate;
+	/* Used only by the thread itself. */
+	isc_eventlist_t		inlined;	/* see run_inline() */
 #ifdef USE_KQUEUE
 	int			kqueue_fd;
 	int			nevents;
@@ -422,6 +509,37 @@ struct isc__socketthread {
 	fd_set			*write_fds_copy;
 	int			maxfd;
 #endif	/* USE_SELECT */
+#ifdef USE_URING
+	bool			uring;
+	int			ring_fd;
+	void			*ring;
+	size_t			ringsize;
+	struct io_uring_sqe	*sqes;
+	size_t			sqessize;
+	uint32_t		*sq_head;
+	uint32_t		*sq_tail;
+	uint32_t		sq_mask;
+	uint32_t		sq_entries;
+	uint32_t		*cq_head;
+	uint32_t		*cq_tail;
+	uint32_t		cq_mask;
+	struct io_uring_cqe	*cqes;
+	struct io_uring_buf_ring *bufring;
+	size_t			bufringsize;
+	unsigned char		*bufs;
+	uint16_t		buftail;
+	unsigned int		nheld;
+	int			bufnext[URING_NBUFS];
+	uint32_t		buflen[URING_NBUFS];
+	struct msghdr		recvmsg;
+	uringfd_t		*uringfds;
+	int			*ready;
+	unsigned int		nready;
+	int			*starved;
+	unsigned int		nstarved;
+	int			*deferred;
+	unsigned int		ndeferred;
+#endif	/* USE_URING */
 };
 
 
@@ -429,6 +547,21 @@ struct isc__socketthread {
 #define MANAGED			1
 #define CLOSE_PENDING		2
 
+/*%
+ * URING_THREAD() is true if 'sock' is served by a network thread that
+ * uses io_uring, and URING_SOCKET() if 'sock' is read through its
+ * thread's multishot recvmsg, which needs 'sock->lock'; see "io_uring
+ * support" below.
+ */
+#ifdef USE_URING
+#define URING_THREAD(sock) \
+	((sock)->manager->threads[(sock)->threadid].uring)
+#define URING_SOCKET(sock)	((sock)->uring)
+#else
+#define URING_THREAD(sock)	false
+#define URING_SOCKET(sock)	false
+#endif
+
 /*
  * send() and recv() iovec counts
  */
@@ -460,7 +593,12 @@ static void build_msghdr_send(isc__socket_t *, char *, isc_socketevent_t *,
 static void build_msghdr_recv(isc__socket_t *, char *, isc_socketevent_t *,
 			      struct msghdr *, struct iovec *, size_t *);
 static bool process_ctlfd(isc__socketthread_t *thread);
+static void process_fd(isc__socketthread_t *thread, int fd, bool readable,
+		       bool writeable);
 static void setdscp(isc__socket_t *sock, isc_dscp_t dscp);
+#ifdef USE_URING
+static void uring_unshare(isc__socket_t *sock);
+#endif
 
 #define SELECT_POKE_SHUTDOWN		(-1)
 #define SELECT_POKE_NOTHING		(-2)
@@ -673,6 +811,334 @@ dec_stats(isc_stats_t *stats, isc_statscounter_t counterid) {
 		isc_stats_decrement(stats, counterid);
 }
 
+#ifdef USE_URING
+/*
+ * io_uring support.
+ *
+ * A network thread of a manager created with isc_socketmgrtype_uring
+ * waits on an io_uring instead of an epoll instance, if the kernel can
+ * do everything listed here.  Sockets are still watched and unwatched
+ * through watch_fd() and unwatch_fd(), which record the wanted events
+ * in epoll_events[] as before; uring_update() then brings the requests
+ * in flight for the descriptor in line with them.
+ *
+ * Readiness is reported by one-shot poll requests, which are re-armed
+ * after they complete, so they behave like level-triggered epoll.  UDP
+ * sockets are read differently: while there are receive events queued,
+ * a multishot recvmsg request places each datagram, with its address
+ * and control messages, in a buffer taken from a ring registered with
+ * the kernel.  The buffer is held on the descriptor's queue until
+ * internal_recv() copies it into the event at the head of the receive
+ * list and hands it back.  Nothing else reads these sockets, so
+ * datagrams are delivered in order without a system call per datagram.
+ *
+ * Requests carry the descriptor, what they are for and the descriptor's
+ * generation number, which changes when it is closed, so completions
+ * that arrive after the descriptor has been reused are recognised and
+ * dropped.  Requests are cancelled before the descriptor is closed, as
+ * closing it does not end them.
+ *
+ * Submissions are made by the io_uring_enter() call that waits for
+ * completions, or earlier if the submission queue fills up.  If that
+ * fails because the completion queue has overflowed, nothing more can
+ * be submitted until completions have been reaped, so the descriptor
+ * is put on the deferred list and uring_flush() tries again later.
+ * Closing such a descriptor is deferred too: a request for it that has
+ * not been submitted yet would otherwise apply to whatever reuses it.
+ */
+#define URING_ENTRIES		1024
+#define URING_BGID		0
+
+#define URING_POLL		0
+#define URING_RECV		1
+#define URING_CANCEL		2
+
+#define URING_DATA(g, fd, kind) \
+	(((uint64_t)(g) << 32) | ((uint64_t)(fd) << 2) | (kind))
+#define URING_DATA_GEN(d)	((uint32_t)((d) >> 32))
+#define URING_DATA_FD(d)	((int)(((d) & 0xffffffffU) >> 2))
+#define URING_DATA_KIND(d)	((int)((d) & 3))
+
+#define URING_LOAD_ACQUIRE(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define URING_STORE_RELEASE(p, v)	__atomic_store_n((p), (v), \
+							 __ATOMIC_RELEASE)
+
+static void
+uring_enter(isc__socketthread_t *thread, bool wait) {
+	char strbuf[ISC_STRERRORSIZE];
+	unsigned int tosubmit;
+	int ret;
+
+	for (;;) {
+		tosubmit = *thread->sq_tail -
+			   URING_LOAD_ACQUIRE(thread->sq_head);
+		if (tosubmit == 0 && !wait) {
+			return;
+		}
+		ret = syscall(__NR_io_uring_enter, thread->ring_fd, tosubmit,
+			      wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0,
+			      NULL, 0);
+		if (ret >= 0) {
+			if (!wait) {
+				continue;
+			}
+			return;
+		}
+		if (errno == EINTR) {
+			if (wait) {
+				return;
+			}
+			continue;
+		}
+		if (errno == EAGAIN || errno == EBUSY) {
+			/*
+			 * Out of memory for requests, or the completion
+			 * queue has overflowed; retrying won't help until
+			 * completions have been reaped, so let the caller
+			 * do that.
+			 */
+			return;
+		}
+		strerror_r(errno, strbuf, sizeof(strbuf));
+		FATAL_ERROR(__FILE__, __LINE__,
+			    "io_uring_enter() failed: %s", strbuf);
+	}
+}
+
+/*
+ * Put 'fd' on the list of descriptors that uring_flush() has to call
+ * uring_update() for, because a request for it could not be queued.
+ */
+static void
+uring_defer(isc__socketthread_t *thread, int fd) {
+	uringfd_t *ufd = &thread->uringfds[fd];
+
+	if (!ufd->deferred) {
+		INSIST(thread->ndeferred < thread->manager->maxsocks);
+		ufd->deferred = true;
+		thread->deferred[thread->ndeferred++] = fd;
+	}
+}
+
+/*
+ * Get a submission queue entry for a request for 'fd', or NULL, having
+ * deferred 'fd', if the submission queue is full and can't be emptied.
+ */
+static struct io_uring_sqe *
+uring_getsqe(isc__socketthread_t *thread, int fd) {
+	struct io_uring_sqe *sqe;
+	uint32_t tail = *thread->sq_tail;
+
+	if (tail - URING_LOAD_ACQUIRE(thread->sq_head) == thread->sq_entries) {
+		uring_enter(thread, false);
+		if (tail - URING_LOAD_ACQUIRE(thread->sq_head) ==
+		    thread->sq_entries)
+		{
+			uring_defer(thread, fd);
+			return (NULL);
+		}
+	}
+
+	sqe = &thread->sqes[tail & thread->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	return (sqe);
+}
+
+static void
+uring_pushsqe(isc__socketthread_t *thread) {
+	URING_STORE_RELEASE(thread->sq_tail, *thread->sq_tail + 1);
+}
+
+static void
+uring_arm_poll(isc__socketthread_t *thread, int fd, uint32_t events) {
+	uringfd_t *ufd = &thread->uringfds[fd];
+	struct io_uring_sqe *sqe = uring_getsqe(thread, fd);
+
+	if (sqe == NULL) {
+		return;
+	}
+
+	/* EPOLLIN and EPOLLOUT have the same values as POLLIN and POLLOUT. */
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	sqe->poll32_events = (events << 16) | (events >> 16);
+#else
+	sqe->poll32_events = events;
+#endif
+	sqe->user_data = URING_DATA(ufd->gen, fd, URING_POLL);
+	uring_pushsqe(thread);
+
+	ufd->polling = true;
+	ufd->pollevents = events;
+}
+
+static void
+uring_arm_recv(isc__socketthread_t *thread, int fd) {
+	uringfd_t *ufd = &thread->uringfds[fd];
+	struct io_uring_sqe *sqe = uring_getsqe(thread, fd);
+
+	if (sqe == NULL) {
+		return;
+	}
+
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)&thread->recvmsg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BGID;
+	sqe->user_data = URING_DATA(ufd->gen, fd, URING_RECV);
+	uring_pushsqe(thread);
+
+	ufd->receiving = true;
+}
+
+static void
+uring_cancel(isc__socketthread_t *thread, int fd, int kind) {
+	uringfd_t *ufd = &thread->uringfds[fd];
+	struct io_uring_sqe *sqe = uring_getsqe(thread, fd);
+
+	if (sqe == NULL) {
+		return;
+	}
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = URING_DATA(ufd->gen, fd, kind);
+	sqe->user_data = URING_DATA(ufd->gen, fd, URING_CANCEL);
+	uring_pushsqe(thread);
+
+	if (kind == URING_POLL) {
+		ufd->pollcancel = true;
+	} else {
+		ufd->recvcancel = true;
+	}
+}
+
+/*
+ * Hand receive buffer 'bid' back to the kernel.
+ */
+static void
+uring_putbuf(isc__socketthread_t *thread, int bid) {
+	struct io_uring_buf *buf;
+
+	buf = &thread->bufring->bufs[thread->buftail & (URING_NBUFS - 1)];
+	buf->addr = (uintptr_t)(thread->bufs + (size_t)bid * URING_BUFSIZE);
+	buf->len = URING_BUFSIZE;
+	buf->bid = bid;
+	thread->buftail++;
+	URING_STORE_RELEASE(&thread->bufring->tail, thread->buftail);
+}
+
+/*
+ * Put 'fd' on the list of descriptors that internal_recv() has to look
+ * at, because it has datagrams or an error waiting.
+ */
+static void
+uring_ready(isc__socketthread_t *thread, int fd) {
+	uringfd_t *ufd = &thread->uringfds[fd];
+
+	if (!ufd->ready) {
+		INSIST(thread->nready < thread->manager->maxsocks);
+		ufd->ready = true;
+		thread->ready[thread->nready++] = fd;
+	}
+}
+
+/*
+ * Make the requests in flight for 'fd' match the events wanted for it.
+ * A request that waits for something no longer wanted is cancelled,
+ * and one that is wanted but was being cancelled is armed again once
+ * its final completion has come in.
+ */
+static void
+uring_update(isc__socketthread_t *thread, int fd) {
+	uringfd_t *ufd = &thread->uringfds[fd];
+	uint32_t events = thread->epoll_events[fd];
+
+	if (ufd->udp) {
+		if ((events & EPOLLIN) != 0) {
+			if (!ufd->receiving && !ufd->starved) {
+				uring_arm_recv(thread, fd);
+			}
+			if (ufd->head != -1 || ufd->recverr != 0) {
+				uring_ready(thread, fd);
+			}
+		} else if (ufd->receiving && !ufd->recvcancel) {
+			uring_cancel(thread, fd, URING_RECV);
+		}
+		events &= ~EPOLLIN;
+	} else if (ufd->receiving || ufd->head != -1 || ufd->recverr != 0) {
+		/*
+		 * Left over from before uring_unshare(): stop reading
+		 * ahead, and hand out what is held before polling.
+		 */
+		if (ufd->receiving && !ufd->recvcancel) {
+			uring_cancel(thread, fd, URING_RECV);
+		}
+		if ((events & EPOLLIN) != 0 &&
+		    (ufd->head != -1 || ufd->recverr != 0))
+		{
+			uring_ready(thread, fd);
+			events &= ~EPOLLIN;
+		}
+	}
+
+	if (!ufd->polling) {
+		if (events != 0) {
+			uring_arm_poll(thread, fd, events);
+		}
+	} else if (!ufd->pollcancel &&
+		   (events == 0 || (events & ~ufd->pollevents) != 0))
+	{
+		uring_cancel(thread, fd, URING_POLL);
+	}
+}
+
+/*
+ * Forget about 'fd', which is about to be closed.  The requests queued
+ * by uring_update() must reach the kernel before the descriptor can be
+ * reused; if they can't yet, 'fd' is deferred and false is returned,
+ * and uring_flush() closes it later.
+ */
+static bool
+uring_close(isc__socketthread_t *thread, int fd) {
+	uringfd_t *ufd = &thread->uringfds[fd];
+
+	while (ufd->head != -1) {
+		int bid = ufd->head;
+		ufd->head = thread->bufnext[bid];
+		uring_putbuf(thread, bid);
+		thread->nheld--;
+	}
+	ufd->tail = -1;
+	ufd->recverr = 0;
+
+	if (ufd->polling || ufd->receiving) {
+		uring_enter(thread, false);
+		if (ufd->deferred ||
+		    *thread->sq_tail != URING_LOAD_ACQUIRE(thread->sq_head))
+		{
+			ufd->closing = true;
+			uring_defer(thread, fd);
+			return (false);
+		}
+	}
+
+	ufd->gen++;
+	ufd->polling = false;
+	ufd->pollcancel = false;
+	ufd->receiving = false;
+	ufd->recvcancel = false;
+	ufd->pollevents = 0;
+	ufd->closing = false;
+
+	return (true);
+}
+#endif	/* USE_URING */
+
 static inline isc_result_t
 watch_fd(isc__socketthread_t *thread, int fd, int msg) {
 	isc_result_t result = ISC_R_SUCCESS;
@@ -706,6 +1172,13 @@ watch_fd(isc__socketthread_t *thread, int fd, int msg) {
 		thread->epoll_events[fd] |= EPOLLOUT;
 	}
 
+#ifdef USE_URING
+	if (thread->uring) {
+		uring_update(thread, fd);
+		return (result);
+	}
+#endif
+
 	event.events = thread->epoll_events[fd];
 	memset(&event.data, 0, sizeof(event.data));
 	event.data.fd = fd;
@@ -790,6 +1263,13 @@ unwatch_fd(isc__socketthread_t *thread, int fd, int msg) {
 		thread->epoll_events[fd] &= ~(EPOLLOUT);
 	}
 
+#ifdef USE_URING
+	if (thread->uring) {
+		uring_update(thread, fd);
+		return (result);
+	}
+#endif
+
 	event.events = thread->epoll_events[fd];
 	memset(&event.data, 0, sizeof(event.data));
 	event.data.fd = fd;
@@ -880,6 +1360,11 @@ wakeup_socket(isc__socketthread_t *thread, int fd, int msg) {
 		thread->fdstate[fd] = CLOSED;
 		(void)unwatch_fd(thread, fd, SELECT_POKE_READ);
 		(void)unwatch_fd(thread, fd, SELECT_POKE_WRITE);
+#ifdef USE_URING
+		if (thread->uring && !uring_close(thread, fd)) {
+			return;
+		}
+#endif
 		(void)close(fd);
 		return;
 	}
@@ -1488,39 +1973,23 @@ dump_msg(struct msghdr *msg) {
 #define DOIO_HARD		2	/* i/o error, event sent */
 #define DOIO_EOF		3	/* EOF, no event sent */
 
+/*
+ * Classify a failed read on 'sock'.  If the error is to be reported,
+ * dev->result is set and DOIO_HARD is returned.
+ */
 static int
-doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
-	int cc;
-	struct iovec iov[MAXSCATTERGATHER_RECV];
-	size_t read_count;
-	struct msghdr msghdr;
-	int recv_errno;
+recv_error(isc__socket_t *sock, isc_socketevent_t *dev, int recv_errno) {
 	char strbuf[ISC_STRERRORSIZE];
-	char cmsgbuf[RECVCMSGBUFLEN] = {0};
-
-	build_msghdr_recv(sock, cmsgbuf, dev, &msghdr, iov, &read_count);
-
-#if defined(ISC_SOCKET_DEBUG)
-	dump_msg(&msghdr);
-#endif
-
-	cc = recvmsg(sock->fd, &msghdr, 0);
-	recv_errno = errno;
-
-#if defined(ISC_SOCKET_DEBUG)
-	dump_msg(&msghdr);
-#endif
 
-	if (cc < 0) {
-		if (SOFT_ERROR(recv_errno))
-			return (DOIO_SOFT);
+	if (SOFT_ERROR(recv_errno))
+		return (DOIO_SOFT);
 
-		if (isc_log_wouldlog(isc_lctx, IOEVENT_LEVEL)) {
-			strerror_r(recv_errno, strbuf, sizeof(strbuf));
-			socket_log(sock, NULL, IOEVENT,
-				  "doio_recv: recvmsg(%d) %d bytes, err %d/%s",
-				   sock->fd, cc, recv_errno, strbuf);
-		}
+	if (isc_log_wouldlog(isc_lctx, IOEVENT_LEVEL)) {
+		strerror_r(recv_errno, strbuf, sizeof(strbuf));
+		socket_log(sock, NULL, IOEVENT,
+			  "doio_recv: recvmsg(%d) failed, err %d/%s",
+			   sock->fd, recv_errno, strbuf);
+	}
 
 #define SOFT_OR_HARD(_system, _isc) \
 	if (recv_errno == _system) { \
@@ -1540,26 +2009,33 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 		return (DOIO_HARD); \
 	}
 
-		SOFT_OR_HARD(ECONNREFUSED, ISC_R_CONNREFUSED);
-		SOFT_OR_HARD(ENETUNREACH, ISC_R_NETUNREACH);
-		SOFT_OR_HARD(EHOSTUNREACH, ISC_R_HOSTUNREACH);
-		SOFT_OR_HARD(EHOSTDOWN, ISC_R_HOSTDOWN);
-		SOFT_OR_HARD(ENOBUFS, ISC_R_NORESOURCES);
-		/* Should never get this one but it was seen. */
+	SOFT_OR_HARD(ECONNREFUSED, ISC_R_CONNREFUSED);
+	SOFT_OR_HARD(ENETUNREACH, ISC_R_NETUNREACH);
+	SOFT_OR_HARD(EHOSTUNREACH, ISC_R_HOSTUNREACH);
+	SOFT_OR_HARD(EHOSTDOWN, ISC_R_HOSTDOWN);
+	SOFT_OR_HARD(ENOBUFS, ISC_R_NORESOURCES);
+	/* Should never get this one but it was seen. */
 #ifdef ENOPROTOOPT
-		SOFT_OR_HARD(ENOPROTOOPT, ISC_R_HOSTUNREACH);
+	SOFT_OR_HARD(ENOPROTOOPT, ISC_R_HOSTUNREACH);
 #endif
-		SOFT_OR_HARD(EINVAL, ISC_R_HOSTUNREACH);
+	SOFT_OR_HARD(EINVAL, ISC_R_HOSTUNREACH);
 
 #undef SOFT_OR_HARD
 #undef ALWAYS_HARD
 
-		dev->result = isc__errno2result(recv_errno);
-		inc_stats(sock->manager->stats,
-			  sock->statsindex[STATID_RECVFAIL]);
-		return (DOIO_HARD);
-	}
+	dev->result = isc__errno2result(recv_errno);
+	inc_stats(sock->manager->stats, sock->statsindex[STATID_RECVFAIL]);
+	return (DOIO_HARD);
+}
 
+/*
+ * Account for 'cc' bytes read into 'dev' through 'msghdr', which was
+ * set up by build_msghdr_recv() to read 'read_count' bytes.
+ */
+static int
+recv_complete(isc__socket_t *sock, isc_socketevent_t *dev,
+	      struct msghdr *msghdr, int cc, size_t read_count)
+{
 	/*
 	 * On TCP and UNIX sockets, zero length reads indicate EOF,
 	 * while on UDP sockets, zero length reads are perfectly valid,
@@ -1580,7 +2056,7 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 	}
 
 	if (sock->type == isc_sockettype_udp) {
-		dev->address.length = msghdr.msg_namelen;
+		dev->address.length = msghdr->msg_namelen;
 		if (isc_sockaddr_getport(&dev->address) == 0) {
 			if (isc_log_wouldlog(isc_lctx, IOEVENT_LEVEL)) {
 				socket_log(sock, &dev->address, IOEVENT,
@@ -1615,7 +2091,7 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 	 * If there are control messages attached, run through them and pull
 	 * out the interesting bits.
 	 */
-	process_cmsg(sock, &msghdr, dev);
+	process_cmsg(sock, msghdr, dev);
 
 	/*
 	 * update the buffers (if any) and the i/o count
@@ -1636,6 +2112,34 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 	return (DOIO_SUCCESS);
 }
 
+static int
+doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
+	int cc;
+	struct iovec iov[MAXSCATTERGATHER_RECV];
+	size_t read_count;
+	struct msghdr msghdr;
+	int recv_errno;
+	char cmsgbuf[RECVCMSGBUFLEN] = {0};
+
+	build_msghdr_recv(sock, cmsgbuf, dev, &msghdr, iov, &read_count);
+
+#if defined(ISC_SOCKET_DEBUG)
+	dump_msg(&msghdr);
+#endif
+
+	cc = recvmsg(sock->fd, &msghdr, 0);
+	recv_errno = errno;
+
+#if defined(ISC_SOCKET_DEBUG)
+	dump_msg(&msghdr);
+#endif
+
+	if (cc < 0)
+		return (recv_error(sock, dev, recv_errno));
+
+	return (recv_complete(sock, dev, &msghdr, cc, read_count));
+}
+
 /*
  * Returns:
  *	DOIO_SUCCESS	The operation succeeded.  dev->result contains
@@ -1761,6 +2265,66 @@ doio_send(isc__socket_t *sock, isc_socketevent_t *dev) {
 	return (DOIO_SUCCESS);
 }
 
+#ifdef USE_SENDMMSG
+/*
+ * Send the datagrams of the 'n' events in 'devs' on UDP socket 'sock'
+ * with as few sendmmsg() calls as possible.
+ *
+ * Returns the number of leading events that are finished, successfully
+ * or not, with dev->result set.  If that is less than 'n', the next
+ * event hit a soft error and should be retried or dropped.
+ */
+static unsigned int
+doio_sendmmsg(isc__socket_t *sock, isc_socketevent_t **devs, unsigned int n) {
+	struct mmsghdr msgs[MAXBATCH];
+	struct iovec iov[MAXBATCH][MAXSCATTERGATHER_SEND];
+	char cmsgbuf[MAXBATCH][SENDCMSGBUFLEN];
+	size_t write_count;
+	unsigned int i, done = 0;
+	int cc;
+
+	INSIST(n <= MAXBATCH);
+
+	/*
+	 * The 'maxudp' firewall simulation is left to doio_send().
+	 */
+	if (sock->manager->maxudp != 0) {
+		while (done < n && doio_send(sock, devs[done]) != DOIO_SOFT)
+			done++;
+		return (done);
+	}
+
+	memset(cmsgbuf, 0, n * sizeof(cmsgbuf[0]));
+	for (i = 0; i < n; i++) {
+		build_msghdr_send(sock, cmsgbuf[i], devs[i], &msgs[i].msg_hdr,
+				  iov[i], &write_count);
+		msgs[i].msg_len = 0;
+	}
+
+	while (done < n) {
+		cc = sendmmsg(sock->fd, &msgs[done], n - done, 0);
+		if (cc <= 0) {
+			/*
+			 * Nothing was sent.  Let doio_send() retry the first
+			 * datagram on its own and classify the error.
+			 */
+			if (doio_send(sock, devs[done]) == DOIO_SOFT)
+				break;
+			done++;
+			continue;
+		}
+
+		for (i = done; i < done + (unsigned int)cc; i++) {
+			devs[i]->n += msgs[i].msg_len;
+			devs[i]->result = ISC_R_SUCCESS;
+		}
+		done += cc;
+	}
+
+	return (done);
+}
+#endif /* USE_SENDMMSG */
+
 /*
  * Kill.
  *
@@ -1830,6 +2394,7 @@ destroy(isc__socket_t **sockp) {
 	INSIST(ISC_LIST_EMPTY(sock->accept_list));
 	INSIST(ISC_LIST_EMPTY(sock->recv_list));
 	INSIST(ISC_LIST_EMPTY(sock->send_list));
+	INSIST(ISC_LIST_EMPTY(sock->batch_list));
 	INSIST(sock->fd >= -1 && sock->fd < (int)manager->maxsocks);
 
 	if (sock->fd >= 0) {
@@ -1871,6 +2436,9 @@ allocate_socket(isc__socketmgr_t *manager, isc_sockettype_t type,
 	sock->threadid = -1;
 	sock->dscp = 0;		/* TOS/TCLASS is zero until set. */
 	sock->dupped = 0;
+#ifdef USE_URING
+	sock->uring = false;
+#endif
 	sock->statsindex = NULL;
 	sock->active = 0;
 
@@ -1884,8 +2452,10 @@ allocate_socket(isc__socketmgr_t *manager, isc_sockettype_t type,
 	 */
 	ISC_LIST_INIT(sock->recv_list);
 	ISC_LIST_INIT(sock->send_list);
+	ISC_LIST_INIT(sock->batch_list);
 	ISC_LIST_INIT(sock->accept_list);
 	ISC_LIST_INIT(sock->connect_list);
+	sock->batching = false;
 	sock->listener = 0;
 	sock->connected = 0;
 	sock->connecting = 0;
@@ -1920,6 +2490,7 @@ free_socket(isc__socket_t **socketp) {
 	INSIST(!sock->connecting);
 	INSIST(ISC_LIST_EMPTY(sock->recv_list));
 	INSIST(ISC_LIST_EMPTY(sock->send_list));
+	INSIST(ISC_LIST_EMPTY(sock->batch_list));
 	INSIST(ISC_LIST_EMPTY(sock->accept_list));
 	INSIST(ISC_LIST_EMPTY(sock->connect_list));
 	INSIST(!ISC_LINK_LINKED(sock, link));
@@ -2538,6 +3109,13 @@ socket_create(isc_socketmgr_t *manager0, int pf, isc_sockettype_t type,
 #if defined(USE_EPOLL)
 	thread->epoll_events[sock->fd] = 0;
 #endif
+#ifdef USE_URING
+	if (thread->uring) {
+		sock->uring = (sock->type == isc_sockettype_udp &&
+			       !sock->dupped);
+		thread->uringfds[sock->fd].udp = sock->uring;
+	}
+#endif
 #ifdef USE_DEVPOLL
 	INSIST(thread->fdpollinfo[sock->fd].want_read == 0 &&
 	       thread->fdpollinfo[sock->fd].want_write == 0);
@@ -2556,8 +3134,14 @@ socket_create(isc_socketmgr_t *manager0, int pf, isc_sockettype_t type,
 	socket_log(sock, NULL, CREATION,
 		   dup_socket != NULL ? "dupped" : "created");
 
-	return (ISC_R_SUCCESS);
-}
+#ifdef USE_URING
+	if (dup_socket != NULL) {
+		uring_unshare((isc__socket_t *)dup_socket);
+	}
+#endif
+
+	return (ISC_R_SUCCESS);
+}
 
 /*%
  * Create a new 'type' socket managed by 'manager'.  Events
@@ -2618,6 +3202,12 @@ isc_socket_open(isc_socket_t *sock0) {
 #if defined(USE_EPOLL)
 		thread->epoll_events[sock->fd] = 0;
 #endif
+#ifdef USE_URING
+		if (thread->uring) {
+			sock->uring = (sock->type == isc_sockettype_udp);
+			thread->uringfds[sock->fd].udp = sock->uring;
+		}
+#endif
 #ifdef USE_DEVPOLL
 		INSIST(thread->fdpollinfo[sock->fd].want_read == 0 &&
 		       thread->fdpollinfo[sock->fd].want_write == 0);
@@ -2767,6 +3357,89 @@ send_senddone_event(isc__socket_t *sock, isc_socketevent_t **dev) {
 	}
 }
 
+/*
+ * Completed I/O requests are frequently all for the same task (e.g. a
+ * burst of datagrams read by a single dispatcher).  Rather than posting
+ * them one at a time, consecutive done events for the same task are
+ * collected and posted with a single isc_task_sendtolist() call, which
+ * takes the task lock once per batch instead of once per event.
+ *
+ * If 'inlined' is set, events received with ISC_SOCKFLAG_INLINE are
+ * moved there instead, still holding their task in ev_sender, for
+ * run_inline() to deliver.
+ */
+typedef struct {
+	isc_task_t	       *task;
+	isc_eventlist_t		events;
+	unsigned int		attached;
+	isc_eventlist_t	       *inlined;
+} donebatch_t;
+
+static inline void
+donebatch_init(donebatch_t *batch) {
+	batch->task = NULL;
+	ISC_LIST_INIT(batch->events);
+	batch->attached = 0;
+	batch->inlined = NULL;
+}
+
+static void
+donebatch_flush(isc__socket_t *sock, donebatch_t *batch) {
+	if (batch->task == NULL)
+		return;
+
+	if (batch->attached > 0) {
+		isc_task_sendtolistanddetach(&batch->task, &batch->events,
+					     sock->threadid, batch->attached);
+	} else {
+		isc_task_sendtolist(batch->task, &batch->events,
+				    sock->threadid);
+	}
+
+	batch->task = NULL;
+	ISC_LIST_INIT(batch->events);
+	batch->attached = 0;
+}
+
+/*
+ * Remove 'dev' from 'list' and add it to 'batch', posting the batch
+ * first if it is destined for a different task.  The caller must call
+ * donebatch_flush() before releasing the socket lock.
+ */
+static void
+donebatch_add(isc__socket_t *sock, donebatch_t *batch,
+	      isc__socketeventlist_t *list, isc_socketevent_t **dev)
+{
+	isc_task_t *task;
+
+	INSIST(dev != NULL && *dev != NULL);
+
+	if (ISC_LINK_LINKED(*dev, ev_link))
+		ISC_LIST_DEQUEUE(*list, *dev, ev_link);
+
+	if (batch->inlined != NULL &&
+	    ((*dev)->attributes & ISC_SOCKEVENTATTR_INLINE) != 0)
+	{
+		ISC_LIST_APPEND(*batch->inlined, (isc_event_t *)*dev, ev_link);
+		*dev = NULL;
+		return;
+	}
+
+	task = (*dev)->ev_sender;
+	(*dev)->ev_sender = sock;
+
+	if (task != batch->task) {
+		donebatch_flush(sock, batch);
+		batch->task = task;
+	}
+
+	if (((*dev)->attributes & ISC_SOCKEVENTATTR_ATTACHED) != 0)
+		batch->attached++;
+
+	ISC_LIST_APPEND(batch->events, (isc_event_t *)*dev, ev_link);
+	*dev = NULL;
+}
+
 /*
  * See comments for send_recvdone_event() above.
  *
@@ -2798,6 +3471,10 @@ send_connectdone_event(isc__socket_t *sock, isc_socket_connev_t **dev) {
  * readable event, and the first item on the accept_list should be
  * the done event we want to send.  If the list is empty, this is a no-op,
  * so just unlock and return.
+ *
+ * While more done events are waiting, further connections are accepted
+ * in the same call, up to MAXACCEPT of them, until the kernel's queue
+ * of established connections is empty.
  */
 static void
 internal_accept(isc__socket_t *sock) {
@@ -2807,12 +3484,18 @@ internal_accept(isc__socket_t *sock) {
 	isc_task_t *task;
 	socklen_t addrlen;
 	int fd;
-	isc_result_t result = ISC_R_SUCCESS;
+	isc_result_t result;
 	char strbuf[ISC_STRERRORSIZE];
-	const char *err = "accept";
+	const char *err;
+	unsigned int naccepted = 0;
+	bool more, drained = false;
 
 	INSIST(VALID_SOCKET(sock));
 
+ again:
+	result = ISC_R_SUCCESS;
+	err = "accept";
+
 	LOCK(&sock->lock);
 	if (sock->fd < 0) {
 		/* Socket is gone */
@@ -2852,8 +3535,14 @@ internal_accept(isc__socket_t *sock) {
 
 	addrlen = sizeof(NEWCONNSOCK(dev)->peer_address.type);
 	memset(&NEWCONNSOCK(dev)->peer_address.type, 0, addrlen);
+#ifdef HAVE_ACCEPT4
+	fd = accept4(sock->fd, &NEWCONNSOCK(dev)->peer_address.type.sa,
+		     (void *)&addrlen, SOCK_NONBLOCK);
+	err = "accept4";
+#else
 	fd = accept(sock->fd, &NEWCONNSOCK(dev)->peer_address.type.sa,
 		    (void *)&addrlen);
+#endif
 
 #ifdef F_DUPFD
 	/*
@@ -2871,8 +3560,14 @@ internal_accept(isc__socket_t *sock) {
 #endif
 
 	if (fd < 0) {
-		if (SOFT_ERROR(errno))
+		if (SOFT_ERROR(errno)) {
+			/*
+			 * Running out of connections part way through
+			 * a batch is not a failure.
+			 */
+			drained = (naccepted > 0);
 			goto soft_error;
+		}
 		switch (errno) {
 		case ENFILE:
 		case EMFILE:
@@ -2951,12 +3646,14 @@ internal_accept(isc__socket_t *sock) {
 	/*
 	 * Poke watcher if there are more pending accepts.
 	 */
-	if (ISC_LIST_EMPTY(sock->accept_list))
+	more = !ISC_LIST_EMPTY(sock->accept_list);
+	if (!more)
 		unwatch_fd(thread, sock->fd,
 			   SELECT_POKE_ACCEPT);
 
 	UNLOCK(&sock->lock);
 
+#ifndef HAVE_ACCEPT4
 	if (fd != -1) {
 		result = make_nonblock(fd);
 		if (result != ISC_R_SUCCESS) {
@@ -2964,12 +3661,14 @@ internal_accept(isc__socket_t *sock) {
 			fd = -1;
 		}
 	}
+#endif
 
 	/*
 	 * -1 means the new socket didn't happen.
 	 */
 	if (fd != -1) {
 		int lockid = FDLOCK_ID(fd);
+		bool locked;
 
 		NEWCONNSOCK(dev)->fd = fd;
 		NEWCONNSOCK(dev)->threadid = gen_threadid(NEWCONNSOCK(dev));
@@ -2999,13 +3698,28 @@ internal_accept(isc__socket_t *sock) {
 			NEWCONNSOCK(dev)->active = 1;
 		}
 
-		LOCK(&nthread->fdlock[lockid]);
+		/*
+		 * process_fd() is holding the lock for the listening
+		 * socket's bucket; the new descriptor may hash to the
+		 * same one, in which case we must not lock it again.
+		 */
+		locked = (nthread == thread && lockid == FDLOCK_ID(sock->fd));
+		if (!locked) {
+			LOCK(&nthread->fdlock[lockid]);
+		}
 		nthread->fds[fd] = NEWCONNSOCK(dev);
 		nthread->fdstate[fd] = MANAGED;
 #if defined(USE_EPOLL)
 		nthread->epoll_events[fd] = 0;
 #endif
-		UNLOCK(&nthread->fdlock[lockid]);
+#ifdef USE_URING
+		if (nthread->uring) {
+			nthread->uringfds[fd].udp = false;
+		}
+#endif
+		if (!locked) {
+			UNLOCK(&nthread->fdlock[lockid]);
+		}
 
 		LOCK(&manager->lock);
 
@@ -3037,22 +3751,191 @@ internal_accept(isc__socket_t *sock) {
 	dev->ev_sender = sock;
 
 	isc_task_sendtoanddetach(&task, ISC_EVENT_PTR(&dev), sock->threadid);
+
+	if (fd != -1 && more && ++naccepted < MAXACCEPT)
+		goto again;
 	return;
 
  soft_error:
 	watch_fd(thread, sock->fd, SELECT_POKE_ACCEPT);
 	UNLOCK(&sock->lock);
 
-	inc_stats(manager->stats, sock->statsindex[STATID_ACCEPTFAIL]);
+	if (!drained)
+		inc_stats(manager->stats, sock->statsindex[STATID_ACCEPTFAIL]);
 	return;
 }
 
+#ifdef USE_RECVMMSG
+/*
+ * Read datagrams on UDP socket 'sock' for up to MAXBATCH of the events
+ * at the head of its receive queue with a single recvmmsg() call.  Each
+ * finished event is removed from the queue and added to 'batch'.
+ *
+ * Returns DOIO_SUCCESS if a datagram was read for every event that was
+ * offered, in which case there may be more waiting, and DOIO_SOFT if
+ * the socket has been drained.  Events that have not been completed,
+ * including those whose datagram was dropped, stay on the queue.
+ */
+static int
+doio_recvmmsg(isc__socket_t *sock, donebatch_t *batch) {
+	isc_socketevent_t *devs[MAXBATCH];
+	struct mmsghdr msgs[MAXBATCH];
+	struct iovec iov[MAXBATCH][MAXSCATTERGATHER_RECV];
+	size_t read_count[MAXBATCH];
+	char cmsgbuf[MAXBATCH][RECVCMSGBUFLEN];
+	isc_socketevent_t *dev;
+	unsigned int i, n = 0;
+	int cc;
+
+	for (dev = ISC_LIST_HEAD(sock->recv_list);
+	     dev != NULL && n < MAXBATCH;
+	     dev = ISC_LIST_NEXT(dev, ev_link))
+	{
+		devs[n] = dev;
+		build_msghdr_recv(sock, cmsgbuf[n], dev, &msgs[n].msg_hdr,
+				  iov[n], &read_count[n]);
+		msgs[n].msg_len = 0;
+		n++;
+	}
+
+	cc = recvmmsg(sock->fd, msgs, n, 0, NULL);
+	if (cc < 0) {
+		if (recv_error(sock, devs[0], errno) == DOIO_SOFT)
+			return (DOIO_SOFT);
+		donebatch_add(sock, batch, &sock->recv_list, &devs[0]);
+		return (DOIO_SUCCESS);
+	}
+
+	for (i = 0; i < (unsigned int)cc; i++) {
+		if (recv_complete(sock, devs[i], &msgs[i].msg_hdr,
+				  msgs[i].msg_len, read_count[i]) ==
+		    DOIO_SUCCESS)
+		{
+			donebatch_add(sock, batch, &sock->recv_list, &devs[i]);
+		}
+	}
+
+	return ((unsigned int)cc < n ? DOIO_SOFT : DOIO_SUCCESS);
+}
+#endif /* USE_RECVMMSG */
+
+#ifdef USE_URING
+/*
+ * Copy the datagram held in receive buffer 'bid' into 'dev', as
+ * doio_recv() would have read it.
+ */
+static int
+uring_recvbuf(isc__socket_t *sock, isc__socketthread_t *thread, int bid,
+	      isc_socketevent_t *dev)
+{
+	unsigned char *buf = thread->bufs + (size_t)bid * URING_BUFSIZE;
+	struct io_uring_recvmsg_out *out = (void *)buf;
+	unsigned char *name = buf + sizeof(*out);
+	unsigned char *control = name + URING_NAMELEN;
+	unsigned char *payload = control + URING_CMSGLEN;
+	size_t avail, read_count, cc;
+	struct msghdr msghdr;
+
+	INSIST(thread->buflen[bid] >= URING_HDRLEN);
+
+	avail = thread->buflen[bid] - URING_HDRLEN;
+	read_count = dev->region.length - dev->n;
+	cc = ISC_MIN(avail, read_count);
+
+	memset(&msghdr, 0, sizeof(msghdr));
+	memset(&dev->address, 0, sizeof(dev->address));
+	memmove(&dev->address.type, name, ISC_MIN(out->namelen,
+						  URING_NAMELEN));
+	msghdr.msg_name = &dev->address.type.sa;
+	msghdr.msg_namelen = out->namelen;
+	msghdr.msg_control = control;
+	msghdr.msg_controllen = out->controllen;
+	msghdr.msg_flags = out->flags;
+	if (avail > read_count) {
+		msghdr.msg_flags |= MSG_TRUNC;
+	}
+	memmove(dev->region.base + dev->n, payload, cc);
+
+	return (recv_complete(sock, dev, &msghdr, cc, read_count));
+}
+
+/*
+ * Complete as many of the events at the head of the receive queue of
+ * UDP socket 'sock' as there are datagrams held for it, adding them to
+ * 'batch'.  A failed recvmsg is reported to the first event, as
+ * doio_recv() would have.
+ */
+static void
+uring_recv(isc__socket_t *sock, donebatch_t *batch) {
+	isc__socketthread_t *thread = &sock->manager->threads[sock->threadid];
+	uringfd_t *ufd = &thread->uringfds[sock->fd];
+	isc_socketevent_t *dev;
+
+	dev = ISC_LIST_HEAD(sock->recv_list);
+	if (dev != NULL && ufd->recverr != 0) {
+		if (recv_error(sock, dev, ufd->recverr) == DOIO_HARD) {
+			donebatch_add(sock, batch, &sock->recv_list, &dev);
+		}
+		ufd->recverr = 0;
+	}
+
+	while ((dev = ISC_LIST_HEAD(sock->recv_list)) != NULL &&
+	       ufd->head != -1)
+	{
+		int bid = ufd->head;
+		int io_state;
+
+		ufd->head = thread->bufnext[bid];
+		if (ufd->head == -1) {
+			ufd->tail = -1;
+		}
+		io_state = uring_recvbuf(sock, thread, bid, dev);
+		uring_putbuf(thread, bid);
+		thread->nheld--;
+		if (io_state == DOIO_SUCCESS) {
+			donebatch_add(sock, batch, &sock->recv_list, &dev);
+		}
+	}
+}
+
+/*
+ * 'sock' has been dup()ed, and the copy shares its receive queue, so
+ * stop reading ahead through the multishot recvmsg: what it took could
+ * have been meant for the copy.  From now on 'sock' is read when it is
+ * readable, once the network thread has handed out what it holds.
+ */
+static void
+uring_unshare(isc__socket_t *sock) {
+	isc__socketthread_t *thread;
+	int lockid;
+
+	LOCK(&sock->lock);
+	if (!sock->uring || sock->fd < 0) {
+		UNLOCK(&sock->lock);
+		return;
+	}
+	sock->uring = false;
+	thread = &sock->manager->threads[sock->threadid];
+	lockid = FDLOCK_ID(sock->fd);
+	LOCK(&thread->fdlock[lockid]);
+	thread->uringfds[sock->fd].udp = false;
+	UNLOCK(&thread->fdlock[lockid]);
+	select_poke(sock->manager, sock->threadid, sock->fd,
+		    SELECT_POKE_READ);
+	UNLOCK(&sock->lock);
+}
+#endif /* USE_URING */
+
 static void
 internal_recv(isc__socket_t *sock) {
 	isc_socketevent_t *dev;
+	donebatch_t batch;
 
 	INSIST(VALID_SOCKET(sock));
 
+	donebatch_init(&batch);
+	batch.inlined = &sock->manager->threads[sock->threadid].inlined;
+
 	LOCK(&sock->lock);
 	if (sock->fd < 0) {
 		/* Socket is gone */
@@ -3067,11 +3950,31 @@ internal_recv(isc__socket_t *sock) {
 	socket_log(sock, NULL, IOEVENT,
 		   "internal_recv: event %p -> task %p", dev, dev->ev_sender);
 
+#ifdef USE_URING
+	if (URING_THREAD(sock)) {
+		uring_recv(sock, &batch);
+		if (URING_SOCKET(sock)) {
+			goto finish;
+		}
+		dev = ISC_LIST_HEAD(sock->recv_list);
+	}
+#endif
+
 	/*
 	 * Try to do as much I/O as possible on this socket.  There are no
 	 * limits here, currently.
 	 */
 	while (dev != NULL) {
+#ifdef USE_RECVMMSG
+		if (sock->type == isc_sockettype_udp &&
+		    ISC_LIST_NEXT(dev, ev_link) != NULL)
+		{
+			if (doio_recvmmsg(sock, &batch) == DOIO_SOFT)
+				goto finish;
+			dev = ISC_LIST_HEAD(sock->recv_list);
+			continue;
+		}
+#endif
 		switch (doio_recv(sock, dev)) {
 		case DOIO_SOFT:
 			goto finish;
@@ -3084,14 +3987,15 @@ internal_recv(isc__socket_t *sock) {
 			 */
 			do {
 				dev->result = ISC_R_EOF;
-				send_recvdone_event(sock, &dev);
+				donebatch_add(sock, &batch, &sock->recv_list,
+					      &dev);
 				dev = ISC_LIST_HEAD(sock->recv_list);
 			} while (dev != NULL);
 			goto finish;
 
 		case DOIO_SUCCESS:
 		case DOIO_HARD:
-			send_recvdone_event(sock, &dev);
+			donebatch_add(sock, &batch, &sock->recv_list, &dev);
 			break;
 		}
 
@@ -3099,6 +4003,7 @@ internal_recv(isc__socket_t *sock) {
 	}
 
  finish:
+	donebatch_flush(sock, &batch);
 	if (ISC_LIST_EMPTY(sock->recv_list)) {
 		unwatch_fd(&sock->manager->threads[sock->threadid], sock->fd,
 			   SELECT_POKE_READ);
@@ -3106,12 +4011,40 @@ internal_recv(isc__socket_t *sock) {
 	UNLOCK(&sock->lock);
 }
 
+/*
+ * Deliver the receive done events that internal_recv() set aside for
+ * ISC_SOCKFLAG_INLINE, now that no socket or descriptor lock is held:
+ * the event actions may well read from or write to 'sock' again.
+ */
+static void
+run_inline(isc__socketthread_t *thread, isc__socket_t *sock) {
+	isc_event_t *event;
+
+	while ((event = ISC_LIST_HEAD(thread->inlined)) != NULL) {
+		isc_socketevent_t *dev = (isc_socketevent_t *)event;
+		isc_task_t *task = event->ev_sender;
+		bool attached;
+
+		ISC_LIST_UNLINK(thread->inlined, event, ev_link);
+		attached = ((dev->attributes &
+			     ISC_SOCKEVENTATTR_ATTACHED) != 0);
+		event->ev_sender = sock;
+		isc_task_sendinline(task, &event);
+		if (attached) {
+			isc_task_detach(&task);
+		}
+	}
+}
+
 static void
 internal_send(isc__socket_t *sock) {
 	isc_socketevent_t *dev;
+	donebatch_t batch;
 
 	INSIST(VALID_SOCKET(sock));
 
+	donebatch_init(&batch);
+
 	LOCK(&sock->lock);
 	if (sock->fd < 0) {
 		/* Socket is gone */
@@ -3131,13 +4064,36 @@ internal_send(isc__socket_t *sock) {
 	 * limits here, currently.
 	 */
 	while (dev != NULL) {
+#ifdef USE_SENDMMSG
+		if (sock->type == isc_sockettype_udp &&
+		    ISC_LIST_NEXT(dev, ev_link) != NULL)
+		{
+			isc_socketevent_t *devs[MAXBATCH];
+			unsigned int i, n = 0, done;
+
+			for (; dev != NULL && n < MAXBATCH;
+			     dev = ISC_LIST_NEXT(dev, ev_link))
+			{
+				devs[n++] = dev;
+			}
+			done = doio_sendmmsg(sock, devs, n);
+			for (i = 0; i < done; i++) {
+				donebatch_add(sock, &batch, &sock->send_list,
+					      &devs[i]);
+			}
+			if (done < n)
+				goto finish;
+			dev = ISC_LIST_HEAD(sock->send_list);
+			continue;
+		}
+#endif
 		switch (doio_send(sock, dev)) {
 		case DOIO_SOFT:
 			goto finish;
 
 		case DOIO_HARD:
 		case DOIO_SUCCESS:
-			send_senddone_event(sock, &dev);
+			donebatch_add(sock, &batch, &sock->send_list, &dev);
 			break;
 		}
 
@@ -3145,6 +4101,7 @@ internal_send(isc__socket_t *sock) {
 	}
 
  finish:
+	donebatch_flush(sock, &batch);
 	if (ISC_LIST_EMPTY(sock->send_list)) {
 		unwatch_fd(&sock->manager->threads[sock->threadid],
 			   sock->fd, SELECT_POKE_WRITE);
@@ -3207,6 +4164,9 @@ process_fd(isc__socketthread_t *thread, int fd, bool readable,
 	}
 
 	UNLOCK(&thread->fdlock[lockid]);
+	if (!ISC_LIST_EMPTY(thread->inlined)) {
+		run_inline(thread, sock);
+	}
 	if (isc_refcount_decrement(&sock->references) == 1) {
 		destroy(&sock);
 	}
@@ -3385,6 +4345,171 @@ process_ctlfd(isc__socketthread_t *thread) {
 	return (false);
 }
 
+#ifdef USE_URING
+/*
+ * Let internal_recv() have the datagrams and errors waiting for
+ * descriptors on the ready list, re-arm the receives that ran out of
+ * buffers if there are some again, and retry the deferred descriptors.
+ */
+static void
+uring_flush(isc__socketthread_t *thread) {
+	unsigned int i, n;
+
+	for (i = 0; i < thread->nready; i++) {
+		int fd = thread->ready[i];
+
+		thread->uringfds[fd].ready = false;
+		process_fd(thread, fd, true, false);
+		uring_update(thread, fd);
+	}
+	thread->nready = 0;
+
+	if (thread->nstarved > 0 && thread->nheld < URING_NBUFS) {
+		n = thread->nstarved;
+		thread->nstarved = 0;
+		for (i = 0; i < n; i++) {
+			int fd = thread->starved[i];
+
+			thread->uringfds[fd].starved = false;
+			uring_update(thread, fd);
+		}
+	}
+
+	/*
+	 * A descriptor that is deferred again goes back on the list at
+	 * or before the entry just taken from it.
+	 */
+	n = thread->ndeferred;
+	thread->ndeferred = 0;
+	for (i = 0; i < n; i++) {
+		int fd = thread->deferred[i];
+
+		thread->uringfds[fd].deferred = false;
+		uring_update(thread, fd);
+		if (thread->uringfds[fd].closing && uring_close(thread, fd)) {
+			(void)close(fd);
+		}
+	}
+}
+
+/*
+ * Submit what is queued, wait for completions and deal with them.
+ * Returns true when the thread has been told to shut down.
+ */
+static bool
+uring_process(isc__socketthread_t *thread) {
+	bool done = false;
+	bool have_ctlevent = false;
+	uint32_t head, tail;
+
+	uring_enter(thread, true);
+
+	head = *thread->cq_head;
+	tail = URING_LOAD_ACQUIRE(thread->cq_tail);
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &thread->cqes[head & thread->cq_mask];
+		uint64_t data = cqe->user_data;
+		uint32_t flags = cqe->flags;
+		int res = cqe->res;
+		int fd = URING_DATA_FD(data);
+		uringfd_t *ufd = &thread->uringfds[fd];
+		int bid;
+
+		/*
+		 * Hand the entry back before anything can submit, so
+		 * that an overflow can be flushed into the space.
+		 */
+		URING_STORE_RELEASE(thread->cq_head, head + 1);
+
+		if (URING_DATA_KIND(data) == URING_CANCEL) {
+			continue;
+		}
+		if (URING_DATA_GEN(data) != ufd->gen || ufd->closing) {
+			/* The descriptor has been closed since. */
+			if ((flags & IORING_CQE_F_BUFFER) != 0) {
+				uring_putbuf(thread,
+					     flags >> IORING_CQE_BUFFER_SHIFT);
+			}
+			continue;
+		}
+
+		switch (URING_DATA_KIND(data)) {
+		case URING_POLL:
+			ufd->polling = false;
+			ufd->pollcancel = false;
+			if (fd == thread->pipe_fds[0]) {
+				have_ctlevent = true;
+				break;
+			}
+			if (res < 0 && res != -ECANCELED) {
+				res = EPOLLERR;
+			}
+			if (res > 0) {
+				/* See process_fds(). */
+				if ((res & (EPOLLERR | EPOLLHUP)) != 0) {
+					res |= thread->epoll_events[fd];
+				}
+				process_fd(thread, fd, (res & EPOLLIN) != 0,
+					   (res & EPOLLOUT) != 0);
+			}
+			uring_update(thread, fd);
+			break;
+
+		case URING_RECV:
+			if (res >= 0 && (flags & IORING_CQE_F_BUFFER) != 0) {
+				bid = flags >> IORING_CQE_BUFFER_SHIFT;
+				thread->buflen[bid] = res;
+				thread->bufnext[bid] = -1;
+				if (ufd->tail == -1) {
+					ufd->head = bid;
+				} else {
+					thread->bufnext[ufd->tail] = bid;
+				}
+				ufd->tail = bid;
+				thread->nheld++;
+				uring_ready(thread, fd);
+			} else if (res == -ENOBUFS) {
+				if (!ufd->starved) {
+					ufd->starved = true;
+					thread->starved[thread->nstarved++] =
+						fd;
+				}
+			} else if (res < 0 && res != -ECANCELED) {
+				ufd->recverr = -res;
+				uring_ready(thread, fd);
+			}
+			if ((flags & IORING_CQE_F_MORE) == 0) {
+				ufd->receiving = false;
+				ufd->recvcancel = false;
+				uring_update(thread, fd);
+			}
+			break;
+
+		default:
+			INSIST(0);
+			ISC_UNREACHABLE();
+		}
+
+		/*
+		 * Don't sit on too many buffers while going through a
+		 * long run of completions.
+		 */
+		if (thread->nheld > URING_NBUFS / 2) {
+			uring_flush(thread);
+		}
+	}
+
+	if (have_ctlevent) {
+		done = process_ctlfd(thread);
+		uring_update(thread, thread->pipe_fds[0]);
+	}
+
+	uring_flush(thread);
+
+	return (done);
+}
+#endif	/* USE_URING */
+
 /*
  * This is the thread that will loop forever, always in a select or poll
  * call.
@@ -3428,6 +4553,11 @@ netthread(void *uap) {
 	ctlfd = thread->pipe_fds[0];
 #endif
 	done = false;
+#ifdef USE_URING
+	while (thread->uring && !done) {
+		done = uring_process(thread);
+	}
+#endif
 	while (!done) {
 		do {
 #ifdef USE_KQUEUE
@@ -3570,6 +4700,249 @@ isc_socketmgr_maxudp(isc_socketmgr_t *manager0, int maxudp) {
 	manager->maxudp = maxudp;
 }
 
+#ifdef USE_URING
+static void
+uring_cleanup(isc__socketthread_t *thread) {
+	isc_mem_t *mctx = thread->manager->mctx;
+	unsigned int maxsocks = thread->manager->maxsocks;
+	struct io_uring_buf_reg reg;
+	unsigned int i;
+
+	if (thread->ring_fd != -1) {
+		/*
+		 * Make sure that receives that have not been cancelled
+		 * yet stop using the buffers before they are freed.
+		 */
+		memset(&reg, 0, sizeof(reg));
+		reg.bgid = URING_BGID;
+		(void)syscall(__NR_io_uring_register, thread->ring_fd,
+			      IORING_UNREGISTER_PBUF_RING, &reg, 1);
+		(void)close(thread->ring_fd);
+		thread->ring_fd = -1;
+	}
+	if (thread->sqes != NULL) {
+		(void)munmap(thread->sqes, thread->sqessize);
+		thread->sqes = NULL;
+	}
+	if (thread->ring != NULL) {
+		(void)munmap(thread->ring, thread->ringsize);
+		thread->ring = NULL;
+	}
+	if (thread->bufring != NULL) {
+		(void)munmap(thread->bufring, thread->bufringsize);
+		thread->bufring = NULL;
+	}
+	if (thread->bufs != NULL) {
+		isc_mem_put(mctx, thread->bufs,
+			    (size_t)URING_NBUFS * URING_BUFSIZE);
+		thread->bufs = NULL;
+	}
+	if (thread->deferred != NULL) {
+		/* Close what is left over; the ring has gone. */
+		for (i = 0; i < thread->ndeferred; i++) {
+			if (thread->uringfds[thread->deferred[i]].closing) {
+				(void)close(thread->deferred[i]);
+			}
+		}
+		isc_mem_put(mctx, thread->deferred, maxsocks * sizeof(int));
+		thread->deferred = NULL;
+	}
+	if (thread->uringfds != NULL) {
+		isc_mem_put(mctx, thread->uringfds,
+			    maxsocks * sizeof(uringfd_t));
+		thread->uringfds = NULL;
+	}
+	if (thread->ready != NULL) {
+		isc_mem_put(mctx, thread->ready, maxsocks * sizeof(int));
+		thread->ready = NULL;
+	}
+	if (thread->starved != NULL) {
+		isc_mem_put(mctx, thread->starved, maxsocks * sizeof(int));
+		thread->starved = NULL;
+	}
+	thread->uring = false;
+}
+
+/*
+ * Check that the kernel can do multishot recvmsg into the buffer ring
+ * by passing a datagram through a socket pair.
+ */
+static bool
+uring_probe(isc__socketthread_t *thread) {
+	uint32_t head;
+	bool ok = false;
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) != 0) {
+		return (false);
+	}
+	if (sv[0] >= (int)thread->manager->maxsocks) {
+		(void)close(sv[0]);
+		(void)close(sv[1]);
+		return (false);
+	}
+
+	thread->uringfds[sv[0]].udp = true;
+	uring_arm_recv(thread, sv[0]);
+	if (write(sv[1], "", 1) == 1) {
+		head = *thread->cq_head;
+		do {
+			uring_enter(thread, true);
+		} while (URING_LOAD_ACQUIRE(thread->cq_tail) == head);
+		ok = (thread->cqes[head & thread->cq_mask].res >= 0 &&
+		      (thread->cqes[head & thread->cq_mask].flags &
+		       IORING_CQE_F_BUFFER) != 0);
+	}
+
+	/*
+	 * The completion is left for uring_process(), which will hand
+	 * the buffer back as the descriptor has been closed by then.
+	 */
+	uring_update(thread, sv[0]);
+	thread->uringfds[sv[0]].udp = false;
+	if (uring_close(thread, sv[0])) {
+		(void)close(sv[0]);
+	}
+	(void)close(sv[1]);
+
+	return (ok);
+}
+
+/*
+ * Set up an io_uring for 'thread'.  Returns false, leaving the thread
+ * to use epoll, if the kernel doesn't support everything needed.
+ */
+static bool
+uring_setup(isc__socketthread_t *thread) {
+	isc_mem_t *mctx = thread->manager->mctx;
+	unsigned int maxsocks = thread->manager->maxsocks;
+	struct io_uring_params params;
+	struct io_uring_buf_reg reg;
+	unsigned char *ring;
+	size_t cqsize;
+	uint32_t *sq_array;
+	unsigned int i;
+
+	thread->ring_fd = -1;
+	thread->ring = NULL;
+	thread->sqes = NULL;
+	thread->bufring = NULL;
+	thread->bufs = NULL;
+	thread->uringfds = NULL;
+	thread->ready = NULL;
+	thread->starved = NULL;
+	thread->deferred = NULL;
+
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_COOP_TASKRUN;
+	thread->ring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+	if (thread->ring_fd == -1 && errno == EINVAL) {
+		memset(&params, 0, sizeof(params));
+		thread->ring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES,
+					  &params);
+	}
+	if (thread->ring_fd == -1 ||
+	    (params.features & IORING_FEAT_SINGLE_MMAP) == 0 ||
+	    (params.features & IORING_FEAT_NODROP) == 0)
+	{
+		goto fail;
+	}
+
+	thread->ringsize = params.sq_off.array +
+			   params.sq_entries * sizeof(uint32_t);
+	cqsize = params.cq_off.cqes +
+		 params.cq_entries * sizeof(struct io_uring_cqe);
+	if (cqsize > thread->ringsize) {
+		thread->ringsize = cqsize;
+	}
+	ring = mmap(NULL, thread->ringsize, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, thread->ring_fd,
+		    IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED) {
+		goto fail;
+	}
+	thread->ring = ring;
+
+	thread->sqessize = params.sq_entries * sizeof(struct io_uring_sqe);
+	thread->sqes = mmap(NULL, thread->sqessize, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, thread->ring_fd,
+			    IORING_OFF_SQES);
+	if (thread->sqes == MAP_FAILED) {
+		thread->sqes = NULL;
+		goto fail;
+	}
+
+	thread->sq_head = (uint32_t *)(ring + params.sq_off.head);
+	thread->sq_tail = (uint32_t *)(ring + params.sq_off.tail);
+	thread->sq_mask = *(uint32_t *)(ring + params.sq_off.ring_mask);
+	thread->sq_entries = *(uint32_t *)(ring + params.sq_off.ring_entries);
+	sq_array = (uint32_t *)(ring + params.sq_off.array);
+	for (i = 0; i < thread->sq_entries; i++) {
+		sq_array[i] = i;
+	}
+	thread->cq_head = (uint32_t *)(ring + params.cq_off.head);
+	thread->cq_tail = (uint32_t *)(ring + params.cq_off.tail);
+	thread->cq_mask = *(uint32_t *)(ring + params.cq_off.ring_mask);
+	thread->cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+	/*
+	 * The receive buffers, and the ring through which they are
+	 * handed to the kernel.
+	 */
+	thread->bufringsize = URING_NBUFS * sizeof(struct io_uring_buf);
+	thread->bufring = mmap(NULL, thread->bufringsize,
+			       PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (thread->bufring == MAP_FAILED) {
+		thread->bufring = NULL;
+		goto fail;
+	}
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t)thread->bufring;
+	reg.ring_entries = URING_NBUFS;
+	reg.bgid = URING_BGID;
+	if (syscall(__NR_io_uring_register, thread->ring_fd,
+		    IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+	{
+		goto fail;
+	}
+	thread->bufs = isc_mem_get(mctx, (size_t)URING_NBUFS * URING_BUFSIZE);
+	thread->buftail = 0;
+	thread->nheld = 0;
+	for (i = 0; i < URING_NBUFS; i++) {
+		uring_putbuf(thread, i);
+	}
+
+	memset(&thread->recvmsg, 0, sizeof(thread->recvmsg));
+	thread->recvmsg.msg_namelen = URING_NAMELEN;
+	thread->recvmsg.msg_controllen = URING_CMSGLEN;
+
+	thread->uringfds = isc_mem_get(mctx, maxsocks * sizeof(uringfd_t));
+	memset(thread->uringfds, 0, maxsocks * sizeof(uringfd_t));
+	for (i = 0; i < maxsocks; i++) {
+		thread->uringfds[i].head = -1;
+		thread->uringfds[i].tail = -1;
+	}
+	thread->ready = isc_mem_get(mctx, maxsocks * sizeof(int));
+	thread->nready = 0;
+	thread->starved = isc_mem_get(mctx, maxsocks * sizeof(int));
+	thread->nstarved = 0;
+	thread->deferred = isc_mem_get(mctx, maxsocks * sizeof(int));
+	thread->ndeferred = 0;
+
+	thread->uring = true;
+	if (!uring_probe(thread)) {
+		goto fail;
+	}
+
+	return (true);
+
+ fail:
+	uring_cleanup(thread);
+	return (false);
+}
+#endif	/* USE_URING */
+
 /*
  * Setup socket thread, thread->manager and thread->threadid must be filled.
  */
@@ -3597,6 +4970,8 @@ setup_thread(isc__socketthread_t *thread) {
 
 	memset(thread->fdstate, 0, thread->manager->maxsocks * sizeof(int));
 
+	ISC_LIST_INIT(thread->inlined);
+
 	thread->fdlock = isc_mem_get(thread->manager->mctx,
 				     FDLOCK_COUNT * sizeof(isc_mutex_t));
 
@@ -3651,6 +5026,20 @@ setup_thread(isc__socketthread_t *thread) {
 				     sizeof(struct epoll_event) *
 				      thread->nevents);
 
+#ifdef USE_URING
+	thread->uring = false;
+	if (thread->manager->type == isc_socketmgrtype_uring) {
+		if (uring_setup(thread)) {
+			thread->epoll_fd = -1;
+			return (watch_fd(thread, thread->pipe_fds[0],
+					 SELECT_POKE_READ));
+		}
+		thread_log(thread, ISC_LOGCATEGORY_GENERAL,
+			   ISC_LOGMODULE_SOCKET, ISC_LOG_INFO,
+			   "io_uring is not available, using epoll");
+	}
+#endif
+
 	thread->epoll_fd = epoll_create(thread->nevents);
 	if (thread->epoll_fd == -1) {
 		result = isc__errno2result(errno);
@@ -3756,7 +5145,14 @@ cleanup_thread(isc_mem_t *mctx, isc__socketthread_t *thread) {
 	isc_mem_put(mctx, thread->events,
 		    sizeof(struct kevent) * thread->nevents);
 #elif defined(USE_EPOLL)
-	close(thread->epoll_fd);
+#ifdef USE_URING
+	if (thread->uring) {
+		uring_cleanup(thread);
+	}
+#endif
+	if (thread->epoll_fd != -1) {
+		close(thread->epoll_fd);
+	}
 
 	isc_mem_put(mctx, thread->events,
 		    sizeof(struct epoll_event) * thread->nevents);
@@ -3815,11 +5211,22 @@ isc_socketmgr_create(isc_mem_t *mctx, isc_socketmgr_t **managerp) {
 isc_result_t
 isc_socketmgr_create2(isc_mem_t *mctx, isc_socketmgr_t **managerp,
 		      unsigned int maxsocks, int nthreads)
+{
+	return (isc_socketmgr_create3(mctx, managerp, maxsocks, nthreads,
+				      isc_socketmgrtype_poll));
+}
+
+isc_result_t
+isc_socketmgr_create3(isc_mem_t *mctx, isc_socketmgr_t **managerp,
+		      unsigned int maxsocks, int nthreads,
+		      isc_socketmgrtype_t type)
 {
 	int i;
 	isc__socketmgr_t *manager;
 
 	REQUIRE(managerp != NULL && *managerp == NULL);
+	REQUIRE(type == isc_socketmgrtype_poll ||
+		type == isc_socketmgrtype_uring);
 
 	if (maxsocks == 0)
 		maxsocks = ISC_SOCKET_MAXSOCKETS;
@@ -3833,6 +5240,7 @@ isc_socketmgr_create2(isc_mem_t *mctx, isc_socketmgr_t **managerp,
 	manager->maxudp = 0;
 	manager->nthreads = nthreads;
 	manager->stats = NULL;
+	manager->type = type;
 
 	manager->common.magic = ISCAPI_SOCKETMGR_MAGIC;
 	manager->common.impmagic = SOCKET_MANAGER_MAGIC;
@@ -3867,6 +5275,27 @@ isc_socketmgr_create2(isc_mem_t *mctx, isc_socketmgr_t **managerp,
 
 }
 
+isc_socketmgrtype_t
+isc_socketmgr_gettype(isc_socketmgr_t *manager0) {
+	isc__socketmgr_t *manager = (isc__socketmgr_t *)manager0;
+#ifdef USE_URING
+	int i;
+#endif
+
+	REQUIRE(VALID_MANAGER(manager));
+
+#ifdef USE_URING
+	for (i = 0; i < manager->nthreads; i++) {
+		if (!manager->threads[i].uring) {
+			return (isc_socketmgrtype_poll);
+		}
+	}
+	return (isc_socketmgrtype_uring);
+#else
+	return (isc_socketmgrtype_poll);
+#endif
+}
+
 isc_result_t
 isc_socketmgr_getmaxsockets(isc_socketmgr_t *manager0, unsigned int *nsockp) {
 	isc__socketmgr_t *manager = (isc__socketmgr_t *)manager0;
@@ -3970,13 +5399,37 @@ socket_recv(isc__socket_t *sock, isc_socketevent_t *dev, isc_task_t *task,
 
 	dev->ev_sender = task;
 
+	if ((flags & ISC_SOCKFLAG_INLINE) != 0) {
+		dev->attributes |= ISC_SOCKEVENTATTR_INLINE;
+	}
+
 	if (sock->type == isc_sockettype_udp) {
-		io_state = doio_recv(sock, dev);
+		/*
+		 * Only the network thread reads io_uring sockets, or
+		 * datagrams could be delivered out of order, and
+		 * ISC_SOCKFLAG_INLINE wants the read done there too.
+		 * uring_unshare() can change the former at any time.
+		 */
+		if ((flags & ISC_SOCKFLAG_INLINE) != 0) {
+			io_state = DOIO_SOFT;
+		} else if (URING_THREAD(sock)) {
+			LOCK(&sock->lock);
+			have_lock = true;
+			if (URING_SOCKET(sock)) {
+				io_state = DOIO_SOFT;
+			} else {
+				io_state = doio_recv(sock, dev);
+			}
+		} else {
+			io_state = doio_recv(sock, dev);
+		}
 	} else {
 		LOCK(&sock->lock);
 		have_lock = true;
 
-		if (ISC_LIST_EMPTY(sock->recv_list)) {
+		if (ISC_LIST_EMPTY(sock->recv_list) &&
+		    (flags & ISC_SOCKFLAG_INLINE) == 0)
+		{
 			io_state = doio_recv(sock, dev);
 		} else {
 			io_state = DOIO_SOFT;
@@ -4092,6 +5545,75 @@ isc_socket_recv2(isc_socket_t *sock0, isc_region_t *region,
 	return (socket_recv(sock, event, task, flags));
 }
 
+#ifdef USE_SENDMMSG
+/*
+ * Under load, several worker threads often answer queries arriving on
+ * the same UDP socket at once.  Sends made with ISC_SOCKFLAG_BATCH are
+ * combined: while one thread is sending, the others queue their
+ * datagrams on sock->batch_list and return at once, and the sending
+ * thread then writes them with sendmmsg() on their behalf.  Datagrams
+ * that cannot be sent right away are dropped, as for
+ * ISC_SOCKFLAG_NORETRY.
+ *
+ * Called by the sending thread, which has set sock->batching, after
+ * sending its own datagram.  To bound the time it spends on others'
+ * work, anything still queued after MAXBATCHROUNDS sendmmsg() calls is
+ * moved to the send queue for the watcher to write.
+ */
+static void
+send_batch(isc__socket_t *sock) {
+	isc_socketevent_t *devs[MAXBATCH];
+	isc_socketevent_t *dev;
+	donebatch_t batch;
+	unsigned int i, n, rounds = 0;
+
+	donebatch_init(&batch);
+
+	LOCK(&sock->lock);
+	INSIST(sock->batching);
+	while (!ISC_LIST_EMPTY(sock->batch_list) &&
+	       rounds++ < MAXBATCHROUNDS)
+	{
+		n = 0;
+		while (n < MAXBATCH &&
+		       (dev = ISC_LIST_HEAD(sock->batch_list)) != NULL)
+		{
+			ISC_LIST_UNLINK(sock->batch_list, dev, ev_link);
+			devs[n++] = dev;
+		}
+		UNLOCK(&sock->lock);
+
+		i = 0;
+		while (i < n) {
+			i += doio_sendmmsg(sock, &devs[i], n - i);
+			if (i < n) {
+				/* Soft error: drop the datagram. */
+				i++;
+			}
+		}
+
+		LOCK(&sock->lock);
+		for (i = 0; i < n; i++) {
+			donebatch_add(sock, &batch, &sock->batch_list,
+				      &devs[i]);
+		}
+		donebatch_flush(sock, &batch);
+	}
+
+	if (!ISC_LIST_EMPTY(sock->batch_list)) {
+		bool do_poke = ISC_LIST_EMPTY(sock->send_list);
+		ISC_LIST_APPENDLIST(sock->send_list, sock->batch_list,
+				    ev_link);
+		if (do_poke) {
+			select_poke(sock->manager, sock->threadid, sock->fd,
+				    SELECT_POKE_WRITE);
+		}
+	}
+	sock->batching = false;
+	UNLOCK(&sock->lock);
+}
+#endif /* USE_SENDMMSG */
+
 static isc_result_t
 socket_send(isc__socket_t *sock, isc_socketevent_t *dev, isc_task_t *task,
 	    const isc_sockaddr_t *address, struct in6_pktinfo *pktinfo,
@@ -4124,6 +5646,30 @@ socket_send(isc__socket_t *sock, isc_socketevent_t *dev, isc_task_t *task,
 	}
 
 	if (sock->type == isc_sockettype_udp) {
+#ifdef USE_SENDMMSG
+		if ((flags & ISC_SOCKFLAG_BATCH) != 0) {
+			LOCK(&sock->lock);
+			if (sock->batching) {
+				/*
+				 * Another thread is sending on this socket;
+				 * leave the datagram for it to send.
+				 */
+				isc_task_attach(task, &ntask);
+				dev->attributes |= ISC_SOCKEVENTATTR_ATTACHED;
+				ISC_LIST_ENQUEUE(sock->batch_list, dev,
+						 ev_link);
+				UNLOCK(&sock->lock);
+				if ((flags & ISC_SOCKFLAG_IMMEDIATE) != 0)
+					result = ISC_R_INPROGRESS;
+				return (result);
+			}
+			sock->batching = true;
+			UNLOCK(&sock->lock);
+
+			io_state = doio_send(sock, dev);
+			send_batch(sock);
+		} else
+#endif
 		io_state = doio_send(sock, dev);
 	} else {
 		LOCK(&sock->lock);
@@ -4239,9 +5785,12 @@ isc_socket_sendto2(isc_socket_t *sock0, isc_region_t *region,
 	isc__socket_t *sock = (isc__socket_t *)sock0;
 
 	REQUIRE(VALID_SOCKET(sock));
-	REQUIRE((flags & ~(ISC_SOCKFLAG_IMMEDIATE|ISC_SOCKFLAG_NORETRY)) == 0);
+	REQUIRE((flags & ~(ISC_SOCKFLAG_IMMEDIATE|ISC_SOCKFLAG_NORETRY|
+			   ISC_SOCKFLAG_BATCH)) == 0);
 	if ((flags & ISC_SOCKFLAG_NORETRY) != 0)
 		REQUIRE(sock->type == isc_sockettype_udp);
+	if ((flags & ISC_SOCKFLAG_BATCH) != 0)
+		REQUIRE((flags & ISC_SOCKFLAG_NORETRY) != 0);
 	event->ev_sender = sock;
 	event->result = ISC_R_UNSET;
 	event->region = *region;
@@ -4614,6 +6163,29 @@ set_tcp_fastopen(isc__socket_t *sock, unsigned int backlog) {
 #endif
 }
 
+/*
+ * Have the kernel hold new connections back until the client has sent
+ * some data, or for up to 'timeout' seconds.
+ */
+static void
+set_tcp_deferaccept(isc__socket_t *sock, unsigned int timeout) {
+#ifdef TCP_DEFER_ACCEPT
+	char strbuf[ISC_STRERRORSIZE];
+	int secs = (int)timeout;
+
+	if (setsockopt(sock->fd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+		       (void *)&secs, sizeof(secs)) < 0) {
+		strerror_r(errno, strbuf, sizeof(strbuf));
+		UNEXPECTED_ERROR(__FILE__, __LINE__,
+				 "setsockopt(%d, TCP_DEFER_ACCEPT) failed "
+				 "with %s", sock->fd, strbuf);
+	}
+#else
+	UNUSED(sock);
+	UNUSED(timeout);
+#endif
+}
+
 /*
  * Set up to listen on a given socket.  We do this by creating an internal
  * event that will be dispatched when the socket has read activity.  The
@@ -4626,6 +6198,13 @@ set_tcp_fastopen(isc__socket_t *sock, unsigned int backlog) {
  */
 isc_result_t
 isc_socket_listen(isc_socket_t *sock0, unsigned int backlog) {
+	return (isc_socket_listen2(sock0, backlog, true, 0));
+}
+
+isc_result_t
+isc_socket_listen2(isc_socket_t *sock0, unsigned int backlog,
+		   bool fastopen, unsigned int deferaccept)
+{
 	isc__socket_t *sock = (isc__socket_t *)sock0;
 	char strbuf[ISC_STRERRORSIZE];
 
@@ -4650,7 +6229,12 @@ isc_socket_listen(isc_socket_t *sock0, unsigned int backlog) {
 		return (ISC_R_UNEXPECTED);
 	}
 
-	set_tcp_fastopen(sock, backlog);
+	if (fastopen) {
+		set_tcp_fastopen(sock, backlog);
+	}
+	if (deferaccept != 0) {
+		set_tcp_deferaccept(sock, deferaccept);
+	}
 
 	sock->listener = 1;
 
@@ -5088,7 +6672,9 @@ isc_socket_cancel(isc_socket_t *sock0, isc_task_t *task, unsigned int how) {
 		isc_socketevent_t      *dev;
 		isc_socketevent_t      *next;
 		isc_task_t	       *current_task;
+		donebatch_t		batch;
 
+		donebatch_init(&batch);
 		dev = ISC_LIST_HEAD(sock->recv_list);
 
 		while (dev != NULL) {
@@ -5097,10 +6683,12 @@ isc_socket_cancel(isc_socket_t *sock0, isc_task_t *task, unsigned int how) {
 
 			if ((task == NULL) || (task == current_task)) {
 				dev->result = ISC_R_CANCELED;
-				send_recvdone_event(sock, &dev);
+				donebatch_add(sock, &batch, &sock->recv_list,
+					      &dev);
 			}
 			dev = next;
 		}
+		donebatch_flush(sock, &batch);
 	}
 
 	if (((how & ISC_SOCKCANCEL_SEND) != 0)
@@ -5108,7 +6696,9 @@ isc_socket_cancel(isc_socket_t *sock0, isc_task_t *task, unsigned int how) {
 		isc_socketevent_t      *dev;
 		isc_socketevent_t      *next;
 		isc_task_t	       *current_task;
+		donebatch_t		batch;
 
+		donebatch_init(&batch);
 		dev = ISC_LIST_HEAD(sock->send_list);
 
 		while (dev != NULL) {
@@ -5117,10 +6707,12 @@ isc_socket_cancel(isc_socket_t *sock0, isc_task_t *task, unsigned int how) {
 
 			if ((task == NULL) || (task == current_task)) {
 				dev->result = ISC_R_CANCELED;
-				send_senddone_event(sock, &dev);
+				donebatch_add(sock, &batch, &sock->send_list,
+					      &dev);
 			}
 			dev = next;
 		}
+		donebatch_flush(sock, &batch);
 	}
 
 	if (((how & ISC_SOCKCANCEL_ACCEPT) != 0)
@@ -5364,6 +6956,104 @@ isc_socket_hasreuseport() {
 	return (hasreuseport);
 }
 
+/*
+ * Network thread N is bound to CPU N, so a datagram that arrived on CPU
+ * C is best read by a socket served by thread C % nthreads.  The
+ * classic BPF program attached to the group does that lookup:
+ *
+ *	A = cpu % nthreads
+ *	if (A == thread) return (index of its first socket)	...
+ *	return (~0)
+ *
+ * An out-of-range return value makes the kernel fall back to its usual
+ * hash, which covers the threads that have no socket in the group.
+ */
+#if defined(SO_ATTACH_REUSEPORT_CBPF) && defined(SKF_AD_CPU)
+#define HAVE_REUSEPORT_CBPF 1
+#endif
+
+isc_result_t
+isc_socket_steerbycpu(isc_socket_t **socks, unsigned int nsocks) {
+#ifdef HAVE_REUSEPORT_CBPF
+	isc__socket_t *sock;
+	isc__socketmgr_t *manager;
+	struct sock_filter *insns;
+	struct sock_fprog prog;
+	unsigned int i, t, n, ninsns;
+	char strbuf[ISC_STRERRORSIZE];
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(socks != NULL && nsocks > 0);
+
+	sock = (isc__socket_t *)socks[0];
+	REQUIRE(VALID_SOCKET(sock));
+	manager = sock->manager;
+
+	if (!isc_socket_hasreuseport()) {
+		return (ISC_R_NOTIMPLEMENTED);
+	}
+
+	ninsns = 2 * manager->nthreads + 3;
+	if (ninsns > BPF_MAXINSNS) {
+		return (ISC_R_RANGE);
+	}
+
+	insns = isc_mem_get(manager->mctx, ninsns * sizeof(*insns));
+	if (insns == NULL) {
+		return (ISC_R_NOMEMORY);
+	}
+
+	n = 0;
+	insns[n++] = (struct sock_filter)
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+	insns[n++] = (struct sock_filter)
+		BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, manager->nthreads);
+	for (t = 0; t < (unsigned int)manager->nthreads; t++) {
+		for (i = 0; i < nsocks; i++) {
+			isc__socket_t *s = (isc__socket_t *)socks[i];
+
+			REQUIRE(VALID_SOCKET(s));
+			REQUIRE(s->type == isc_sockettype_udp);
+			if (s->threadid == (int)t) {
+				break;
+			}
+		}
+		if (i < nsocks) {
+			insns[n++] = (struct sock_filter)
+				BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, t, 0, 1);
+			insns[n++] = (struct sock_filter)
+				BPF_STMT(BPF_RET | BPF_K, i);
+		}
+	}
+	insns[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, ~0U);
+	INSIST(n <= ninsns);
+
+	prog.len = n;
+	prog.filter = insns;
+
+	LOCK(&sock->lock);
+	if (setsockopt(sock->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+		       (void *)&prog, sizeof(prog)) < 0)
+	{
+		strerror_r(errno, strbuf, sizeof(strbuf));
+		socket_log(sock, NULL, CREATION,
+			   "setsockopt(%d, SO_ATTACH_REUSEPORT_CBPF) "
+			   "failed: %s", sock->fd, strbuf);
+		result = isc__errno2result(errno);
+	}
+	UNLOCK(&sock->lock);
+
+	isc_mem_put(manager->mctx, insns, ninsns * sizeof(*insns));
+
+	return (result);
+#else
+	UNUSED(socks);
+	UNUSED(nsocks);
+
+	return (ISC_R_NOTIMPLEMENTED);
+#endif /* HAVE_REUSEPORT_CBPF */
+}
+
 
 #if defined(HAVE_LIBXML2) || defined(HAVE_JSON)
 static const char *
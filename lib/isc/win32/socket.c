@@ -2512,6 +2512,24 @@ isc_socketmgr_create2(isc_mem_t *mctx, isc_socketmgr_t **managerp,
 	return (ISC_R_SUCCESS);
 }
 
+isc_result_t
+isc_socketmgr_create3(isc_mem_t *mctx, isc_socketmgr_t **managerp,
+		      unsigned int maxsocks, int nthreads,
+		      isc_socketmgrtype_t type)
+{
+	REQUIRE(type == isc_socketmgrtype_poll ||
+		type == isc_socketmgrtype_uring);
+
+	return (isc_socketmgr_create2(mctx, managerp, maxsocks, nthreads));
+}
+
+isc_socketmgrtype_t
+isc_socketmgr_gettype(isc_socketmgr_t *manager) {
+	REQUIRE(VALID_MANAGER(manager));
+
+	return (isc_socketmgrtype_poll);
+}
+
 isc_result_t
 isc_socketmgr_getmaxsockets(isc_socketmgr_t *manager, unsigned int *nsockp) {
 	REQUIRE(VALID_MANAGER(manager));
@@ -2972,11 +2990,20 @@ isc_socket_filter(isc_socket_t *sock, const char *filter) {
  */
 isc_result_t
 isc_socket_listen(isc_socket_t *sock, unsigned int backlog) {
+	return (isc_socket_listen2(sock, backlog, true, 0));
+}
+
+isc_result_t
+isc_socket_listen2(isc_socket_t *sock, unsigned int backlog,
+		   bool fastopen, unsigned int deferaccept)
+{
 	char strbuf[ISC_STRERRORSIZE];
 #if defined(ENABLE_TCP_FASTOPEN) && defined(TCP_FASTOPEN)
 	char on = 1;
 #endif
 
+	UNUSED(deferaccept);
+
 	REQUIRE(VALID_SOCKET(sock));
 
 	LOCK(&sock->lock);
@@ -3007,7 +3034,8 @@ isc_socket_listen(isc_socket_t *sock, unsigned int backlog) {
 	}
 
 #if defined(ENABLE_TCP_FASTOPEN) && defined(TCP_FASTOPEN)
-	if (setsockopt(sock->fd, IPPROTO_TCP, TCP_FASTOPEN,
+	if (fastopen &&
+	    setsockopt(sock->fd, IPPROTO_TCP, TCP_FASTOPEN,
 		       &on, sizeof(on)) < 0) {
 		strerror_r(errno, strbuf, sizeof(strbuf));
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
@@ -3015,6 +3043,8 @@ isc_socket_listen(isc_socket_t *sock, unsigned int backlog) {
 				 sock->fd, strbuf);
 		/* TCP_FASTOPEN is experimental so ignore failures */
 	}
+#else
+	UNUSED(fastopen);
 #endif
 
 	socket_log(__LINE__, sock, NULL, TRACE, "listening");
@@ -3612,6 +3642,14 @@ isc_socket_hasreuseport() {
 	return (false);
 }
 
+isc_result_t
+isc_socket_steerbycpu(isc_socket_t **socks, unsigned int nsocks) {
+	UNUSED(socks);
+	UNUSED(nsocks);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
 #ifdef HAVE_LIBXML2
 
 static const char *
@@ -1012,6 +1012,7 @@ static cfg_type_t cfg_type_fstrm_model = {
 static cfg_clausedef_t
 options_clauses[] = {
 	{ "answer-cookie", &cfg_type_boolean, 0 },
+	{ "async-logging", &cfg_type_boolean, 0 },
 	{ "automatic-interface-scan", &cfg_type_boolean, 0 },
 	{ "avoid-v4-udp-ports", &cfg_type_bracketed_portlist, 0 },
 	{ "avoid-v6-udp-ports", &cfg_type_bracketed_portlist, 0 },
@@ -1110,6 +1111,8 @@ options_clauses[] = {
 	{ "statistics-interval", &cfg_type_uint32, CFG_CLAUSEFLAG_ANCIENT },
 	{ "tcp-advertised-timeout", &cfg_type_uint32, 0 },
 	{ "tcp-clients", &cfg_type_uint32, 0 },
+	{ "tcp-defer-accept", &cfg_type_uint32, 0 },
+	{ "tcp-fastopen", &cfg_type_boolean, 0 },
 	{ "tcp-idle-timeout", &cfg_type_uint32, 0 },
 	{ "tcp-initial-timeout", &cfg_type_uint32, 0 },
 	{ "tcp-keepalive-timeout", &cfg_type_uint32, 0 },
@@ -1123,11 +1126,14 @@ options_clauses[] = {
 	{ "transfers-out", &cfg_type_uint32, 0 },
 	{ "transfers-per-ns", &cfg_type_uint32, 0 },
 	{ "treat-cr-as-space", &cfg_type_boolean, CFG_CLAUSEFLAG_ANCIENT },
+	{ "udp-cpu-steering", &cfg_type_boolean, 0 },
+	{ "udp-run-to-completion", &cfg_type_boolean, 0 },
 	{ "use-id-pool", &cfg_type_boolean, CFG_CLAUSEFLAG_ANCIENT },
 	{ "use-ixfr", &cfg_type_boolean, CFG_CLAUSEFLAG_OBSOLETE },
 	{ "use-v4-udp-ports", &cfg_type_bracketed_portlist, 0 },
 	{ "use-v6-udp-ports", &cfg_type_bracketed_portlist, 0 },
 	{ "version", &cfg_type_qstringornone, 0 },
+	{ "work-stealing", &cfg_type_boolean, 0 },
 	{ NULL, NULL, 0 }
 };
 
@@ -1940,6 +1946,7 @@ view_clauses[] = {
 	{ "resolver-nonbackoff-tries", &cfg_type_uint32, 0 },
 	{ "resolver-query-timeout", &cfg_type_uint32, 0 },
 	{ "resolver-retry-interval", &cfg_type_uint32, 0 },
+	{ "response-cache-size", &cfg_type_sizeval, 0 },
 	{ "response-padding", &cfg_type_resppadding, 0 },
 	{ "response-policy", &cfg_type_rpz, 0 },
 	{ "rfc2308-type1", &cfg_type_boolean, CFG_CLAUSEFLAG_ANCIENT },
@@ -2482,6 +2489,12 @@ static cfg_type_t cfg_type_printtime = {
 	&cfg_rep_string, printtime_enums
 };
 
+static const char *logformat_enums[] = { "binary", "text", NULL };
+static cfg_type_t cfg_type_logformat = {
+	"logformat", cfg_parse_enum, cfg_print_ustring, cfg_doc_enum,
+	&cfg_rep_string, &logformat_enums
+};
+
 static cfg_clausedef_t
 channel_clauses[] = {
 	/* Destinations.  We no longer require these to be first. */
@@ -2495,6 +2508,7 @@ channel_clauses[] = {
 	{ "print-severity", &cfg_type_boolean, 0 },
 	{ "print-category", &cfg_type_boolean, 0 },
 	{ "buffered", &cfg_type_boolean, 0 },
+	{ "format", &cfg_type_logformat, 0 },
 	{ NULL, NULL, 0 }
 };
 static cfg_clausedef_t *
@@ -48,6 +48,7 @@
 #include <dns/rdatalist.h>
 #include <dns/rdataset.h>
 #include <dns/resolver.h>
+#include <dns/respcache.h>
 #include <dns/stats.h>
 #include <dns/tsig.h>
 #include <dns/view.h>
@@ -56,6 +57,7 @@
 #include <ns/interfacemgr.h>
 #include <ns/log.h>
 #include <ns/notify.h>
+#include <ns/querylog.h>
 #include <ns/server.h>
 #include <ns/stats.h>
 #include <ns/update.h>
@@ -110,6 +112,13 @@
  * server.
  */
 
+#define NTCPTASKS			16
+/*%<
+ * Number of tasks shared by the TCP connections of a client manager.
+ * A connection only uses its task to read the next request and to
+ * time out when idle, so a small pool is enough.
+ */
+
 #define COOKIE_SIZE 24U /* 8 + 4 + 4 + 8 */
 #define ECS_SIZE 20U /* 2 + 1 + 1 + [0..16] */
 
@@ -118,6 +127,48 @@
 #define WANTPAD(x) (((x)->attributes & NS_CLIENTATTR_WANTPAD) != 0)
 #define USEKEEPALIVE(x) (((x)->attributes & NS_CLIENTATTR_USEKEEPALIVE) != 0)
 
+/*%
+ * An open TCP connection.  This holds what has to be kept for as long
+ * as the connection is open: the socket, the reader for the next
+ * request, the idle timer and the slot in the TCP client quota.  A
+ * client is only attached to the connection while it is working on a
+ * request, so an idle connection does not tie up a client with its
+ * own task, timer, message and buffers.
+ *
+ * The connection holds a reference to itself from the time it is
+ * opened until it is closed and no read is outstanding; each client
+ * working on one of its requests holds another.
+ */
+struct ns_tcpconn {
+	unsigned int			magic;
+	isc_refcount_t			refs;
+	ns_clientmgr_t *		manager;
+	ns_interface_t *		interface;
+	ns_tcplistener_t *		listener;
+	isc_quota_t *			tcpquota;
+	isc_socket_t *			socket;
+	isc_sockaddr_t			peeraddr;
+	isc_task_t *			task;
+	isc_timer_t *			timer;
+	dns_tcpmsg_t			tcpmsg;
+	isc_event_t			ctlevent;
+
+	/* Lock covers the connection state. */
+	isc_mutex_t			lock;
+	bool				pipelined;
+	bool				keepalive;
+	bool				reading;
+	bool				closing;
+	unsigned int			nclients;
+
+	ISC_LINK(ns_tcpconn_t)		link;
+};
+
+#define TCPCONN_MAGIC			ISC_MAGIC('N', 'S', 'C', 't')
+#define VALID_TCPCONN(c)		ISC_MAGIC_VALID(c, TCPCONN_MAGIC)
+
+typedef ISC_LIST(ns_tcpconn_t) tcpconn_list_t;
+
 /*% nameserver client manager structure */
 struct ns_clientmgr {
 	/* Unlocked. */
@@ -136,9 +187,10 @@ struct ns_clientmgr {
 	isc_mutex_t			lock;
 	bool			exiting;
 
-	/* Lock covers the clients list */
+	/* Lock covers the clients and connections lists */
 	isc_mutex_t			listlock;
 	client_list_t			clients;      /*%< All active clients */
+	tcpconn_list_t			tcpconns;     /*%< Open TCP connections */
 
 	/* Lock covers the recursing list */
 	isc_mutex_t			reclock;
@@ -149,6 +201,10 @@ struct ns_clientmgr {
 	unsigned int			nextmctx;
 	isc_mem_t *			mctxpool[NMCTXS];
 #endif
+
+	/*%< task pool for TCP connections. */
+	unsigned int			nexttask;
+	isc_task_t *			taskpool[NTCPTASKS];
 };
 
 #define MANAGER_MAGIC			ISC_MAGIC('N', 'S', 'C', 'm')
@@ -194,10 +250,10 @@ struct ns_clientmgr {
 
 #define NS_CLIENTSTATE_READING  3
 /*%<
- * The client object is a TCP client object that has received
- * a connection.  It has a tcpsocket, tcpmsg, TCP quota, and an
- * outstanding TCP read request.  This state is not used for
- * UDP client objects.
+ * The client object is a TCP client object that has been handed
+ * a request read from a TCP connection.  It has a tcpsocket, a
+ * reference to the connection, and the request in tcpreq.  This
+ * state is not used for UDP client objects.
  */
 
 #define NS_CLIENTSTATE_WORKING  4
@@ -229,8 +285,11 @@ struct ns_clientmgr {
 
 LIBNS_EXTERNAL_DATA unsigned int ns_client_requests;
 
-static void read_settimeout(ns_client_t *client, bool newconn);
-static void client_read(ns_client_t *client, bool newconn);
+static bool tcpconn_read(ns_tcpconn_t *conn, bool newconn);
+static void tcpconn_request(isc_task_t *task, isc_event_t *event);
+static void tcpconn_timeout(isc_task_t *task, isc_event_t *event);
+static void tcpconn_destroy(isc_task_t *task, isc_event_t *event);
+static void tcpconn_detach(ns_tcpconn_t **connp);
 static void client_accept(ns_client_t *client);
 static void client_udprecv(ns_client_t *client);
 static void clientmgr_destroy(ns_clientmgr_t *manager);
@@ -239,9 +298,9 @@ static void ns_client_endrequest(ns_client_t *client);
 static void client_start(isc_task_t *task, isc_event_t *event);
 static void ns_client_dumpmessage(ns_client_t *client, const char *reason);
 static isc_result_t get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
-			       dns_dispatch_t *disp, bool tcp);
-static isc_result_t get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp,
-			       isc_socket_t *sock, ns_client_t *oldclient);
+			       dns_dispatch_t *disp,
+			       ns_tcplistener_t *listener);
+static isc_result_t get_worker(ns_tcpconn_t *conn);
 static void compute_cookie(ns_client_t *client, uint32_t when,
 			   uint32_t nonce, const unsigned char *secret,
 			   isc_buffer_t *buf);
@@ -290,127 +349,483 @@ ns_client_settimeout(ns_client_t *client, unsigned int seconds) {
 	}
 }
 
+/*%
+ * Allocate a TCP connection object for 'client' to accept a connection
+ * with, attached to the TCP client quota (tcp-clients).  The object is
+ * set up by tcpconn_open() once the connection has been accepted.
+ */
+static isc_result_t
+tcpconn_init(ns_client_t *client, bool force) {
+	isc_result_t result;
+	isc_quota_t *quota = NULL;
+	ns_tcpconn_t *conn = NULL;
+
+	REQUIRE(client->tcpconn == NULL);
+
+	/*
+	 * Try to attach to the quota first, so we won't pointlessly
+	 * allocate memory for a tcpconn object if we can't get one.
+	 */
+	if (force) {
+		result = isc_quota_force(&client->sctx->tcpquota, &quota);
+	} else {
+		result = isc_quota_attach(&client->sctx->tcpquota, &quota);
+	}
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+
+	/*
+	 * A global memory context is used for the allocation as the
+	 * connection outlives the client that accepted it, and is
+	 * released by whichever client happens to finish with it last.
+	 */
+	conn = isc_mem_get(client->sctx->mctx, sizeof(*conn));
+	if (conn == NULL) {
+		isc_quota_detach(&quota);
+		return (ISC_R_NOMEMORY);
+	}
+
+	conn->magic = TCPCONN_MAGIC;
+	isc_refcount_init(&conn->refs, 1);
+	conn->manager = NULL;
+	conn->interface = NULL;
+	conn->listener = NULL;
+	conn->tcpquota = quota;
+	conn->socket = NULL;
+	conn->task = NULL;
+	conn->timer = NULL;
+	isc_mutex_init(&conn->lock);
+	conn->pipelined = false;
+	conn->keepalive = false;
+	conn->reading = false;
+	conn->closing = false;
+	conn->nclients = 0;
+	ISC_LINK_INIT(conn, link);
+
+	client->tcpconn = conn;
+
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Free a connection object that was never opened.
+ */
+static void
+tcpconn_free(ns_client_t *client) {
+	ns_tcpconn_t *conn = client->tcpconn;
+	uint_fast32_t refs;
+
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(conn->socket == NULL);
+
+	client->tcpconn = NULL;
+
+	isc_quota_detach(&conn->tcpquota);
+	isc_mutex_destroy(&conn->lock);
+	refs = isc_refcount_decrement(&conn->refs);
+	INSIST(refs == 1);
+	isc_refcount_destroy(&conn->refs);
+	conn->magic = 0;
+	isc_mem_put(client->sctx->mctx, conn, sizeof(*conn));
+}
+
+/*%
+ * Get a task from the manager's pool for a connection.
+ */
+static isc_result_t
+tcpconn_gettask(ns_clientmgr_t *manager, isc_task_t **taskp) {
+	isc_result_t result = ISC_R_SUCCESS;
+	unsigned int nexttask;
+
+	LOCK(&manager->lock);
+	nexttask = manager->nexttask++;
+	if (manager->nexttask == NTCPTASKS) {
+		manager->nexttask = 0;
+	}
+	if (manager->taskpool[nexttask] == NULL) {
+		result = isc_task_create(manager->taskmgr, 0,
+					 &manager->taskpool[nexttask]);
+		if (result == ISC_R_SUCCESS) {
+			isc_task_setname(manager->taskpool[nexttask],
+					 "tcpconn", manager);
+		}
+	}
+	if (result == ISC_R_SUCCESS) {
+		isc_task_attach(manager->taskpool[nexttask], taskp);
+	}
+	UNLOCK(&manager->lock);
+
+	return (result);
+}
+
+/*%
+ * The connection accepted by 'client' on '*sockp' has been let in:
+ * hand it over to the connection object allocated by tcpconn_init(),
+ * and start reading the first request.  The client is left free to
+ * accept the next connection.
+ */
+static isc_result_t
+tcpconn_open(ns_client_t *client, isc_socket_t **sockp, bool pipelined) {
+	isc_result_t result;
+	ns_clientmgr_t *manager = client->manager;
+	ns_tcpconn_t *conn = client->tcpconn;
+	bool detach;
+
+	REQUIRE(VALID_TCPCONN(conn));
+
+	result = tcpconn_gettask(manager, &conn->task);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+
+	result = isc_timer_create(manager->timermgr, isc_timertype_inactive,
+				  NULL, NULL, conn->task, tcpconn_timeout,
+				  conn, &conn->timer);
+	if (result != ISC_R_SUCCESS) {
+		isc_task_detach(&conn->task);
+		return (result);
+	}
+
+	client->tcpconn = NULL;
+
+	conn->manager = manager;
+	ns_interface_attach(client->interface, &conn->interface);
+	conn->listener = client->tcplistener;
+	conn->socket = *sockp;
+	*sockp = NULL;
+	conn->peeraddr = client->peeraddr;
+	conn->pipelined = pipelined;
+	dns_tcpmsg_init(client->sctx->mctx, conn->socket, &conn->tcpmsg);
+	ISC_EVENT_INIT(&conn->ctlevent, sizeof(conn->ctlevent), 0, NULL,
+		       NS_EVENT_CLIENTCONTROL, tcpconn_destroy, conn, conn,
+		       NULL, NULL);
+
+	/*
+	 * The connection counts as active on the listener until it is
+	 * destroyed, just as the client servicing it used to.
+	 */
+	isc_refcount_increment0(&conn->listener->ntcpactive);
+
+	LOCK(&manager->listlock);
+	ISC_LIST_APPEND(manager->tcpconns, conn, link);
+	UNLOCK(&manager->listlock);
+
+	LOCK(&conn->lock);
+	detach = tcpconn_read(conn, true);
+	UNLOCK(&conn->lock);
+
+	if (detach) {
+		tcpconn_detach(&conn);
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Start closing the connection.  Returns true if the caller must
+ * drop the connection's reference to itself, which it must do after
+ * unlocking the connection.  Otherwise, a read is outstanding and the
+ * reference will be dropped when it has been canceled.
+ *
+ * The connection must be locked.
+ */
+static bool
+tcpconn_close(ns_tcpconn_t *conn) {
+	if (conn->closing) {
+		return (false);
+	}
+
+	conn->closing = true;
+	(void)isc_timer_reset(conn->timer, isc_timertype_inactive,
+			      NULL, NULL, true);
+	if (conn->reading) {
+		dns_tcpmsg_cancelread(&conn->tcpmsg);
+		return (false);
+	}
+
+	return (true);
+}
+
+static void
+tcpconn_detach(ns_tcpconn_t **connp) {
+	ns_tcpconn_t *conn = *connp;
+	isc_event_t *ev;
+
+	REQUIRE(VALID_TCPCONN(conn));
+
+	*connp = NULL;
+
+	if (isc_refcount_decrement(&conn->refs) == 1) {
+		/*
+		 * Events for the connection are delivered to its task,
+		 * so that is where it must be destroyed.
+		 */
+		ev = &conn->ctlevent;
+		isc_task_send(conn->task, &ev);
+	}
+}
+
+/*%
+ * The last reference to a connection has gone.
+ */
 static void
-read_settimeout(ns_client_t *client, bool newconn) {
+tcpconn_destroy(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
+	ns_clientmgr_t *manager = conn->manager;
+	ns_interface_t *ifp = NULL;
+	bool destroy_manager = false, restart = false, claimed = false;
+
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(task == conn->task);
+
+	INSIST(conn->closing && !conn->reading && conn->nclients == 0);
+
+	dns_tcpmsg_invalidate(&conn->tcpmsg);
+	isc_timer_detach(&conn->timer);
+	isc_socket_detach(&conn->socket);
+	isc_quota_detach(&conn->tcpquota);
+	(void)isc_refcount_decrement(&conn->listener->ntcpactive);
+
+	/*
+	 * If this was the last thing keeping the listener active, nobody
+	 * may be accepting new connections on it any more; in that case
+	 * get a client to do so.  Until that client has started
+	 * accepting, other connections closing at the same time would
+	 * see nobody accepting either, so only the first to claim the
+	 * restart gets one; otherwise every extra client would go on
+	 * accepting, and hold a slot in the TCP client quota.
+	 */
+	if (isc_refcount_current(&conn->listener->ntcpaccepting) == 0) {
+		bool expected = false;
+		claimed = atomic_compare_exchange_strong(
+				&conn->listener->restarting, &expected, true);
+	}
+	restart = claimed;
+
+	LOCK(&manager->listlock);
+	ISC_LIST_UNLINK(manager->tcpconns, conn, link);
+	LOCK(&manager->lock);
+	if (manager->exiting) {
+		restart = false;
+		destroy_manager = (ISC_LIST_EMPTY(manager->clients) &&
+				   ISC_LIST_EMPTY(manager->tcpconns));
+	}
+	UNLOCK(&manager->lock);
+	UNLOCK(&manager->listlock);
+
+	if (restart && (manager->sctx->options & NS_SERVER_CLIENTTEST) == 0 &&
+	    get_client(manager, conn->interface, NULL,
+		       conn->listener) == ISC_R_SUCCESS)
+	{
+		/* client_accept() will drop the claim. */
+		claimed = false;
+	}
+	if (claimed) {
+		atomic_store(&conn->listener->restarting, false);
+	}
+
+	ifp = conn->interface;
+	conn->interface = NULL;
+	isc_task_detach(&conn->task);
+	isc_mutex_destroy(&conn->lock);
+	isc_refcount_destroy(&conn->refs);
+	conn->magic = 0;
+	isc_mem_put(manager->sctx->mctx, conn, sizeof(*conn));
+
+	ns_interface_detach(&ifp);
+
+	if (destroy_manager) {
+		clientmgr_destroy(manager);
+	}
+}
+
+/*%
+ * Read the next request from the connection.  If that fails, the
+ * connection is closed, and as with tcpconn_close(), true is returned
+ * if the caller must drop the connection's reference to itself.
+ *
+ * The connection must be locked.
+ */
+static bool
+tcpconn_read(ns_tcpconn_t *conn, bool newconn) {
 	isc_result_t result;
 	isc_interval_t interval;
+	ns_server_t *sctx = conn->manager->sctx;
 	unsigned int ds;
 
-	if (newconn)
-		ds = client->sctx->initialtimo;
-	else if (USEKEEPALIVE(client))
-		ds = client->sctx->keepalivetimo;
-	else
-		ds = client->sctx->idletimo;
+	REQUIRE(!conn->reading && !conn->closing);
+
+	result = dns_tcpmsg_readmessage(&conn->tcpmsg, conn->task,
+					tcpconn_request, conn);
+	if (result != ISC_R_SUCCESS) {
+		return (tcpconn_close(conn));
+	}
+	conn->reading = true;
+
+	/*
+	 * Set a timeout to limit the amount of time we will wait
+	 * for a request on this TCP connection.
+	 */
+	if (newconn) {
+		ds = sctx->initialtimo;
+	} else if (conn->keepalive) {
+		ds = sctx->keepalivetimo;
+	} else {
+		ds = sctx->idletimo;
+	}
 
 	isc_interval_set(&interval, ds / 10, 100000000 * (ds % 10));
-	result = isc_timer_reset(client->timer, isc_timertype_once, NULL,
+	result = isc_timer_reset(conn->timer, isc_timertype_once, NULL,
 				 &interval, false);
-	client->timerset = true;
 	if (result != ISC_R_SUCCESS) {
-		ns_client_log(client, NS_LOGCATEGORY_CLIENT,
+		isc_log_write(ns_lctx, NS_LOGCATEGORY_CLIENT,
 			      NS_LOGMODULE_CLIENT, ISC_LOG_ERROR,
 			      "setting timeout: %s",
 			      isc_result_totext(result));
 		/* Continue anyway. */
 	}
+
+	return (false);
 }
 
 /*%
- * Allocate a reference-counted object that will maintain a single pointer to
- * the (also reference-counted) TCP client quota, shared between all the
- * clients processing queries on a single TCP connection, so that all
- * clients sharing the one socket will together consume only one slot in
- * the 'tcp-clients' quota.
+ * A request, or an error, has been read from the connection.  Hand
+ * the request to a client, and unless requests are being pipelined,
+ * wait until it has been answered before reading the next one.
  */
-static isc_result_t
-tcpconn_init(ns_client_t *client, bool force) {
+static void
+tcpconn_request(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
 	isc_result_t result;
-	isc_quota_t *quota = NULL;
-	ns_tcpconn_t *tconn = NULL;
+	isc_region_t r;
+	bool detach = false;
 
-	REQUIRE(client->tcpconn == NULL);
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(event->ev_type == DNS_EVENT_TCPMSG);
+	REQUIRE(event->ev_sender == &conn->tcpmsg);
+	REQUIRE(task == conn->task);
 
-	/*
-	 * Try to attach to the quota first, so we won't pointlessly
-	 * allocate memory for a tcpconn object if we can't get one.
-	 */
-	if (force) {
-		result = isc_quota_force(&client->sctx->tcpquota, &quota);
-	} else {
-		result = isc_quota_attach(&client->sctx->tcpquota, &quota);
+	LOCK(&conn->lock);
+
+	INSIST(conn->reading);
+	conn->reading = false;
+	(void)isc_timer_reset(conn->timer, isc_timertype_inactive,
+			      NULL, NULL, true);
+
+	result = conn->tcpmsg.result;
+	if (conn->closing) {
+		/* The read has been canceled. */
+		detach = true;
+		goto unlock;
 	}
 	if (result != ISC_R_SUCCESS) {
-		return (result);
+		if (isc_log_wouldlog(ns_lctx, ISC_LOG_DEBUG(3))) {
+			char peerbuf[ISC_SOCKADDR_FORMATSIZE];
+
+			isc_sockaddr_format(&conn->peeraddr, peerbuf,
+					    sizeof(peerbuf));
+			isc_log_write(ns_lctx, NS_LOGCATEGORY_CLIENT,
+				      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(3),
+				      "client %s: TCP connection closed: %s",
+				      peerbuf, isc_result_totext(result));
+		}
+		detach = tcpconn_close(conn);
+		goto unlock;
 	}
 
 	/*
-	 * A global memory context is used for the allocation as different
-	 * client structures may have different memory contexts assigned and a
-	 * reference counter allocated here might need to be freed by a
-	 * different client.  The performance impact caused by memory context
-	 * contention here is expected to be negligible, given that this code
-	 * is only executed for TCP connections.
+	 * Only queries are pipelined; anything else, such as an UPDATE
+	 * or a NOTIFY, is answered before the next request is read.
 	 */
-	tconn = isc_mem_allocate(client->sctx->mctx, sizeof(*tconn));
+	isc_buffer_usedregion(&conn->tcpmsg.buffer, &r);
+	if (r.length < DNS_MESSAGE_HEADERLEN ||
+	    ((r.base[2] >> 3) & 0x0f) != dns_opcode_query)
+	{
+		conn->pipelined = false;
+	}
 
-	isc_refcount_init(&tconn->refs, 1);
-	tconn->tcpquota = quota;
-	quota = NULL;
-	tconn->pipelined = false;
+	result = get_worker(conn);
+	if (result != ISC_R_SUCCESS) {
+		detach = tcpconn_close(conn);
+		goto unlock;
+	}
 
-	client->tcpconn = tconn;
+	if (conn->pipelined) {
+		detach = tcpconn_read(conn, false);
+	}
 
-	return (ISC_R_SUCCESS);
+ unlock:
+	UNLOCK(&conn->lock);
+
+	if (detach) {
+		tcpconn_detach(&conn);
+	}
 }
 
 /*%
- * Increase the count of client structures sharing the TCP connection
- * that 'source' is associated with; add a pointer to the same tcpconn
- * to 'target', thus associating it with the same TCP connection.
+ * The connection has been idle for too long.
  */
 static void
-tcpconn_attach(ns_client_t *source, ns_client_t *target) {
-	int old_refs;
+tcpconn_timeout(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
+	bool detach = false;
 
-	REQUIRE(source->tcpconn != NULL);
-	REQUIRE(target->tcpconn == NULL);
-	REQUIRE(source->tcpconn->pipelined);
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(task == conn->task);
 
-	old_refs = isc_refcount_increment(&source->tcpconn->refs);
-	INSIST(old_refs > 0);
-	target->tcpconn = source->tcpconn;
+	isc_event_free(&event);
+
+	LOCK(&conn->lock);
+	if (conn->reading) {
+		detach = tcpconn_close(conn);
+	}
+	UNLOCK(&conn->lock);
+
+	if (detach) {
+		tcpconn_detach(&conn);
+	}
 }
 
 /*%
- * Decrease the count of client structures sharing the TCP connection that
- * 'client' is associated with.  If this is the last client using this TCP
- * connection, we detach from the TCP quota and free the tcpconn
- * object. Either way, client->tcpconn is set to NULL.
+ * 'client' has finished with the request it was handed by its TCP
+ * connection.  If 'keep' is true the connection carries on, and if it
+ * was waiting for the client, it reads the next request; otherwise it
+ * is closed.
  */
 static void
-tcpconn_detach(ns_client_t *client) {
-	ns_tcpconn_t *tconn = NULL;
-	int old_refs;
+tcpconn_release(ns_client_t *client, bool keep, bool keepalive) {
+	ns_tcpconn_t *conn = client->tcpconn;
+	bool detach = false;
 
-	REQUIRE(client->tcpconn != NULL);
+	REQUIRE(VALID_TCPCONN(conn));
 
-	tconn = client->tcpconn;
 	client->tcpconn = NULL;
 
-	old_refs = isc_refcount_decrement(&tconn->refs);
-	INSIST(old_refs > 0);
+	LOCK(&conn->lock);
+	INSIST(conn->nclients > 0);
+	conn->nclients--;
+	if (keepalive) {
+		conn->keepalive = true;
+	}
+	if (!keep) {
+		detach = tcpconn_close(conn);
+	} else if (!conn->reading && !conn->closing && conn->nclients == 0) {
+		detach = tcpconn_read(conn, false);
+	}
+	UNLOCK(&conn->lock);
 
-	if (old_refs == 1) {
-		isc_quota_detach(&tconn->tcpquota);
-		isc_mem_free(client->sctx->mctx, tconn);
+	if (detach) {
+		ns_tcpconn_t *self = conn;
+		tcpconn_detach(&self);
 	}
+	tcpconn_detach(&conn);
 }
 
 /*%
- * Mark a client as active and increment the interface's 'ntcpactive'
+ * Mark a client as active and increment its listener's 'ntcpactive'
  * counter, as a signal that there is at least one client servicing
- * TCP queries for the interface. If we reach the TCP client quota at
+ * TCP queries for the listener. If we reach the TCP client quota at
  * some point, this will be used to determine whether a quota overrun
  * should be permitted.
  *
@@ -421,11 +836,11 @@ tcpconn_detach(ns_client_t *client) {
 static void
 mark_tcp_active(ns_client_t *client, bool active) {
 	if (active && !client->tcpactive) {
-		isc_refcount_increment0(&client->interface->ntcpactive);
+		isc_refcount_increment0(&client->tcplistener->ntcpactive);
 		client->tcpactive = active;
 	} else if (!active && client->tcpactive) {
 		uint32_t old =
-			isc_refcount_decrement(&client->interface->ntcpactive);
+			isc_refcount_decrement(&client->tcplistener->ntcpactive);
 		INSIST(old > 0);
 		client->tcpactive = active;
 	}
@@ -440,6 +855,7 @@ mark_tcp_active(ns_client_t *client, bool active) {
 static bool
 exit_check(ns_client_t *client) {
 	bool destroy_manager = false;
+	bool keepconn = false, keepalive = false;
 	ns_clientmgr_t *manager = NULL;
 
 	REQUIRE(NS_CLIENT_VALID(client));
@@ -514,86 +930,45 @@ exit_check(ns_client_t *client) {
 						client, rlink);
 			UNLOCK(&manager->reclock);
 		}
+		keepalive = USEKEEPALIVE(client);
 		ns_client_endrequest(client);
 
 		client->state = NS_CLIENTSTATE_READING;
 		INSIST(client->recursionquota == NULL);
 
 		if (NS_CLIENTSTATE_READING == client->newstate) {
+			/*
+			 * The request has been answered.  The TCP
+			 * connection carries on without this client.
+			 */
 			INSIST(client->tcpconn != NULL);
-			if (!client->tcpconn->pipelined) {
-				client_read(client, false);
-				client->newstate = NS_CLIENTSTATE_MAX;
-				return (true); /* We're done. */
-			} else if (client->mortal) {
-				client->newstate = NS_CLIENTSTATE_INACTIVE;
-			} else
-				return (false);
+			keepconn = true;
+			client->newstate = NS_CLIENTSTATE_INACTIVE;
 		}
 	}
 
 	if (client->state == NS_CLIENTSTATE_READING) {
 		/*
-		 * We are trying to abort the current TCP connection,
-		 * if any.
+		 * We are done with the request read from the TCP
+		 * connection, and unless it was answered, with the
+		 * connection itself.
 		 */
 		INSIST(client->recursionquota == NULL);
 		INSIST(client->newstate <= NS_CLIENTSTATE_READY);
 
-		if (client->nreads > 0) {
-			dns_tcpmsg_cancelread(&client->tcpmsg);
-		}
-
-		/* Still waiting for read cancel completion. */
-		if (client->nreads > 0) {
-			return (true);
-		}
-
-		if (client->tcpmsg_valid) {
-			dns_tcpmsg_invalidate(&client->tcpmsg);
-			client->tcpmsg_valid = false;
-		}
-
-		/*
-		 * Soon the client will be ready to accept a new TCP
-		 * connection or UDP request, but we may have enough
-		 * clients doing that already.  Check whether this client
-		 * needs to remain active and allow it go inactive if
-		 * not.
-		 *
-		 * UDP clients always go inactive at this point, but a TCP
-		 * client may need to stay active and return to READY
-		 * state if no other clients are available to listen
-		 * for TCP requests on this interface.
-		 *
-		 * Regardless, if we're going to FREED state, that means
-		 * the system is shutting down and we don't need to
-		 * retain clients.
-		 */
-		if (client->mortal && TCP_CLIENT(client) &&
-		    client->newstate != NS_CLIENTSTATE_FREED &&
-		    (client->sctx->options & NS_SERVER_CLIENTTEST) == 0 &&
-		    isc_refcount_current(&client->interface->ntcpaccepting) == 0)
-		{
-			/* Nobody else is accepting */
-			client->mortal = false;
-			client->newstate = NS_CLIENTSTATE_READY;
+		if (client->tcpreq.base != NULL) {
+			isc_mem_put(client->sctx->mctx, client->tcpreq.base,
+				    client->tcpreq.length);
+			isc_buffer_initnull(&client->tcpreq);
 		}
 
-		/*
-		 * Detach from TCP connection and TCP client quota,
-		 * if appropriate. If this is the last reference to
-		 * the TCP connection in our pipeline group, the
-		 * TCP quota slot will be released.
-		 */
-		if (client->tcpconn) {
-			tcpconn_detach(client);
+		if (client->tcpconn != NULL) {
+			tcpconn_release(client, keepconn, keepalive);
 		}
 
 		if (client->tcpsocket != NULL) {
 			CTRACE("closetcp");
 			isc_socket_detach(&client->tcpsocket);
-			mark_tcp_active(client, false);
 		}
 
 		if (client->timerset) {
@@ -635,8 +1010,8 @@ exit_check(ns_client_t *client) {
 		 * We are trying to enter the inactive state.
 		 */
 		if (client->naccepts > 0) {
-			isc_socket_cancel(client->tcplistener, client->task,
-					  ISC_SOCKCANCEL_ACCEPT);
+			isc_socket_cancel(client->tcplistener->socket,
+					  client->task, ISC_SOCKCANCEL_ACCEPT);
 		}
 
 		/* Still waiting for accept cancel completion. */
@@ -663,8 +1038,8 @@ exit_check(ns_client_t *client) {
 		INSIST(client->naccepts == 0);
 		INSIST(client->recursionquota == NULL);
 		if (client->tcplistener != NULL) {
-			isc_socket_detach(&client->tcplistener);
 			mark_tcp_active(client, false);
+			client->tcplistener = NULL;
 		}
 		if (client->udpsocket != NULL) {
 			isc_socket_detach(&client->udpsocket);
@@ -735,7 +1110,8 @@ exit_check(ns_client_t *client) {
 			ISC_LIST_UNLINK(manager->clients, client, link);
 			LOCK(&manager->lock);
 			if (manager->exiting &&
-			    ISC_LIST_EMPTY(manager->clients))
+			    ISC_LIST_EMPTY(manager->clients) &&
+			    ISC_LIST_EMPTY(manager->tcpconns))
 				destroy_manager = true;
 			UNLOCK(&manager->lock);
 			UNLOCK(&manager->listlock);
@@ -743,6 +1119,7 @@ exit_check(ns_client_t *client) {
 
 		ns_query_free(client);
 		isc_mem_put(client->mctx, client->recvbuf, RECV_BUFFER_SIZE);
+		isc_mem_put(client->mctx, client->sendbuf, SEND_BUFFER_SIZE);
 		isc_event_free((isc_event_t **)&client->sendevent);
 		isc_event_free((isc_event_t **)&client->recvevent);
 		isc_timer_detach(&client->timer);
@@ -763,6 +1140,11 @@ exit_check(ns_client_t *client) {
 				    client->keytag_len);
 			client->keytag_len = 0;
 		}
+		if (client->querylog != NULL) {
+			isc_mem_put(client->mctx, client->querylog,
+				    NS_QUERYLOG_MAXSIZE);
+			client->querylog = NULL;
+		}
 
 		dns_message_destroy(&client->message);
 
@@ -827,7 +1209,7 @@ client_start(isc_task_t *task, isc_event_t *event) {
 
 	if (TCP_CLIENT(client)) {
 		if (client->tcpconn != NULL) {
-			client_read(client, false);
+			ns__client_request(task, event);
 		} else {
 			client_accept(client);
 		}
@@ -872,7 +1254,6 @@ client_shutdown(isc_task_t *task, isc_event_t *event) {
 static void
 ns_client_endrequest(ns_client_t *client) {
 	INSIST(client->naccepts == 0);
-	INSIST(client->nreads == 0);
 	INSIST(client->nsends == 0);
 	INSIST(client->nrecvs == 0);
 	INSIST(client->nupdates == 0);
@@ -881,6 +1262,10 @@ ns_client_endrequest(ns_client_t *client) {
 
 	CTRACE("endrequest");
 
+	if ((client->attributes & NS_CLIENTATTR_QUERYLOG) != 0) {
+		ns_querylog_end(client);
+	}
+
 	if (client->next != NULL) {
 		(client->next)(client);
 		client->next = NULL;
@@ -997,6 +1382,31 @@ client_senddone(isc_task_t *task, isc_event_t *event) {
 	ns_client_next(client, ISC_R_SUCCESS);
 }
 
+unsigned int
+ns_client_sendbufsize(ns_client_t *client) {
+	unsigned int bufsize;
+
+	REQUIRE(NS_CLIENT_VALID(client));
+
+	if (TCP_CLIENT(client)) {
+		return (TCP_BUFFER_SIZE - 2);
+	}
+
+	if ((client->attributes & NS_CLIENTATTR_HAVECOOKIE) == 0) {
+		if (client->view != NULL)
+			bufsize = client->view->nocookieudp;
+		else
+			bufsize = 512;
+	} else
+		bufsize = client->udpsize;
+	if (bufsize > client->udpsize)
+		bufsize = client->udpsize;
+	if (bufsize > SEND_BUFFER_SIZE)
+		bufsize = SEND_BUFFER_SIZE;
+
+	return (bufsize);
+}
+
 /*%
  * We only want to fail with ISC_R_NOSPACE when called from
  * ns_client_sendraw() and not when called from ns_client_send(),
@@ -1008,7 +1418,7 @@ client_senddone(isc_task_t *task, isc_event_t *event) {
 static isc_result_t
 client_allocsendbuf(ns_client_t *client, isc_buffer_t *buffer,
 		    isc_buffer_t *tcpbuffer, uint32_t length,
-		    unsigned char *sendbuf, unsigned char **datap)
+		    unsigned char **datap)
 {
 	unsigned char *data;
 	uint32_t bufsize;
@@ -1039,18 +1449,8 @@ client_allocsendbuf(ns_client_t *client, isc_buffer_t *buffer,
 			isc_buffer_putuint16(buffer, (uint16_t)length);
 		}
 	} else {
-		data = sendbuf;
-		if ((client->attributes & NS_CLIENTATTR_HAVECOOKIE) == 0) {
-			if (client->view != NULL)
-				bufsize = client->view->nocookieudp;
-			else
-				bufsize = 512;
-		} else
-			bufsize = client->udpsize;
-		if (bufsize > client->udpsize)
-			bufsize = client->udpsize;
-		if (bufsize > SEND_BUFFER_SIZE)
-			bufsize = SEND_BUFFER_SIZE;
+		data = client->sendbuf;
+		bufsize = ns_client_sendbufsize(client);
 		if (length > bufsize) {
 			result = ISC_R_NOSPACE;
 			goto done;
@@ -1094,7 +1494,7 @@ client_sendpkg(ns_client_t *client, isc_buffer_t *buffer) {
 		{
 			return (DNS_R_BLACKHOLED);
 		}
-		sockflags |= ISC_SOCKFLAG_NORETRY;
+		sockflags |= ISC_SOCKFLAG_NORETRY | ISC_SOCKFLAG_BATCH;
 	}
 
 	if ((client->attributes & NS_CLIENTATTR_PKTINFO) != 0 &&
@@ -1151,7 +1551,6 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *message) {
 	isc_buffer_t buffer;
 	isc_region_t r;
 	isc_region_t *mr;
-	unsigned char sendbuf[SEND_BUFFER_SIZE];
 
 	REQUIRE(NS_CLIENT_VALID(client));
 
@@ -1164,7 +1563,7 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *message) {
 	}
 
 	result = client_allocsendbuf(client, &buffer, NULL, mr->length,
-				     sendbuf, &data);
+				     &data);
 	if (result != ISC_R_SUCCESS)
 		goto done;
 
@@ -1190,6 +1589,43 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *message) {
 	ns_client_next(client, result);
 }
 
+/*
+ * Count the time taken to answer a query in the view's latency histogram.
+ * Only answers are counted: errors, such as a REFUSED from an ACL, and
+ * truncated responses, which include those that rate limiting slips,
+ * would otherwise swamp the fastest buckets.  An answer is counted by
+ * where it came from: recursion if it had to recurse, the cache if it
+ * used any data from the cache, and otherwise a local zone.
+ */
+static void
+count_latency(ns_client_t *client) {
+	ns_latencytype_t type;
+	isc_time_t now;
+	uint64_t usec;
+
+	if ((client->message->rcode != dns_rcode_noerror &&
+	     client->message->rcode != dns_rcode_nxdomain) ||
+	    (client->message->flags & DNS_MESSAGEFLAG_TC) != 0)
+	{
+		return;
+	}
+
+	if ((client->attributes & NS_CLIENTATTR_RECURSED) != 0) {
+		type = ns_latency_recursion;
+	} else if ((client->attributes & NS_CLIENTATTR_CACHEANSWER) != 0) {
+		type = ns_latency_cache;
+	} else {
+		type = ns_latency_auth;
+	}
+
+	isc_time_now(&now);
+	usec = isc_time_microdiff(&now, &client->recvtime);
+
+	isc_stats_increment(client->view->querylatencystats,
+			    ns_stats_latencycounter(TCP_CLIENT(client), type,
+						    usec));
+}
+
 static void
 client_send(ns_client_t *client) {
 	isc_result_t result;
@@ -1199,7 +1635,6 @@ client_send(ns_client_t *client) {
 	isc_region_t r;
 	dns_compress_t cctx;
 	bool cleanup_cctx = false;
-	unsigned char sendbuf[SEND_BUFFER_SIZE];
 	unsigned int render_opts;
 	unsigned int preferred_glue;
 	bool opt_included = false;
@@ -1239,9 +1674,12 @@ client_send(ns_client_t *client) {
 	}
 
 	/*
-	 * Create an OPT for our reply.
+	 * Create an OPT for our reply, unless query_respcache() has
+	 * already made one.
 	 */
-	if ((client->attributes & NS_CLIENTATTR_WANTOPT) != 0) {
+	if ((client->attributes & NS_CLIENTATTR_WANTOPT) != 0 &&
+	    client->opt == NULL)
+	{
 		result = ns_client_addopt(client, client->message,
 					  &client->opt);
 		if (result != ISC_R_SUCCESS)
@@ -1252,7 +1690,7 @@ client_send(ns_client_t *client) {
 	 * XXXRTH  The following doesn't deal with TCP buffer resizing.
 	 */
 	result = client_allocsendbuf(client, &buffer, &tcpbuffer, 0,
-				     sendbuf, &data);
+				     &data);
 	if (result != ISC_R_SUCCESS)
 		goto done;
 
@@ -1291,6 +1729,27 @@ client_send(ns_client_t *client) {
 		if (result != ISC_R_SUCCESS)
 			goto done;
 	}
+
+	/*
+	 * A response found in the response cache replaces all the
+	 * sections.  If it doesn't fit, send just the question.
+	 */
+	if (client->query.respcache.entry != NULL) {
+		result = dns_respcache_render(client->query.respcache.entry,
+					      client->message);
+		if (result == ISC_R_NOSPACE) {
+			client->message->flags |= DNS_MESSAGEFLAG_TC;
+			result = dns_message_rendersection(client->message,
+							   DNS_SECTION_QUESTION,
+							   0);
+			if (result == ISC_R_NOSPACE)
+				result = ISC_R_SUCCESS;
+		}
+		if (result != ISC_R_SUCCESS)
+			goto done;
+		goto renderend;
+	}
+
 	result = dns_message_rendersection(client->message,
 					   DNS_SECTION_QUESTION, 0);
 	if (result == ISC_R_NOSPACE) {
@@ -1329,6 +1788,24 @@ client_send(ns_client_t *client) {
 					   preferred_glue | render_opts);
 	if (result != ISC_R_SUCCESS && result != ISC_R_NOSPACE)
 		goto done;
+
+	/*
+	 * Cache the complete response, before the OPT and any TSIG are
+	 * added, if query_send() found it could be cached.
+	 */
+	if (result == ISC_R_SUCCESS &&
+	    (client->query.attributes & NS_QUERYATTR_RESPCACHE) != 0)
+	{
+		dns_respcache_add(client->view->respcache,
+				  client->query.origqname,
+				  client->message->rdclass,
+				  client->query.qtype,
+				  client->query.respcache.variant,
+				  client->query.respcache.db,
+				  client->query.respcache.version,
+				  client->query.respcache.flags,
+				  client->message);
+	}
  renderend:
 	result = dns_message_renderend(client->message);
 	if (result != ISC_R_SUCCESS)
@@ -1364,6 +1841,16 @@ client_send(ns_client_t *client) {
 		cleanup_cctx = false;
 	}
 
+	if ((client->attributes & NS_CLIENTATTR_QUERYLOG) != 0) {
+		ns_querylog_response(client);
+	}
+
+	if (client->message->opcode == dns_opcode_query &&
+	    client->view != NULL && client->view->querylatencystats != NULL)
+	{
+		count_latency(client);
+	}
+
 	if (client->sendcb != NULL) {
 		client->sendcb(&buffer);
 	} else if (TCP_CLIENT(client)) {
@@ -2368,7 +2855,8 @@ process_opt(ns_client_t *client, dns_rdataset_t *opt) {
 
 /*
  * Handle an incoming request event from the socket (UDP case)
- * or tcpmsg (TCP case).
+ * or the client's control event once it has been handed a request
+ * by its TCP connection (TCP case).
  */
 void
 ns__client_request(isc_task_t *task, isc_event_t *event) {
@@ -2405,6 +2893,13 @@ ns__client_request(isc_task_t *task, isc_event_t *event) {
 
 	ns_client_requests++;
 
+	/*
+	 * Unlike 'requesttime' below, which is the task's idea of the
+	 * time, this is read from the clock so that it is precise enough
+	 * to measure how long the request takes.
+	 */
+	isc_time_now(&client->recvtime);
+
 	if (event->ev_type == ISC_SOCKEVENT_RECVDONE) {
 		INSIST(!TCP_CLIENT(client));
 		sevent = (isc_socketevent_t *)event;
@@ -2434,15 +2929,13 @@ ns__client_request(isc_task_t *task, isc_event_t *event) {
 	} else {
 		INSIST(TCP_CLIENT(client));
 		INSIST(client->tcpconn != NULL);
-		REQUIRE(event->ev_type == DNS_EVENT_TCPMSG);
-		REQUIRE(event->ev_sender == &client->tcpmsg);
-		buffer = &client->tcpmsg.buffer;
-		result = client->tcpmsg.result;
-		INSIST(client->nreads == 1);
+		REQUIRE(event == &client->ctlevent);
+		buffer = &client->tcpreq;
+		result = ISC_R_SUCCESS;
 		/*
-		 * client->peeraddr was set when the connection was accepted.
+		 * client->peeraddr was set when the request was handed
+		 * over by the connection.
 		 */
-		client->nreads--;
 	}
 
 	reqsize = isc_buffer_usedlength(buffer);
@@ -2619,33 +3112,6 @@ ns__client_request(isc_task_t *task, isc_event_t *event) {
 		return;
 	}
 
-	/*
-	 * Pipeline TCP query processing.
-	 */
-	if (TCP_CLIENT(client) &&
-	    client->message->opcode != dns_opcode_query)
-	{
-		client->tcpconn->pipelined = false;
-	}
-	if (TCP_CLIENT(client) && client->tcpconn->pipelined) {
-		/*
-		 * We're pipelining. Replace the client; the
-		 * replacement can read the TCP socket looking
-		 * for new messages and this one can process the
-		 * current message asynchronously.
-		 *
-		 * There will now be at least three clients using this
-		 * TCP socket - one accepting new connections,
-		 * one reading an existing connection to get new
-		 * messages, and one answering the message already
-		 * received.
-		 */
-		result = ns_client_replace(client);
-		if (result != ISC_R_SUCCESS) {
-			client->tcpconn->pipelined = false;
-		}
-	}
-
 	dns_opcodestats_increment(client->sctx->opcodestats,
 				  client->message->opcode);
 	switch (client->message->opcode) {
@@ -3151,10 +3617,16 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 		goto cleanup_message;
 	}
 
+	client->sendbuf = isc_mem_get(client->mctx, SEND_BUFFER_SIZE);
+	if  (client->sendbuf == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_sendevent;
+	}
+
 	client->recvbuf = isc_mem_get(client->mctx, RECV_BUFFER_SIZE);
 	if  (client->recvbuf == NULL) {
 		result = ISC_R_NOMEMORY;
-		goto cleanup_sendevent;
+		goto cleanup_sendbuf;
 	}
 
 	client->recvevent = isc_socket_socketevent(client->mctx, client,
@@ -3170,7 +3642,6 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	client->state = NS_CLIENTSTATE_INACTIVE;
 	client->newstate = NS_CLIENTSTATE_MAX;
 	client->naccepts = 0;
-	client->nreads = 0;
 	client->nsends = 0;
 	client->nrecvs = 0;
 	client->nupdates = 0;
@@ -3182,7 +3653,7 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	client->udpsocket = NULL;
 	client->tcplistener = NULL;
 	client->tcpsocket = NULL;
-	client->tcpmsg_valid = false;
+	isc_buffer_initnull(&client->tcpreq);
 	client->tcpbuf = NULL;
 	client->opt = NULL;
 	client->udpsize = 512;
@@ -3220,6 +3691,7 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	ISC_QLINK_INIT(client, ilink);
 	client->keytag = NULL;
 	client->keytag_len = 0;
+	client->querylog = NULL;
 	client->rcode_override = -1; 	/* not set */
 
 	/*
@@ -3250,6 +3722,9 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
  cleanup_recvbuf:
 	isc_mem_put(client->mctx, client->recvbuf, RECV_BUFFER_SIZE);
 
+ cleanup_sendbuf:
+	isc_mem_put(client->mctx, client->sendbuf, SEND_BUFFER_SIZE);
+
  cleanup_sendevent:
 	isc_event_free((isc_event_t **)&client->sendevent);
 
@@ -3272,39 +3747,16 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	return (result);
 }
 
-static void
-client_read(ns_client_t *client, bool newconn) {
-	isc_result_t result;
-
-	CTRACE("read");
-
-	result = dns_tcpmsg_readmessage(&client->tcpmsg, client->task,
-					ns__client_request, client);
-	if (result != ISC_R_SUCCESS)
-		goto fail;
-
-	/*
-	 * Set a timeout to limit the amount of time we will wait
-	 * for a request on this TCP connection.
-	 */
-	read_settimeout(client, newconn);
-
-	client->state = client->newstate = NS_CLIENTSTATE_READING;
-	INSIST(client->nreads == 0);
-	INSIST(client->recursionquota == NULL);
-	client->nreads++;
-
-	return;
- fail:
-	ns_client_next(client, result);
-}
-
 static void
 client_newconn(isc_task_t *task, isc_event_t *event) {
 	isc_result_t result;
 	ns_client_t *client = event->ev_arg;
 	isc_socket_newconnev_t *nevent = (isc_socket_newconnev_t *)event;
 	dns_aclenv_t *env = ns_interfacemgr_getaclenv(client->interface->mgr);
+	isc_socket_t *sock = NULL;
+	isc_netaddr_t netaddr;
+	bool pipelined;
+	int match;
 	uint32_t old;
 
 	REQUIRE(event->ev_type == ISC_SOCKEVENT_NEWCONN);
@@ -3325,21 +3777,13 @@ client_newconn(isc_task_t *task, isc_event_t *event) {
 	INSIST(client->naccepts == 1);
 	client->naccepts--;
 
-	old = isc_refcount_decrement(&client->interface->ntcpaccepting);
+	old = isc_refcount_decrement(&client->tcplistener->ntcpaccepting);
 	INSIST(old > 0);
 
-	/*
-	 * We must take ownership of the new socket before the exit
-	 * check to make sure it gets destroyed if we decide to exit.
-	 */
 	if (nevent->result == ISC_R_SUCCESS) {
-		client->tcpsocket = nevent->newsocket;
-		isc_socket_setname(client->tcpsocket, "client-tcp", NULL);
-		client->state = NS_CLIENTSTATE_READING;
-		INSIST(client->recursionquota == NULL);
-
-		(void)isc_socket_getpeername(client->tcpsocket,
-					     &client->peeraddr);
+		sock = nevent->newsocket;
+		isc_socket_setname(sock, "client-tcp", NULL);
+		(void)isc_socket_getpeername(sock, &client->peeraddr);
 		client->peeraddr_valid = true;
 		ns_client_log(client, NS_LOGCATEGORY_CLIENT,
 			   NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(3),
@@ -3359,54 +3803,61 @@ client_newconn(isc_task_t *task, isc_event_t *event) {
 			      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(3),
 			      "accept failed: %s",
 			      isc_result_totext(nevent->result));
-		tcpconn_detach(client);
 	}
 
-	if (exit_check(client))
+	/*
+	 * We must get rid of the new socket, if any, before the exit
+	 * check, as the client may be freed by it.
+	 */
+	if (sock == NULL || client->state > client->newstate) {
+		if (sock != NULL) {
+			isc_socket_detach(&sock);
+		}
+		tcpconn_free(client);
+		client->peeraddr_valid = false;
+		(void)exit_check(client);
 		goto freeevent;
+	}
 
-	if (nevent->result == ISC_R_SUCCESS) {
-		int match;
-		isc_netaddr_t netaddr;
-
-		isc_netaddr_fromsockaddr(&netaddr, &client->peeraddr);
-
-		if (client->sctx->blackholeacl != NULL &&
-		    (dns_acl_match(&netaddr, NULL, client->sctx->blackholeacl,
-				   env, &match, NULL) == ISC_R_SUCCESS) &&
-		    match > 0)
-		{
-			ns_client_log(client, DNS_LOGCATEGORY_SECURITY,
-				      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(10),
-				      "blackholed connection attempt");
-			client->newstate = NS_CLIENTSTATE_READY;
-			(void)exit_check(client);
-			goto freeevent;
-		}
+	isc_netaddr_fromsockaddr(&netaddr, &client->peeraddr);
 
-		INSIST(client->tcpmsg_valid == false);
-		dns_tcpmsg_init(client->mctx, client->tcpsocket,
-				&client->tcpmsg);
-		client->tcpmsg_valid = true;
+	if (client->sctx->blackholeacl != NULL &&
+	    (dns_acl_match(&netaddr, NULL, client->sctx->blackholeacl,
+			   env, &match, NULL) == ISC_R_SUCCESS) &&
+	    match > 0)
+	{
+		ns_client_log(client, DNS_LOGCATEGORY_SECURITY,
+			      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(10),
+			      "blackholed connection attempt");
+		isc_socket_detach(&sock);
+		tcpconn_free(client);
+		goto accept;
+	}
 
-		/*
-		 * Let a new client take our place immediately, before
-		 * we wait for a request packet.  If we don't,
-		 * telnetting to port 53 (once per CPU) will
-		 * deny service to legitimate TCP clients.
-		 */
-		result = ns_client_replace(client);
-		if (result == ISC_R_SUCCESS &&
-		    (client->sctx->keepresporder == NULL ||
+	pipelined = (client->sctx->keepresporder == NULL ||
 		     !dns_acl_allowed(&netaddr, NULL,
-				     client->sctx->keepresporder, env)))
-		{
-			client->tcpconn->pipelined = true;
-		}
+				      client->sctx->keepresporder, env));
 
-		client_read(client, true);
+	result = tcpconn_open(client, &sock, pipelined);
+	if (result != ISC_R_SUCCESS) {
+		ns_client_log(client, NS_LOGCATEGORY_CLIENT,
+			      NS_LOGMODULE_CLIENT, ISC_LOG_WARNING,
+			      "setting up TCP connection: %s",
+			      isc_result_totext(result));
+		isc_socket_detach(&sock);
+		tcpconn_free(client);
 	}
 
+ accept:
+	/*
+	 * The connection reads its own requests and gets clients to
+	 * answer them, so we can go straight back to accepting the next
+	 * one.  If we didn't, telnetting to port 53 (once per CPU)
+	 * would deny service to legitimate TCP clients.
+	 */
+	client->peeraddr_valid = false;
+	client_accept(client);
+
  freeevent:
 	isc_event_free(&event);
 }
@@ -3438,26 +3889,27 @@ client_accept(ns_client_t *client) {
 		 * accept new connections.
 		 *
 		 * So, we check here to see if any other clients are
-		 * already servicing TCP queries on this interface (whether
-		 * accepting, reading, or processing). If we find that at
-		 * least one client other than this one is active, then
-		 * it's okay *not* to call accept - we can let this
-		 * client go inactive and another will take over when it's
-		 * done.
+		 * already accepting on this listener, or any connections
+		 * it accepted are still open. If we find that at least
+		 * one besides this client is active, then it's okay *not*
+		 * to call accept - we can let this client go inactive and
+		 * another will take over when the last connection closes.
 		 *
 		 * If there aren't enough active clients on the interface,
 		 * then we can be a little bit flexible about the quota.
 		 * We'll allow *one* extra client through to ensure we're
-		 * listening on every interface; we do this by setting the
-		 * 'force' option to tcpconn_init().
+		 * listening on every listener of every interface; we do
+		 * this by setting the 'force' option to tcpconn_init().
 		 *
 		 * (Note: In practice this means that the real TCP client
-		 * quota is tcp-clients plus the number of listening
-		 * interfaces plus 1.)
+		 * quota is tcp-clients plus the number of TCP listeners
+		 * plus 1.)
 		 */
-		exit = (isc_refcount_current(&client->interface->ntcpactive) >
+		exit = (isc_refcount_current(
+				&client->tcplistener->ntcpactive) >
 			(client->tcpactive ? 1U : 0U));
 		if (exit) {
+			atomic_store(&client->tcplistener->restarting, false);
 			client->newstate = NS_CLIENTSTATE_INACTIVE;
 			(void)exit_check(client);
 			return;
@@ -3468,13 +3920,12 @@ client_accept(ns_client_t *client) {
 	}
 
 	/*
-	 * If this client was set up using get_client() or get_worker(),
-	 * then TCP is already marked active. However, if it was restarted
-	 * from exit_check(), it might not be, so we take care of it now.
+	 * If this client was set up using get_client(), then TCP is
+	 * already marked active; make sure of it anyway.
 	 */
 	mark_tcp_active(client, true);
 
-	result = isc_socket_accept(client->tcplistener, client->task,
+	result = isc_socket_accept(client->tcplistener->socket, client->task,
 				   client_newconn, client);
 	if (result != ISC_R_SUCCESS) {
 		/*
@@ -3488,8 +3939,9 @@ client_accept(ns_client_t *client) {
 				 "isc_socket_accept() failed: %s",
 				 isc_result_totext(result));
 
-		tcpconn_detach(client);
+		tcpconn_free(client);
 		mark_tcp_active(client, false);
+		atomic_store(&client->tcplistener->restarting, false);
 		return;
 	}
 
@@ -3502,39 +3954,52 @@ client_accept(ns_client_t *client) {
 	client->naccepts++;
 
 	/*
-	 * The interface's 'ntcpaccepting' counter is incremented when
+	 * The listener's 'ntcpaccepting' counter is incremented when
 	 * any client calls accept(), and decremented in client_newconn()
 	 * once the connection is established.
 	 *
-	 * When the client object is shutting down after handling a TCP
-	 * request (see exit_check()), if this value is at least one, that
-	 * means another client has called accept() and is waiting to
-	 * establish the next connection. That means the client may be
-	 * be free to become inactive; otherwise it may need to start
-	 * listening for connections itself to prevent the interface
-	 * going dead.
+	 * When a TCP connection is destroyed (see tcpconn_destroy()), if
+	 * this value is at least one, that means a client has called
+	 * accept() and is waiting to establish the next connection.
+	 * Otherwise a client has to be started to listen for connections
+	 * to prevent the interface going dead.  Once it has been
+	 * incremented, a client that tcpconn_destroy() started for that
+	 * (see 'restarting') is no longer needed.
 	 */
-	isc_refcount_increment0(&client->interface->ntcpaccepting);
+	isc_refcount_increment0(&client->tcplistener->ntcpaccepting);
+	atomic_store(&client->tcplistener->restarting, false);
 }
 
 static void
 client_udprecv(ns_client_t *client) {
 	isc_result_t result;
 	isc_region_t r;
+	unsigned int flags = 0;
 
 	CTRACE("udprecv");
 
+	/*
+	 * With "udp-run-to-completion", the query is processed by the
+	 * network thread that reads it, when the client's task is idle,
+	 * up to the point where it has to wait for something such as
+	 * recursion; it then carries on in the client's task as usual.
+	 */
+	if (ns_server_getoption(client->sctx, NS_SERVER_RUNTOCOMPLETION)) {
+		flags |= ISC_SOCKFLAG_INLINE;
+	}
+
 	r.base = client->recvbuf;
 	r.length = RECV_BUFFER_SIZE;
 	result = isc_socket_recv2(client->udpsocket, &r, 1,
-				  client->task, client->recvevent, 0);
+				  client->task, client->recvevent, flags);
 	if (result != ISC_R_SUCCESS) {
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
 				 "isc_socket_recv2() failed: %s",
 				 isc_result_totext(result));
 		/*
 		 * This cannot happen in the current implementation, since
-		 * isc_socket_recv2() cannot fail if flags == 0.
+		 * isc_socket_recv2() cannot fail without
+		 * ISC_SOCKFLAG_IMMEDIATE.
 		 *
 		 * If this does fail, we just go idle.
 		 */
@@ -3577,24 +4042,23 @@ ns_client_shuttingdown(ns_client_t *client) {
 isc_result_t
 ns_client_replace(ns_client_t *client) {
 	isc_result_t result;
-	bool tcp;
 
 	CTRACE("replace");
 
 	REQUIRE(client != NULL);
 	REQUIRE(client->manager != NULL);
 
-	tcp = TCP_CLIENT(client);
-	if (tcp && client->tcpconn != NULL && client->tcpconn->pipelined) {
-		result = get_worker(client->manager, client->interface,
-				    client->tcpsocket, client);
-	} else {
+	/*
+	 * A TCP client only ever works on a request handed to it by
+	 * its connection, which goes on reading by itself; there is
+	 * nothing to replace.
+	 */
+	if (!TCP_CLIENT(client)) {
 		result = get_client(client->manager, client->interface,
-				    client->dispatch, tcp);
-
-	}
-	if (result != ISC_R_SUCCESS) {
-		return (result);
+				    client->dispatch, NULL);
+		if (result != ISC_R_SUCCESS) {
+			return (result);
+		}
 	}
 
 	/*
@@ -3613,11 +4077,10 @@ ns_client_replace(ns_client_t *client) {
 
 static void
 clientmgr_destroy(ns_clientmgr_t *manager) {
-#if NMCTXS > 0
 	int i;
-#endif
 
 	REQUIRE(ISC_LIST_EMPTY(manager->clients));
+	REQUIRE(ISC_LIST_EMPTY(manager->tcpconns));
 
 	MTRACE("clientmgr_destroy");
 
@@ -3628,6 +4091,11 @@ clientmgr_destroy(ns_clientmgr_t *manager) {
 	}
 #endif
 
+	for (i = 0; i < NTCPTASKS; i++) {
+		if (manager->taskpool[i] != NULL)
+			isc_task_detach(&manager->taskpool[i]);
+	}
+
 	ISC_QUEUE_DESTROY(manager->inactive);
 
 	isc_mutex_destroy(&manager->lock);
@@ -3649,9 +4117,7 @@ ns_clientmgr_create(isc_mem_t *mctx, ns_server_t *sctx, isc_taskmgr_t *taskmgr,
 {
 	ns_clientmgr_t *manager;
 	isc_result_t result;
-#if NMCTXS > 0
 	int i;
-#endif
 
 	manager = isc_mem_get(mctx, sizeof(*manager));
 	if (manager == NULL)
@@ -3677,12 +4143,16 @@ ns_clientmgr_create(isc_mem_t *mctx, ns_server_t *sctx, isc_taskmgr_t *taskmgr,
 
 	ISC_LIST_INIT(manager->clients);
 	ISC_LIST_INIT(manager->recursing);
+	ISC_LIST_INIT(manager->tcpconns);
 	ISC_QUEUE_INIT(manager->inactive, ilink);
 #if NMCTXS > 0
 	manager->nextmctx = 0;
 	for (i = 0; i < NMCTXS; i++)
 		manager->mctxpool[i] = NULL; /* will be created on-demand */
 #endif
+	manager->nexttask = 0;
+	for (i = 0; i < NTCPTASKS; i++)
+		manager->taskpool[i] = NULL; /* will be created on-demand */
 	manager->magic = MANAGER_MAGIC;
 
 	MTRACE("create");
@@ -3706,6 +4176,7 @@ ns_clientmgr_destroy(ns_clientmgr_t **managerp) {
 	isc_result_t result;
 	ns_clientmgr_t *manager;
 	ns_client_t *client;
+	ns_tcpconn_t *conn;
 	bool need_destroy = false, unlock = false;
 
 	REQUIRE(managerp != NULL);
@@ -3730,7 +4201,22 @@ ns_clientmgr_destroy(ns_clientmgr_t **managerp) {
 	     client = ISC_LIST_NEXT(client, link))
 		isc_task_shutdown(client->task);
 
-	if (ISC_LIST_EMPTY(manager->clients))
+	for (conn = ISC_LIST_HEAD(manager->tcpconns);
+	     conn != NULL;
+	     conn = ISC_LIST_NEXT(conn, link))
+	{
+		ns_tcpconn_t *self = conn;
+		bool detach;
+
+		LOCK(&conn->lock);
+		detach = tcpconn_close(conn);
+		UNLOCK(&conn->lock);
+		if (detach)
+			tcpconn_detach(&self);
+	}
+
+	if (ISC_LIST_EMPTY(manager->clients) &&
+	    ISC_LIST_EMPTY(manager->tcpconns))
 		need_destroy = true;
 
 	if (unlock)
@@ -3742,9 +4228,13 @@ ns_clientmgr_destroy(ns_clientmgr_t **managerp) {
 	*managerp = NULL;
 }
 
+/*
+ * Get a client to listen on 'ifp', for UDP queries on 'disp' or, if
+ * 'listener' is not NULL, for TCP connections on 'listener'.
+ */
 static isc_result_t
 get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
-	   dns_dispatch_t *disp, bool tcp)
+	   dns_dispatch_t *disp, ns_tcplistener_t *listener)
 {
 	isc_result_t result = ISC_R_SUCCESS;
 	isc_event_t *ev;
@@ -3790,13 +4280,11 @@ get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
 	client->dscp = ifp->dscp;
 	client->rcode_override = -1;	/* not set */
 
-	if (tcp) {
+	if (listener != NULL) {
+		client->tcplistener = listener;
 		mark_tcp_active(client, true);
 
 		client->attributes |= NS_CLIENTATTR_TCP;
-		isc_socket_attach(ifp->tcpsocket,
-				  &client->tcplistener);
-
 	} else {
 		isc_socket_t *sock;
 
@@ -3813,17 +4301,20 @@ get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
 	return (ISC_R_SUCCESS);
 }
 
+/*
+ * Get a client to work on the request just read from 'conn'.
+ *
+ * The connection must be locked.
+ */
 static isc_result_t
-get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock,
-	   ns_client_t *oldclient)
-{
+get_worker(ns_tcpconn_t *conn) {
 	isc_result_t result = ISC_R_SUCCESS;
+	ns_clientmgr_t *manager = conn->manager;
 	isc_event_t *ev;
 	ns_client_t *client;
 	MTRACE("get worker");
 
 	REQUIRE(manager != NULL);
-	REQUIRE(oldclient != NULL);
 
 	if (manager->exiting)
 		return (ISC_R_SHUTTINGDOWN);
@@ -3853,30 +4344,29 @@ get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock,
 	}
 
 	client->manager = manager;
-	ns_interface_attach(ifp, &client->interface);
-	client->newstate = client->state = NS_CLIENTSTATE_WORKING;
+	ns_interface_attach(conn->interface, &client->interface);
+	client->state = NS_CLIENTSTATE_READING;
+	client->newstate = NS_CLIENTSTATE_MAX;
 	INSIST(client->recursionquota == NULL);
 	client->sctx = manager->sctx;
 
-	client->dscp = ifp->dscp;
+	client->dscp = conn->interface->dscp;
 
 	client->attributes |= NS_CLIENTATTR_TCP;
 	client->mortal = true;
 	client->sendcb = NULL;
 	client->rcode_override = -1;	/* not set */
 
-	tcpconn_attach(oldclient, client);
-	mark_tcp_active(client, true);
+	isc_refcount_increment(&conn->refs);
+	conn->nclients++;
+	client->tcpconn = conn;
 
-	isc_socket_attach(ifp->tcpsocket, &client->tcplistener);
-	isc_socket_attach(sock, &client->tcpsocket);
-	isc_socket_setname(client->tcpsocket, "worker-tcp", NULL);
-	(void)isc_socket_getpeername(client->tcpsocket, &client->peeraddr);
+	isc_socket_attach(conn->socket, &client->tcpsocket);
+	client->peeraddr = conn->peeraddr;
 	client->peeraddr_valid = true;
 
-	INSIST(client->tcpmsg_valid == false);
-	dns_tcpmsg_init(client->mctx, client->tcpsocket, &client->tcpmsg);
-	client->tcpmsg_valid = true;
+	INSIST(client->tcpreq.base == NULL);
+	dns_tcpmsg_keepbuffer(&conn->tcpmsg, &client->tcpreq);
 
 	INSIST(client->nctls == 0);
 	client->nctls++;
@@ -3948,7 +4438,13 @@ ns_clientmgr_createclients(ns_clientmgr_t *manager, unsigned int n,
 	MTRACE("createclients");
 
 	for (disp = 0; disp < n; disp++) {
-		result = get_client(manager, ifp, ifp->udpdispatch[disp], tcp);
+		if (tcp) {
+			result = get_client(manager, ifp, NULL,
+					    &ifp->tcplisteners[disp]);
+		} else {
+			result = get_client(manager, ifp,
+					    ifp->udpdispatch[disp], NULL);
+		}
 		if (result != ISC_R_SUCCESS)
 			break;
 	}
@@ -81,11 +81,7 @@
  ***/
 
 /*% reference-counted TCP connection object */
-typedef struct ns_tcpconn {
-	isc_refcount_t		refs;
-	isc_quota_t		*tcpquota;
-	bool			pipelined;
-} ns_tcpconn_t;
+typedef struct ns_tcpconn ns_tcpconn_t;
 
 /*% nameserver client structure */
 struct ns_client {
@@ -96,7 +92,6 @@ struct ns_client {
 	int			state;
 	int			newstate;
 	int			naccepts;
-	int			nreads;
 	int			nsends;
 	int			nrecvs;
 	int			nupdates;
@@ -115,16 +110,16 @@ struct ns_client {
 	dns_view_t		*view;
 	dns_dispatch_t		*dispatch;
 	isc_socket_t		*udpsocket;
-	isc_socket_t		*tcplistener;
+	ns_tcplistener_t	*tcplistener;
 	isc_socket_t		*tcpsocket;
 	unsigned char		*tcpbuf;
-	dns_tcpmsg_t		tcpmsg;
-	bool			tcpmsg_valid;
+	isc_buffer_t		tcpreq;	      /*%< Request read over TCP */
 	isc_timer_t		*timer;
 	isc_timer_t		*delaytimer;
 	bool 			timerset;
 	dns_message_t		*message;
 	isc_socketevent_t	*sendevent;
+	unsigned char		*sendbuf;
 	isc_socketevent_t	*recvevent;
 	unsigned char		*recvbuf;
 	dns_rdataset_t		*opt;
@@ -136,6 +131,7 @@ struct ns_client {
 	void 			*shutdown_arg;
 	ns_query_t		query;
 	isc_time_t		requesttime;
+	isc_time_t		recvtime;     /*%< for latency statistics */
 	isc_stdtime_t		now;
 	isc_time_t		tnow;
 	dns_name_t		signername;   /*%< [T]SIG key name */
@@ -177,6 +173,7 @@ struct ns_client {
 	uint32_t		expire;
 	unsigned char		*keytag;
 	uint16_t		keytag_len;
+	unsigned char		*querylog;    /*%< binary query log record */
 
 	/*%
 	 * Used to override the DNS response code in ns_client_error().
@@ -212,6 +209,9 @@ typedef ISC_LIST(ns_client_t) client_list_t;
 #define NS_CLIENTATTR_USEKEEPALIVE	0x10000 /*%< use TCP keepalive */
 
 #define NS_CLIENTATTR_NOSETFC		0x20000 /*%< don't set servfail cache */
+#define NS_CLIENTATTR_QUERYLOG		0x40000 /*%< binary query log pending */
+#define NS_CLIENTATTR_RECURSED		0x80000 /*%< answer needed recursion */
+#define NS_CLIENTATTR_CACHEANSWER	0x100000 /*%< answer used the cache */
 
 /*
  * Flag to use with the SERVFAIL cache to indicate
@@ -247,6 +247,13 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *msg);
  * send msg as a response using client->message->id for the id.
  */
 
+unsigned int
+ns_client_sendbufsize(ns_client_t *client);
+/*%<
+ * Return the size of the largest response, without any TCP length
+ * prefix, that can be sent to 'client'.
+ */
+
 void
 ns_client_error(ns_client_t *client, isc_result_t result);
 /*%<
@@ -314,7 +321,8 @@ ns_clientmgr_createclients(ns_clientmgr_t *manager, unsigned int n,
 /*%<
  * Create up to 'n' clients listening on interface 'ifp'.
  * If 'tcp' is true, the clients will listen for TCP connections,
- * otherwise for UDP requests.
+ * one on each of the interface's first 'n' TCP listeners, otherwise
+ * for UDP requests, one on each of its first 'n' UDP dispatches.
  */
 
 isc_sockaddr_t *
@@ -42,6 +42,7 @@
 
 #include <stdbool.h>
 
+#include <isc/atomic.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
 #include <isc/socket.h>
@@ -63,6 +64,31 @@
 #define NS_INTERFACEFLAG_ANYADDR	0x01U	/*%< bound to "any" address */
 #define MAX_UDP_DISPATCH 128		/*%< Maximum number of UDP dispatchers
 						     to start per interface */
+#define MAX_TCP_LISTENERS 128		/*%< Maximum number of TCP listeners
+						     to start per interface */
+
+/*%
+ * A TCP listening socket.  An interface may have several, bound to the
+ * same address with SO_REUSEPORT, and the clients that accept connections
+ * on one are accounted for separately so that none is left unattended.
+ */
+struct ns_tcplistener {
+	isc_socket_t *		socket;		/*%< TCP socket. */
+	isc_refcount_t		ntcpaccepting;	/*%< Number of clients
+						     ready to accept new
+						     TCP connections on this
+						     listener */
+	isc_refcount_t		ntcpactive;	/*%< Number of clients
+						     servicing TCP queries
+						     (whether accepting or
+						     connected) */
+	atomic_bool		restarting;	/*%< A client has been
+						     started to accept
+						     new connections on
+						     this listener, and
+						     is not accepting yet */
+};
+
 /*% The nameserver interface structure */
 struct ns_interface {
 	unsigned int		magic;		/*%< Magic number. */
@@ -75,17 +101,11 @@ struct ns_interface {
 	char 			name[32];	/*%< Null terminated. */
 	dns_dispatch_t *	udpdispatch[MAX_UDP_DISPATCH];
 						/*%< UDP dispatchers. */
-	isc_socket_t *		tcpsocket;	/*%< TCP socket. */
+	ns_tcplistener_t	tcplisteners[MAX_TCP_LISTENERS];
+						/*%< TCP listeners. */
 	isc_dscp_t		dscp;		/*%< "listen-on" DSCP value */
-	isc_refcount_t		ntcpaccepting;	/*%< Number of clients
-						     ready to accept new
-						     TCP connections on this
-						     interface */
-	isc_refcount_t		ntcpactive;	/*%< Number of clients
-						     servicing TCP queries
-						     (whether accepting or
-						     connected) */
 	int			nudpdispatch;	/*%< Number of UDP dispatches */
+	int			ntcplisteners;	/*%< Number of TCP listeners */
 	ns_clientmgr_t *	clientmgr;	/*%< Client manager. */
 	ISC_LINK(ns_interface_t) link;
 };
@@ -128,6 +148,25 @@ ns_interfacemgr_setbacklog(ns_interfacemgr_t *mgr, int backlog);
  * Set the size of the listen() backlog queue.
  */
 
+void
+ns_interfacemgr_setcpusteering(ns_interfacemgr_t *mgr, bool value);
+/*%<
+ * If 'value' is true, the UDP listeners opened for an interface from
+ * now on have each datagram read by the listener whose network thread
+ * runs on the CPU that received it, where the system supports it.
+ * See isc_socket_steerbycpu().
+ */
+
+void
+ns_interfacemgr_settcpoptions(ns_interfacemgr_t *mgr, bool fastopen,
+			      unsigned int deferaccept);
+/*%<
+ * Set the options of the TCP listeners opened from now on: whether to
+ * enable TCP Fast Open, and how many seconds the system may hold new
+ * connections back waiting for data, or zero for not at all.  See
+ * isc_socket_listen2().
+ */
+
 bool
 ns_interfacemgr_islistening(ns_interfacemgr_t *mgr);
 /*%<
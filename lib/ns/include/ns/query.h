@@ -91,6 +91,14 @@ struct ns_query {
 		bool			is_zone;
 	} redirect;
 
+	struct {
+		dns_respentry_t *	entry;
+		unsigned int		variant;
+		uint32_t		flags;
+		dns_db_t *		db;
+		dns_dbversion_t *	version;
+	} respcache;
+
 	ns_query_recparam_t		recparam;
 
 	dns_keytag_t root_key_sentinel_keyid;
@@ -115,6 +123,7 @@ struct ns_query {
 #define NS_QUERYATTR_DNS64EXCLUDE	0x08000
 #define NS_QUERYATTR_RRL_CHECKED	0x10000
 #define NS_QUERYATTR_REDIRECT		0x20000
+#define NS_QUERYATTR_RESPCACHE		0x40000
 
 typedef struct query_ctx query_ctx_t;
 
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef NS_QUERYLOG_H
+#define NS_QUERYLOG_H 1
+
+/*! \file
+ * \brief
+ * Binary query logging.
+ *
+ * When the "queries" category is sent to a binary logging channel,
+ * each query is logged as a record with a fixed layout instead of a
+ * line of text, which is much cheaper to produce.  The record is
+ * built when the query is logged, and written when the request ends,
+ * so that it can include the response code.
+ *
+ * All fields are in network byte order:
+ *
+ *\code
+ *	offset	size
+ *	 0	2	length of the record, including this field
+ *	 2	1	format version (NS_QUERYLOG_VERSION)
+ *	 3	1	EDNS version, if NS_QUERYLOG_EDNS is set
+ *	 4	2	flags (NS_QUERYLOG_*)
+ *	 6	2	response code, if NS_QUERYLOG_RESPONSE is set
+ *	 8	4	time the request was received, seconds
+ *	12	4	... and nanoseconds
+ *	16	8	client object identifier ("client @0x...")
+ *	24	2	query type
+ *	26	2	query class
+ *	28	1	client address family (0 if unknown, 4 or 6)
+ *	29	1	destination address family (4 or 6)
+ *	30	2	client port
+ *	32	16	client address
+ *	48	16	destination address
+ *	64	1	ECS address family, if NS_QUERYLOG_ECS is set
+ *	65	1	ECS source prefix length
+ *	66	1	ECS scope prefix length
+ *	67	1	length of the query name
+ *	68	16	ECS address
+ *	84	1	length of the TSIG/SIG(0) signer name, or 0
+ *	85	1	length of the view name
+ *	86		query name in uncompressed wire format,
+ *			signer name in uncompressed wire format,
+ *			view name
+ *\endcode
+ *
+ * IPv4 addresses take the first four bytes of their field; unused
+ * bytes are zero.
+ */
+
+#include <isc/buffer.h>
+#include <isc/lang.h>
+#include <isc/region.h>
+#include <isc/time.h>
+#include <isc/types.h>
+
+#include <ns/types.h>
+
+#define NS_QUERYLOG_VERSION	1
+#define NS_QUERYLOG_HEADERSIZE	86
+#define NS_QUERYLOG_MAXSIZE	(NS_QUERYLOG_HEADERSIZE + 3 * 255)
+
+/*%
+ * Record flags.
+ */
+#define NS_QUERYLOG_RECURSE	0x0001	/*%< recursion desired ("+") */
+#define NS_QUERYLOG_SIGNED	0x0002	/*%< signed request ("S") */
+#define NS_QUERYLOG_EDNS	0x0004	/*%< EDNS request ("E") */
+#define NS_QUERYLOG_TCP		0x0008	/*%< received over TCP ("T") */
+#define NS_QUERYLOG_DO		0x0010	/*%< DNSSEC OK ("D") */
+#define NS_QUERYLOG_CD		0x0020	/*%< checking disabled ("C") */
+#define NS_QUERYLOG_COOKIE	0x0040	/*%< valid server cookie ("V") */
+#define NS_QUERYLOG_WANTCOOKIE	0x0080	/*%< client cookie only ("K") */
+#define NS_QUERYLOG_ECS		0x0100	/*%< EDNS client subnet */
+#define NS_QUERYLOG_RESPONSE	0x0200	/*%< a response was sent */
+
+/*%
+ * Options for ns_querylog_totext().
+ */
+#define NS_QUERYLOG_TEXTRCODE	0x0001	/*%< append the response code */
+
+ISC_LANG_BEGINDECLS
+
+void
+ns_querylog_start(ns_client_t *client, unsigned int flags,
+		  unsigned int extflags);
+/*%<
+ * Build a binary query log record for the query 'client' has just
+ * received; 'flags' and 'extflags' are the message flags and extended
+ * flags of the request.  The record is written by ns_querylog_end().
+ *
+ * Requires:
+ *\li	'client' is valid, and its query name has been set.
+ */
+
+void
+ns_querylog_response(ns_client_t *client);
+/*%<
+ * Note in the pending record, if any, that a response is being sent
+ * and what its response code is.
+ */
+
+void
+ns_querylog_end(ns_client_t *client);
+/*%<
+ * Write the pending record, if any, to the "queries" category.
+ */
+
+isc_result_t
+ns_querylog_totext(isc_region_t *source, unsigned int options,
+		   isc_time_t *when, isc_buffer_t *target);
+/*%<
+ * Convert the record at the start of 'source' to the text that
+ * would have been logged for the same query in the "queries"
+ * category, and consume it.  If 'when' is not NULL, it is set to the
+ * time the query was received.  If NS_QUERYLOG_TEXTRCODE is set in
+ * 'options', the response code is appended.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMORE		'source' is empty.
+ *\li	#ISC_R_UNEXPECTEDEND	'source' ends part way through the record.
+ *\li	#ISC_R_NOTIMPLEMENTED	the record is of an unknown version.
+ *\li	#DNS_R_FORMERR		the record is malformed.
+ *\li	#ISC_R_NOSPACE		'target' is too small.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* NS_QUERYLOG_H */
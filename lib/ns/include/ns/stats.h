@@ -14,6 +14,9 @@
 
 /*! \file include/ns/stats.h */
 
+#include <inttypes.h>
+#include <stdbool.h>
+
 #include <ns/types.h>
 
 /*%
@@ -102,9 +105,34 @@ enum {
 	ns_statscounter_prefetch = 63,
 	ns_statscounter_keytagopt = 64,
 
-	ns_statscounter_max = 65
+	ns_statscounter_respcachehit = 65,
+	ns_statscounter_respcachemiss = 66,
+
+	ns_statscounter_max = 67
 };
 
+/*%
+ * Query latency histograms.  The time from receiving a query to sending
+ * the response is counted in one of NS_LATENCY_BUCKETS buckets whose
+ * bounds double from 16 microseconds: bucket 0 counts responses sent in
+ * under 16us, bucket 1 those in under 32us and so on, and the last
+ * bucket counts everything slower than the one before it.  There is a
+ * separate histogram for each transport and each kind of answer, laid
+ * out one after another in a single set of counters so that they can
+ * share an isc_stats_t.
+ */
+#define NS_LATENCY_BUCKETS	20
+
+typedef enum {
+	ns_latency_auth = 0,		/*%< answered from a local zone */
+	ns_latency_cache = 1,		/*%< answered from the cache */
+	ns_latency_recursion = 2,	/*%< needed recursion */
+	ns_latency_max = 3
+} ns_latencytype_t;
+
+#define NS_LATENCY_COUNTERS	(2 * ns_latency_max * NS_LATENCY_BUCKETS)
+
+
 void
 ns_stats_attach(ns_stats_t *stats, ns_stats_t **statsp);
 
@@ -123,4 +151,22 @@ ns_stats_decrement(ns_stats_t *stats, isc_statscounter_t counter);
 isc_stats_t *
 ns_stats_get(ns_stats_t *stats);
 
+isc_statscounter_t
+ns_stats_latencycounter(bool tcp, ns_latencytype_t type, uint64_t usec);
+/*%<
+ * Return the query latency counter for a response of kind 'type' sent
+ * 'usec' microseconds after the query was received over TCP if 'tcp' is
+ * true or UDP otherwise.
+ */
+
+uint64_t
+ns_stats_latencylimit(unsigned int bucket);
+/*%<
+ * Return the upper bound, in microseconds, of the latencies counted in
+ * 'bucket', or 0 for the last bucket, which has none.
+ *
+ * Requires:
+ *\li	'bucket' is less than NS_LATENCY_BUCKETS.
+ */
+
 #endif /* NS_STATS_H */
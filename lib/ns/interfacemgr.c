@@ -81,6 +81,9 @@ struct ns_interfacemgr {
 	ISC_LIST(isc_sockaddr_t) listenon;
 	int			backlog;	/*%< Listen queue size */
 	unsigned int		udpdisp;	/*%< UDP dispatch count */
+	bool			cpusteering;	/*%< Steer UDP by CPU */
+	bool			tcpfastopen;	/*%< TCP Fast Open */
+	unsigned int		tcpdeferaccept;	/*%< TCP_DEFER_ACCEPT */
 #ifdef USE_ROUTE_SOCKET
 	isc_task_t *		task;
 	isc_socket_t *		route;
@@ -215,6 +218,9 @@ ns_interfacemgr_create(isc_mem_t *mctx,
 	mgr->listenon4 = NULL;
 	mgr->listenon6 = NULL;
 	mgr->udpdisp = udpdisp;
+	mgr->cpusteering = false;
+	mgr->tcpfastopen = true;
+	mgr->tcpdeferaccept = 0;
 
 	ISC_LIST_INIT(mgr->interfaces);
 	ISC_LIST_INIT(mgr->listenon);
@@ -322,6 +328,25 @@ ns_interfacemgr_setbacklog(ns_interfacemgr_t *mgr, int backlog) {
 
 }
 
+void
+ns_interfacemgr_setcpusteering(ns_interfacemgr_t *mgr, bool value) {
+	REQUIRE(NS_INTERFACEMGR_VALID(mgr));
+	LOCK(&mgr->lock);
+	mgr->cpusteering = value;
+	UNLOCK(&mgr->lock);
+}
+
+void
+ns_interfacemgr_settcpoptions(ns_interfacemgr_t *mgr, bool fastopen,
+			      unsigned int deferaccept)
+{
+	REQUIRE(NS_INTERFACEMGR_VALID(mgr));
+	LOCK(&mgr->lock);
+	mgr->tcpfastopen = fastopen;
+	mgr->tcpdeferaccept = deferaccept;
+	UNLOCK(&mgr->lock);
+}
+
 dns_aclenv_t *
 ns_interfacemgr_getaclenv(ns_interfacemgr_t *mgr) {
 	REQUIRE(NS_INTERFACEMGR_VALID(mgr));
@@ -385,7 +410,7 @@ ns_interface_create(ns_interfacemgr_t *mgr, isc_sockaddr_t *addr,
 {
 	ns_interface_t *ifp;
 	isc_result_t result;
-	int disp;
+	int disp, i;
 
 	REQUIRE(NS_INTERFACEMGR_VALID(mgr));
 
@@ -415,18 +440,15 @@ ns_interface_create(ns_interfacemgr_t *mgr, isc_sockaddr_t *addr,
 	for (disp = 0; disp < MAX_UDP_DISPATCH; disp++)
 		ifp->udpdispatch[disp] = NULL;
 
-	ifp->tcpsocket = NULL;
-
-	/*
-	 * Create a single TCP client object.  It will replace itself
-	 * with a new one as soon as it gets a connection, so the actual
-	 * connections will be handled in parallel even though there is
-	 * only one client initially.
-	 */
-	isc_refcount_init(&ifp->ntcpaccepting, 0);
-	isc_refcount_init(&ifp->ntcpactive, 0);
+	for (i = 0; i < MAX_TCP_LISTENERS; i++) {
+		ifp->tcplisteners[i].socket = NULL;
+		isc_refcount_init(&ifp->tcplisteners[i].ntcpaccepting, 0);
+		isc_refcount_init(&ifp->tcplisteners[i].ntcpactive, 0);
+		atomic_init(&ifp->tcplisteners[i].restarting, false);
+	}
 
 	ifp->nudpdispatch = 0;
+	ifp->ntcplisteners = 0;
 
 	ifp->dscp = -1;
 
@@ -490,6 +512,28 @@ ns_interface_listenudp(ns_interface_t *ifp) {
 
 	}
 
+	/*
+	 * Where the listeners are separate SO_REUSEPORT sockets rather
+	 * than dup()s of one socket, each has its own receive queue.
+	 * Optionally have the kernel pick the one read on the CPU that
+	 * took the packet off the network.
+	 */
+	if (ifp->mgr->cpusteering && ifp->nudpdispatch > 1) {
+		isc_socket_t *socks[MAX_UDP_DISPATCH];
+
+		for (disp = 0; disp < ifp->nudpdispatch; disp++) {
+			socks[disp] =
+				dns_dispatch_getsocket(ifp->udpdispatch[disp]);
+		}
+		result = isc_socket_steerbycpu(socks, ifp->nudpdispatch);
+		if (result != ISC_R_SUCCESS) {
+			isc_log_write(IFMGR_COMMON_LOGARGS, ISC_LOG_WARNING,
+				      "could not steer UDP listeners "
+				      "by CPU: %s",
+				      isc_result_totext(result));
+		}
+	}
+
 	result = ns_clientmgr_createclients(ifp->clientmgr, ifp->nudpdispatch,
 					    ifp, false);
 	if (result != ISC_R_SUCCESS) {
@@ -514,7 +558,7 @@ ns_interface_listenudp(ns_interface_t *ifp) {
 }
 
 static isc_result_t
-ns_interface_accepttcp(ns_interface_t *ifp) {
+ns_interface_listentcp(ns_interface_t *ifp, ns_tcplistener_t *listener) {
 	isc_result_t result;
 
 	/*
@@ -523,18 +567,18 @@ ns_interface_accepttcp(ns_interface_t *ifp) {
 	result = isc_socket_create(ifp->mgr->socketmgr,
 				   isc_sockaddr_pf(&ifp->addr),
 				   isc_sockettype_tcp,
-				   &ifp->tcpsocket);
+				   &listener->socket);
 	if (result != ISC_R_SUCCESS) {
 		isc_log_write(IFMGR_COMMON_LOGARGS, ISC_LOG_ERROR,
 				 "creating TCP socket: %s",
 				 isc_result_totext(result));
 		goto tcp_socket_failure;
 	}
-	isc_socket_setname(ifp->tcpsocket, "dispatcher", NULL);
+	isc_socket_setname(listener->socket, "dispatcher", NULL);
 #ifndef ISC_ALLOW_MAPPED
-	isc_socket_ipv6only(ifp->tcpsocket, true);
+	isc_socket_ipv6only(listener->socket, true);
 #endif
-	result = isc_socket_bind(ifp->tcpsocket, &ifp->addr,
+	result = isc_socket_bind(listener->socket, &ifp->addr,
 				 ISC_SOCKET_REUSEADDRESS);
 	if (result != ISC_R_SUCCESS) {
 		isc_log_write(IFMGR_COMMON_LOGARGS, ISC_LOG_ERROR,
@@ -544,9 +588,11 @@ ns_interface_accepttcp(ns_interface_t *ifp) {
 	}
 
 	if (ifp->dscp != -1)
-		isc_socket_dscp(ifp->tcpsocket, ifp->dscp);
+		isc_socket_dscp(listener->socket, ifp->dscp);
 
-	result = isc_socket_listen(ifp->tcpsocket, ifp->mgr->backlog);
+	result = isc_socket_listen2(listener->socket, ifp->mgr->backlog,
+				    ifp->mgr->tcpfastopen,
+				    ifp->mgr->tcpdeferaccept);
 	if (result != ISC_R_SUCCESS) {
 		isc_log_write(IFMGR_COMMON_LOGARGS, ISC_LOG_ERROR,
 				 "listening on TCP socket: %s",
@@ -558,22 +604,65 @@ ns_interface_accepttcp(ns_interface_t *ifp) {
 	 * If/when there a multiple filters listen to the
 	 * result.
 	 */
-	(void)isc_socket_filter(ifp->tcpsocket, "dataready");
+	(void)isc_socket_filter(listener->socket, "dataready");
+
+	return (ISC_R_SUCCESS);
+
+ tcp_listen_failure:
+ tcp_bind_failure:
+	isc_socket_detach(&listener->socket);
+ tcp_socket_failure:
+	return (result);
+}
+
+static isc_result_t
+ns_interface_accepttcp(ns_interface_t *ifp) {
+	isc_result_t result;
+	int n, i;
+
+	/*
+	 * Where the system spreads incoming connections over several
+	 * sockets bound to the same address, open one per network
+	 * thread, as for UDP, so that accepting connections is not
+	 * left to just one of them.
+	 */
+	n = 1;
+	if (isc_socket_hasreuseport()) {
+		n = ISC_MIN(ifp->mgr->udpdisp, MAX_TCP_LISTENERS);
+	}
+	for (i = 0; i < n; i++) {
+		result = ns_interface_listentcp(ifp, &ifp->tcplisteners[i]);
+		if (result != ISC_R_SUCCESS) {
+			goto tcp_listen_failure;
+		}
+		ifp->ntcplisteners++;
+	}
 
-	result = ns_clientmgr_createclients(ifp->clientmgr, 1, ifp, true);
+	/*
+	 * Create a single TCP client object for each listener.  It will
+	 * replace itself with a new one as soon as it gets a connection,
+	 * so the actual connections will be handled in parallel even
+	 * though there is only one client initially.
+	 */
+	result = ns_clientmgr_createclients(ifp->clientmgr, ifp->ntcplisteners,
+					    ifp, true);
 	if (result != ISC_R_SUCCESS) {
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
 				 "TCP ns_clientmgr_createclients(): %s",
 				 isc_result_totext(result));
-		goto accepttcp_failure;
+		/*
+		 * The clients that were created use the listeners,
+		 * which are closed when the interface is destroyed.
+		 */
+		return (result);
 	}
 	return (ISC_R_SUCCESS);
 
- accepttcp_failure:
  tcp_listen_failure:
- tcp_bind_failure:
-	isc_socket_detach(&ifp->tcpsocket);
- tcp_socket_failure:
+	for (i = ifp->ntcplisteners - 1; i >= 0; i--) {
+		isc_socket_detach(&ifp->tcplisteners[i].socket);
+	}
+	ifp->ntcplisteners = 0;
 	return (result);
 }
 
@@ -637,7 +726,7 @@ ns_interface_shutdown(ns_interface_t *ifp) {
 static void
 ns_interface_destroy(ns_interface_t *ifp) {
 	isc_mem_t *mctx = ifp->mgr->mctx;
-	int disp;
+	int disp, i;
 
 	REQUIRE(NS_INTERFACE_VALID(ifp));
 
@@ -650,15 +739,19 @@ ns_interface_destroy(ns_interface_t *ifp) {
 			dns_dispatch_detach(&(ifp->udpdispatch[disp]));
 		}
 
-	if (ifp->tcpsocket != NULL)
-		isc_socket_detach(&ifp->tcpsocket);
+	for (i = 0; i < MAX_TCP_LISTENERS; i++) {
+		if (ifp->tcplisteners[i].socket != NULL)
+			isc_socket_detach(&ifp->tcplisteners[i].socket);
+	}
 
 	isc_mutex_destroy(&ifp->lock);
 
 	ns_interfacemgr_detach(&ifp->mgr);
 
-	isc_refcount_destroy(&ifp->ntcpactive);
-	isc_refcount_destroy(&ifp->ntcpaccepting);
+	for (i = 0; i < MAX_TCP_LISTENERS; i++) {
+		isc_refcount_destroy(&ifp->tcplisteners[i].ntcpactive);
+		isc_refcount_destroy(&ifp->tcplisteners[i].ntcpaccepting);
+	}
 
 	ifp->magic = 0;
 	isc_mem_put(mctx, ifp, sizeof(*ifp));
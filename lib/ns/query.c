@@ -50,6 +50,7 @@
 #include <dns/rdatastruct.h>
 #include <dns/rdatatype.h>
 #include <dns/resolver.h>
+#include <dns/respcache.h>
 #include <dns/result.h>
 #include <dns/stats.h>
 #include <dns/tkey.h>
@@ -62,6 +63,7 @@
 #include <ns/interfacemgr.h>
 #include <ns/hooks.h>
 #include <ns/log.h>
+#include <ns/querylog.h>
 #include <ns/server.h>
 #include <ns/sortlist.h>
 #include <ns/stats.h>
@@ -143,6 +145,22 @@ do { \
 #define REDIRECT(c)		(((c)->query.attributes & \
 				  NS_QUERYATTR_REDIRECT) != 0)
 
+/*% Add the response to the response cache? */
+#define RESPCACHE(c)		(((c)->query.attributes & \
+				  NS_QUERYATTR_RESPCACHE) != 0)
+
+/*%
+ * Query properties, other than the question, that a response in the
+ * response cache depends on.
+ */
+#define RESPCACHE_RD		0x01
+#define RESPCACHE_CD		0x02
+#define RESPCACHE_DO		0x04
+#define RESPCACHE_AD		0x08
+#define RESPCACHE_EDNS		0x10
+#define RESPCACHE_NOAUTHORITY	0x20
+#define RESPCACHE_NOADDITIONAL	0x40
+
 /*% Does the rdataset 'r' have an attached 'No QNAME Proof'? */
 #define NOQNAME(r)		(((r)->attributes & \
 				  DNS_RDATASETATTR_NOQNAME) != 0)
@@ -389,6 +407,9 @@ query_setup(ns_client_t *client, dns_rdatatype_t qtype);
 static isc_result_t
 query_lookup(query_ctx_t *qctx);
 
+static isc_result_t
+query_respcache(query_ctx_t *qctx);
+
 static void
 fetch_callback(isc_task_t *task, isc_event_t *event);
 
@@ -532,6 +553,33 @@ inc_stats(ns_client_t *client, isc_statscounter_t counter) {
 	}
 }
 
+/*%
+ * Decide whether the response about to be sent to 'client' can be
+ * added to the response cache: it must have been made from a single
+ * version of the zone the query was answered from, and not be an
+ * error or truncated.
+ */
+static void
+query_respcache_setup(ns_client_t *client, isc_statscounter_t counter) {
+	ns_dbversion_t *dbversion;
+
+	dbversion = ISC_LIST_HEAD(client->query.activeversions);
+	if ((client->message->rcode != dns_rcode_noerror &&
+	     client->message->rcode != dns_rcode_nxdomain) ||
+	    (client->message->flags & DNS_MESSAGEFLAG_TC) != 0 ||
+	    dbversion == NULL ||
+	    ISC_LIST_NEXT(dbversion, link) != NULL ||
+	    dbversion->db != client->query.authdb)
+	{
+		client->query.attributes &= ~NS_QUERYATTR_RESPCACHE;
+		return;
+	}
+
+	client->query.respcache.flags = counter;
+	client->query.respcache.db = dbversion->db;
+	client->query.respcache.version = dbversion->version;
+}
+
 static void
 query_send(ns_client_t *client) {
 	isc_statscounter_t counter;
@@ -541,7 +589,13 @@ query_send(ns_client_t *client) {
 	else
 		inc_stats(client, ns_statscounter_authans);
 
-	if (client->message->rcode == dns_rcode_noerror) {
+	if (client->query.respcache.entry != NULL) {
+		/*
+		 * The response came from the response cache, with the
+		 * counter that applied when it was first sent.
+		 */
+		counter = client->query.respcache.flags;
+	} else if (client->message->rcode == dns_rcode_noerror) {
 		dns_section_t answer = DNS_SECTION_ANSWER;
 		if (ISC_LIST_EMPTY(client->message->sections[answer])) {
 			if (client->query.isreferral)
@@ -557,6 +611,10 @@ query_send(ns_client_t *client) {
 	else /* We end up here in case of YXDOMAIN, and maybe others */
 		counter = ns_statscounter_failure;
 
+	if (RESPCACHE(client)) {
+		query_respcache_setup(client, counter);
+	}
+
 	inc_stats(client, counter);
 	ns_client_send(client);
 }
@@ -681,6 +739,12 @@ query_reset(ns_client_t *client, bool everything) {
 		client->query.dns64_aaaaoklen =  0;
 	}
 
+	if (client->query.respcache.entry != NULL) {
+		dns_respcache_detachentry(&client->query.respcache.entry);
+	}
+	client->query.respcache.db = NULL;
+	client->query.respcache.version = NULL;
+
 	ns_client_putrdataset(client, &client->query.redirect.rdataset);
 	ns_client_putrdataset(client, &client->query.redirect.sigrdataset);
 	if (client->query.redirect.db != NULL) {
@@ -792,6 +856,7 @@ ns_query_init(ns_client_t *client) {
 	client->query.redirect.is_zone = false;
 	client->query.redirect.fname =
 		dns_fixedname_initname(&client->query.redirect.fixed);
+	client->query.respcache.entry = NULL;
 	query_reset(client, false);
 	result = ns_client_newdbversion(client, 3);
 	if (result != ISC_R_SUCCESS) {
@@ -5402,6 +5467,13 @@ ns__query_start(query_ctx_t *qctx) {
 		} else {
 			inc_stats(qctx->client, ns_statscounter_udp);
 		}
+
+		if (qctx->view->respcache != NULL) {
+			result = query_respcache(qctx);
+			if (result != ISC_R_COMPLETE) {
+				return (result);
+			}
+		}
 	}
 
 	return (query_lookup(qctx));
@@ -5410,6 +5482,115 @@ ns__query_start(query_ctx_t *qctx) {
 	return (result);
 }
 
+/*%
+ * Check the response cache for a response to the query.  If there is
+ * one, send it; the message sections are left empty, and client_send()
+ * renders the cached response in their place.  Otherwise, if the
+ * response could be cached, mark the query so that query_send() and
+ * client_send() will add it.
+ *
+ * Only authoritative answers from master and slave zones, to queries
+ * that cannot use the cache, are cached, and only where nothing else
+ * but the zone contents and the query can change the response.
+ */
+static isc_result_t
+query_respcache(query_ctx_t *qctx) {
+	ns_client_t *client = qctx->client;
+	dns_respentry_t *entry = NULL;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	unsigned int variant = 0, maxlength;
+	uint32_t flags = 0;
+	isc_result_t result;
+
+	if (!qctx->is_zone || !qctx->authoritative || qctx->zone == NULL ||
+	    (dns_zone_gettype(qctx->zone) != dns_zone_master &&
+	     dns_zone_gettype(qctx->zone) != dns_zone_slave) ||
+	    USECACHE(client) ||
+	    qctx->view->rrl != NULL || qctx->view->sortlist != NULL ||
+	    qctx->view->nocasecompress != NULL ||
+	    qctx->view->rpzs != NULL || qctx->view->dns64cnt != 0 ||
+	    qctx->view->hooktable != NULL ||
+	    client->message->tsigkey != NULL ||
+	    client->message->sig0key != NULL ||
+	    (client->attributes & NS_CLIENTATTR_WANTEXPIRE) != 0 ||
+	    dns_rdatatype_ismeta(qctx->qtype) ||
+	    qctx->qtype == dns_rdatatype_rrsig ||
+	    qctx->qtype == dns_rdatatype_sig)
+	{
+		return (ISC_R_COMPLETE);
+	}
+
+	if ((client->message->flags & DNS_MESSAGEFLAG_RD) != 0) {
+		variant |= RESPCACHE_RD;
+	}
+	if ((client->message->flags & DNS_MESSAGEFLAG_CD) != 0) {
+		variant |= RESPCACHE_CD;
+	}
+	if (WANTDNSSEC(client)) {
+		variant |= RESPCACHE_DO;
+	}
+	if (WANTAD(client)) {
+		variant |= RESPCACHE_AD;
+	}
+	if ((client->attributes & NS_CLIENTATTR_WANTOPT) != 0) {
+		variant |= RESPCACHE_EDNS;
+	}
+	if (NOAUTHORITY(client)) {
+		variant |= RESPCACHE_NOAUTHORITY;
+	}
+	if (NOADDITIONAL(client)) {
+		variant |= RESPCACHE_NOADDITIONAL;
+	}
+
+	/*
+	 * A cached response is only used if it fits in the send buffer
+	 * alongside the OPT, so make the OPT now; client_send() will use
+	 * it.  Nothing it depends on changes while the query is answered
+	 * from the zone.
+	 */
+	maxlength = ns_client_sendbufsize(client);
+	if ((client->attributes & NS_CLIENTATTR_WANTOPT) != 0) {
+		if (client->opt == NULL) {
+			result = ns_client_addopt(client, client->message,
+						  &client->opt);
+			if (result != ISC_R_SUCCESS) {
+				return (ISC_R_COMPLETE);
+			}
+		}
+		result = dns_rdataset_first(client->opt);
+		if (result != ISC_R_SUCCESS) {
+			return (ISC_R_COMPLETE);
+		}
+		dns_rdataset_current(client->opt, &rdata);
+		/* See dns_message_setopt(). */
+		if (maxlength < 11 + rdata.length) {
+			return (ISC_R_COMPLETE);
+		}
+		maxlength -= 11 + rdata.length;
+	}
+
+	result = dns_respcache_find(qctx->view->respcache,
+				    client->query.qname,
+				    client->message->rdclass, qctx->qtype,
+				    variant, qctx->db, qctx->version,
+				    maxlength, &flags, &entry);
+	if (result != ISC_R_SUCCESS) {
+		ns_stats_increment(client->sctx->nsstats,
+				   ns_statscounter_respcachemiss);
+		client->query.attributes |= NS_QUERYATTR_RESPCACHE;
+		client->query.respcache.variant = variant;
+		return (ISC_R_COMPLETE);
+	}
+
+	ns_stats_increment(client->sctx->nsstats,
+			   ns_statscounter_respcachehit);
+	dns_respcache_reply(entry, client->message);
+	client->query.respcache.entry = entry;
+	client->query.respcache.flags = flags;
+
+	return (ns_query_done(qctx));
+}
+
 /*%
  * Perform a local database lookup, in either an authoritative or
  * cache database. If unable to answer, call ns_query_done(); otherwise
@@ -5501,6 +5682,7 @@ query_lookup(query_ctx_t *qctx) {
 
 	if (!qctx->is_zone) {
 		dns_cache_updatestats(qctx->view->cache, result);
+		qctx->client->attributes |= NS_CLIENTATTR_CACHEANSWER;
 	}
 
 	if ((qctx->client->query.dboptions & DNS_DBFIND_STALEOK) != 0) {
@@ -5706,6 +5888,7 @@ ns_query_recurse(ns_client_t *client, dns_rdatatype_t qtype, dns_name_t *qname,
 
 	if (!resuming)
 		inc_stats(client, ns_statscounter_recursion);
+	client->attributes |= NS_CLIENTATTR_RECURSED;
 
 	/*
 	 * We are about to recurse, which means that this client will
@@ -10819,7 +11002,11 @@ log_query(ns_client_t *client, unsigned int flags, unsigned int extflags) {
 	dns_rdataset_t *rdataset;
 	int level = ISC_LOG_INFO;
 
-	if (! isc_log_wouldlog(ns_lctx, level))
+	if (isc_log_wouldlogbinary(ns_lctx, NS_LOGCATEGORY_QUERIES, level)) {
+		ns_querylog_start(client, flags, extflags);
+	}
+
+	if (! isc_log_wouldlogtext(ns_lctx, NS_LOGCATEGORY_QUERIES, level))
 		return;
 
 	rdataset = ISC_LIST_HEAD(client->query.qname->list);
@@ -0,0 +1,475 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <isc/buffer.h>
+#include <isc/log.h>
+#include <isc/mem.h>
+#include <isc/netaddr.h>
+#include <isc/print.h>
+#include <isc/sockaddr.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/compress.h>
+#include <dns/ecs.h>
+#include <dns/fixedname.h>
+#include <dns/message.h>
+#include <dns/name.h>
+#include <dns/rcode.h>
+#include <dns/rdataset.h>
+#include <dns/result.h>
+#include <dns/view.h>
+
+#include <ns/client.h>
+#include <ns/log.h>
+#include <ns/query.h>
+#include <ns/querylog.h>
+
+/*
+ * Offsets of the fields that are filled in after the record is built.
+ */
+#define OFFSET_FLAGS	4
+#define OFFSET_RCODE	6
+
+#define ADDRSIZE	16
+
+static inline unsigned int
+peekuint16(const unsigned char *p) {
+	return ((p[0] << 8) | p[1]);
+}
+
+static inline void
+pokeuint16(unsigned char *p, unsigned int val) {
+	p[0] = (val >> 8) & 0xff;
+	p[1] = val & 0xff;
+}
+
+static unsigned int
+addrfamily(const isc_netaddr_t *na) {
+	switch (na->family) {
+	case AF_INET:
+		return (4);
+	case AF_INET6:
+		return (6);
+	default:
+		return (0);
+	}
+}
+
+static void
+putaddr(isc_buffer_t *b, const isc_netaddr_t *na) {
+	unsigned char addr[ADDRSIZE];
+
+	memset(addr, 0, sizeof(addr));
+	if (na != NULL && na->family == AF_INET) {
+		memmove(addr, &na->type.in, 4);
+	} else if (na != NULL && na->family == AF_INET6) {
+		memmove(addr, &na->type.in6, 16);
+	}
+	isc_buffer_putmem(b, addr, sizeof(addr));
+}
+
+static void
+putname(isc_buffer_t *b, const dns_name_t *name) {
+	isc_region_t r;
+
+	if (name != NULL) {
+		dns_name_toregion(name, &r);
+		isc_buffer_putmem(b, r.base, r.length);
+	}
+}
+
+void
+ns_querylog_start(ns_client_t *client, unsigned int flags,
+		  unsigned int extflags)
+{
+	isc_buffer_t b;
+	isc_netaddr_t peer;
+	dns_rdataset_t *rdataset;
+	const char *viewname = "";
+	unsigned int qflags = 0, viewlen;
+	uint64_t id;
+
+	REQUIRE(NS_CLIENT_VALID(client));
+	REQUIRE(client->query.qname != NULL);
+
+	if (client->querylog == NULL) {
+		client->querylog = isc_mem_get(client->mctx,
+					       NS_QUERYLOG_MAXSIZE);
+		if (client->querylog == NULL) {
+			return;
+		}
+	}
+
+	rdataset = ISC_LIST_HEAD(client->query.qname->list);
+	INSIST(rdataset != NULL);
+
+	if ((client->query.attributes & NS_QUERYATTR_WANTRECURSION) != 0) {
+		qflags |= NS_QUERYLOG_RECURSE;
+	}
+	if (client->signer != NULL) {
+		qflags |= NS_QUERYLOG_SIGNED;
+	}
+	if (client->ednsversion >= 0) {
+		qflags |= NS_QUERYLOG_EDNS;
+	}
+	if ((client->attributes & NS_CLIENTATTR_TCP) != 0) {
+		qflags |= NS_QUERYLOG_TCP;
+	}
+	if ((extflags & DNS_MESSAGEEXTFLAG_DO) != 0) {
+		qflags |= NS_QUERYLOG_DO;
+	}
+	if ((flags & DNS_MESSAGEFLAG_CD) != 0) {
+		qflags |= NS_QUERYLOG_CD;
+	}
+	if ((client->attributes & NS_CLIENTATTR_HAVECOOKIE) != 0) {
+		qflags |= NS_QUERYLOG_COOKIE;
+	} else if ((client->attributes & NS_CLIENTATTR_WANTCOOKIE) != 0) {
+		qflags |= NS_QUERYLOG_WANTCOOKIE;
+	}
+	if ((client->attributes & NS_CLIENTATTR_HAVEECS) != 0) {
+		qflags |= NS_QUERYLOG_ECS;
+	}
+
+	if (client->view != NULL) {
+		viewname = client->view->name;
+	}
+	viewlen = ISC_MIN(strlen(viewname), 255);
+
+	isc_buffer_init(&b, client->querylog, NS_QUERYLOG_MAXSIZE);
+
+	isc_buffer_putuint16(&b, 0);	/* length, filled in below */
+	isc_buffer_putuint8(&b, NS_QUERYLOG_VERSION);
+	isc_buffer_putuint8(&b, (client->ednsversion >= 0)
+				? client->ednsversion : 0);
+	isc_buffer_putuint16(&b, qflags);
+	isc_buffer_putuint16(&b, 0);	/* rcode */
+	isc_buffer_putuint32(&b, isc_time_seconds(&client->requesttime));
+	isc_buffer_putuint32(&b, isc_time_nanoseconds(&client->requesttime));
+	id = (uint64_t)(uintptr_t)client;
+	isc_buffer_putuint32(&b, (uint32_t)(id >> 32));
+	isc_buffer_putuint32(&b, (uint32_t)id);
+	isc_buffer_putuint16(&b, rdataset->type);
+	isc_buffer_putuint16(&b, rdataset->rdclass);
+
+	if (client->peeraddr_valid) {
+		isc_netaddr_fromsockaddr(&peer, &client->peeraddr);
+		isc_buffer_putuint8(&b, addrfamily(&peer));
+		isc_buffer_putuint8(&b, addrfamily(&client->destaddr));
+		isc_buffer_putuint16(&b,
+				     isc_sockaddr_getport(&client->peeraddr));
+		putaddr(&b, &peer);
+	} else {
+		isc_buffer_putuint8(&b, 0);
+		isc_buffer_putuint8(&b, addrfamily(&client->destaddr));
+		isc_buffer_putuint16(&b, 0);
+		putaddr(&b, NULL);
+	}
+	putaddr(&b, &client->destaddr);
+
+	if ((qflags & NS_QUERYLOG_ECS) != 0) {
+		isc_buffer_putuint8(&b, addrfamily(&client->ecs.addr));
+		isc_buffer_putuint8(&b, client->ecs.source);
+		isc_buffer_putuint8(&b, client->ecs.scope);
+	} else {
+		isc_buffer_putuint8(&b, 0);
+		isc_buffer_putuint8(&b, 0);
+		isc_buffer_putuint8(&b, 0);
+	}
+	isc_buffer_putuint8(&b, client->query.qname->length);
+	putaddr(&b, ((qflags & NS_QUERYLOG_ECS) != 0)
+		    ? &client->ecs.addr : NULL);
+	isc_buffer_putuint8(&b, (client->signer != NULL)
+				? client->signer->length : 0);
+	isc_buffer_putuint8(&b, viewlen);
+	INSIST(isc_buffer_usedlength(&b) == NS_QUERYLOG_HEADERSIZE);
+
+	putname(&b, client->query.qname);
+	putname(&b, client->signer);
+	isc_buffer_putmem(&b, (const unsigned char *)viewname, viewlen);
+
+	pokeuint16(client->querylog, isc_buffer_usedlength(&b));
+	client->attributes |= NS_CLIENTATTR_QUERYLOG;
+}
+
+void
+ns_querylog_response(ns_client_t *client) {
+	unsigned char *p;
+
+	REQUIRE(NS_CLIENT_VALID(client));
+
+	if ((client->attributes & NS_CLIENTATTR_QUERYLOG) == 0) {
+		return;
+	}
+
+	p = client->querylog;
+	pokeuint16(p + OFFSET_FLAGS,
+		   peekuint16(p + OFFSET_FLAGS) | NS_QUERYLOG_RESPONSE);
+	pokeuint16(p + OFFSET_RCODE, client->message->rcode);
+}
+
+void
+ns_querylog_end(ns_client_t *client) {
+	REQUIRE(NS_CLIENT_VALID(client));
+
+	if ((client->attributes & NS_CLIENTATTR_QUERYLOG) == 0) {
+		return;
+	}
+
+	client->attributes &= ~NS_CLIENTATTR_QUERYLOG;
+	isc_log_writebinary(ns_lctx, NS_LOGCATEGORY_QUERIES,
+			    NS_LOGMODULE_QUERY, ISC_LOG_INFO,
+			    client->querylog, peekuint16(client->querylog));
+}
+
+static isc_result_t
+getaddr(isc_buffer_t *b, unsigned int family, isc_netaddr_t *na) {
+	struct in_addr ina;
+	struct in6_addr ina6;
+	unsigned char *p = isc_buffer_current(b);
+
+	isc_buffer_forward(b, ADDRSIZE);
+
+	switch (family) {
+	case 4:
+		memmove(&ina, p, 4);
+		isc_netaddr_fromin(na, &ina);
+		return (ISC_R_SUCCESS);
+	case 6:
+		memmove(&ina6, p, 16);
+		isc_netaddr_fromin6(na, &ina6);
+		return (ISC_R_SUCCESS);
+	default:
+		return (DNS_R_FORMERR);
+	}
+}
+
+static isc_result_t
+getname(isc_buffer_t *b, unsigned int length, dns_name_t *name) {
+	isc_buffer_t source;
+	dns_decompress_t dctx;
+	isc_result_t result;
+
+	isc_buffer_init(&source, isc_buffer_current(b), length);
+	isc_buffer_add(&source, length);
+	isc_buffer_setactive(&source, length);
+	isc_buffer_forward(b, length);
+
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_NONE);
+	result = dns_name_fromwire(name, &source, &dctx, 0, NULL);
+	dns_decompress_invalidate(&dctx);
+	if (result == ISC_R_SUCCESS &&
+	    isc_buffer_remaininglength(&source) != 0)
+	{
+		result = DNS_R_FORMERR;
+	}
+
+	return (result == ISC_R_SUCCESS ? result : DNS_R_FORMERR);
+}
+
+isc_result_t
+ns_querylog_totext(isc_region_t *source, unsigned int options,
+		   isc_time_t *when, isc_buffer_t *target)
+{
+	isc_buffer_t b;
+	isc_result_t result;
+	unsigned int length, ednsversion, flags, rcode, seconds, nanoseconds;
+	unsigned int peerfamily, destfamily, port, ecsfamily;
+	unsigned int qnamelen, signerlen, viewlen;
+	dns_rdatatype_t qtype;
+	dns_rdataclass_t qclass;
+	uint64_t id;
+	isc_netaddr_t peer, dest;
+	isc_sockaddr_t peersa;
+	dns_ecs_t ecs;
+	dns_fixedname_t fqname, fsigner;
+	dns_name_t *qname, *signer;
+	const char *viewname = "";
+	char peerbuf[ISC_SOCKADDR_FORMATSIZE];
+	char namebuf[DNS_NAME_FORMATSIZE];
+	char signerbuf[DNS_NAME_FORMATSIZE];
+	char typebuf[DNS_RDATATYPE_FORMATSIZE];
+	char classbuf[DNS_RDATACLASS_FORMATSIZE];
+	char onbuf[ISC_NETADDR_FORMATSIZE];
+	char ecsbuf[DNS_ECS_FORMATSIZE + sizeof(" [ECS ]") - 1] = { 0 };
+	char ednsbuf[sizeof("E(255)")] = { 0 };
+	char viewbuf[256];
+
+	REQUIRE(source != NULL);
+	REQUIRE(target != NULL);
+
+	if (source->length == 0) {
+		return (ISC_R_NOMORE);
+	}
+	if (source->length < 3) {
+		return (ISC_R_UNEXPECTEDEND);
+	}
+
+	length = peekuint16(source->base);
+	if (length > source->length) {
+		return (ISC_R_UNEXPECTEDEND);
+	}
+	if (source->base[2] != NS_QUERYLOG_VERSION) {
+		return (ISC_R_NOTIMPLEMENTED);
+	}
+	if (length < NS_QUERYLOG_HEADERSIZE) {
+		return (DNS_R_FORMERR);
+	}
+
+	isc_buffer_init(&b, source->base, length);
+	isc_buffer_add(&b, length);
+	isc_buffer_forward(&b, 3);
+
+	ednsversion = isc_buffer_getuint8(&b);
+	flags = isc_buffer_getuint16(&b);
+	rcode = isc_buffer_getuint16(&b);
+	seconds = isc_buffer_getuint32(&b);
+	nanoseconds = isc_buffer_getuint32(&b);
+	id = (uint64_t)isc_buffer_getuint32(&b) << 32;
+	id |= isc_buffer_getuint32(&b);
+	qtype = isc_buffer_getuint16(&b);
+	qclass = isc_buffer_getuint16(&b);
+	peerfamily = isc_buffer_getuint8(&b);
+	destfamily = isc_buffer_getuint8(&b);
+	port = isc_buffer_getuint16(&b);
+	if (peerfamily != 0) {
+		result = getaddr(&b, peerfamily, &peer);
+		if (result != ISC_R_SUCCESS) {
+			return (result);
+		}
+		isc_sockaddr_fromnetaddr(&peersa, &peer, port);
+		isc_sockaddr_format(&peersa, peerbuf, sizeof(peerbuf));
+	} else {
+		isc_buffer_forward(&b, ADDRSIZE);
+		snprintf(peerbuf, sizeof(peerbuf), "(no-peer)");
+	}
+	result = getaddr(&b, destfamily, &dest);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+	ecsfamily = isc_buffer_getuint8(&b);
+	ecs.source = isc_buffer_getuint8(&b);
+	ecs.scope = isc_buffer_getuint8(&b);
+	qnamelen = isc_buffer_getuint8(&b);
+	if ((flags & NS_QUERYLOG_ECS) != 0) {
+		result = getaddr(&b, ecsfamily, &ecs.addr);
+		if (result != ISC_R_SUCCESS) {
+			return (result);
+		}
+	} else {
+		isc_buffer_forward(&b, ADDRSIZE);
+	}
+	signerlen = isc_buffer_getuint8(&b);
+	viewlen = isc_buffer_getuint8(&b);
+
+	if (isc_buffer_remaininglength(&b) != qnamelen + signerlen + viewlen) {
+		return (DNS_R_FORMERR);
+	}
+
+	qname = dns_fixedname_initname(&fqname);
+	result = getname(&b, qnamelen, qname);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+	signer = NULL;
+	if (signerlen != 0) {
+		signer = dns_fixedname_initname(&fsigner);
+		result = getname(&b, signerlen, signer);
+		if (result != ISC_R_SUCCESS) {
+			return (result);
+		}
+	}
+	memmove(viewbuf, isc_buffer_current(&b), viewlen);
+	viewbuf[viewlen] = '\0';
+
+	dns_name_format(qname, namebuf, sizeof(namebuf));
+	if (signer != NULL) {
+		dns_name_format(signer, signerbuf, sizeof(signerbuf));
+	}
+	dns_rdataclass_format(qclass, classbuf, sizeof(classbuf));
+	dns_rdatatype_format(qtype, typebuf, sizeof(typebuf));
+	isc_netaddr_format(&dest, onbuf, sizeof(onbuf));
+
+	if ((flags & NS_QUERYLOG_EDNS) != 0) {
+		snprintf(ednsbuf, sizeof(ednsbuf), "E(%u)", ednsversion);
+	}
+
+	if ((flags & NS_QUERYLOG_ECS) != 0) {
+		strlcpy(ecsbuf, " [ECS ", sizeof(ecsbuf));
+		dns_ecs_format(&ecs, ecsbuf + 6, sizeof(ecsbuf) - 6);
+		strlcat(ecsbuf, "]", sizeof(ecsbuf));
+	}
+
+	if (viewlen != 0 && strcmp(viewbuf, "_bind") != 0 &&
+	    strcmp(viewbuf, "_default") != 0)
+	{
+		viewname = viewbuf;
+	}
+
+	/*
+	 * This is what ns_client_log() and log_query() would have
+	 * logged.
+	 */
+	result = isc_buffer_printf(target,
+				   "client @0x%" PRIx64 " %s%s%s (%s)%s%s: "
+				   "query: %s %s %s %s%s%s%s%s%s%s (%s)%s",
+				   id, peerbuf,
+				   (signer != NULL) ? "/key " : "",
+				   (signer != NULL) ? signerbuf : "",
+				   namebuf,
+				   (*viewname != '\0') ? ": view " : "",
+				   viewname,
+				   namebuf, classbuf, typebuf,
+				   ((flags & NS_QUERYLOG_RECURSE) != 0)
+					? "+" : "-",
+				   ((flags & NS_QUERYLOG_SIGNED) != 0)
+					? "S" : "",
+				   ednsbuf,
+				   ((flags & NS_QUERYLOG_TCP) != 0) ? "T" : "",
+				   ((flags & NS_QUERYLOG_DO) != 0) ? "D" : "",
+				   ((flags & NS_QUERYLOG_CD) != 0) ? "C" : "",
+				   ((flags & NS_QUERYLOG_COOKIE) != 0)
+					? "V"
+					: ((flags & NS_QUERYLOG_WANTCOOKIE) != 0)
+					? "K" : "",
+				   onbuf, ecsbuf);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+
+	if ((options & NS_QUERYLOG_TEXTRCODE) != 0) {
+		result = isc_buffer_printf(target, " response: ");
+		if (result == ISC_R_SUCCESS &&
+		    (flags & NS_QUERYLOG_RESPONSE) != 0)
+		{
+			result = dns_rcode_totext(rcode, target);
+		} else if (result == ISC_R_SUCCESS) {
+			result = isc_buffer_printf(target, "-");
+		}
+		if (result != ISC_R_SUCCESS) {
+			return (result);
+		}
+	}
+
+	if (when != NULL) {
+		isc_time_set(when, seconds, nanoseconds);
+	}
+
+	isc_region_consume(source, length);
+
+	return (ISC_R_SUCCESS);
+}
@@ -59,35 +59,44 @@ ns_server_create(isc_mem_t *mctx, ns_matchview_t matchingview,
 
 	CHECKFATAL(ns_stats_create(mctx, ns_statscounter_max, &sctx->nsstats));
 
-	CHECKFATAL(dns_rdatatypestats_create(mctx, &sctx->rcvquerystats));
+	CHECKFATAL(dns_rdatatypestats_create2(mctx, &sctx->rcvquerystats,
+					      ISC_STATS_SHARDED));
 
 	CHECKFATAL(dns_opcodestats_create(mctx, &sctx->opcodestats));
 
 	CHECKFATAL(dns_rcodestats_create(mctx, &sctx->rcodestats));
 
-	CHECKFATAL(isc_stats_create(mctx, &sctx->udpinstats4,
-				    dns_sizecounter_in_max));
+	CHECKFATAL(isc_stats_create2(mctx, &sctx->udpinstats4,
+				     dns_sizecounter_in_max,
+				     ISC_STATS_SHARDED));
 
-	CHECKFATAL(isc_stats_create(mctx, &sctx->udpoutstats4,
-				    dns_sizecounter_out_max));
+	CHECKFATAL(isc_stats_create2(mctx, &sctx->udpoutstats4,
+				     dns_sizecounter_out_max,
+				     ISC_STATS_SHARDED));
 
-	CHECKFATAL(isc_stats_create(mctx, &sctx->udpinstats6,
-				    dns_sizecounter_in_max));
+	CHECKFATAL(isc_stats_create2(mctx, &sctx->udpinstats6,
+				     dns_sizecounter_in_max,
+				     ISC_STATS_SHARDED));
 
-	CHECKFATAL(isc_stats_create(mctx, &sctx->udpoutstats6,
-				    dns_sizecounter_out_max));
+	CHECKFATAL(isc_stats_create2(mctx, &sctx->udpoutstats6,
+				     dns_sizecounter_out_max,
+				     ISC_STATS_SHARDED));
 
-	CHECKFATAL(isc_stats_create(mctx, &sctx->tcpinstats4,
-				    dns_sizecounter_in_max));
+	CHECKFATAL(isc_stats_create2(mctx, &sctx->tcpinstats4,
+				     dns_sizecounter_in_max,
+				     ISC_STATS_SHARDED));
 
-	CHECKFATAL(isc_stats_create(mctx, &sctx->tcpoutstats4,
-				    dns_sizecounter_out_max));
+	CHECKFATAL(isc_stats_create2(mctx, &sctx->tcpoutstats4,
+				     dns_sizecounter_out_max,
+				     ISC_STATS_SHARDED));
 
-	CHECKFATAL(isc_stats_create(mctx, &sctx->tcpinstats6,
-				    dns_sizecounter_in_max));
+	CHECKFATAL(isc_stats_create2(mctx, &sctx->tcpinstats6,
+				     dns_sizecounter_in_max,
+				     ISC_STATS_SHARDED));
 
-	CHECKFATAL(isc_stats_create(mctx, &sctx->tcpoutstats6,
-				    dns_sizecounter_out_max));
+	CHECKFATAL(isc_stats_create2(mctx, &sctx->tcpoutstats6,
+				     dns_sizecounter_out_max,
+				     ISC_STATS_SHARDED));
 
 	sctx->initialtimo = 300;
 	sctx->idletimo = 300;
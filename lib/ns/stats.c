@@ -80,7 +80,8 @@ ns_stats_create(isc_mem_t *mctx, int ncounters, ns_stats_t **statsp) {
 
 	isc_mutex_init(&stats->lock);
 
-	result = isc_stats_create(mctx, &stats->counters, ncounters);
+	result = isc_stats_create2(mctx, &stats->counters, ncounters,
+				   ISC_STATS_SHARDED);
 	if (result != ISC_R_SUCCESS)
 		goto clean_mutex;
 
@@ -121,3 +122,29 @@ ns_stats_get(ns_stats_t *stats) {
 
 	return (stats->counters);
 }
+
+isc_statscounter_t
+ns_stats_latencycounter(bool tcp, ns_latencytype_t type, uint64_t usec) {
+	unsigned int bucket = 0;
+	uint64_t limit = 16;
+
+	REQUIRE(type < ns_latency_max);
+
+	while (usec >= limit && bucket < NS_LATENCY_BUCKETS - 1) {
+		bucket++;
+		limit <<= 1;
+	}
+
+	return (((tcp ? ns_latency_max : 0) + type) * NS_LATENCY_BUCKETS +
+		bucket);
+}
+
+uint64_t
+ns_stats_latencylimit(unsigned int bucket) {
+	REQUIRE(bucket < NS_LATENCY_BUCKETS);
+
+	if (bucket == NS_LATENCY_BUCKETS - 1) {
+		return (0);
+	}
+	return ((uint64_t)16 << bucket);
+}
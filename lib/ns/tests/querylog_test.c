@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/buffer.h>
+#include <isc/region.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/rcode.h>
+#include <dns/result.h>
+
+#include <ns/querylog.h>
+
+/*
+ * Build a record for a query for 'qname'/A from 192.0.2.1#5300 to
+ * 192.0.2.53 into 'buf', and return its length.
+ */
+static unsigned int
+build(unsigned char *buf, unsigned int flags, unsigned int rcode,
+      const char *qname, const char *signer, const char *view)
+{
+	dns_fixedname_t fq, fs;
+	dns_name_t *qn, *sn = NULL;
+	isc_buffer_t b;
+	isc_region_t r;
+	unsigned char peer[16] = { 192, 0, 2, 1 };
+	unsigned char dest[16] = { 192, 0, 2, 53 };
+	unsigned char ecs[16] = { 10, 1, 2, 0 };
+	isc_result_t result;
+
+	qn = dns_fixedname_initname(&fq);
+	result = dns_name_fromstring(qn, qname, 0, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	if (signer != NULL) {
+		sn = dns_fixedname_initname(&fs);
+		result = dns_name_fromstring(sn, signer, 0, NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	isc_buffer_init(&b, buf, NS_QUERYLOG_MAXSIZE);
+	isc_buffer_putuint16(&b, 0);
+	isc_buffer_putuint8(&b, NS_QUERYLOG_VERSION);
+	isc_buffer_putuint8(&b, 0);
+	isc_buffer_putuint16(&b, flags);
+	isc_buffer_putuint16(&b, rcode);
+	isc_buffer_putuint32(&b, 1000);
+	isc_buffer_putuint32(&b, 5000000);
+	isc_buffer_putuint32(&b, 0);
+	isc_buffer_putuint32(&b, 0x1234);
+	isc_buffer_putuint16(&b, dns_rdatatype_a);
+	isc_buffer_putuint16(&b, dns_rdataclass_in);
+	isc_buffer_putuint8(&b, 4);
+	isc_buffer_putuint8(&b, 4);
+	isc_buffer_putuint16(&b, 5300);
+	isc_buffer_putmem(&b, peer, sizeof(peer));
+	isc_buffer_putmem(&b, dest, sizeof(dest));
+	isc_buffer_putuint8(&b, 4);
+	isc_buffer_putuint8(&b, 24);
+	isc_buffer_putuint8(&b, 0);
+	isc_buffer_putuint8(&b, qn->length);
+	isc_buffer_putmem(&b, ecs, sizeof(ecs));
+	isc_buffer_putuint8(&b, (sn != NULL) ? sn->length : 0);
+	isc_buffer_putuint8(&b, strlen(view));
+	assert_int_equal(isc_buffer_usedlength(&b), NS_QUERYLOG_HEADERSIZE);
+
+	dns_name_toregion(qn, &r);
+	isc_buffer_putmem(&b, r.base, r.length);
+	if (sn != NULL) {
+		dns_name_toregion(sn, &r);
+		isc_buffer_putmem(&b, r.base, r.length);
+	}
+	isc_buffer_putmem(&b, (const unsigned char *)view, strlen(view));
+
+	buf[0] = isc_buffer_usedlength(&b) >> 8;
+	buf[1] = isc_buffer_usedlength(&b) & 0xff;
+
+	return (isc_buffer_usedlength(&b));
+}
+
+/*
+ * Convert the record at the start of 'source' and check the text.
+ */
+static void
+check(isc_region_t *source, unsigned int options, const char *expect) {
+	char textbuf[1024];
+	isc_buffer_t text;
+	isc_result_t result;
+	isc_time_t when;
+
+	isc_buffer_init(&text, textbuf, sizeof(textbuf));
+	result = ns_querylog_totext(source, options, &when, &text);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(isc_buffer_usedlength(&text), strlen(expect));
+	assert_memory_equal(textbuf, expect, strlen(expect));
+	assert_int_equal(isc_time_seconds(&when), 1000);
+	assert_int_equal(isc_time_nanoseconds(&when), 5000000);
+}
+
+/* records convert to what would have been logged as text */
+static void
+totext_test(void **state) {
+	unsigned char buf[NS_QUERYLOG_MAXSIZE * 3];
+	isc_region_t r;
+	isc_buffer_t text;
+	unsigned int n = 0;
+
+	UNUSED(state);
+
+	n += build(buf + n, NS_QUERYLOG_RECURSE | NS_QUERYLOG_EDNS |
+		   NS_QUERYLOG_TCP | NS_QUERYLOG_COOKIE,
+		   0, "www.example", NULL, "_default");
+	n += build(buf + n, NS_QUERYLOG_SIGNED | NS_QUERYLOG_DO |
+		   NS_QUERYLOG_CD | NS_QUERYLOG_WANTCOOKIE | NS_QUERYLOG_ECS,
+		   0, "www.example", "key.example", "internal");
+	n += build(buf + n, 0, 0, ".", NULL, "");
+
+	r.base = buf;
+	r.length = n;
+	check(&r, 0, "client @0x1234 192.0.2.1#5300 (www.example): "
+	      "query: www.example IN A +E(0)TV (192.0.2.53)");
+	check(&r, 0, "client @0x1234 192.0.2.1#5300/key key.example "
+	      "(www.example): view internal: "
+	      "query: www.example IN A -SDCK (192.0.2.53) "
+	      "[ECS 10.1.2.0/24/0]");
+	check(&r, 0, "client @0x1234 192.0.2.1#5300 (.): "
+	      "query: . IN A - (192.0.2.53)");
+
+	isc_buffer_init(&text, buf, sizeof(buf));
+	assert_int_equal(ns_querylog_totext(&r, 0, NULL, &text),
+			 ISC_R_NOMORE);
+}
+
+/* the response code is appended on request */
+static void
+rcode_test(void **state) {
+	unsigned char buf[NS_QUERYLOG_MAXSIZE * 2];
+	isc_region_t r;
+	unsigned int n = 0;
+
+	UNUSED(state);
+
+	n += build(buf + n, NS_QUERYLOG_RESPONSE, dns_rcode_nxdomain,
+		   "www.example", NULL, "");
+	n += build(buf + n, 0, 0, "www.example", NULL, "");
+
+	r.base = buf;
+	r.length = n;
+	check(&r, NS_QUERYLOG_TEXTRCODE,
+	      "client @0x1234 192.0.2.1#5300 (www.example): "
+	      "query: www.example IN A - (192.0.2.53) response: NXDOMAIN");
+	check(&r, NS_QUERYLOG_TEXTRCODE,
+	      "client @0x1234 192.0.2.1#5300 (www.example): "
+	      "query: www.example IN A - (192.0.2.53) response: -");
+}
+
+/* short, unknown and malformed records are rejected */
+static void
+bad_test(void **state) {
+	unsigned char buf[NS_QUERYLOG_MAXSIZE];
+	char textbuf[1024];
+	isc_buffer_t text;
+	isc_region_t r;
+	unsigned int n;
+
+	UNUSED(state);
+
+	n = build(buf, 0, 0, "www.example", NULL, "view");
+	isc_buffer_init(&text, textbuf, sizeof(textbuf));
+
+	/* truncated */
+	r.base = buf;
+	r.length = 2;
+	assert_int_equal(ns_querylog_totext(&r, 0, NULL, &text),
+			 ISC_R_UNEXPECTEDEND);
+	r.length = n - 1;
+	assert_int_equal(ns_querylog_totext(&r, 0, NULL, &text),
+			 ISC_R_UNEXPECTEDEND);
+	assert_int_equal(r.length, n - 1);
+
+	/* too small a target */
+	r.length = n;
+	isc_buffer_init(&text, textbuf, 10);
+	assert_int_equal(ns_querylog_totext(&r, 0, NULL, &text),
+			 ISC_R_NOSPACE);
+	assert_int_equal(r.length, n);
+	isc_buffer_init(&text, textbuf, sizeof(textbuf));
+
+	/* unknown version */
+	buf[2] = NS_QUERYLOG_VERSION + 1;
+	assert_int_equal(ns_querylog_totext(&r, 0, NULL, &text),
+			 ISC_R_NOTIMPLEMENTED);
+	buf[2] = NS_QUERYLOG_VERSION;
+
+	/* name lengths that don't add up */
+	buf[67]++;
+	assert_int_equal(ns_querylog_totext(&r, 0, NULL, &text),
+			 DNS_R_FORMERR);
+	buf[67]--;
+
+	/* a bad query name */
+	buf[NS_QUERYLOG_HEADERSIZE] = 64;
+	assert_int_equal(ns_querylog_totext(&r, 0, NULL, &text),
+			 DNS_R_FORMERR);
+	buf[NS_QUERYLOG_HEADERSIZE] = 3;
+
+	/* an unknown address family */
+	buf[29] = 5;
+	assert_int_equal(ns_querylog_totext(&r, 0, NULL, &text),
+			 DNS_R_FORMERR);
+	buf[29] = 4;
+
+	/* shorter than the fixed part */
+	buf[0] = 0;
+	buf[1] = NS_QUERYLOG_HEADERSIZE - 1;
+	assert_int_equal(ns_querylog_totext(&r, 0, NULL, &text),
+			 DNS_R_FORMERR);
+	buf[1] = n;
+
+	/* and the original converts */
+	assert_int_equal(ns_querylog_totext(&r, 0, NULL, &text),
+			 ISC_R_SUCCESS);
+	assert_int_equal(r.length, 0);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(totext_test),
+		cmocka_unit_test(rcode_test),
+		cmocka_unit_test(bad_test),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif
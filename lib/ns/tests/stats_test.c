@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <setjmp.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/util.h>
+
+#include <ns/stats.h>
+
+/* test the bucket limits returned by ns_stats_latencylimit() */
+static void
+latencylimit_test(void **state) {
+	unsigned int bucket;
+
+	UNUSED(state);
+
+	assert_int_equal(ns_stats_latencylimit(0), 16);
+	assert_int_equal(ns_stats_latencylimit(1), 32);
+	for (bucket = 1; bucket < NS_LATENCY_BUCKETS - 1; bucket++) {
+		assert_int_equal(ns_stats_latencylimit(bucket),
+				 2 * ns_stats_latencylimit(bucket - 1));
+	}
+	assert_int_equal(ns_stats_latencylimit(NS_LATENCY_BUCKETS - 2),
+			 4194304);
+	assert_int_equal(ns_stats_latencylimit(NS_LATENCY_BUCKETS - 1), 0);
+}
+
+/* test that latencies on either side of each limit land in the right bucket */
+static void
+latencycounter_buckets_test(void **state) {
+	unsigned int bucket;
+	uint64_t limit;
+
+	UNUSED(state);
+
+	assert_int_equal(ns_stats_latencycounter(false, ns_latency_auth, 0),
+			 0);
+
+	for (bucket = 0; bucket < NS_LATENCY_BUCKETS - 1; bucket++) {
+		limit = ns_stats_latencylimit(bucket);
+		assert_int_equal(ns_stats_latencycounter(false,
+							 ns_latency_auth,
+							 limit - 1),
+				 bucket);
+		assert_int_equal(ns_stats_latencycounter(false,
+							 ns_latency_auth,
+							 limit),
+				 bucket + 1);
+	}
+
+	/* Anything slower than the last limit goes in the last bucket. */
+	assert_int_equal(ns_stats_latencycounter(false, ns_latency_auth,
+						 UINT64_MAX),
+			 NS_LATENCY_BUCKETS - 1);
+}
+
+/* test that each transport and kind of answer has its own histogram */
+static void
+latencycounter_layout_test(void **state) {
+	bool seen[NS_LATENCY_COUNTERS];
+	unsigned int bucket, tcp;
+	ns_latencytype_t type;
+	isc_statscounter_t counter;
+	uint64_t usec;
+
+	UNUSED(state);
+
+	memset(seen, 0, sizeof(seen));
+
+	for (tcp = 0; tcp < 2; tcp++) {
+		for (type = 0; type < ns_latency_max; type++) {
+			for (bucket = 0; bucket < NS_LATENCY_BUCKETS;
+			     bucket++)
+			{
+				usec = (bucket == 0)
+					? 0
+					: ns_stats_latencylimit(bucket - 1);
+				counter = ns_stats_latencycounter(tcp != 0,
+								  type, usec);
+				assert_true(counter >= 0);
+				assert_true(counter < NS_LATENCY_COUNTERS);
+				assert_int_equal(counter % NS_LATENCY_BUCKETS,
+						 bucket);
+				assert_false(seen[counter]);
+				seen[counter] = true;
+			}
+		}
+	}
+
+	assert_int_equal(ns_stats_latencycounter(false, ns_latency_auth, 0),
+			 0);
+	assert_int_equal(ns_stats_latencycounter(false, ns_latency_cache, 0),
+			 NS_LATENCY_BUCKETS);
+	assert_int_equal(ns_stats_latencycounter(true, ns_latency_auth, 0),
+			 ns_latency_max * NS_LATENCY_BUCKETS);
+	assert_int_equal(ns_stats_latencycounter(true, ns_latency_recursion,
+						 UINT64_MAX),
+			 NS_LATENCY_COUNTERS - 1);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(latencylimit_test),
+		cmocka_unit_test(latencycounter_buckets_test),
+		cmocka_unit_test(latencycounter_layout_test),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif /* HAVE_CMOCKA */